@@ -0,0 +1,327 @@
+#ifndef BMCXXABI_H_INCLUDED
+#define BMCXXABI_H_INCLUDED
+
+// BMCXXABI-specific (i.e. non-ABI) interfaces.
+
+#include <stddef.h>
+
+namespace std {
+    class type_info;
+}
+
+extern "C" {
+
+// Run static-storage initialisers/constructors; should be called at startup.
+void bmcxxabi_run_init();
+
+// Run static-storage destructors (both registered dynamically and statically).
+void bmcxxabi_run_destructors();
+
+// Enter the names of the given type_info objects into the name interning table, and point each
+// at the canonical copy of its name (available when built with BMCXX_TYPE_INTERN). Call this for
+// the main image's type_info objects first, and then for each separately-linked module's (which
+// carries its own copies of type_info objects) as it is loaded, while they are still writable; its
+// types then compare equal to the same types elsewhere, at the cost of a pointer comparison. Returns
+// the number of type_info objects whose names couldn't be entered because the table is full (see
+// BMCXX_TYPE_INTERN_SLOTS); those only compare equal within their own module.
+size_t bmcxxabi_intern_type_infos(const std::type_info * const *tinfos, size_t count);
+
+// A stop function for bmcxxabi_cancel_current_stack. It is called for each frame in turn,
+// innermost first, before the frame's cleanups are run, with the frame's canonical frame address
+// (the value of the stack pointer in the frame's caller just before the call; this increases
+// towards the outermost frame on a downward-growing stack) and the context pointer given. To end
+// the cancellation at the frame, it transfers control to that frame or an outer one (eg via
+// longjmp); if it returns, the frame's cleanups are run and unwinding continues.
+typedef void (*bmcxxabi_cancel_stop_fn)(void *cfa, void *ctx);
+
+// Cancel the current task: unwind the current thread's stack, running only cleanups (destructors
+// of local objects), until the stop function ends the unwind. No exception object is allocated
+// and catch clauses (including catch(...)) are neither matched nor entered. Does not return; if
+// the stop function never ends the unwind, terminates. A cleanup must not call this function.
+[[noreturn]] void bmcxxabi_cancel_current_stack(bmcxxabi_cancel_stop_fn stop, void *ctx);
+
+// A static exception (available when built with BMCXX_STATIC_EXCEPTIONS): a statically allocated
+// exception object which can be thrown, via bmcxxabi_throw_static, any number of times (and by
+// several threads at once) without being allocated, copied or destroyed. A handler which catches
+// it by reference refers to the object itself, so must not modify it. Eg:
+//
+//     const timeout_error timeout;
+//     const bmcxxabi_static_exception timeout_exc = { &timeout, &typeid(timeout_error) };
+//     ...
+//     bmcxxabi_throw_static(&timeout_exc);
+struct bmcxxabi_static_exception {
+    const void *object;             // the exception object
+    const std::type_info *type;     // its (most derived) type
+};
+
+// Throw a static exception. As for a throw expression, this returns only by way of a handler.
+[[noreturn]] void bmcxxabi_throw_static(const bmcxxabi_static_exception *exc);
+
+// An exception arena (available when built with BMCXX_EXCEPTION_ARENAS): while it is the current
+// thread's current arena, exceptions thrown by the thread are allocated from it, and freed all at
+// once when it is popped. For a scope (eg handling one request) within which exceptions are
+// thrown and caught. Eg:
+//
+//     bmcxxabi_exception_arena arena;
+//     bmcxxabi_exception_arena_push(&arena, 0);
+//     ... (handle the request)
+//     bmcxxabi_exception_arena_pop(&arena);
+//
+// with the pop in a destructor, if exceptions may propagate out of the scope. An exception which
+// does (or is otherwise still alive when the arena is popped) remains valid: the arena's storage
+// is then kept until the last such exception is freed. Arenas nest; each must be popped before
+// the one pushed before it, and in the same thread. The contents of the structure are private.
+struct bmcxxabi_exception_arena {
+    void *block;                    // the arena's storage
+    void *outer;                    // storage of the enclosing arena
+};
+
+// Push an arena, with capacity bytes for exceptions (0 for the default, set at build time by
+// BMCXX_EXCEPTION_ARENA_SIZE, default 4096), as the current thread's current arena. The storage
+// popped from the thread's last arena is reused if it is large enough. Exceptions which don't fit
+// are allocated individually, as usual.
+void bmcxxabi_exception_arena_push(bmcxxabi_exception_arena *arena, size_t capacity);
+
+// Pop the current thread's current arena (which must be the given one), releasing the storage of
+// its exceptions, and keeping the storage for reuse.
+void bmcxxabi_exception_arena_pop(bmcxxabi_exception_arena *arena);
+
+// Free any arena storage kept for reuse by the current thread.
+void bmcxxabi_exception_arena_trim();
+
+// Called, when built with BMCXX_THREADS, while waiting for another thread (eg one which is
+// initialising a guarded static). The default implementation just spins; an environment with a
+// scheduler may define its own, to yield to other threads.
+void bmcxxabi_thread_yield();
+
+// Return the number of the current CPU, from 0. Used, when built with BMCXX_THROW_PROFILE,
+// BMCXX_THROW_BACKTRACE, BMCXX_STATS, BMCXX_EH_TRACE or BMCXX_THROW_GOVERNOR, to select a per-CPU
+// table. The default implementation always returns 0; an environment with more than one CPU
+// should define its own.
+unsigned bmcxxabi_cpu_id();
+
+// Throw-site profiling (available when built with BMCXX_THROW_PROFILE). Profiling is initially
+// disabled.
+struct bmcxxabi_throw_site {
+    const void *site;               // return address of the __cxa_throw/__cxa_rethrow call (which,
+                                    // as these do not return, may be past the end of the function)
+    const std::type_info *type;     // thrown type
+    unsigned long long count;       // number of throws
+    unsigned long long caught;      // number of those which have been caught
+    unsigned long long cycles;      // total cycles from throw to catch, for those caught
+};
+
+// Enable (enable != 0) or disable profiling.
+void bmcxxabi_throw_profile_enable(int enable);
+
+// Store up to max entries, for the (site, type) pairs thrown since the last reset, in descending
+// order of count. Returns the number of entries stored. If dropped is not null, the number of
+// throws not accounted for (because the profiler's tables, or the array, were full) is stored via
+// it.
+size_t bmcxxabi_throw_profile_snapshot(bmcxxabi_throw_site *sites, size_t max,
+        unsigned long long *dropped);
+
+// Reset all counts to zero.
+void bmcxxabi_throw_profile_reset();
+
+// Throw-storm governor (available when built with BMCXX_THROW_GOVERNOR). Throw rates are
+// measured per CPU, over a sliding window, for each throw site and type, for each type, and in
+// total; when one reaches its threshold, the storm callback is called. The governor is initially
+// disabled.
+struct bmcxxabi_throw_storm {
+    const void *site;               // return address of the __cxa_throw call, or null for the rate
+                                    // of all throws of the type (or of all throws)
+    const std::type_info *type;     // thrown type, or null for the rate of all throws
+    unsigned long long rate;        // throws on the CPU in the last window
+    unsigned cpu;                   // the CPU
+};
+
+// The storm callback is called on the throwing thread, before unwinding starts, the first time in
+// a window that a rate reaches its threshold. It must not throw, and should be quick (eg set a
+// flag telling the application to report errors without throwing).
+typedef void (*bmcxxabi_throw_storm_callback)(const bmcxxabi_throw_storm *storm);
+
+struct bmcxxabi_throw_governor_config {
+    unsigned long long window;          // length of the sliding window, in cycles
+    unsigned long long site_threshold;  // throws per window on one CPU, from one site, of one
+                                        // type (0: none)
+    unsigned long long type_threshold;  // throws per window on one CPU of one type (0: none)
+    unsigned long long cpu_threshold;   // throws per window on one CPU (0: none)
+    bmcxxabi_throw_storm_callback callback;
+};
+
+// Enable the governor with the given configuration (which is copied), or, if config is null,
+// disable it.
+void bmcxxabi_throw_governor_configure(const bmcxxabi_throw_governor_config *config);
+
+// A current throw rate, summed over all CPUs
+struct bmcxxabi_throw_rate {
+    const void *site;               // as for bmcxxabi_throw_storm (null for all throws of the type)
+    const std::type_info *type;     // thrown type
+    unsigned long long rate;        // throws in the last window
+    unsigned long long total;       // throws counted since the program started
+};
+
+// Store up to max current rates, for sites and types thrown within the last window, in
+// descending order of rate. Returns the number stored. If total_rate is not null, the rate of all
+// throws is stored via it.
+size_t bmcxxabi_throw_governor_rates(bmcxxabi_throw_rate *rates, size_t max,
+        unsigned long long *total_rate);
+
+// Personality routine profiling (available when built with BMCXX_PERSONALITY_PROFILE): totals
+// for the frames of a function, for the search phase [0] and the cleanup phase [1].
+struct bmcxxabi_personality_frame {
+    const void *function;               // function start address
+    unsigned long long calls[2];        // personality routine calls
+    unsigned long long callsites[2];    // call-site records scanned
+    unsigned long long actions[2];      // action (and throw specification) entries evaluated
+    unsigned long long do_catch[2];     // __do_catch calls
+    unsigned long long cycles[2];       // cycles spent in the personality routine
+};
+
+// Store the totals for up to max functions, the most expensive (by total cycles) first. Returns
+// the number stored. If dropped is not null, the number of personality routine calls not recorded
+// (because the profiler's table was full) is stored via it.
+size_t bmcxxabi_personality_profile_snapshot(bmcxxabi_personality_frame *frames, size_t max,
+        unsigned long long *dropped);
+
+// Reset all totals to zero.
+void bmcxxabi_personality_profile_reset();
+
+// First-use latency profiling of guarded statics (available when built with BMCXX_GUARD_PROFILE):
+// the initialisation of a function-local static (or other guarded variable).
+struct bmcxxabi_guard_init {
+    const void *guard;                  // the guard object
+    const void *caller;                 // return address of the __cxa_guard_acquire call, in the
+                                        // function containing the static
+    unsigned long long start;           // cycle count when the (latest) initialisation started
+    unsigned long long cycles;          // cycles from __cxa_guard_acquire returning 1 to
+                                        // __cxa_guard_release, if complete
+    unsigned long long aborts;          // attempts abandoned via __cxa_guard_abort (the
+                                        // initialiser threw)
+    unsigned long long abort_cycles;    // total cycles spent in those attempts
+    unsigned complete;                  // non-zero once initialised
+};
+
+// Store up to max initialisations, the slowest (by cycles plus abort_cycles) first. Returns the
+// number stored. If dropped is not null, the number of initialisations not recorded (because the
+// profiler's table was full) is stored via it.
+size_t bmcxxabi_guard_profile_snapshot(bmcxxabi_guard_init *inits, size_t max,
+        unsigned long long *dropped);
+
+// Throw-time backtrace capture (available when built with BMCXX_THROW_BACKTRACE). The capture
+// method, set via bmcxxabi_throw_backtrace_mode; the default is BMCXXABI_BACKTRACE_UNWIND.
+enum {
+    BMCXXABI_BACKTRACE_NONE = 0,            // no capture
+    BMCXXABI_BACKTRACE_FRAME_POINTER = 1,   // walk the frame pointer chain
+    BMCXXABI_BACKTRACE_UNWIND = 2,          // use _Unwind_Backtrace
+};
+
+// Maximum number of frames in a captured backtrace (the depth captured is set at build time, by
+// BMCXX_THROW_BACKTRACE_DEPTH, default 16)
+#define BMCXXABI_BACKTRACE_MAX_FRAMES 32
+
+// A recorded throw
+struct bmcxxabi_throw_record {
+    unsigned long long time;        // cycle count when thrown
+    const std::type_info *type;     // thrown type
+    unsigned cpu;                   // CPU thrown on
+    unsigned rethrow;               // non-zero for a rethrow
+    unsigned depth;                 // number of frames captured
+    void *frames[BMCXXABI_BACKTRACE_MAX_FRAMES];  // return addresses, from the throw site outwards
+};
+
+void bmcxxabi_throw_backtrace_mode(int mode);
+
+// Copy up to max frames of the backtrace of the exception currently being handled (the most
+// recently caught, including one which has escaped to std::terminate) in the current thread.
+// Returns the number of frames copied (0 if there is no such exception).
+unsigned bmcxxabi_exception_backtrace(void **frames, unsigned max);
+
+// Copy up to max of the most recently recorded throws (from all CPUs), most recent first. Returns
+// the number copied.
+size_t bmcxxabi_recent_throws(bmcxxabi_throw_record *records, size_t max);
+
+// Runtime statistics (available when built with BMCXX_STATS): totals since startup.
+struct bmcxxabi_stats {
+    unsigned long long exceptions_allocated;    // __cxa_allocate_exception calls
+    unsigned long long exceptions_freed;        // __cxa_free_exception calls (incl. via end of catch)
+    unsigned long long exception_bytes_live;    // bytes currently allocated for exceptions
+    unsigned long long throws;                  // __cxa_throw calls
+    unsigned long long rethrows;                // __cxa_rethrow calls
+    unsigned long long frames_search;           // personality routine calls, search phase
+    unsigned long long frames_cleanup;          // personality routine calls, cleanup phase
+    unsigned long long handlers_found;          // handlers found in the search phase
+    unsigned long long terminates;              // calls to std::terminate by the runtime
+    unsigned long long do_catch_calls;          // type_info::__do_catch calls by the personality
+                                                // routine (not answered by the catch matrix)
+    unsigned long long do_upcast_calls;         // type_info::__do_upcast calls
+    unsigned long long guard_acquires;          // __cxa_guard_acquire calls
+    unsigned long long guard_contended;         // ...which waited for another thread
+    unsigned long long atexit_registrations;    // __cxa_atexit calls
+    unsigned long long atexit_table_size;       // capacity of the __cxa_atexit table (entries)
+    unsigned long long atexit_table_entries;    // entries currently in the table
+    unsigned long long run_init_cycles;         // cycles spent in bmcxxabi_run_init
+};
+
+// Store the current totals via stats. The counters are read individually, so the totals may not
+// be mutually consistent if other threads are using the runtime at the same time.
+void bmcxxabi_get_stats(bmcxxabi_stats *stats);
+
+// Exception-handling event trace (available when built with BMCXX_EH_TRACE). Events, and the
+// meaning of the arg field of their records:
+enum {
+    BMCXXABI_TRACE_ALLOCATE = 1,        // __cxa_allocate_exception; arg: thrown object size
+    BMCXXABI_TRACE_THROW,               // __cxa_throw; arg: address of thrown type's type_info
+    BMCXXABI_TRACE_RETHROW,             // __cxa_rethrow
+    BMCXXABI_TRACE_SEARCH_CONTINUE,     // personality routine, search phase, no handler in frame;
+                                        // arg (for all personality events): function start
+    BMCXXABI_TRACE_HANDLER_FOUND,       // personality routine, search phase, handler found
+    BMCXXABI_TRACE_CLEANUP_CONTINUE,    // personality routine, cleanup phase, nothing to run
+    BMCXXABI_TRACE_INSTALL_CLEANUP,     // personality routine, cleanup phase, run a cleanup
+    BMCXXABI_TRACE_INSTALL_HANDLER,     // personality routine, cleanup phase, enter the handler
+    BMCXXABI_TRACE_PERSONALITY_ERROR,   // personality routine failed (no LSDA, or bad version)
+    BMCXXABI_TRACE_BEGIN_CATCH,         // __cxa_begin_catch; arg: handler count
+    BMCXXABI_TRACE_END_CATCH,           // __cxa_end_catch; arg: handler count remaining
+                                        // (negative, as signed, for a rethrown exception)
+    BMCXXABI_TRACE_FREE,                // __cxa_free_exception
+    BMCXXABI_TRACE_GUARD_ACQUIRE,       // __cxa_guard_acquire (on entry)
+    BMCXXABI_TRACE_GUARD_RELEASE,       // __cxa_guard_release
+    BMCXXABI_TRACE_GUARD_ABORT,         // __cxa_guard_abort
+    BMCXXABI_TRACE_HANDLER_TYPE,        // personality routine, search phase, the handler found is
+                                        // a catch (recorded just before HANDLER_FOUND); arg:
+                                        // address of the caught type's type_info (0 for catch(...))
+};
+
+// A trace record. The layout is the same (32 bytes, in the target's byte order) for 32- and
+// 64-bit targets, so that drained records can be written out as they are and decoded by
+// bmcxx-tracedump (tools/tracedump.cc).
+struct bmcxxabi_trace_record {
+    unsigned long long time;        // cycle count
+    unsigned long long object;      // address of the thrown object, or the guard object
+    unsigned long long arg;         // see above
+    unsigned event;                 // BMCXXABI_TRACE_xxx
+    unsigned cpu;                   // CPU of the event
+};
+
+// A trace callback receives each record as it is produced (instead of it being written to the
+// ring buffers). It is called from within the runtime, possibly during unwinding, so must not
+// throw or use exceptions, and should be quick.
+typedef void (*bmcxxabi_trace_callback)(const bmcxxabi_trace_record *record);
+
+// Enable (enable != 0) or disable tracing. Tracing is initially disabled.
+void bmcxxabi_trace_enable(int enable);
+
+// Set the callback for trace records, or (callback == nullptr) restore the default, which writes
+// them to the per-CPU ring buffers.
+void bmcxxabi_trace_set_callback(bmcxxabi_trace_callback callback);
+
+// Move up to max records from the ring buffers to the given array; returns the number moved.
+// Records from any one CPU are in order, but those from different CPUs are not interleaved (sort
+// by time for a single sequence). If lost is not null, the number of records overwritten before
+// they could be read is stored via it.
+size_t bmcxxabi_trace_drain(bmcxxabi_trace_record *records, size_t max, unsigned long long *lost);
+
+}
+
+#endif /* BMCXXABI_H_INCLUDED */
@@ -0,0 +1,78 @@
+// Stack cancellation via forced unwind.
+//
+// bmcxxabi_cancel_current_stack unwinds the current thread's stack using _Unwind_ForcedUnwind,
+// running the cleanups (destructors of local objects) in each frame, until the caller's stop
+// function transfers control out of the unwind (eg via longjmp) at the frame it chooses. Compared
+// with throwing an exception to cancel, this makes a single pass over the frames rather than
+// two, allocates nothing, and never matches catch clauses: the personality routine ignores catch
+// handlers and exception specifications during a forced unwind (see personality.cc), so no
+// __do_catch calls are made and no handler, not even catch(...), is entered.
+//
+// The unwind exception object cannot be on the stack, since frames being cleaned up reuse the
+// stack below them, so it is kept per thread (as for the other per-thread exception state; see
+// threads.h). A cleanup must therefore not itself start a cancellation.
+//
+// THREAD-SAFETY : per-thread state only.
+
+#include <cstdint>
+
+#include <unwind.h>
+
+#include "config.h"
+#include "threads.h"
+#include "../include/bmcxxabi.h"
+
+// Declared here rather than via <exception>; see cxa_routines.cc.
+namespace std {
+    [[noreturn]] void terminate() noexcept;
+}
+
+namespace {
+
+// The state of a cancellation in progress
+struct cancel_state {
+    _Unwind_Exception unwind_exc;
+    bmcxxabi_cancel_stop_fn stop;
+    void *ctx;
+};
+
+BMCXX_THREAD_LOCAL cancel_state current_cancel;
+
+// Called by the unwinder for each frame, before its personality routine
+_Unwind_Reason_Code cancel_stop(int, _Unwind_Action actions, uint64_t, _Unwind_Exception *,
+        _Unwind_Context *context, void *param)
+{
+    cancel_state *cancel = (cancel_state *)param;
+    if (actions & _UA_END_OF_STACK) {
+        // no stop frame
+        return _URC_FATAL_PHASE2_ERROR;
+    }
+    cancel->stop((void *)_Unwind_GetCFA(context), cancel->ctx);
+    return _URC_NO_REASON;
+}
+
+// (Not normally called: the unwind exception object is never caught.)
+void cleanup_cancel(_Unwind_Reason_Code, _Unwind_Exception *)
+{
+
+}
+
+} // anon namespace
+
+// Unwind the current stack, running cleanups, until the stop function transfers control out.
+// Does not return: if the end of the stack is reached, or the unwind fails, terminates.
+extern "C"
+void bmcxxabi_cancel_current_stack(bmcxxabi_cancel_stop_fn stop, void *ctx)
+{
+    cancel_state *cancel = &current_cancel;
+    cancel->stop = stop;
+    cancel->ctx = ctx;
+
+    char exception_class[8] = {'\0','L','C','N','X','X','M','B'}; // BMXXNCL\0
+    __builtin_memcpy(&cancel->unwind_exc.exception_class, exception_class, sizeof(exception_class));
+    cancel->unwind_exc.exception_cleanup = cleanup_cancel;
+
+    _Unwind_ForcedUnwind(&cancel->unwind_exc, cancel_stop, cancel);
+
+    BMCXX_TERMINATE();
+}
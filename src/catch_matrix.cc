@@ -0,0 +1,93 @@
+// Closed-world catch matching via a precomputed table. See catch_matrix.h.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+#include "catch_matrix.h"
+#include "../include/typeinfo"
+
+#ifdef BMCXX_CATCH_MATRIX
+
+#ifndef BMCXX_CATCH_MATRIX_SIZE
+#define BMCXX_CATCH_MATRIX_SIZE 4096
+#endif
+
+// Filled in (in the image file) by bmcxx-catchgen. Must not be const, or the compiler might assume
+// the (all zero) initial contents.
+__attribute__((section(".bmcxx_catch_matrix"), used))
+catch_matrix_entry bmcxxabi_catch_matrix[BMCXX_CATCH_MATRIX_SIZE] = {};
+
+namespace {
+
+// Find the entry with the specified key in the (sorted) range [first, first + count), or nullptr
+const catch_matrix_entry *find_entry(const catch_matrix_entry *first, uint32_t count,
+        uint64_t key) noexcept
+{
+    while (count > 0) {
+        uint32_t half = count / 2;
+        const catch_matrix_entry *mid = first + half;
+        if (mid->key < key) {
+            first = mid + 1;
+            count -= half + 1;
+        }
+        else if (mid->key > key) {
+            count = half;
+        }
+        else {
+            return mid;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+int bmcxxabi_catch_matrix_lookup(const std::type_info *catch_type,
+        const std::type_info *thrown_type, void **thrown_obj) noexcept
+{
+    const catch_matrix_entry *matrix = bmcxxabi_catch_matrix;
+    if (matrix[0].key != catch_matrix_magic) {
+        return -1;
+    }
+
+    if ((uintptr_t)thrown_type < matrix[1].key || (uintptr_t)thrown_type > matrix[1].data) {
+        return -1;
+    }
+
+    uint32_t num_catch = (uint32_t)matrix[0].data;
+    const catch_matrix_entry *catch_ent = find_entry(matrix + 2, num_catch, (uintptr_t)catch_type);
+    if (catch_ent == nullptr) {
+        return -1;
+    }
+
+    const catch_matrix_entry *pair_ent = find_entry(matrix + (uint32_t)catch_ent->data,
+            (uint32_t)(catch_ent->data >> 32), (uintptr_t)thrown_type);
+    if (pair_ent == nullptr) {
+        // Doesn't match only if the thrown type is one of those the tool matched against
+        uint32_t num_thrown = (uint32_t)(matrix[0].data >> 32);
+        if (find_entry(matrix + 2 + num_catch, num_thrown, (uintptr_t)thrown_type) == nullptr) {
+            return -1;
+        }
+        return 0;
+    }
+
+    ptrdiff_t offset = (ptrdiff_t)((int64_t)pair_ent->data >> catch_match_offset_shift);
+    switch (pair_ent->data & catch_match_kind_mask) {
+    case catch_match_object:
+        *thrown_obj = (char *)*thrown_obj + offset;
+        return 1;
+    case catch_match_pointer:
+    {
+        // The handler expects the pointer value, not the object containing it. A null pointer
+        // value must not be adjusted.
+        char *ptr_val = *(char **)*thrown_obj;
+        *thrown_obj = (ptr_val == nullptr) ? nullptr : ptr_val + offset;
+        return 1;
+    }
+    default:
+        return -1;
+    }
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _CATCH_MATRIX_H_INCLUDED
+#define _CATCH_MATRIX_H_INCLUDED 1
+
+#include <cstdint>
+
+// The "catch matrix": a table, computed after linking by the bmcxx-catchgen tool (see "tools"
+// directory), giving for pairs of (catch type, thrown type) whether a handler for the catch type
+// matches the thrown type, and the adjustment to apply to the exception object pointer if so.
+// The personality routine consults this first, and falls back to __do_catch only for pairs that
+// are not covered by the table. This is only useful for an image which is statically linked
+// (the "closed world" case), where all types that might be thrown or caught are known.
+//
+// The table is stored in a fixed-size array (bmcxxabi_catch_matrix, in section
+// .bmcxx_catch_matrix) reserved in the image when built with BMCXX_CATCH_MATRIX defined. The tool
+// fills in the array in the linked image file; since the array size does not change, no
+// re-linking is required.
+//
+// The array consists of entries of two 64-bit fields, whatever the target's pointer size, so that
+// the 32-bit halves of packed fields are well defined everywhere. The layout is:
+//
+//   entry 0: key = catch_matrix_magic
+//            data = number of catch-type entries (low 32 bits), number of thrown-type entries
+//                   (high 32)
+//
+//   entry 1: key = lowest address of a known thrown type's type_info
+//            data = highest address of a known thrown type's type_info
+//
+//   catch-type entries, sorted by key:
+//            key = address of type_info for the catch type
+//            data = index (in the array) of first pair entry (low 32 bits), number of pair
+//                   entries for this catch type (high 32 bits)
+//
+//   thrown-type entries (the known thrown types), sorted by key:
+//            key = address of type_info for the thrown type
+//            data = 0
+//
+//   pair entries, grouped by catch type, sorted by key within each group:
+//            key = address of type_info for the thrown type
+//            data = match kind (bits 0-7), signed adjustment (bits 8+)
+//
+// A known thrown type which does not appear in the group for a (listed) catch type does not
+// match. A catch type which is not listed is not covered; nor is a thrown type which is not
+// known, whether its type_info is outside the range of known thrown types (as might be the case
+// for a type_info from a separately-loaded module) or within it (as for a type_info without a
+// symbol, which the tool can't find).
+
+struct catch_matrix_entry {
+    uint64_t key;
+    uint64_t data;
+};
+
+constexpr uint64_t catch_matrix_magic = 0x32584d4843584d42ull; // "BMXCHMX2"
+
+// Match kinds for pair entries
+enum : uint64_t {
+    catch_match_object = 1,   // matches; adjust exception object pointer by offset
+    catch_match_pointer = 2,  // matches; exception object is a pointer, adjust pointer value
+    catch_match_fallback = 3, // not covered; use __do_catch
+};
+
+constexpr uint64_t catch_match_kind_mask = 0xFF;
+constexpr int catch_match_offset_shift = 8;
+
+namespace std {
+    class type_info;
+}
+
+// Look up a (catch type, thrown type) pair in the catch matrix. Returns 1 if the catch type
+// matches (and adjusts *thrown_obj, as per __do_catch), 0 if it does not match, or -1 if the pair
+// is not covered by the matrix (in which case __do_catch must be used).
+int bmcxxabi_catch_matrix_lookup(const std::type_info *catch_type,
+        const std::type_info *thrown_type, void **thrown_obj) noexcept;
+
+#endif
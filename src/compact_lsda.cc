@@ -0,0 +1,46 @@
+// Compact LSDAs, produced after linking. See compact_lsda.h.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+#include "compact_lsda.h"
+
+#ifdef BMCXX_COMPACT_LSDA
+
+#ifndef BMCXX_COMPACT_LSDA_SIZE
+#define BMCXX_COMPACT_LSDA_SIZE 8192
+#endif
+
+// Filled in (in the image file) by bmcxx-lsdacompact. Must not be const, or the compiler might
+// assume the (all zero) initial contents.
+__attribute__((section(".bmcxx_compact_lsda"), used))
+uintptr_t bmcxxabi_compact_lsda[BMCXX_COMPACT_LSDA_SIZE] = {};
+
+const compact_lsda_header *compact_lsda_find(const void *lsda) noexcept
+{
+    const uintptr_t *table = bmcxxabi_compact_lsda;
+    if (table[0] != compact_lsda_magic) {
+        return nullptr;
+    }
+
+    const uintptr_t *first = table + 2;
+    uintptr_t count = table[1];
+    while (count > 0) {
+        uintptr_t half = count / 2;
+        const uintptr_t *mid = first + half * 2;
+        if (mid[0] < (uintptr_t)lsda) {
+            first = mid + 2;
+            count -= half + 1;
+        }
+        else if (mid[0] > (uintptr_t)lsda) {
+            count = half;
+        }
+        else {
+            return (const compact_lsda_header *)((const char *)table + mid[1]);
+        }
+    }
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _COMPACT_LSDA_H_INCLUDED
+#define _COMPACT_LSDA_H_INCLUDED 1
+
+#include <cstdint>
+
+// Compact LSDAs: a fixed-width, aligned form of the language-specific data (call-site and action
+// tables) of each function, produced after linking by the bmcxx-lsdacompact tool (see "tools"
+// directory) from the DWARF LSDAs in .gcc_except_table. The personality routine can then find the
+// call site by binary search, with no LEB128 or encoded values to decode, type_info pointers
+// already resolved and action chains already flattened. Like the catch matrix (catch_matrix.h),
+// this is only for an image which is statically linked and not position-independent, since the
+// tables hold absolute addresses.
+//
+// The tables are stored in a fixed-size array (bmcxxabi_compact_lsda, in section
+// .bmcxx_compact_lsda) reserved in the image when built with BMCXX_COMPACT_LSDA defined. The tool
+// fills in the array in the linked image file, without re-linking. The layout is:
+//
+//   word 0:  compact_lsda_magic
+//   word 1:  number of index entries
+//   index entries (two words each), sorted by the first:
+//            address of the original (DWARF) LSDA
+//            byte offset, from the start of the array, of the compact LSDA for it
+//   compact LSDAs, each beginning at a word boundary:
+//            compact_lsda_header
+//            compact_call_site[num_call_sites], sorted by start
+//            compact_action[num_actions]
+//            type_info pointers for exception specifications
+//
+// __gxx_personality_v0 looks up the compact LSDA for the LSDA of each frame in the index (and
+// decodes the DWARF LSDA if it is not there). Optionally, the tool also changes each FDE's LSDA
+// pointer to point to the compact LSDA itself, and the personality routine pointer of the FDEs'
+// CIEs to __bmcxx_personality_compact, which uses it directly (without an index lookup).
+
+constexpr uintptr_t compact_lsda_magic = 0x314453434c584d42ull; // "BMXLCSD1"
+
+// (distinguishes a compact LSDA from a DWARF one, whose first byte is the landing pad start
+// encoding; GCC always uses DW_EH_PE_omit, 0xff)
+constexpr uint32_t compact_lsda_tag = 0x4c434d42u;  // "BMCL"
+
+struct compact_lsda_header {
+    uint32_t tag;               // compact_lsda_tag
+    uint32_t num_call_sites;
+    uintptr_t lp_start;         // landing pad base; 0 for the function start
+};
+
+struct compact_call_site {
+    uint32_t start;             // offset from function start
+    uint32_t length;
+    uint32_t landing_pad;       // offset from landing pad base; 0 for none
+    uint32_t action;            // index (plus 1) of the first action of the chain, among the
+                                // actions following the call sites; 0 for cleanup only
+};
+
+// An entry in a (flattened) action chain. The handler switch value is the type index from the
+// DWARF action table, which the landing pad expects:
+//   > 0: catch clause; type is the caught type's type_info (0 for catch(...))
+//   < 0: exception specification; type is the address of an array of type_info pointers, of
+//        length (flags & compact_action_count_mask)
+//   = 0: cleanup
+struct compact_action {
+    uintptr_t type;
+    int32_t switch_value;
+    uint32_t flags;
+};
+
+constexpr uint32_t compact_action_last = 0x80000000u;   // last entry of the chain
+constexpr uint32_t compact_action_count_mask = 0x7fffffffu;
+
+// Find the compact form of the given (DWARF) LSDA, or nullptr if there is none
+const compact_lsda_header *compact_lsda_find(const void *lsda) noexcept;
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef BMCXX_CONFIG_H_INCLUDED
+#define BMCXX_CONFIG_H_INCLUDED 1
+
+// Compile-time configuration.
+//
+// The runtime's dependencies on its environment (memory allocation, termination, locking,
+// per-thread state and the CPU number) and the optional instrumentation are selected at compile
+// time. Each dependency is a macro naming the function, type or expression to use. The choice
+// costs nothing at run time: calls are direct, and can be inlined.
+//
+// The defaults suit a hosted environment, or a single-threaded one with a C library. A product
+// can instead provide its own configuration header, named by BMCXX_CONFIG_HEADER (see the
+// CONFIG_HEADER make variable). That header is included first, and can define any of the macros
+// below as well as the other BMCXX_xxx options, such as BMCXX_THREADS or BMCXX_NO_SSD. Every source
+// includes this header before testing any option.
+//
+// Allocation and termination:
+//   BMCXX_EXCEPTION_ALLOC, BMCXX_EXCEPTION_FREE
+//           functions to allocate and free exceptions, and exception arena storage
+//           (malloc/free-like). Not used with BMCXX_BOUNDED_LATENCY, which allocates from a static
+//           pool. Default: malloc, free.
+//   BMCXX_ATEXIT_ALLOC, BMCXX_ATEXIT_FREE
+//           functions to allocate and free the __cxa_atexit registration table. Default: malloc,
+//           free.
+//   BMCXX_TERMINATE
+//           [[noreturn]] function called when an exception can't be allocated, or isn't caught.
+//           Default: std::terminate.
+//
+// Locking and waiting (used with BMCXX_THREADS; see threads.h):
+//   BMCXX_LOCK
+//           lock type protecting the exception pool and the __cxa_atexit table. It must have
+//           lock() and unlock() members, and must work when zero-initialised, since it is used
+//           before constructors run. Default: bmcxx_spinlock.
+//   BMCXX_THREAD_YIELD
+//           function called on each iteration while waiting, either for a lock or for another
+//           thread initialising a guarded static. Default: bmcxxabi_thread_yield, which the
+//           environment can replace at link time.
+//
+// Per-thread and per-CPU state (see threads.h):
+//   BMCXX_THREAD_LOCAL
+//           storage class for the per-thread exception state. Default: __thread with
+//           BMCXX_THREADS, otherwise nothing, so there is a single global state.
+//   BMCXX_EH_GLOBALS
+//           function returning a pointer to the current thread's exception state
+//           (__cxa_eh_globals*). For an environment which keeps that state itself, eg in a
+//           kernel's task structure. Default: a BMCXX_THREAD_LOCAL instance.
+//   BMCXX_CPU_ID
+//           function returning the number of the current CPU, used to index per-CPU tables.
+//           Default: bmcxxabi_cpu_id.
+//
+// Type matching:
+//   BMCXX_TYPE_INTERN
+//           provide bmcxxabi_intern_type_infos, which points the names of separately-linked
+//           modules' type_info objects at canonical copies, via an interning table (see
+//           typeinfo_intern.cc), so that they match by name pointer. Default: not defined;
+//           type_info objects are equal only if they or their name pointers are identical, which
+//           suffices within a single image. Comparison is the same either way.
+//
+// Instrumentation:
+//   BMCXX_INSTRUMENT
+//           compile in all of the instrumentation: BMCXX_STATS, BMCXX_THROW_PROFILE,
+//           BMCXX_PERSONALITY_PROFILE, BMCXX_THROW_BACKTRACE, BMCXX_EH_TRACE and
+//           BMCXX_GUARD_PROFILE. Each of these can also be defined on its own. Default: no
+//           instrumentation.
+//
+// An option which is not defined costs nothing: its hooks compile away. Of those defined, the
+// throw profile, the event trace and the throw governor are switched on at run time, and cost one
+// load and test of a flag, at each throw or tracepoint, while switched off.
+
+#ifdef BMCXX_CONFIG_HEADER
+#include BMCXX_CONFIG_HEADER
+#endif
+
+#ifndef BMCXX_EXCEPTION_ALLOC
+#define BMCXX_EXCEPTION_ALLOC malloc
+#endif
+
+#ifndef BMCXX_EXCEPTION_FREE
+#define BMCXX_EXCEPTION_FREE free
+#endif
+
+#ifndef BMCXX_ATEXIT_ALLOC
+#define BMCXX_ATEXIT_ALLOC malloc
+#endif
+
+#ifndef BMCXX_ATEXIT_FREE
+#define BMCXX_ATEXIT_FREE free
+#endif
+
+#ifndef BMCXX_TERMINATE
+#define BMCXX_TERMINATE std::terminate
+#endif
+
+#ifdef BMCXX_INSTRUMENT
+#ifndef BMCXX_STATS
+#define BMCXX_STATS 1
+#endif
+#ifndef BMCXX_THROW_PROFILE
+#define BMCXX_THROW_PROFILE 1
+#endif
+#ifndef BMCXX_PERSONALITY_PROFILE
+#define BMCXX_PERSONALITY_PROFILE 1
+#endif
+#ifndef BMCXX_THROW_BACKTRACE
+#define BMCXX_THROW_BACKTRACE 1
+#endif
+#ifndef BMCXX_EH_TRACE
+#define BMCXX_EH_TRACE 1
+#endif
+#ifndef BMCXX_GUARD_PROFILE
+#define BMCXX_GUARD_PROFILE 1
+#endif
+#endif
+
+#endif
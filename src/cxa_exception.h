@@ -1,12 +1,51 @@
 #ifndef _CXA_EXCEPTION_H_INCLUDED
 #define _CXA_EXCEPTION_H_INCLUDED 1
 
+#include "config.h"
+
+#include <cstdint>
+
 #include <unwind.h>
 
 #include "../include/typeinfo"
+#include "throw_backtrace.h"
+
+struct throw_profile_entry;
+struct exception_arena_block;
 
 struct __cxa_exception { 
 
+#ifdef BMCXX_THROW_PROFILE
+    // Throw-site profiler (see throw_profile.cc) entry for the most recent throw of this exception,
+    // or null if not being profiled, and the cycle count at the time of that throw
+    throw_profile_entry *profileEntry;
+    uint64_t profileThrowTime;
+#endif
+
+#ifdef BMCXX_STATS
+    // Size of the allocation (header and thrown object), for the statistics (see stats.cc)
+    size_t allocatedSize;
+#endif
+
+#ifdef BMCXX_THROW_BACKTRACE
+    // Return addresses captured when the exception was thrown, from the throw site outwards (see
+    // throw_backtrace.cc)
+    unsigned backtraceDepth;
+    void *backtraceFrames[BMCXX_THROW_BACKTRACE_DEPTH];
+#endif
+
+#ifdef BMCXX_STATIC_EXCEPTIONS
+    // For a throw of a static exception (see bmcxxabi_throw_static), the exception object, which
+    // is not stored after this header; otherwise null. (As for the ABI's "dependent" exceptions.)
+    void *primaryException;
+#endif
+
+#ifdef BMCXX_EXCEPTION_ARENAS
+    // The exception arena storage (see bmcxxabi_exception_arena_push) the exception was allocated
+    // from, or null if it was allocated individually
+    exception_arena_block *arenaBlock;
+#endif
+
     // This field isn't documented in the C++ ABI, but LLVM's libunwind includes it with a
     // comment that it's for C++0x exception_ptr support.
     //
@@ -16,6 +55,12 @@ struct __cxa_exception {
     
     // From this point, structure is specified by the ABI. However, the compiler does not AFAIK
     // generate code that in any way relies on this structure.
+    //
+    // With BMCXX_COMPACT_EXCEPTION_HEADER, the fields this runtime never uses (the handlers, which
+    // are always null, and the personality routine's unused cache fields) are left out. On x86-64
+    // this takes the header from 128 to 96 bytes, so that a header and a small thrown object fit
+    // in two cache lines rather than three. Debuggers and other tools which assume the ABI layout
+    // won't be able to decode exceptions from such a build.
     // -----------------------------------------
 
     std::type_info *exceptionType;
@@ -26,8 +71,10 @@ struct __cxa_exception {
     // Any replacement "unexpected" handler must be of this type.
     typedef void (*unexpected_handler) ();
 
+#ifndef BMCXX_COMPACT_EXCEPTION_HEADER
     /* std:: */ unexpected_handler unexpectedHandler;
     /* std:: */ terminate_handler terminateHandler;
+#endif
 
     __cxa_exception *nextException;
 
@@ -36,8 +83,10 @@ struct __cxa_exception {
 
     // following fields can be used by the personality return, eg to cache
     // values between search phase and unwind phase:
+#ifndef BMCXX_COMPACT_EXCEPTION_HEADER
     const char *actionRecord;
     const char *languageSpecificData;
+#endif
     void *catchTemp;
     void *adjustedPtr;
 
@@ -45,6 +94,29 @@ struct __cxa_exception {
     _Unwind_Exception unwindHeader;
 };
 
+// The thrown object of an exception
+inline void *thrown_object(__cxa_exception *cxa_ex) noexcept
+{
+#ifdef BMCXX_STATIC_EXCEPTIONS
+    if (cxa_ex->primaryException != nullptr) {
+        return cxa_ex->primaryException;
+    }
+#endif
+    return cxa_ex + 1;
+}
+
+// Per-thread exception state (as specified by the ABI). See BMCXX_EH_GLOBALS in config.h.
+struct __cxa_eh_globals {
+    __cxa_exception *caughtExceptions;   // stack of exceptions being handled, most recent first
+    unsigned int uncaughtExceptions;     // exceptions thrown and not yet caught
+#ifdef BMCXX_EXCEPTION_ARENAS
+    exception_arena_block *exceptionArena;       // storage of the current exception arena, or null
+    exception_arena_block *exceptionArenaCache;  // storage of a popped arena, kept for reuse
+#endif
+};
+
 extern "C" void *__cxa_begin_catch(void *exception_object) noexcept;
+extern "C" __cxa_eh_globals *__cxa_get_globals() noexcept;
+extern "C" __cxa_eh_globals *__cxa_get_globals_fast() noexcept;
 
 #endif
@@ -1,9 +1,24 @@
 #include <cstdlib>
 #include <cstring>
 #include <cstdint>
-#include <exception> // for std::terminate
 
+#include "config.h"
 #include "cxa_exception.h"
+#include "cycle_count.h"
+#include "eh_trace.h"
+#include "guard_profile.h"
+#include "stats.h"
+#include "threads.h"
+#include "throw_governor.h"
+#include "throw_profile.h"
+#include "../include/bmcxxabi.h"
+
+// std::terminate is provided by the environment (or, in a hosted build, by hosted.cc). It is
+// declared here rather than via <exception>, which for a hosted build would bring in the host
+// library's definition of std::type_info.
+namespace std {
+    [[noreturn]] void terminate() noexcept;
+}
 
 // Funky C++ stuff.
 //
@@ -27,50 +42,356 @@
 
 namespace {
 
-// THREAD-SAFETY : these variables should be thread-local variables
-//  (technically they should be part of __cxa_eh_globals struct, retrieved via __cxa_get_globals or
-//   __cxa_get_globals_fast; we don't implement those).
-__cxa_exception *handled_exc_stack_top = nullptr;
-unsigned num_uncaught_exceptions = 0;
+// Per-thread exception state: the stack of caught exceptions and the number of uncaught
+// exceptions. Unless the environment provides it (via BMCXX_EH_GLOBALS; see config.h), it is
+// thread-local if built with BMCXX_THREADS (see threads.h).
+#ifdef BMCXX_EH_GLOBALS
+inline __cxa_eh_globals *get_eh_globals() noexcept
+{
+    return BMCXX_EH_GLOBALS();
+}
+#else
+BMCXX_THREAD_LOCAL __cxa_eh_globals eh_globals = { nullptr, 0 };
+
+inline __cxa_eh_globals *get_eh_globals() noexcept
+{
+    return &eh_globals;
+}
+#endif
+
+// Terminate, as required when an exception cannot be allocated or is not caught
+[[noreturn]] void runtime_terminate() noexcept
+{
+    stat_add(stat_terminates);
+    BMCXX_TERMINATE();
+}
+
+// Count an exception allocation (or freeing) of the given exception, in the statistics
+inline void count_allocation(__cxa_exception *cxa_ex, size_t size) noexcept
+{
+#ifdef BMCXX_STATS
+    cxa_ex->allocatedSize = size;
+    stat_add(stat_exceptions_allocated);
+    stat_add(stat_exception_bytes_allocated, size);
+#else
+    (void)cxa_ex;
+    (void)size;
+#endif
+}
+
+inline void count_free(__cxa_exception *cxa_ex) noexcept
+{
+#ifdef BMCXX_STATS
+    stat_add(stat_exceptions_freed);
+    stat_add(stat_exception_bytes_freed, cxa_ex->allocatedSize);
+#else
+    (void)cxa_ex;
+#endif
+}
+
+}
+
+#ifdef BMCXX_EXCEPTION_ARENAS
+
+// Exception arenas.
+//
+// Where exceptions are thrown and caught within a bounded scope (eg the handling of one request),
+// the scope can push an exception arena for the current thread (bmcxxabi_exception_arena_push),
+// and pop it at the end (bmcxxabi_exception_arena_pop). While it is the current arena,
+// exceptions are allocated from it by bumping an offset, and freeing one (after its destructor has
+// run, at the end of its last handler) just counts it; popping the arena releases the storage of
+// them all at once, and keeps it (one block per thread) for reuse by the next push, so that a scope
+// which throws need not use the allocator at all. An exception which doesn't fit in the arena is
+// allocated individually, as usual.
+//
+// An exception from the arena which is still alive when the arena is popped (eg one propagating out
+// of the scope, through the destructor which pops the arena, or one still being handled) has
+// escaped, and can't be moved (promoted to individually-allocated storage), since the unwinder or a
+// handler refers to it. Instead, the arena's storage is not reused but is left to its remaining
+// exceptions: the count of live exceptions (which includes one for the arena itself while it is
+// pushed) is decremented as each is freed, and the storage is freed, as for an individually-
+// allocated exception, with the last. The count is atomic, so this is safe wherever the exceptions
+// are freed. The cost of an escape is that the whole block stays allocated meanwhile, and that the
+// thread's next push allocates a new one.
+
+#ifdef BMCXX_BOUNDED_LATENCY
+#error "BMCXX_EXCEPTION_ARENAS is not supported with BMCXX_BOUNDED_LATENCY"
+#endif
+
+#ifndef BMCXX_EXCEPTION_ARENA_SIZE
+#define BMCXX_EXCEPTION_ARENA_SIZE 4096
+#endif
+
+// The storage of an arena; the exceptions follow the header
+struct alignas(__BIGGEST_ALIGNMENT__) exception_arena_block {
+    size_t capacity;    // bytes available for exceptions
+    size_t used;
+    size_t live;        // exceptions allocated and not yet freed, plus 1 while the arena is pushed
+};
+
+namespace {
+
+constexpr size_t arena_align = __BIGGEST_ALIGNMENT__;
+
+// Allocate an exception (header and thrown object) of the given size from the current thread's
+// arena; returns null if there is no arena, or no room in it.
+inline char *arena_allocate(exception_arena_block *block, size_t needed) noexcept
+{
+    if (block == nullptr) {
+        return nullptr;
+    }
+    size_t size = (needed + arena_align - 1) & ~(arena_align - 1);
+    if (size > block->capacity - block->used) {
+        return nullptr;
+    }
+    char *buf = (char *)(block + 1) + block->used;
+    block->used += size;
+    __atomic_fetch_add(&block->live, 1, __ATOMIC_RELAXED);
+    return buf;
+}
+
+// Release a reference to an arena's storage (for an exception freed, or the arena popped); true
+// if it was the last
+inline bool arena_release(exception_arena_block *block) noexcept
+{
+    return __atomic_sub_fetch(&block->live, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+}
+
+extern "C"
+void bmcxxabi_exception_arena_push(bmcxxabi_exception_arena *arena, size_t capacity)
+{
+    __cxa_eh_globals *globals = get_eh_globals();
+    if (capacity == 0) {
+        capacity = BMCXX_EXCEPTION_ARENA_SIZE;
+    }
+
+    exception_arena_block *block = globals->exceptionArenaCache;
+    if (block != nullptr && block->capacity >= capacity) {
+        globals->exceptionArenaCache = nullptr;
+    }
+    else {
+        // (if the storage can't be allocated, the arena has none, and exceptions are allocated
+        // individually)
+        block = (exception_arena_block *)BMCXX_EXCEPTION_ALLOC(sizeof(exception_arena_block)
+                + capacity);
+        if (block != nullptr) {
+            block->capacity = capacity;
+        }
+    }
+    if (block != nullptr) {
+        block->used = 0;
+        block->live = 1;
+    }
+
+    arena->block = block;
+    arena->outer = globals->exceptionArena;
+    globals->exceptionArena = block;
+}
+
+extern "C"
+void bmcxxabi_exception_arena_pop(bmcxxabi_exception_arena *arena)
+{
+    __cxa_eh_globals *globals = get_eh_globals();
+    exception_arena_block *block = (exception_arena_block *)arena->block;
+    if (globals->exceptionArena != block) {
+        // not the current arena
+        runtime_terminate();
+    }
+    globals->exceptionArena = (exception_arena_block *)arena->outer;
+
+    if (block == nullptr || !arena_release(block)) {
+        // no storage, or exceptions have escaped (the last of them frees the storage)
+        return;
+    }
+
+    // Keep the larger of this storage and any already kept
+    exception_arena_block *cached = globals->exceptionArenaCache;
+    if (cached == nullptr || cached->capacity < block->capacity) {
+        globals->exceptionArenaCache = block;
+        block = cached;
+    }
+    if (block != nullptr) {
+        BMCXX_EXCEPTION_FREE(block);
+    }
+}
+
+// Free the storage kept for reuse by the current thread (eg before the thread exits)
+extern "C"
+void bmcxxabi_exception_arena_trim()
+{
+    __cxa_eh_globals *globals = get_eh_globals();
+    if (globals->exceptionArenaCache != nullptr) {
+        BMCXX_EXCEPTION_FREE(globals->exceptionArenaCache);
+        globals->exceptionArenaCache = nullptr;
+    }
+}
+
+#endif
+
+#ifdef BMCXX_BOUNDED_LATENCY
+
+// In the bounded-latency mode, exceptions are allocated from a fixed pool of fixed-size blocks
+// rather than from the heap, so that allocation and freeing take constant time. A block holds the
+// __cxa_exception header and the thrown object; throwing a larger object, or more exceptions at
+// once than there are blocks, terminates. Blocks are cache-line aligned, so that a header and a
+// small thrown object span as few lines as they can (two, with BMCXX_COMPACT_EXCEPTION_HEADER).
+
+#ifndef BMCXX_EXCEPTION_POOL_BLOCKS
+#define BMCXX_EXCEPTION_POOL_BLOCKS 16
+#endif
+
+#ifndef BMCXX_EXCEPTION_BLOCK_SIZE
+#define BMCXX_EXCEPTION_BLOCK_SIZE 512
+#endif
+
+namespace {
+
+static_assert(BMCXX_EXCEPTION_BLOCK_SIZE > sizeof(__cxa_exception),
+        "BMCXX_EXCEPTION_BLOCK_SIZE too small for the exception header");
+
+union alignas(64) exception_block {
+    exception_block *next_free;
+    alignas(__BIGGEST_ALIGNMENT__) char storage[BMCXX_EXCEPTION_BLOCK_SIZE];
+};
+
+exception_block exception_pool[BMCXX_EXCEPTION_POOL_BLOCKS];
+
+// Blocks are used from the pool in order, and then from the free list once freed
+exception_block *free_blocks = nullptr;
+unsigned num_pool_blocks_used = 0;
+
+// protects the above
+BMCXX_LOCK pool_lock;
 
 }
 
+extern "C"
+void * __cxa_allocate_exception(size_t thrown_size) noexcept
+{
+    if (thrown_size > BMCXX_EXCEPTION_BLOCK_SIZE - sizeof(__cxa_exception)) {
+        runtime_terminate();
+    }
+
+    pool_lock.lock();
+    exception_block *block = free_blocks;
+    if (block != nullptr) {
+        free_blocks = block->next_free;
+    }
+    else if (num_pool_blocks_used < BMCXX_EXCEPTION_POOL_BLOCKS) {
+        block = &exception_pool[num_pool_blocks_used++];
+    }
+    pool_lock.unlock();
+
+    if (block == nullptr) {
+        runtime_terminate();
+    }
+
+    memset(block->storage, 0, sizeof(__cxa_exception));
+    count_allocation((__cxa_exception *)block->storage, sizeof(exception_block));
+    void *thrown = block->storage + sizeof(__cxa_exception);
+    eh_trace(BMCXXABI_TRACE_ALLOCATE, thrown, thrown_size);
+    return thrown;
+}
+
+extern "C"
+void __cxa_free_exception(void *exc) noexcept
+{
+    exception_block *block = (exception_block *)((char *)exc - sizeof(__cxa_exception));
+    eh_trace(BMCXXABI_TRACE_FREE, exc);
+    count_free((__cxa_exception *)block->storage);
+
+    pool_lock.lock();
+    block->next_free = free_blocks;
+    free_blocks = block;
+    pool_lock.unlock();
+}
+
+#else
+
 extern "C"
 void * __cxa_allocate_exception(size_t thrown_size) noexcept
 {
     // We need space for __cxa_exception + the exception object
     size_t needed = thrown_size + sizeof(__cxa_exception);
     
-    char *buf = (char *) malloc(needed);
+#ifdef BMCXX_EXCEPTION_ARENAS
+    exception_arena_block *arena = get_eh_globals()->exceptionArena;
+    char *buf = arena_allocate(arena, needed);
+    if (buf == nullptr) {
+        arena = nullptr;
+        buf = (char *) BMCXX_EXCEPTION_ALLOC(needed);
+    }
+#else
+    char *buf = (char *) BMCXX_EXCEPTION_ALLOC(needed);
+#endif
     
     if (buf == nullptr) {
-        std::terminate();
+        runtime_terminate();
     }
 
     memset(buf, 0, sizeof(__cxa_exception));
-    return buf + sizeof(__cxa_exception);
+#ifdef BMCXX_EXCEPTION_ARENAS
+    ((__cxa_exception *)buf)->arenaBlock = arena;
+#endif
+    count_allocation((__cxa_exception *)buf, needed);
+    void *thrown = buf + sizeof(__cxa_exception);
+    eh_trace(BMCXXABI_TRACE_ALLOCATE, thrown, thrown_size);
+    return thrown;
 }
 
 extern "C"
 void __cxa_free_exception(void *exc) noexcept
 {
     char *exc_p = (char *)exc - sizeof(__cxa_exception);
-    free(exc_p);
+    eh_trace(BMCXXABI_TRACE_FREE, exc);
+    count_free((__cxa_exception *)exc_p);
+#ifdef BMCXX_EXCEPTION_ARENAS
+    exception_arena_block *arena = ((__cxa_exception *)exc_p)->arenaBlock;
+    if (arena != nullptr) {
+        // (the storage is released all at once, by the arena's pop or its last escaped exception)
+        if (arena_release(arena)) {
+            BMCXX_EXCEPTION_FREE(arena);
+        }
+        return;
+    }
+#endif
+    BMCXX_EXCEPTION_FREE(exc_p);
 }
 
+#endif
+
+#ifdef BMCXX_THROW_PROFILE
+
+// Record a throw (or rethrow) of the given exception from the given site, if profiling is enabled
+static inline void profile_throw(__cxa_exception *cxa_ex, const void *site)
+{
+    if (__builtin_expect(__atomic_load_n(&throw_profile_enabled, __ATOMIC_RELAXED), 0)) {
+        cxa_ex->profileEntry = throw_profile_record(site, cxa_ex->exceptionType);
+        cxa_ex->profileThrowTime = bmcxx_cycle_count();
+    }
+    else {
+        cxa_ex->profileEntry = nullptr;
+    }
+}
+
+#endif
+
 // Cleanup exception, would not normally be called except by foreign exception handler(?)
 static void cleanup_exception(_Unwind_Reason_Code, _Unwind_Exception *)
 {
 
 }
 
-// Note we mustn't specify noexcept here: exceptions must propagate through
-extern "C"
-void __cxa_throw(void *thrown, std::type_info *tinfo, void (*destructor)(void *))
+// Start a throw of the given exception, thrown (via __cxa_throw or bmcxxabi_throw_static) from
+// the given site, whose frame is given (for the throw profiler and backtrace capture). Returns
+// only if the exception isn't caught. (Always inlined, so that the backtrace starts from the
+// caller's frame.)
+__attribute__((always_inline))
+static inline void raise_exception(__cxa_exception *cxa_ex, std::type_info *tinfo,
+        void (*destructor)(void *), const void *site, void *frame)
 {
-    uintptr_t cxa_addr = (uintptr_t)thrown - sizeof(__cxa_exception);
-    __cxa_exception *cxa_ex = (__cxa_exception *) cxa_addr;
-    
     // The following should not be required, as __cxa_exception should have trivial default
     // construction:
     //     new(cxa_ex) __cxa_exception;
@@ -80,11 +401,20 @@ void __cxa_throw(void *thrown, std::type_info *tinfo, void (*destructor)(void *)
     cxa_ex->exceptionType = tinfo;
     cxa_ex->exceptionDestructor = destructor;
 
+#ifndef BMCXX_COMPACT_EXCEPTION_HEADER
     // We're supposed to set these to the current handlers, but we don't support that.
     cxa_ex->unexpectedHandler = nullptr;
     cxa_ex->terminateHandler = nullptr;
+#endif
     
-    num_uncaught_exceptions++;
+    get_eh_globals()->uncaughtExceptions++;
+    stat_add(stat_throws);
+
+#ifdef BMCXX_THROW_GOVERNOR
+    if (__builtin_expect(__atomic_load_n(&throw_governor_enabled, __ATOMIC_ACQUIRE), 0)) {
+        throw_governor_record(site, tinfo);
+    }
+#endif
     
     cxa_ex->handlerCount = 0;
     
@@ -93,10 +423,125 @@ void __cxa_throw(void *thrown, std::type_info *tinfo, void (*destructor)(void *)
     
     cxa_ex->unwindHeader.exception_cleanup = cleanup_exception;
 
+#ifdef BMCXX_THROW_PROFILE
+    profile_throw(cxa_ex, site);
+#endif
+    (void)site;
+
+#ifdef BMCXX_THROW_BACKTRACE
+    cxa_ex->backtraceDepth = throw_backtrace_capture(frame, tinfo, false, cxa_ex->backtraceFrames);
+#else
+    (void)frame;
+#endif
+
+    eh_trace(BMCXXABI_TRACE_THROW, cxa_ex + 1, (uintptr_t)tinfo);
+
     _Unwind_RaiseException(&cxa_ex->unwindHeader);
+}
+
+// Note we mustn't specify noexcept here: exceptions must propagate through
+extern "C"
+void __cxa_throw(void *thrown, std::type_info *tinfo, void (*destructor)(void *))
+{
+    uintptr_t cxa_addr = (uintptr_t)thrown - sizeof(__cxa_exception);
+    __cxa_exception *cxa_ex = (__cxa_exception *) cxa_addr;
+
+    raise_exception(cxa_ex, tinfo, destructor, __builtin_return_address(0),
+            __builtin_frame_address(0));
     
     __cxa_begin_catch(thrown);
-    std::terminate();
+    runtime_terminate();
+}
+
+#ifdef BMCXX_STATIC_EXCEPTIONS
+
+// Static exceptions.
+//
+// A static exception (bmcxxabi_static_exception) is an exception object which is never copied or
+// destroyed by the runtime, and can be thrown any number of times, including by several threads
+// at once. The header of an exception is specific to one throw (it holds the unwinder's state
+// and the position in the stack of caught exceptions), so each throw of a static exception uses
+// a separate header, which refers to the object (via primaryException; see thrown_object in
+// cxa_exception.h). The header comes from a small per-thread set, so that throwing allocates
+// nothing unless more than BMCXX_STATIC_THROW_HEADERS throws of static exceptions are active in
+// the thread at once (eg one thrown in a handler for another); in that case the header is
+// allocated as for any other exception.
+
+#ifndef BMCXX_STATIC_THROW_HEADERS
+#define BMCXX_STATIC_THROW_HEADERS 4
+#endif
+
+static_assert(BMCXX_STATIC_THROW_HEADERS > 0 && BMCXX_STATIC_THROW_HEADERS <= 32,
+        "BMCXX_STATIC_THROW_HEADERS must be between 1 and 32");
+
+namespace {
+
+BMCXX_THREAD_LOCAL __cxa_exception static_throw_headers[BMCXX_STATIC_THROW_HEADERS];
+
+// Mask of the headers in use
+BMCXX_THREAD_LOCAL uint32_t static_throw_headers_used = 0;
+
+__cxa_exception *claim_static_header() noexcept
+{
+    uint32_t free_mask = ~static_throw_headers_used;
+    if (free_mask != 0) {
+        unsigned i = __builtin_ctz(free_mask);
+        if (i < BMCXX_STATIC_THROW_HEADERS) {
+            static_throw_headers_used |= (uint32_t)1 << i;
+            return &static_throw_headers[i];
+        }
+    }
+
+    // All in use: allocate a header, with no object
+    return (__cxa_exception *)__cxa_allocate_exception(0) - 1;
+}
+
+void release_static_header(__cxa_exception *cxa_ex) noexcept
+{
+    uintptr_t offset = (uintptr_t)cxa_ex - (uintptr_t)static_throw_headers;
+    if (offset < sizeof(static_throw_headers)) {
+        eh_trace(BMCXXABI_TRACE_FREE, cxa_ex + 1);
+        static_throw_headers_used &= ~((uint32_t)1 << (offset / sizeof(__cxa_exception)));
+    }
+    else {
+        __cxa_free_exception(cxa_ex + 1);
+    }
+}
+
+} // anon namespace
+
+extern "C"
+void bmcxxabi_throw_static(const bmcxxabi_static_exception *exc)
+{
+    __cxa_exception *cxa_ex = claim_static_header();
+    cxa_ex->primaryException = const_cast<void *>(exc->object);
+
+    raise_exception(cxa_ex, const_cast<std::type_info *>(exc->type), nullptr,
+            __builtin_return_address(0), __builtin_frame_address(0));
+
+    __cxa_begin_catch(cxa_ex + 1);
+    runtime_terminate();
+}
+
+#endif
+
+// Destroy an exception which is no longer referenced
+static void destroy_exception(__cxa_exception *cxa_ex) noexcept
+{
+    void *native_exc = cxa_ex + 1;
+
+#ifdef BMCXX_STATIC_EXCEPTIONS
+    if (cxa_ex->primaryException != nullptr) {
+        // a throw of a static exception: the object lives on
+        release_static_header(cxa_ex);
+        return;
+    }
+#endif
+
+    if (cxa_ex->exceptionDestructor) {
+        cxa_ex->exceptionDestructor(native_exc);
+    }
+    __cxa_free_exception(native_exc);
 }
 
 extern "C"
@@ -106,6 +551,14 @@ void *__cxa_begin_catch(void *exception_object) noexcept
 
     uintptr_t cxa_addr = (uintptr_t)exception_object - sizeof(__cxa_exception);
     __cxa_exception *cxa_ex = (__cxa_exception *) cxa_addr;
+    __cxa_eh_globals *globals = get_eh_globals();
+
+#ifdef BMCXX_THROW_PROFILE
+    if (cxa_ex->profileEntry != nullptr) {
+        throw_profile_caught(cxa_ex->profileEntry, bmcxx_cycle_count() - cxa_ex->profileThrowTime);
+        cxa_ex->profileEntry = nullptr;
+    }
+#endif
 
     if (cxa_ex->handlerCount < 0) {
         // negative handler count indicates in-flight re-thrown exception
@@ -113,21 +566,57 @@ void *__cxa_begin_catch(void *exception_object) noexcept
     }
     else {
         // otherwise, handler count should be 0
-        cxa_ex->nextException = handled_exc_stack_top;
-        handled_exc_stack_top = cxa_ex;
+        cxa_ex->nextException = globals->caughtExceptions;
+        globals->caughtExceptions = cxa_ex;
     }
 
     cxa_ex->handlerCount++;
-    num_uncaught_exceptions--;
+    globals->uncaughtExceptions--;
+
+    eh_trace(BMCXXABI_TRACE_BEGIN_CATCH, exception_object, cxa_ex->handlerCount);
     
     return cxa_ex->adjustedPtr;
 }
 
+// Called by a handler which catches by value, before __cxa_begin_catch, to get the (adjusted)
+// address of the exception object to copy from. The argument is as for __cxa_begin_catch.
+extern "C"
+void *__cxa_get_exception_ptr(void *exception_object) noexcept
+{
+    uintptr_t cxa_addr = (uintptr_t)exception_object - sizeof(__cxa_exception);
+    __cxa_exception *cxa_ex = (__cxa_exception *) cxa_addr;
+    return cxa_ex->adjustedPtr;
+}
+
+// The number of exceptions thrown (or rethrown) in the current thread and not yet caught; this is
+// what std::uncaught_exceptions() returns. (The name is as in libc++abi.)
+extern "C"
+unsigned int __cxa_uncaught_exceptions() noexcept
+{
+    return get_eh_globals()->uncaughtExceptions;
+}
+
+// The current thread's exception state (for a debugger, or another runtime component which needs
+// it). __cxa_get_globals_fast may assume the state already exists; here, it always does.
+extern "C"
+__cxa_eh_globals *__cxa_get_globals() noexcept
+{
+    return get_eh_globals();
+}
+
+extern "C"
+__cxa_eh_globals *__cxa_get_globals_fast() noexcept
+{
+    return get_eh_globals();
+}
+
 extern "C"
 void __cxa_end_catch() noexcept
 {
     // Take the exception at the top of the caught exception stack
-    __cxa_exception *st_top = handled_exc_stack_top;
+    __cxa_eh_globals *globals = get_eh_globals();
+    __cxa_exception *st_top = globals->caughtExceptions;
+    uintptr_t native_exc_addr = (uintptr_t)(st_top) + sizeof(__cxa_exception);
 
     // There are three cases where end catch is called:
     // 1. a handler is completing normally
@@ -141,14 +630,11 @@ void __cxa_end_catch() noexcept
     if (st_top->handlerCount > 0) {
         // positive handler count, not re-thrown
 
+        eh_trace(BMCXXABI_TRACE_END_CATCH, (void *)native_exc_addr, st_top->handlerCount - 1);
         if (--(st_top->handlerCount) == 0) {
-            handled_exc_stack_top = st_top->nextException;
+            globals->caughtExceptions = st_top->nextException;
             if (--(st_top->referenceCount) == 0) {
-                // destroy.
-                if (st_top->exceptionDestructor) {
-                    uintptr_t native_exc_addr = (uintptr_t)(st_top) + sizeof(__cxa_exception);
-                    st_top->exceptionDestructor((void *) native_exc_addr);
-                }
+                destroy_exception(st_top);
             }
         }
     }
@@ -156,8 +642,9 @@ void __cxa_end_catch() noexcept
         // negative handler count, in-flight rethrown exception
 
         ++(st_top->handlerCount); // decrement (negative) count
+        eh_trace(BMCXXABI_TRACE_END_CATCH, (void *)native_exc_addr, st_top->handlerCount);
         if (st_top->handlerCount == 0) {
-            handled_exc_stack_top = st_top->nextException;
+            globals->caughtExceptions = st_top->nextException;
         }
     }
 }
@@ -165,42 +652,178 @@ void __cxa_end_catch() noexcept
 extern "C"
 void __cxa_rethrow()
 {
-    if (handled_exc_stack_top == nullptr) {
-        std::terminate();
+    __cxa_eh_globals *globals = get_eh_globals();
+    if (globals->caughtExceptions == nullptr) {
+        runtime_terminate();
     }
 
-    // remove the exception from the stack of uncaught exceptions
-    __cxa_exception *exc = handled_exc_stack_top;
-    handled_exc_stack_top = exc->nextException;
+    // The exception stays on the stack of caught exceptions: the handler which rethrows it is
+    // still active, and its __cxa_end_catch call (when it exits, or if the exception is caught
+    // again within it, when the inner handler exits) is what removes it.
+    __cxa_exception *exc = globals->caughtExceptions;
 
     // Make the handlerCount negative to mark this exception as in-flight rethrown
     exc->handlerCount = -exc->handlerCount;
 
-    num_uncaught_exceptions++;
+    globals->uncaughtExceptions++;
+    stat_add(stat_rethrows);
+
+#ifdef BMCXX_THROW_PROFILE
+    profile_throw(exc, __builtin_return_address(0));
+#endif
 
-    _Unwind_RaiseException(&handled_exc_stack_top->unwindHeader);
+#ifdef BMCXX_THROW_BACKTRACE
+    // Record the rethrow (but keep the backtrace of the original throw in the exception)
+    void *rethrow_frames[BMCXX_THROW_BACKTRACE_DEPTH];
+    throw_backtrace_capture(__builtin_frame_address(0), exc->exceptionType, true, rethrow_frames);
+#endif
+
+    eh_trace(BMCXXABI_TRACE_RETHROW, exc + 1);
+
+    _Unwind_RaiseException(&exc->unwindHeader);
 
     void *cxx_exception = (void *)((uintptr_t)exc + sizeof(__cxa_exception));
     __cxa_begin_catch(cxx_exception);
-    std::terminate();
+    runtime_terminate();
 }
 
+#ifdef BMCXX_THROW_BACKTRACE
+
+// Copy (up to max frames of) the backtrace captured when the most recently caught exception (which
+// is still being handled) in the current thread was thrown; returns the number copied. An exception
+// which escapes to std::terminate is treated as caught, so this can be used in a terminate handler.
+extern "C"
+unsigned bmcxxabi_exception_backtrace(void **frames, unsigned max)
+{
+    __cxa_exception *exc = get_eh_globals()->caughtExceptions;
+    if (exc == nullptr) {
+        return 0;
+    }
+    unsigned depth = exc->backtraceDepth < max ? exc->backtraceDepth : max;
+    memcpy(frames, exc->backtraceFrames, depth * sizeof(void *));
+    return depth;
+}
+
+#endif
+
+// Static-initialisation guards. The first byte of the guard is set (by __cxa_guard_release) once
+// initialisation is complete, and is checked by compiler-generated code before calling
+// __cxa_guard_acquire. With BMCXX_THREADS, the second byte is set while a thread is performing
+// the initialisation; other threads wait for it to complete (or abort). __cxa_guard_acquire first
+// loads the guard, so that a guard which is already initialised costs a single load, with no
+// atomic read-modify-write. The two bytes are updated together, as a 16-bit value, so that an
+// uncontended first acquire is then a single compare-exchange.
+
+#ifdef BMCXX_THREADS
+namespace {
+
+typedef uint16_t __attribute__((may_alias)) guard_state_t;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+constexpr guard_state_t guard_initialised = 0x0001;
+constexpr guard_state_t guard_in_progress = 0x0100;
+#else
+constexpr guard_state_t guard_initialised = 0x0100;
+constexpr guard_state_t guard_in_progress = 0x0001;
+#endif
+
+} // anon namespace
+#endif
+
 extern "C"
 int __cxa_guard_acquire (int64_t *guard_object)
 {
-    // THREAD-SAFETY : this should acquire a mutex
-    return (*(char *)guard_object) == 0;
+    eh_trace(BMCXXABI_TRACE_GUARD_ACQUIRE, guard_object);
+    stat_add(stat_guard_acquires);
+
+#ifdef BMCXX_THREADS
+    guard_state_t *state = (guard_state_t *)guard_object;
+    if (__atomic_load_n(state, __ATOMIC_ACQUIRE) & guard_initialised) {
+        return 0;
+    }
+
+    guard_state_t expected = 0;
+    bool waited = false;
+    while (!__atomic_compare_exchange_n(state, &expected, guard_in_progress, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        // 'expected' now holds the current state: either initialised, or in progress in another
+        // thread
+        if (expected & guard_initialised) {
+            return 0;
+        }
+        if (!waited) {
+            stat_add(stat_guard_contended);
+            waited = true;
+        }
+        BMCXX_THREAD_YIELD();
+        expected = 0;
+    }
+#ifdef BMCXX_GUARD_PROFILE
+    guard_profile_begin(guard_object, __builtin_return_address(0));
+#endif
+    return 1;
+#else
+    char *initialised = (char *)guard_object;
+    if (*initialised != 0) {
+        return 0;
+    }
+#ifdef BMCXX_GUARD_PROFILE
+    guard_profile_begin(guard_object, __builtin_return_address(0));
+#endif
+    return 1;
+#endif
 }
 
 extern "C"
 void __cxa_guard_release(int64_t *guard_object)
 {
-    // THREAD-SAFETY : this should release the mutex acquired via __cxa_guard_acquire
+#ifdef BMCXX_GUARD_PROFILE
+    guard_profile_end(guard_object, false);
+#endif
+    eh_trace(BMCXXABI_TRACE_GUARD_RELEASE, guard_object);
+
+#ifdef BMCXX_THREADS
+    __atomic_store_n((guard_state_t *)guard_object, guard_initialised, __ATOMIC_RELEASE);
+#else
     *guard_object = 1;
+#endif
 }
 
 extern "C"
 void __cxa_guard_abort(int64_t *guard_object)
 {
-    // THREAD-SAFETY : this should release the mutex acquired via __cxa_guard_acquire
+#ifdef BMCXX_GUARD_PROFILE
+    guard_profile_end(guard_object, true);
+#endif
+    eh_trace(BMCXXABI_TRACE_GUARD_ABORT, guard_object);
+
+#ifdef BMCXX_THREADS
+    __atomic_store_n((guard_state_t *)guard_object, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+#ifdef BMCXX_THREADS
+
+// Called while waiting for another thread. This default just spins; the environment may replace
+// it (a hosted build does, see hosted.cc).
+extern "C" __attribute__((weak))
+void bmcxxabi_thread_yield()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
 }
+
+#endif
+
+#ifdef BMCXX_PER_CPU
+
+// Number of the current CPU, used to select per-CPU tables. This default is for a single CPU; the
+// environment should replace it if it has more than one (a hosted build does, see hosted.cc).
+extern "C" __attribute__((weak))
+unsigned bmcxxabi_cpu_id()
+{
+    return 0;
+}
+
+#endif
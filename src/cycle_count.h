@@ -0,0 +1,18 @@
+#ifndef BMCXX_CYCLE_COUNT_H_INCLUDED
+#define BMCXX_CYCLE_COUNT_H_INCLUDED 1
+
+#include <cstdint>
+
+// Cycle counter, for the profiling modes (BMCXX_THROW_PROFILE, BMCXX_PERSONALITY_PROFILE), to
+// timestamp recorded throws (BMCXX_THROW_BACKTRACE) and to time static initialisation
+// (BMCXX_STATS): the TSC on x86; elsewhere there is no counter, and this returns 0.
+inline uint64_t bmcxx_cycle_count() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,405 @@
+#ifndef _DWARF_EH_H_INCLUDED
+#define _DWARF_EH_H_INCLUDED 1
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+// Decoding of DWARF EH encoded values, as used in the LSDA (language-specific data area) for
+// C++ functions, and in the .eh_frame section. Used by the personality routine (personality.cc),
+// and also by the host-side tools (see "tools" directory), which is why these are in a header.
+
+namespace {
+
+// DWARF EH encodings. These specify how a value is encoded, and what it is relative to
+enum {
+  DW_EH_PE_absptr = 0,  // (not relative)
+  
+  // value encodings (mask 0x0f), may be 0 (absptr)
+  DW_EH_PE_uleb128 = 1,  // variable-length unsigned
+  DW_EH_PE_udata2 = 2,   // 2-byte unsigned
+  DW_EH_PE_udata4 = 3,   // 4-byte unsigned
+  DW_EH_PE_udata8 = 4,   // 8-byte unsigned
+  
+  DW_EH_PE_sleb128 = 9,  // variable-length signed
+  DW_EH_PE_sdata2 = 10,  // 2-byte signed
+  DW_EH_PE_sdata4 = 11,  // 4-byte signed
+  DW_EH_PE_sdata8 = 12,  // 8-byte signed
+
+  // What is it relative to (mask 0x70)? may be 0 (absolute)
+  DW_EH_PE_pcrel = 0x10,
+  DW_EH_PE_textrel = 0x20,
+  DW_EH_PE_datarel = 0x30,
+  DW_EH_PE_funcrel = 0x40,
+  DW_EH_PE_aligned = 0x50,  // ??
+  
+  // "indirect" bit: value is indirect, i.e. specifies address holding value
+  DW_EH_PE_indirect = 0x80,
+  
+  DW_EH_PE_omit = 0xFF  // no value
+};
+
+template <typename T>
+inline T read_val(const uint8_t *& p) noexcept
+{
+    T val;
+    memcpy(&val, p, sizeof(T));
+    p += sizeof(T);
+    return val;
+}
+
+// Read ULEB128-encoded value, bump pointer
+inline uintptr_t read_ULEB128(const uint8_t *& p) noexcept
+{
+    // A series of bytes, each worth 7 bits of value. The last byte has bit 8 clear.
+    
+    uint8_t bval = *p++;
+    if (!(bval & 0x80)) {
+        // Single-byte value (by far the most common case)
+        return bval;
+    }
+
+    uintptr_t val = bval & 0x7F;
+    unsigned shift = 7;
+    
+    do {
+        bval = *p++;
+        val |= ((uintptr_t)(bval & 0x7F)) << shift;
+        shift += 7;
+    } while (bval & 0x80);
+    
+    return val;
+}
+
+// Read SLEB128-encoded value, bump pointer
+inline intptr_t read_SLEB128(const uint8_t *& p) noexcept
+{
+    // A series of bytes, each worth 7 bits of value. The last byte has bit 8 clear.
+    
+    uintptr_t val = 0;    
+    unsigned shift = 0;
+    uint8_t bval;
+    
+    do {
+        bval = *p++;
+        val |= ((uintptr_t)(bval & 0x7F)) << shift;
+        shift += 7;
+    } while (bval & 0x80);
+    
+    if (bval & 0x40) {
+        // sign bit is set, need to extend it
+        if (shift < (sizeof(uintptr_t) * 8 /* CHAR_BIT */)) {
+            val |= ((uintptr_t)-1) << shift;
+        }
+    }
+    
+    return val;
+}
+
+// Decode the (up to 8-byte) LEB128 value held in the low 'len' bytes of a (little-endian) word,
+// i.e. discard the following bytes and the continuation bits, and pack the 7-bit groups together
+// (without looping). Yields up to 56 bits of value.
+inline uint64_t leb128_gather(uint64_t word, unsigned len) noexcept
+{
+    word &= ~(uint64_t)0 >> (64 - len * 8);
+    word &= 0x7F7F7F7F7F7F7F7FULL;
+    word = (word & 0x007F007F007F007FULL) | ((word & 0x7F007F007F007F00ULL) >> 1);
+    word = (word & 0x00003FFF00003FFFULL) | ((word & 0x3FFF00003FFF0000ULL) >> 2);
+    word = (word & 0x000000000FFFFFFFULL) | ((word & 0x0FFFFFFF00000000ULL) >> 4);
+    return word;
+}
+
+// Find the length of a LEB128 value of up to 8 bytes, held in the low bytes of a (little-endian)
+// word; returns 0 if the value is longer than 8 bytes.
+inline unsigned leb128_length(uint64_t word) noexcept
+{
+    uint64_t stop_bits = ~word & 0x8080808080808080ULL;
+    if (stop_bits == 0) return 0;
+    return (__builtin_ctzll(stop_bits) >> 3) + 1;
+}
+
+inline uint64_t read_le64(const uint8_t *p) noexcept
+{
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+// Read ULEB128-encoded value which must lie before 'end', bump pointer. Aborts if the value runs
+// past the end. Never reads data at or past 'end'.
+inline uintptr_t read_ULEB128(const uint8_t *& p, const uint8_t *end) noexcept
+{
+    if (p >= end) abort();
+
+    uint8_t bval = *p;
+    if (!(bval & 0x80)) {
+        p++;
+        return bval;
+    }
+
+    if (end - p >= 8) {
+        // Multi-byte value: decode up to 8 bytes at once
+        uint64_t word = read_le64(p);
+        unsigned len = leb128_length(word);
+        if (len != 0) {
+            p += len;
+            return leb128_gather(word, len);
+        }
+    }
+
+    // Long value, or near the end: a byte at a time
+    uintptr_t val = 0;
+    unsigned shift = 0;
+    do {
+        if (p == end) abort();
+        bval = *p++;
+        if (shift < (sizeof(uintptr_t) * 8 /* CHAR_BIT */)) {
+            val |= ((uintptr_t)(bval & 0x7F)) << shift;
+        }
+        shift += 7;
+    } while (bval & 0x80);
+
+    return val;
+}
+
+// Read SLEB128-encoded value which must lie before 'end', bump pointer. Aborts if the value runs
+// past the end. Never reads data at or past 'end'.
+inline intptr_t read_SLEB128(const uint8_t *& p, const uint8_t *end) noexcept
+{
+    if (p >= end) abort();
+
+    uint8_t bval = *p;
+    if (!(bval & 0x80)) {
+        p++;
+        // sign-extend from bit 6
+        return (intptr_t)(bval ^ 0x40) - 0x40;
+    }
+
+    if (end - p >= 8) {
+        uint64_t word = read_le64(p);
+        unsigned len = leb128_length(word);
+        if (len != 0) {
+            p += len;
+            // sign-extend from the top bit of the value (bit len*7-1; at most bit 55)
+            unsigned unused_bits = 64 - len * 7;
+            return (int64_t)(leb128_gather(word, len) << unused_bits) >> unused_bits;
+        }
+    }
+
+    uintptr_t val = 0;
+    unsigned shift = 0;
+    do {
+        if (p == end) abort();
+        bval = *p++;
+        if (shift < (sizeof(uintptr_t) * 8 /* CHAR_BIT */)) {
+            val |= ((uintptr_t)(bval & 0x7F)) << shift;
+        }
+        shift += 7;
+    } while (bval & 0x80);
+
+    if ((bval & 0x40) && shift < (sizeof(uintptr_t) * 8 /* CHAR_BIT */)) {
+        val |= ((uintptr_t)-1) << shift;
+    }
+
+    return val;
+}
+
+// Base addresses for the relative encodings (DW_EH_PE_textrel, _datarel, _funcrel). A base of
+// 0 means that the base is not known; a value using that encoding is then unsupported.
+struct dwarf_eh_bases {
+    uintptr_t text;
+    uintptr_t data;
+    uintptr_t func;
+};
+
+// Read the value part of a DWARF EH encoded value, with the specified encoding, without applying
+// the relative-base or indirection parts of the encoding; bump pointer. (This, and the functions
+// below, are always inlined so that when the encoding is a constant, as it is in the specialised
+// call-site table walkers in the personality routine, the decoding reduces to a single load).
+__attribute__((always_inline))
+inline uintptr_t read_dwarf_encoded_raw(const uint8_t *& p, uint8_t encoding) noexcept
+{
+    uintptr_t val;
+    
+    switch (encoding & 0x0Fu) {
+    case DW_EH_PE_absptr:
+        // absolute, not-relative value (maybe can still be indirect?)
+        val = (uintptr_t) read_val<uint64_t>(p);
+        break;
+    case DW_EH_PE_uleb128:
+        val = read_ULEB128(p);
+        break;
+    case DW_EH_PE_udata2:
+        val = (uintptr_t) read_val<uint16_t>(p);
+        break;
+    case DW_EH_PE_udata4:
+        val = (uintptr_t) read_val<uint32_t>(p);
+        break;
+    case DW_EH_PE_udata8:
+        val = (uintptr_t) read_val<uint64_t>(p);
+        break;
+    case DW_EH_PE_sleb128:
+        val = read_SLEB128(p);
+        break;
+    case DW_EH_PE_sdata2:
+        val = read_val<int16_t>(p);
+        break;
+    case DW_EH_PE_sdata4:
+        val = read_val<int32_t>(p);
+        break;
+    case DW_EH_PE_sdata8:
+        val = read_val<int64_t>(p);
+        break;
+    default:
+        abort(); // unsupported
+    }
+
+    return val;
+}
+
+// Apply the relative-base and indirection parts of an encoding to a raw value which was read
+// from field_p. A 0 value remains 0 regardless of encoding (as in libsupc++); this matters eg for
+// a catch(...) entry in a types table with an indirect encoding.
+__attribute__((always_inline))
+inline uintptr_t apply_dwarf_encoding(uintptr_t val, const uint8_t *field_p, uint8_t encoding,
+        const dwarf_eh_bases *bases) noexcept
+{
+    if (val == 0) {
+        return 0;
+    }
+
+    uintptr_t base = 0;
+
+    switch (encoding & 0x70u) {
+    case DW_EH_PE_absptr:
+    case DW_EH_PE_aligned:
+        // not relative
+        break;
+    case DW_EH_PE_pcrel:
+        // "PC" relative
+        val += (uintptr_t) field_p;
+        break;
+    case DW_EH_PE_textrel:
+        if (bases == nullptr || (base = bases->text) == 0) abort();
+        val += base;
+        break;
+    case DW_EH_PE_datarel:
+        if (bases == nullptr || (base = bases->data) == 0) abort();
+        val += base;
+        break;
+    case DW_EH_PE_funcrel:
+        if (bases == nullptr || (base = bases->func) == 0) abort();
+        val += base;
+        break;
+    default:
+        abort(); // unsupported
+    }
+
+    if (encoding & DW_EH_PE_indirect) {
+        val = *(uintptr_t *)val;
+    }
+
+    return val;
+}
+
+// Align for a DW_EH_PE_aligned value (which is an absolute pointer, aligned to pointer size)
+__attribute__((always_inline))
+inline void align_for_encoding(const uint8_t *& p, uint8_t encoding) noexcept
+{
+    if ((encoding & 0x70u) == DW_EH_PE_aligned) {
+        uintptr_t addr = (uintptr_t) p;
+        p += ((addr + sizeof(uintptr_t) - 1) & ~(uintptr_t)(sizeof(uintptr_t) - 1)) - addr;
+    }
+}
+
+// Read DWARF EH value with the specified encoding, bump pointer
+__attribute__((always_inline))
+inline uintptr_t read_dwarf_encoded_val(const uint8_t *& p, uint8_t encoding,
+        const dwarf_eh_bases *bases = nullptr) noexcept
+{
+    if (encoding == DW_EH_PE_omit) {
+        return 0;
+    }
+    
+    align_for_encoding(p, encoding);
+    const uint8_t *orig_p = p;
+    uintptr_t val = read_dwarf_encoded_raw(p, encoding);
+    return apply_dwarf_encoding(val, orig_p, encoding, bases);
+}
+
+// Read DWARF EH encoded value: encoding, followed by encoded value; bump pointer
+inline uintptr_t read_dwarf_encoded_val(const uint8_t *& p,
+        const dwarf_eh_bases *bases = nullptr) noexcept
+{
+    uint8_t encoding = *p++;
+    return read_dwarf_encoded_val(p, encoding, bases);    
+}
+
+// Get the fixed size for a particular encoding, if it exists, or 0
+__attribute__((always_inline))
+inline unsigned size_from_encoding(uint8_t encoding) noexcept
+{
+    unsigned val = 0;
+    
+    switch (encoding & 0x0Fu) {
+    case DW_EH_PE_omit:
+    case DW_EH_PE_uleb128:
+    case DW_EH_PE_sleb128:
+        break;
+    case DW_EH_PE_udata2:
+    case DW_EH_PE_sdata2:
+        val = 2;
+        break;
+    case DW_EH_PE_udata4:
+    case DW_EH_PE_sdata4:
+        val = 4;
+        break;
+    case DW_EH_PE_udata8:
+    case DW_EH_PE_sdata8:
+    case DW_EH_PE_absptr:
+        val = 8;
+        break;
+    default:
+        abort(); // unsupported
+    }
+    
+    return val;
+}
+
+// Read DWARF EH value with the specified encoding, which must lie before 'end'; bump pointer.
+// Aborts if the value runs past the end.
+__attribute__((always_inline))
+inline uintptr_t read_dwarf_encoded_bounded(const uint8_t *& p, const uint8_t *end,
+        uint8_t encoding, const dwarf_eh_bases *bases = nullptr) noexcept
+{
+    if (encoding == DW_EH_PE_omit) {
+        return 0;
+    }
+
+    align_for_encoding(p, encoding);
+    const uint8_t *orig_p = p;
+    uintptr_t val;
+
+    unsigned size = size_from_encoding(encoding);
+    if (size == 0) {
+        if ((encoding & 0x0Fu) == DW_EH_PE_uleb128) {
+            val = read_ULEB128(p, end);
+        }
+        else {
+            val = read_SLEB128(p, end);
+        }
+    }
+    else {
+        if (p > end || (uintptr_t)(end - p) < size) abort();
+        val = read_dwarf_encoded_raw(p, encoding);
+    }
+
+    return apply_dwarf_encoding(val, orig_p, encoding, bases);
+}
+
+} // anon namespace
+
+#endif
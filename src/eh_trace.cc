@@ -0,0 +1,153 @@
+// Exception-handling event trace.
+//
+// When built with BMCXX_EH_TRACE defined, the runtime has tracepoints at each step in the life of
+// an exception (allocation, throw, each decision of the personality routine, begin/end of catch,
+// rethrow and freeing) and in the guard functions. While tracing is enabled (it is initially
+// disabled; see bmcxxabi_trace_enable), each tracepoint produces a fixed-size record
+// (bmcxxabi_trace_record) with a timestamp, which is passed to the callback set via
+// bmcxxabi_trace_set_callback, or, if there is none, written to a ring buffer for the current CPU
+// (BMCXX_EH_TRACE_RING records per ring, BMCXX_EH_TRACE_CPUS rings, indexed by bmcxxabi_cpu_id()).
+// The rings are read, and emptied, by bmcxxabi_trace_drain; the host-side decoder
+// (tools/tracedump.cc) reconstructs a timeline for each exception from the drained records.
+//
+// A record is written under a per-record sequence number (as for a seqlock), so writing takes no
+// lock and a ring can be written from several threads at once (eg if a thread is preempted, or
+// migrates, while writing). When a ring is full, the oldest records are overwritten; the reader
+// counts those that it has missed as lost.
+//
+// THREAD-SAFETY : bmcxxabi_trace_drain must not be called from more than one thread at once.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+#include "cycle_count.h"
+#include "eh_trace.h"
+#include "threads.h"
+
+#ifdef BMCXX_EH_TRACE
+
+#ifndef BMCXX_EH_TRACE_RING
+#define BMCXX_EH_TRACE_RING 1024
+#endif
+
+#ifndef BMCXX_EH_TRACE_CPUS
+#ifdef BMCXX_THREADS
+#define BMCXX_EH_TRACE_CPUS 16
+#else
+#define BMCXX_EH_TRACE_CPUS 1
+#endif
+#endif
+
+char eh_trace_enabled = 0;
+
+namespace {
+
+bmcxxabi_trace_callback trace_callback = nullptr;
+
+// A record in a ring; seq is the (1-based) position in the ring's sequence of records, or 0 while
+// the record is being written
+struct ring_record {
+    uint64_t seq;
+    bmcxxabi_trace_record record;
+};
+
+struct alignas(64) trace_ring {
+    uint64_t next;   // number of records ever written
+    uint64_t read;   // number of records consumed (or lost) by the reader
+    ring_record records[BMCXX_EH_TRACE_RING];
+};
+
+trace_ring trace_rings[BMCXX_EH_TRACE_CPUS];
+
+void ring_write(const bmcxxabi_trace_record &record) noexcept
+{
+    trace_ring &ring = trace_rings[record.cpu % BMCXX_EH_TRACE_CPUS];
+    uint64_t seq = __atomic_fetch_add(&ring.next, 1, __ATOMIC_RELAXED) + 1;
+    ring_record &rr = ring.records[(seq - 1) % BMCXX_EH_TRACE_RING];
+
+    __atomic_store_n(&rr.seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    rr.record = record;
+    __atomic_store_n(&rr.seq, seq, __ATOMIC_RELEASE);
+}
+
+} // anon namespace
+
+__attribute__((noinline))
+void eh_trace_emit(unsigned event, uintptr_t object, uint64_t arg) noexcept
+{
+    bmcxxabi_trace_record record;
+    record.time = bmcxx_cycle_count();
+    record.object = object;
+    record.arg = arg;
+    record.event = event;
+    record.cpu = BMCXX_CPU_ID();
+
+    bmcxxabi_trace_callback callback = __atomic_load_n(&trace_callback, __ATOMIC_ACQUIRE);
+    if (callback != nullptr) {
+        callback(&record);
+    }
+    else {
+        ring_write(record);
+    }
+}
+
+extern "C"
+void bmcxxabi_trace_enable(int enable)
+{
+    __atomic_store_n(&eh_trace_enabled, (char)(enable != 0), __ATOMIC_RELAXED);
+}
+
+extern "C"
+void bmcxxabi_trace_set_callback(bmcxxabi_trace_callback callback)
+{
+    __atomic_store_n(&trace_callback, callback, __ATOMIC_RELEASE);
+}
+
+// Copy records not yet read from each ring in turn (so the records from each CPU are in order, but
+// those from different CPUs are not merged). A record still being written ends the copy from its
+// ring, to be read by the next call.
+extern "C"
+size_t bmcxxabi_trace_drain(bmcxxabi_trace_record *records, size_t max, unsigned long long *lost)
+{
+    size_t num_records = 0;
+    uint64_t num_lost = 0;
+
+    for (trace_ring &ring : trace_rings) {
+        uint64_t next = __atomic_load_n(&ring.next, __ATOMIC_ACQUIRE);
+        uint64_t s = ring.read;
+        if (next - s > BMCXX_EH_TRACE_RING) {
+            num_lost += next - BMCXX_EH_TRACE_RING - s;
+            s = next - BMCXX_EH_TRACE_RING;
+        }
+
+        for ( ; s < next && num_records < max; ++s) {
+            ring_record &rr = ring.records[s % BMCXX_EH_TRACE_RING];
+            uint64_t seq = __atomic_load_n(&rr.seq, __ATOMIC_ACQUIRE);
+            if (seq <= s) {
+                // not yet written
+                break;
+            }
+            if (seq == s + 1) {
+                bmcxxabi_trace_record record = rr.record;
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (__atomic_load_n(&rr.seq, __ATOMIC_RELAXED) == seq) {
+                    records[num_records++] = record;
+                    continue;
+                }
+            }
+            // overwritten
+            ++num_lost;
+        }
+
+        ring.read = s;
+    }
+
+    if (lost != nullptr) {
+        *lost = num_lost;
+    }
+    return num_records;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _EH_TRACE_H_INCLUDED
+#define _EH_TRACE_H_INCLUDED 1
+
+// Exception-handling event trace (built with BMCXX_EH_TRACE defined). See eh_trace.cc. Without
+// BMCXX_EH_TRACE, eh_trace does nothing.
+
+#include <cstdint>
+
+#include "config.h"
+#include "../include/bmcxxabi.h"
+
+#ifdef BMCXX_EH_TRACE
+
+// Non-zero while tracing is enabled (via bmcxxabi_trace_enable)
+extern char eh_trace_enabled;
+
+// Deliver a record of an event to the callback, or to the current CPU's ring
+void eh_trace_emit(unsigned event, uintptr_t object, uint64_t arg) noexcept;
+
+#endif
+
+// Tracepoint: record an event concerning the given object (the thrown object, for exception
+// events, or the guard object), if tracing is enabled.
+inline void eh_trace(unsigned event, const void *object, uint64_t arg = 0) noexcept
+{
+#ifdef BMCXX_EH_TRACE
+    if (__builtin_expect(__atomic_load_n(&eh_trace_enabled, __ATOMIC_RELAXED), 0)) {
+        eh_trace_emit(event, (uintptr_t)object, arg);
+    }
+#else
+    (void)event;
+    (void)object;
+    (void)arg;
+#endif
+}
+
+#endif
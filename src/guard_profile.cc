@@ -0,0 +1,175 @@
+// First-use latency profiler for guarded statics.
+//
+// Function-local statics are initialised lazily, under __cxa_guard_acquire, the first time control
+// passes through their declarations, so an expensive initialiser adds its cost to whatever first
+// reaches it (eg the first request down a cold code path). When built with BMCXX_GUARD_PROFILE
+// defined, the runtime times each initialisation, from __cxa_guard_acquire returning 1 to
+// __cxa_guard_release (or __cxa_guard_abort, if the initialiser throws), and records it against
+// the guard, along with the caller (the return address of the __cxa_guard_acquire call, in the
+// function containing the static). bmcxxabi_guard_profile_snapshot returns the initialisations,
+// slowest first, so that expensive ones can be found and moved to startup. The time for a static
+// whose initialiser initialises other statics includes theirs.
+//
+// There is no run-time switch: __cxa_guard_acquire is only called until a static is initialised,
+// so the cost (two cycle counter reads and a table lookup per initialisation) is not on any
+// steady-state path.
+//
+// The initialisations are kept in a single fixed-size table (BMCXX_GUARD_PROFILE_SLOTS entries, a
+// power of 2), indexed by hashing the guard address. Entries are claimed with atomic
+// compare-and-exchange, so recording is lock-free; the other fields of an entry are only written by
+// the thread holding the guard (which excludes other initialising threads), but are read
+// concurrently by snapshots, so are accessed atomically. An entry keeps its guard for the life of
+// the program. Initialisations which cannot be given an entry (because the table is full around
+// the hash position) are counted as dropped.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+#include "cycle_count.h"
+#include "guard_profile.h"
+#include "../include/bmcxxabi.h"
+
+#ifdef BMCXX_GUARD_PROFILE
+
+#ifndef BMCXX_GUARD_PROFILE_SLOTS
+#define BMCXX_GUARD_PROFILE_SLOTS 512
+#endif
+
+namespace {
+
+constexpr unsigned profile_slots = BMCXX_GUARD_PROFILE_SLOTS;
+static_assert(profile_slots != 0 && (profile_slots & (profile_slots - 1)) == 0,
+        "BMCXX_GUARD_PROFILE_SLOTS must be a power of 2");
+
+// Maximum number of slots examined (from the initial hash position) before giving up
+constexpr unsigned max_probes = profile_slots < 16 ? profile_slots : 16;
+
+struct guard_entry {
+    const int64_t *guard;   // null if the entry is unused
+    const void *caller;
+    uint64_t start;         // cycle count when the latest attempt started
+    uint64_t cycles;        // duration of the completed initialisation
+    uint64_t aborts;
+    uint64_t abort_cycles;
+    unsigned complete;
+};
+
+guard_entry profile_table[profile_slots];
+uint64_t num_dropped = 0;
+
+unsigned hash_guard(const int64_t *guard) noexcept
+{
+    return (unsigned)(((uint64_t)(uintptr_t)guard * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// Find the entry for a guard, claiming one if there is none and claim is true
+guard_entry *find_entry(const int64_t *guard, bool claim) noexcept
+{
+    unsigned hash = hash_guard(guard);
+
+    for (unsigned i = 0; i < max_probes; ++i) {
+        guard_entry &entry = profile_table[(hash + i) & (profile_slots - 1)];
+        const int64_t *entry_guard = __atomic_load_n(&entry.guard, __ATOMIC_ACQUIRE);
+        if (entry_guard == nullptr) {
+            if (!claim) {
+                return nullptr;
+            }
+            if (__atomic_compare_exchange_n(&entry.guard, &entry_guard, guard, false,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return &entry;
+            }
+            // Lost a race to claim this entry; entry_guard is now the winning guard, check it
+        }
+        if (entry_guard == guard) {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+// Total cycles spent initialising (including abandoned attempts) of a snapshot entry
+uint64_t total_cycles(const bmcxxabi_guard_init &init) noexcept
+{
+    return init.cycles + init.abort_cycles;
+}
+
+} // anon namespace
+
+void guard_profile_begin(const int64_t *guard, const void *caller) noexcept
+{
+    guard_entry *entry = find_entry(guard, true);
+    if (entry == nullptr) {
+        __atomic_fetch_add(&num_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_store_n(&entry->caller, caller, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->start, bmcxx_cycle_count(), __ATOMIC_RELAXED);
+}
+
+void guard_profile_end(const int64_t *guard, bool aborted) noexcept
+{
+    uint64_t end = bmcxx_cycle_count();
+    guard_entry *entry = find_entry(guard, false);
+    if (entry == nullptr) {
+        return;
+    }
+
+    uint64_t cycles = end - __atomic_load_n(&entry->start, __ATOMIC_RELAXED);
+    if (aborted) {
+        __atomic_fetch_add(&entry->aborts, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&entry->abort_cycles, cycles, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_store_n(&entry->cycles, cycles, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->complete, 1u, __ATOMIC_RELEASE);
+    }
+}
+
+// Store the (up to max) slowest initialisations, by total cycles, in descending order. An
+// initialisation in progress is included (with complete 0), as is one which has only been
+// abandoned so far.
+extern "C"
+size_t bmcxxabi_guard_profile_snapshot(bmcxxabi_guard_init *inits, size_t max,
+        unsigned long long *dropped)
+{
+    size_t num_inits = 0;
+
+    for (guard_entry &entry : profile_table) {
+        bmcxxabi_guard_init init;
+        init.guard = __atomic_load_n(&entry.guard, __ATOMIC_ACQUIRE);
+        if (init.guard == nullptr) {
+            continue;
+        }
+        init.complete = __atomic_load_n(&entry.complete, __ATOMIC_ACQUIRE);
+        init.caller = __atomic_load_n(&entry.caller, __ATOMIC_RELAXED);
+        init.start = __atomic_load_n(&entry.start, __ATOMIC_RELAXED);
+        init.cycles = __atomic_load_n(&entry.cycles, __ATOMIC_RELAXED);
+        init.aborts = __atomic_load_n(&entry.aborts, __ATOMIC_RELAXED);
+        init.abort_cycles = __atomic_load_n(&entry.abort_cycles, __ATOMIC_RELAXED);
+
+        // Insert in order, dropping the cheapest if the array is full
+        size_t i = num_inits;
+        if (num_inits < max) {
+            ++num_inits;
+        }
+        else if (max == 0 || total_cycles(inits[max - 1]) >= total_cycles(init)) {
+            continue;
+        }
+        else {
+            i = max - 1;
+        }
+        for ( ; i > 0 && total_cycles(inits[i - 1]) < total_cycles(init); --i) {
+            inits[i] = inits[i - 1];
+        }
+        inits[i] = init;
+    }
+
+    if (dropped != nullptr) {
+        *dropped = __atomic_load_n(&num_dropped, __ATOMIC_RELAXED);
+    }
+    return num_inits;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _GUARD_PROFILE_H_INCLUDED
+#define _GUARD_PROFILE_H_INCLUDED 1
+
+#include "config.h"
+
+// First-use latency profiler for guarded statics (built with BMCXX_GUARD_PROFILE defined). See
+// guard_profile.cc.
+
+#ifdef BMCXX_GUARD_PROFILE
+
+#include <cstdint>
+
+// Record that initialisation of the static with the given guard has started (__cxa_guard_acquire
+// is about to return 1), called from the given return address
+void guard_profile_begin(const int64_t *guard, const void *caller) noexcept;
+
+// Record that initialisation of the static with the given guard has completed (__cxa_guard_release)
+// or, if aborted is true, been abandoned (__cxa_guard_abort)
+void guard_profile_end(const int64_t *guard, bool aborted) noexcept;
+
+#endif
+
+#endif
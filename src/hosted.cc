@@ -0,0 +1,179 @@
+// Support for a hosted build (BMCXX_HOSTED defined), in which this library replaces libsupc++ for
+// a program on a hosted system (eg Linux, using the system C library and libgcc unwinder). This
+// supplies the parts of the runtime which would otherwise be provided by the environment:
+// std::terminate, std::uncaught_exceptions, the global allocation and deallocation functions, the
+// handlers for calls to pure or deleted virtual functions, and the entry points for a failed
+// dynamic_cast or typeid (__cxa_bad_cast, __cxa_bad_typeid) and for a violated exception
+// specification (__cxa_call_unexpected); with BMCXX_THREADS, a
+// bmcxxabi_thread_yield which yields to the scheduler; and, if per-CPU data is used (see
+// threads.h), a bmcxxabi_cpu_id which returns the CPU the calling thread is running on.
+// See also static_destructors.cc, which arranges for exit-time destructors to be run.
+//
+// The standard exception classes (std::exception, std::bad_alloc etc) are part of the C++ library
+// rather than the ABI runtime, and are not provided; allocation failure, a failed dynamic_cast to a
+// reference and typeid of a null pointer are therefore fatal rather than throwing std::bad_alloc,
+// std::bad_cast or std::bad_typeid.
+
+#include "config.h"
+
+#ifdef BMCXX_HOSTED
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "threads.h"
+
+#if defined(BMCXX_THREADS) || defined(BMCXX_PER_CPU)
+#include <sched.h>
+#endif
+
+extern "C" unsigned int __cxa_uncaught_exceptions() noexcept;
+extern "C" void *__cxa_begin_catch(void *exception_object) noexcept;
+
+namespace std {
+
+[[noreturn]] void terminate() noexcept
+{
+    abort();
+}
+
+int uncaught_exceptions() noexcept
+{
+    return (int)__cxa_uncaught_exceptions();
+}
+
+} // namespace std
+
+namespace {
+
+void *allocate(std::size_t size) noexcept
+{
+    // (malloc(0) may return null, but operator new must return a unique pointer)
+    return malloc(size != 0 ? size : 1);
+}
+
+void *allocate(std::size_t size, std::align_val_t align) noexcept
+{
+    // aligned_alloc requires that size is a multiple of the alignment
+    std::size_t al = (std::size_t)align;
+    std::size_t rounded = (size + al - 1) & ~(al - 1);
+    if (rounded < size) return nullptr;
+    return aligned_alloc(al, rounded != 0 ? rounded : al);
+}
+
+void *allocate_or_terminate(void *p) noexcept
+{
+    if (p == nullptr) {
+        std::terminate();
+    }
+    return p;
+}
+
+} // anon namespace
+
+void *operator new(std::size_t size)
+{
+    return allocate_or_terminate(allocate(size));
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate_or_terminate(allocate(size));
+}
+
+void *operator new(std::size_t size, std::align_val_t align)
+{
+    return allocate_or_terminate(allocate(size, align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+    return allocate_or_terminate(allocate(size, align));
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return allocate(size, align);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return allocate(size, align);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, std::size_t) noexcept { free(p); }
+void operator delete[](void *p, std::size_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+
+// Called via the vtable slot of a pure virtual function, or of a deleted virtual function
+extern "C" void __cxa_pure_virtual()
+{
+    std::terminate();
+}
+
+extern "C" void __cxa_deleted_virtual()
+{
+    std::terminate();
+}
+
+// A failed dynamic_cast to a reference type, or typeid applied to a null pointer, would throw
+// std::bad_cast or std::bad_typeid; since those classes aren't provided, these are fatal.
+extern "C" void __cxa_bad_cast()
+{
+    std::terminate();
+}
+
+extern "C" void __cxa_bad_typeid()
+{
+    std::terminate();
+}
+
+// Called from the landing pad of a function whose dynamic exception specification was violated
+// (see personality.cc). std::unexpected no longer exists (C++17), and its default action was to
+// terminate; the exception is caught first, as it would be by a handler.
+extern "C" void __cxa_call_unexpected(void *exception_object)
+{
+    __cxa_begin_catch(exception_object);
+    std::terminate();
+}
+
+#ifdef BMCXX_THREADS
+
+extern "C" void bmcxxabi_thread_yield()
+{
+    sched_yield();
+}
+
+#endif
+
+#ifdef BMCXX_PER_CPU
+
+extern "C" unsigned bmcxxabi_cpu_id()
+{
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : (unsigned)cpu;
+}
+
+#endif
+
+#endif
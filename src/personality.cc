@@ -5,7 +5,16 @@
 
 #include <unwind.h>
 
+#include "config.h"
 #include "cxa_exception.h"
+#include "cycle_count.h"
+#include "dwarf_eh.h"
+#include "eh_trace.h"
+#include "catch_matrix.h"
+#include "compact_lsda.h"
+#include "personality_profile.h"
+#include "stats.h"
+#include "threads.h"
 #include "../include/typeinfo"
 
 // Definition of the "personality" routine, __gxx_personality_v0, which is referenced in g++-
@@ -19,190 +28,540 @@
 //
 // Additionally, the (LLVM) libcxxabi source was consulted.
 
+// Not all unwinders provide these; they are only needed for textrel/datarel encodings, which
+// are not generally used on x86-64.
+extern "C" uintptr_t _Unwind_GetTextRelBase(_Unwind_Context *) __attribute__((weak));
+extern "C" uintptr_t _Unwind_GetDataRelBase(_Unwind_Context *) __attribute__((weak));
+
+#ifdef BMCXX_BOUNDED_LATENCY
+// Maximum number of entries processed in an action chain (or a throw specification's type list)
+// in the bounded-latency mode; a longer chain aborts.
+#ifndef BMCXX_MAX_ACTION_CHAIN
+#define BMCXX_MAX_ACTION_CHAIN 64
+#endif
+#endif
+
 namespace {
 
-// DWARF EH encodings. These specify how a value is encoded, and what it is relative to
-enum {
-  DW_EH_PE_absptr = 0,  // (not relative)
-  
-  // value encodings (mask 0x0f), may be 0 (absptr)
-  DW_EH_PE_uleb128 = 1,  // variable-length unsigned
-  DW_EH_PE_udata2 = 2,   // 2-byte unsigned
-  DW_EH_PE_udata4 = 3,   // 4-byte unsigned
-  DW_EH_PE_udata8 = 4,   // 8-byte unsigned
-  
-  DW_EH_PE_sleb128 = 9,  // variable-length signed
-  DW_EH_PE_sdata2 = 10,  // 2-byte signed
-  DW_EH_PE_sdata4 = 11,  // 4-byte signed
-  DW_EH_PE_sdata8 = 12,  // 8-byte signed
-
-  // What is it relative to (mask 0x70)? may be 0 (absolute)
-  DW_EH_PE_pcrel = 0x10,
-  DW_EH_PE_textrel = 0x20,
-  DW_EH_PE_datarel = 0x30,
-  DW_EH_PE_funcrel = 0x40,
-  DW_EH_PE_aligned = 0x50,  // ??
-  
-  // "indirect" bit: value is indirect, i.e. specifies address holding value
-  DW_EH_PE_indirect = 0x80,
-  
-  DW_EH_PE_omit = 0xFF  // no value
+#ifdef BMCXX_PERSONALITY_PROFILE
+
+// Work done by the personality routine for the current frame
+BMCXX_THREAD_LOCAL personality_frame_cost frame_cost;
+
+// Measures a call of the personality routine, and records it (when destroyed) against the frame's
+// function (see personality_profile.cc)
+class frame_profiler {
+    _Unwind_Action actions;
+    _Unwind_Context *context;
+    uint64_t start;
+
+public:
+    frame_profiler(_Unwind_Action actions_p, _Unwind_Context *context_p) noexcept
+        : actions(actions_p), context(context_p)
+    {
+        frame_cost = {0, 0, 0};
+        start = bmcxx_cycle_count();
+    }
+
+    ~frame_profiler()
+    {
+        uint64_t cycles = bmcxx_cycle_count() - start;
+        personality_profile_record(_Unwind_GetRegionStart(context),
+                (actions & _UA_SEARCH_PHASE) == 0, frame_cost, cycles);
+    }
 };
 
-template <typename T>
-T read_val(const uint8_t *& p) noexcept
+#endif
+
+// Trace the decision of the personality routine for a frame (for BMCXX_EH_TRACE)
+inline void trace_decision(_Unwind_Reason_Code result, _Unwind_Action actions,
+        _Unwind_Exception *unwind_exc, _Unwind_Context *context) noexcept
 {
-    T val;
-    memcpy(&val, p, sizeof(T));
-    p += sizeof(T);
-    return val;
+#ifdef BMCXX_EH_TRACE
+    if (__builtin_expect(!__atomic_load_n(&eh_trace_enabled, __ATOMIC_RELAXED), 1)) {
+        return;
+    }
+
+    unsigned event;
+    if (result == _URC_CONTINUE_UNWIND) {
+        event = (actions & _UA_SEARCH_PHASE) ? BMCXXABI_TRACE_SEARCH_CONTINUE
+                : BMCXXABI_TRACE_CLEANUP_CONTINUE;
+    }
+    else if (result == _URC_HANDLER_FOUND) {
+        event = BMCXXABI_TRACE_HANDLER_FOUND;
+    }
+    else if (result == _URC_INSTALL_CONTEXT) {
+        event = (actions & _UA_HANDLER_FRAME) ? BMCXXABI_TRACE_INSTALL_HANDLER
+                : BMCXXABI_TRACE_INSTALL_CLEANUP;
+    }
+    else {
+        event = BMCXXABI_TRACE_PERSONALITY_ERROR;
+    }
+
+    // (for a native exception, the thrown object follows the _Unwind_Exception)
+    eh_trace_emit(event, (uintptr_t)(unwind_exc + 1), _Unwind_GetRegionStart(context));
+#else
+    (void)result;
+    (void)actions;
+    (void)unwind_exc;
+    (void)context;
+#endif
 }
 
-// Read ULEB128-encoded value, bump pointer
-uintptr_t read_ULEB128(const uint8_t *& p) noexcept
+// Count an action chain entry against the bound (for BMCXX_BOUNDED_LATENCY), and in the frame's
+// profile (for BMCXX_PERSONALITY_PROFILE)
+inline void count_action_entry(unsigned &count) noexcept
 {
-    // A series of bytes, each worth 7 bits of value. The last byte has bit 8 clear.
-    
-    uintptr_t val = 0;    
-    unsigned shift = 0;
-    uint8_t bval;
-    
-    do {
-        bval = *p++;
-        val |= ((uintptr_t)(bval & 0x7F)) << shift;
-        shift += 7;
-    } while (bval & 0x80);
-    
-    return val;
+#ifdef BMCXX_BOUNDED_LATENCY
+    if (++count > BMCXX_MAX_ACTION_CHAIN) abort();
+#else
+    (void)count;
+#endif
+#ifdef BMCXX_PERSONALITY_PROFILE
+    ++frame_cost.actions;
+#endif
 }
 
-// Read SLEB128-encoded value, bump pointer
-intptr_t read_SLEB128(const uint8_t *& p) noexcept
+// Fill in the text- or data-relative base, if the specified encoding requires it. These bases
+// can only be obtained from the unwinder, if it supports them (see weak declarations above);
+// otherwise they remain 0, and decoding a value with such an encoding aborts.
+void get_rel_bases(uint8_t encoding, _Unwind_Context *context, dwarf_eh_bases &bases) noexcept
 {
-    // A series of bytes, each worth 7 bits of value. The last byte has bit 8 clear.
-    
-    uintptr_t val = 0;    
-    unsigned shift = 0;
-    uint8_t bval;
-    
-    do {
-        bval = *p++;
-        val |= ((uintptr_t)(bval & 0x7F)) << shift;
-        shift += 7;
-    } while (bval & 0x80);
-    
-    if (bval & 0x40) {
-        // sign bit is set, need to extend it
-        if (shift < (sizeof(uintptr_t) * 8 /* CHAR_BIT */)) {
-            val |= ((uintptr_t)-1) << shift;
+    if (encoding == DW_EH_PE_omit) return;
+
+    switch (encoding & 0x70u) {
+    case DW_EH_PE_textrel:
+        if (bases.text == 0 && _Unwind_GetTextRelBase != nullptr) {
+            bases.text = _Unwind_GetTextRelBase(context);
+        }
+        break;
+    case DW_EH_PE_datarel:
+        if (bases.data == 0 && _Unwind_GetDataRelBase != nullptr) {
+            bases.data = _Unwind_GetDataRelBase(context);
         }
+        break;
+    default:
+        break;
     }
-    
-    return val;
 }
 
-// Read DWARF EH value with the specified encoding, bump pointer
-uintptr_t read_dwarf_encoded_val(const uint8_t *& p, uint8_t encoding) noexcept
+// Check whether a handler for catch_type can catch thrown_type; adjust *thrown_obj as necessary
+// (see type_info::__do_catch).
+bool catch_matches(const std::type_info *catch_type, const std::type_info *thrown_type,
+        void **thrown_obj) noexcept
+{
+#ifdef BMCXX_CATCH_MATRIX
+    // Consult the precomputed catch matrix first
+    int matrix_result = bmcxxabi_catch_matrix_lookup(catch_type, thrown_type, thrown_obj);
+    if (matrix_result >= 0) {
+        return matrix_result != 0;
+    }
+#endif
+
+#ifdef BMCXX_PERSONALITY_PROFILE
+    ++frame_cost.do_catch;
+#endif
+    stat_add(stat_do_catch_calls);
+
+    return catch_type->__do_catch(thrown_type, thrown_obj, 1);
+}
+
+// Information from the LSDA header (see description of the LSDA in __gxx_personality_v0 below)
+struct lsda_header {
+    const uint8_t *lp_start;     // landing pad base
+    const uint8_t *types_tbl;    // (end of) the types table; null if none
+    const uint8_t *callsite_tbl;
+    const uint8_t *actions_tbl;  // action table; this is also the end of the call-site table
+    uint8_t types_encoding;
+    uint8_t callsite_encoding;
+    dwarf_eh_bases bases;
+};
+
+// Encoding template argument value meaning "not specialised; use the encoding from the header"
+constexpr unsigned dynamic_encoding = 0x100u;
+
+// Read the type_info pointer from a types table entry (index > 0)
+template <unsigned TypesEnc>
+inline const std::type_info *read_types_entry(const lsda_header &hdr, uintptr_t index) noexcept
 {
-    const uint8_t *orig_p = p;
+    uint8_t types_encoding = (TypesEnc == dynamic_encoding) ? hdr.types_encoding
+            : (uint8_t)TypesEnc;
+    unsigned type_info_sz = size_from_encoding(types_encoding);
+    if (type_info_sz == 0 || hdr.types_tbl == nullptr) abort();
 
-    if (encoding == DW_EH_PE_omit) {
-        return 0;
+    // The types table lies between the action table and the types table pointer
+    if (index > (uintptr_t)(hdr.types_tbl - hdr.actions_tbl) / type_info_sz) abort();
+
+    const uint8_t *catch_type_p = hdr.types_tbl - index * type_info_sz;
+    return (const std::type_info *)
+            read_dwarf_encoded_val(catch_type_p, types_encoding, &hdr.bases);
+}
+
+// The end of the exception specification list at the given position. The LSDA doesn't record the
+// extent of the list (which lies after the types table), but the list names each types table
+// entry at most once, so it extends no further than a list of every entry, each with a
+// maximal-length LEB128 index, would.
+template <unsigned TypesEnc>
+inline const uint8_t *throw_spec_end(const lsda_header &hdr, const uint8_t *throw_spec) noexcept
+{
+    uint8_t types_encoding = (TypesEnc == dynamic_encoding) ? hdr.types_encoding
+            : (uint8_t)TypesEnc;
+    unsigned type_info_sz = size_from_encoding(types_encoding);
+    if (type_info_sz == 0 || hdr.types_tbl == nullptr) abort();
+
+    constexpr uintptr_t max_leb128_len = (sizeof(uintptr_t) * 8 + 6) / 7;
+    uintptr_t entries = (uintptr_t)(hdr.types_tbl - hdr.actions_tbl) / type_info_sz;
+    return throw_spec + (entries + 1) * max_leb128_len;
+}
+
+// Set the context to run the landing pad for a cleanup
+_Unwind_Reason_Code install_cleanup(const uint8_t *landing_pad, _Unwind_Exception *unwind_exc,
+        _Unwind_Context *context) noexcept
+{
+    // Set the registers in context so that the landing pad can resume unwind when done:
+    _Unwind_SetGR(context, (int)__builtin_eh_return_data_regno(0), (uintptr_t)unwind_exc);
+    _Unwind_SetGR(context, (int)__builtin_eh_return_data_regno(1), (uintptr_t)0);
+    _Unwind_SetIP(context, (uintptr_t)landing_pad);
+    return _URC_INSTALL_CONTEXT;
+}
+
+// Cache the values for entering a handler (catch clause or exception specification) in the cleanup
+// phase
+_Unwind_Reason_Code handler_found(__cxa_exception *cxa_exception, void *adjusted_ptr,
+        intptr_t switch_value, const uint8_t *landing_pad) noexcept
+{
+    cxa_exception->adjustedPtr = adjusted_ptr;
+    cxa_exception->handlerSwitchValue = switch_value;
+    cxa_exception->catchTemp = (void *)landing_pad;
+    stat_add(stat_handlers_found);
+    return _URC_HANDLER_FOUND;
+}
+
+// Process the action chain for the call site containing the IP. The action_entry is as per the
+// call site table (0 for cleanup only).
+template <unsigned TypesEnc>
+_Unwind_Reason_Code process_actions(const lsda_header &hdr, uintptr_t lp_offs,
+        uintptr_t action_entry, _Unwind_Action actions, _Unwind_Exception *unwind_exc,
+        _Unwind_Context *context) noexcept
+{
+    if (lp_offs == 0) {
+        // Apparently, offset of 0 means no cleanup/catch
+        return _URC_CONTINUE_UNWIND;
     }
-    
-    uintptr_t val;
-    
-    switch (encoding & 0x0Fu) {
-    case DW_EH_PE_absptr:
-        // absolute, not-relative value (maybe can still be indirect?)
-        val = (uintptr_t) read_val<uint64_t>(p);
-        break;
-    case DW_EH_PE_uleb128:
-        val = read_ULEB128(p);
-        break;
-    case DW_EH_PE_udata2:
-        val = (uintptr_t) read_val<uint16_t>(p);
-        break;
-    case DW_EH_PE_udata4:
-        val = (uintptr_t) read_val<uint32_t>(p);
-        break;
-    case DW_EH_PE_udata8:
-        val = (uintptr_t) read_val<uint64_t>(p);
-        break;
-    case DW_EH_PE_sleb128:
-        val = read_SLEB128(p);
-        break;
-    case DW_EH_PE_sdata2:
-        val = read_val<int16_t>(p);
-        break;
-    case DW_EH_PE_sdata4:
-        val = read_val<int32_t>(p);
-        break;
-    case DW_EH_PE_sdata8:
-        val = read_val<int64_t>(p);
-        break;
-    default:
-        abort(); // unsupported
+
+    if (action_entry == 0) {
+        // action_entry == 0 : cleanup only, no catches
+        if (actions & _UA_SEARCH_PHASE) {
+            return _URC_CONTINUE_UNWIND;
+        }
+        
+        // Forced unwind, or cleanup phase
+        return install_cleanup(hdr.lp_start + lp_offs, unwind_exc, context);
     }
-    
-    switch (encoding & 0x70u) {
-    case DW_EH_PE_absptr:
-        // not relative
-        break;
-    case DW_EH_PE_pcrel:
-        // "PC" relative
-        if (val) {
-            val += (uintptr_t) orig_p;
+
+    // A non-zero action entry refers to the action table, which then runs up to the types table;
+    // an LSDA with actions but no types table is malformed.
+    if (hdr.types_tbl == nullptr || action_entry > (uintptr_t)(hdr.types_tbl - hdr.actions_tbl)) {
+        abort();
+    }
+
+    const uint8_t *action_entry_ptr = hdr.actions_tbl + (action_entry - 1);
+
+    uintptr_t cxa_exception_addr = (uintptr_t)unwind_exc - offsetof(__cxa_exception, unwindHeader);
+    __cxa_exception *cxa_exception = (__cxa_exception *) cxa_exception_addr;
+
+    // Catch handlers and exception specifications are only checked in the search phase (in the
+    // cleanup phase, the handler frame is dealt with via cached values, see above, and for other
+    // frames the search phase has already determined that no handler matches). They are never
+    // checked for a forced unwind (used for thread cancellation or unwind-based longjmp).
+    bool check_handlers = (actions & (_UA_SEARCH_PHASE | _UA_FORCE_UNWIND)) == _UA_SEARCH_PHASE;
+    bool have_cleanup = false;
+    unsigned chain_count = 0;
+
+    while (true) {
+        count_action_entry(chain_count);
+
+        // "Each entry in the action table is a pair of signed LEB128 values"...
+        // read the first one now, act on it, and read the 2nd (offset to next
+        // entry) afterwards.
+        const uint8_t *action_read_ptr = action_entry_ptr;
+        intptr_t type_info_index = read_SLEB128(action_read_ptr, hdr.types_tbl);
+        
+        if (type_info_index == 0) {
+            // cleanup. Note that this may be followed by catch handlers in the chain (eg a
+            // local object with a destructor inside a "try" block), so keep going.
+            have_cleanup = true;
         }
-        break;
-    default:
-        abort(); // unsupported
+        else if (!check_handlers) {
+            // (skip)
+        }
+        else if (type_info_index > 0) {
+            // catch handler for single type
+            const std::type_info *catch_type = read_types_entry<TypesEnc>(hdr, type_info_index);
+
+            void * cxx_exception_ptr = thrown_object(cxa_exception);
+
+            // A null catch_type is a catch-any aka "catch(...)". Otherwise we
+            // need to check the type.
+            if (catch_type == nullptr
+                    || catch_matches(catch_type, cxa_exception->exceptionType,
+                            &cxx_exception_ptr)) {
+                // Cache the values that will be used in phase 2:
+                eh_trace(BMCXXABI_TRACE_HANDLER_TYPE, unwind_exc + 1, (uintptr_t)catch_type);
+                return handler_found(cxa_exception, cxx_exception_ptr, type_info_index,
+                        hdr.lp_start + lp_offs);
+            }
+        }
+        else /* (type_info_index < 0) */ {
+            // throw specification (C++98). This is matched if the exception thrown is *not*
+            // any from a list of types. The (negated) index is a byte offset + 1 to the list.
+            const uint8_t *throw_spec_ptr = hdr.types_tbl + (-type_info_index - 1);
+            const uint8_t *throw_spec_limit = throw_spec_end<TypesEnc>(hdr, throw_spec_ptr);
+            bool allowed = false;
+            uintptr_t ts_index = read_ULEB128(throw_spec_ptr, throw_spec_limit);
+            unsigned spec_count = 0;
+            while (ts_index != 0) {
+                count_action_entry(spec_count);
+                const std::type_info *spec_type = read_types_entry<TypesEnc>(hdr, ts_index);
+
+                void * cxx_exception_ptr = thrown_object(cxa_exception);
+
+                if (catch_matches(spec_type, cxa_exception->exceptionType, &cxx_exception_ptr)) {
+                    allowed = true;
+                    break;
+                }
+
+                ts_index = read_ULEB128(throw_spec_ptr, throw_spec_limit);
+            }
+
+            if (!allowed) {
+                // The handler should just call __cxa_call_unexpected(), but
+                // that's in the hands of the compiler...
+                return handler_found(cxa_exception, thrown_object(cxa_exception), // un-adjusted!
+                        type_info_index, hdr.lp_start + lp_offs);
+            }
+        }
+
+        // The next value is an offset from its own position in the action table (i.e. from
+        // action_read_ptr, which is now just past the type index):
+        const uint8_t *next_offs_ptr = action_read_ptr;
+        intptr_t action_entry_offs = read_SLEB128(action_read_ptr, hdr.types_tbl);
+        if (action_entry_offs == 0) break;
+        action_entry_ptr = next_offs_ptr + action_entry_offs;
+        if (action_entry_ptr < hdr.actions_tbl) abort();
+    }
+    
+    // Got to end of actions without a match. If there was a cleanup, and this is the cleanup
+    // phase, run it; otherwise continue unwind.
+    if (have_cleanup && !(actions & _UA_SEARCH_PHASE)) {
+        return install_cleanup(hdr.lp_start + lp_offs, unwind_exc, context);
     }
 
-    if (encoding & DW_EH_PE_indirect) {
-        val = *(uintptr_t *)val;
+    return _URC_CONTINUE_UNWIND;
+}
+
+// Walk the call-site table to find the entry for the IP (as an offset from function start) and
+// process its actions. The call-site encoding is specialised via template parameter (or is
+// dynamic_encoding, to use the encoding from the header); likewise for the types encoding.
+template <unsigned CallSiteEnc, unsigned TypesEnc>
+_Unwind_Reason_Code scan_lsda(const lsda_header &hdr, uintptr_t rIP_offs,
+        _Unwind_Action actions, _Unwind_Exception *unwind_exc, _Unwind_Context *context) noexcept
+{
+    const uint8_t callsite_encoding = (CallSiteEnc == dynamic_encoding) ? hdr.callsite_encoding
+            : (uint8_t)CallSiteEnc;
+
+    const uint8_t *p = hdr.callsite_tbl;
+    const uint8_t *callsite_end = hdr.actions_tbl;
+
+    while (p < callsite_end) {
+        uintptr_t cs_start = read_dwarf_encoded_bounded(p, callsite_end, callsite_encoding);
+        uintptr_t cs_len = read_dwarf_encoded_bounded(p, callsite_end, callsite_encoding);
+        uintptr_t lp_offs = read_dwarf_encoded_bounded(p, callsite_end, callsite_encoding);
+        uintptr_t action_entry = read_ULEB128(p, callsite_end);
+
+#ifdef BMCXX_PERSONALITY_PROFILE
+        ++frame_cost.callsites;
+#endif
+
+        if (rIP_offs < cs_start) {
+            // call sites ordered by start address, therefore, we won't find one from here
+            break;
+        }
+
+        if (rIP_offs - cs_start < cs_len) {
+            // matches location, we still need to check actions
+            return process_actions<TypesEnc>(hdr, lp_offs, action_entry, actions, unwind_exc,
+                    context);
+        }
     }
 
-    return val;
+    // "If the personality function finds that there is no entry for the current PC in the
+    // call-site table, then there is no exception information. This should not happen in normal
+    // operation, and in C++ will lead to a call to std::terminate". (GCC omits call-site entries
+    // for regions which must not throw, eg calls from a noexcept function).
+
+    // We return an error here, that way _Unwind_RaiseException returns (instead of unwinding) and
+    // std::terminate() can be called from _cxa_throw(...).
+    return _URC_FATAL_PHASE1_ERROR;
 }
 
-// Read DWARF EH encoded value: encoding, followed by encoded value; bump pointer
-uintptr_t read_dwarf_encoded_val(const uint8_t *& p) noexcept
+typedef _Unwind_Reason_Code (*lsda_scanner)(const lsda_header &hdr, uintptr_t rIP_offs,
+        _Unwind_Action actions, _Unwind_Exception *unwind_exc, _Unwind_Context *context);
+
+// Select the call-site table walker for the given encodings. GCC uses uleb128 for the call-site
+// table; Clang uses udata4 or uleb128. The types table is typically pcrel|indirect|sdata4 for
+// position-independent code and udata4 or absptr otherwise. Other combinations use the generic
+// (unspecialised) walker, as does everything if BMCXX_NO_LSDA_SPECIALISE is defined (to save
+// space).
+lsda_scanner select_lsda_scanner(uint8_t callsite_encoding, uint8_t types_encoding) noexcept
 {
-    uint8_t encoding = *p++;
-    return read_dwarf_encoded_val(p, encoding);    
+#ifndef BMCXX_NO_LSDA_SPECIALISE
+    constexpr unsigned pic_types = DW_EH_PE_indirect | DW_EH_PE_pcrel | DW_EH_PE_sdata4;
+
+    if (types_encoding == DW_EH_PE_omit) {
+        // No types table; the types encoding is never used
+        types_encoding = DW_EH_PE_udata4;
+    }
+
+    if (callsite_encoding == DW_EH_PE_uleb128) {
+        switch (types_encoding) {
+        case pic_types: return scan_lsda<DW_EH_PE_uleb128, pic_types>;
+        case DW_EH_PE_udata4: return scan_lsda<DW_EH_PE_uleb128, DW_EH_PE_udata4>;
+        case DW_EH_PE_absptr: return scan_lsda<DW_EH_PE_uleb128, DW_EH_PE_absptr>;
+        }
+    }
+    else if (callsite_encoding == DW_EH_PE_udata4) {
+        switch (types_encoding) {
+        case pic_types: return scan_lsda<DW_EH_PE_udata4, pic_types>;
+        case DW_EH_PE_udata4: return scan_lsda<DW_EH_PE_udata4, DW_EH_PE_udata4>;
+        case DW_EH_PE_absptr: return scan_lsda<DW_EH_PE_udata4, DW_EH_PE_absptr>;
+        }
+    }
+#endif
+
+    return scan_lsda<dynamic_encoding, dynamic_encoding>;
 }
 
-// Get the fixed size for a particular encoding, if it exists, or 0
-unsigned size_from_encoding(uint8_t encoding) noexcept
+#ifdef BMCXX_COMPACT_LSDA
+
+// Compact LSDAs with at most this many call sites are searched linearly rather than by binary
+// search: for a short table (most functions have only a few call sites), a scan with a
+// predictable exit costs less than the mispredicted branches of a binary search.
+#ifndef BMCXX_COMPACT_LSDA_LINEAR_MAX
+#define BMCXX_COMPACT_LSDA_LINEAR_MAX 8
+#endif
+
+// Find the call site containing the IP in a compact LSDA (see compact_lsda.h) and process its
+// actions, as scan_lsda and process_actions do for a DWARF LSDA
+_Unwind_Reason_Code scan_compact_lsda(const compact_lsda_header *lsda, uintptr_t rIP_offs,
+        _Unwind_Action actions, _Unwind_Exception *unwind_exc, _Unwind_Context *context) noexcept
 {
-    unsigned val = 0;
-    
-    switch (encoding & 0x0Fu) {
-    case DW_EH_PE_omit:
-    case DW_EH_PE_uleb128:
-    case DW_EH_PE_sleb128:
-        break;
-    case DW_EH_PE_udata2:
-    case DW_EH_PE_sdata2:
-        val = 2;
-        break;
-    case DW_EH_PE_udata4:
-    case DW_EH_PE_sdata4:
-        val = 4;
-        break;
-    case DW_EH_PE_udata8:
-    case DW_EH_PE_sdata8:
-    case DW_EH_PE_absptr:
-        val = 8;
-        break;
-    default:
-        abort(); // unsupported
+    const compact_call_site *call_sites = (const compact_call_site *)(lsda + 1);
+    const compact_action *action_tbl = (const compact_action *)(call_sites + lsda->num_call_sites);
+
+    // Find the last call site starting at or before the IP
+    const compact_call_site *cs = nullptr;
+    uint32_t num_call_sites = lsda->num_call_sites;
+    if (num_call_sites <= BMCXX_COMPACT_LSDA_LINEAR_MAX) {
+        for (uint32_t i = 0; i < num_call_sites && call_sites[i].start <= rIP_offs; ++i) {
+#ifdef BMCXX_PERSONALITY_PROFILE
+            ++frame_cost.callsites;
+#endif
+            cs = &call_sites[i];
+        }
     }
-    
-    return val;
+    else {
+        uint32_t lo = 0, hi = num_call_sites;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+#ifdef BMCXX_PERSONALITY_PROFILE
+            ++frame_cost.callsites;
+#endif
+            if (call_sites[mid].start <= rIP_offs) {
+                cs = &call_sites[mid];
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+    }
+    if (cs == nullptr || rIP_offs - cs->start >= cs->length) {
+        // No entry for the IP (see scan_lsda)
+        return _URC_FATAL_PHASE1_ERROR;
+    }
+
+    if (cs->landing_pad == 0) {
+        return _URC_CONTINUE_UNWIND;
+    }
+    const uint8_t *lp_start = lsda->lp_start != 0 ? (const uint8_t *)lsda->lp_start
+            : (const uint8_t *)_Unwind_GetRegionStart(context);
+    const uint8_t *landing_pad = lp_start + cs->landing_pad;
+
+    if (cs->action == 0) {
+        if (actions & _UA_SEARCH_PHASE) {
+            return _URC_CONTINUE_UNWIND;
+        }
+        return install_cleanup(landing_pad, unwind_exc, context);
+    }
+
+    uintptr_t cxa_exception_addr = (uintptr_t)unwind_exc - offsetof(__cxa_exception, unwindHeader);
+    __cxa_exception *cxa_exception = (__cxa_exception *) cxa_exception_addr;
+
+    // (see process_actions)
+    bool check_handlers = (actions & (_UA_SEARCH_PHASE | _UA_FORCE_UNWIND)) == _UA_SEARCH_PHASE;
+    bool have_cleanup = false;
+    unsigned chain_count = 0;
+
+    for (const compact_action *action = &action_tbl[cs->action - 1]; ; ++action) {
+        count_action_entry(chain_count);
+
+        if (action->switch_value == 0) {
+            have_cleanup = true;
+        }
+        else if (!check_handlers) {
+            // (skip)
+        }
+        else if (action->switch_value > 0) {
+            const std::type_info *catch_type = (const std::type_info *)action->type;
+            void *cxx_exception_ptr = thrown_object(cxa_exception);
+            if (catch_type == nullptr
+                    || catch_matches(catch_type, cxa_exception->exceptionType,
+                            &cxx_exception_ptr)) {
+                eh_trace(BMCXXABI_TRACE_HANDLER_TYPE, unwind_exc + 1, (uintptr_t)catch_type);
+                return handler_found(cxa_exception, cxx_exception_ptr, action->switch_value,
+                        landing_pad);
+            }
+        }
+        else {
+            const std::type_info * const *spec_types = (const std::type_info * const *)action->type;
+            uint32_t spec_len = action->flags & compact_action_count_mask;
+            bool allowed = false;
+            unsigned spec_count = 0;
+            for (uint32_t i = 0; i < spec_len && !allowed; ++i) {
+                count_action_entry(spec_count);
+                void *cxx_exception_ptr = thrown_object(cxa_exception);
+                allowed = catch_matches(spec_types[i], cxa_exception->exceptionType,
+                        &cxx_exception_ptr);
+            }
+            if (!allowed) {
+                return handler_found(cxa_exception, thrown_object(cxa_exception),
+                        action->switch_value, landing_pad);
+            }
+        }
+
+        if (action->flags & compact_action_last) break;
+    }
+
+    if (have_cleanup && !(actions & _UA_SEARCH_PHASE)) {
+        return install_cleanup(landing_pad, unwind_exc, context);
+    }
+
+    return _URC_CONTINUE_UNWIND;
 }
 
+#endif
+
 } // anon namespace
 
 
@@ -236,9 +595,18 @@ unsigned size_from_encoding(uint8_t encoding) noexcept
 // and in this case the "exception ptr" register (..._regno(0)) is a pointer to the _Unwind_Exception.
 // However for a catch (..._regno(1) is non-zero) then regno(0) is a pointer to the actual thrown
 // object.
-extern "C"
-_Unwind_Reason_Code __gxx_personality_v0(int version, _Unwind_Action actions, uint64_t exception_class,
-    _Unwind_Exception *unwind_exc, _Unwind_Context *context) noexcept {
+//
+// When built with BMCXX_COMPACT_LSDA, a frame's LSDA may have been converted to the compact form
+// (see compact_lsda.h), which is used in preference. For __bmcxx_personality_compact
+// (compact_personality), the LSDA pointer is normally to the compact form itself.
+static inline _Unwind_Reason_Code gxx_personality(int version, _Unwind_Action actions,
+    uint64_t exception_class, _Unwind_Exception *unwind_exc, _Unwind_Context *context,
+    bool compact_personality) noexcept {
+
+#ifdef BMCXX_PERSONALITY_PROFILE
+    frame_profiler profiler(actions, context);
+#endif
+    stat_add((actions & _UA_SEARCH_PHASE) ? stat_frames_search : stat_frames_cleanup);
     
     uint32_t cpp;
     char cppstr[4] = {0,'+','+','C'};
@@ -342,33 +710,60 @@ _Unwind_Reason_Code __gxx_personality_v0(int version, _Unwind_Action actions, ui
         //        description of typeIndex in the action table).
 
         const uint8_t *lsda = (const uint8_t *) _Unwind_GetLanguageSpecificData(context);
+        if (lsda == nullptr) {
+            // A frame can have a personality routine but no LSDA (if the CIE is shared with
+            // functions that do need one); nothing to do for it.
+            return _URC_CONTINUE_UNWIND;
+        }
+
+#ifdef BMCXX_COMPACT_LSDA
+        const compact_lsda_header *compact = (const compact_lsda_header *)lsda;
+        if (!compact_personality || compact->tag != compact_lsda_tag) {
+            compact = compact_lsda_find(lsda);
+        }
+        if (compact != nullptr) {
+            uintptr_t ip_offs = _Unwind_GetIP(context) - 1 - _Unwind_GetRegionStart(context);
+            return scan_compact_lsda(compact, ip_offs, actions, unwind_exc, context);
+        }
+#else
+        (void)compact_personality;
+#endif
+
         const uintptr_t rIP = _Unwind_GetIP(context) - 1;
         const uintptr_t func_start = _Unwind_GetRegionStart(context);
+
+        lsda_header hdr;
+        hdr.bases.text = 0;
+        hdr.bases.data = 0;
+        hdr.bases.func = func_start;
     
         // Landing pad start; defaults to function start
-        const uint8_t *lp_start = (const uint8_t *) read_dwarf_encoded_val(lsda);
-        if (lp_start == nullptr) {
-            lp_start = (uint8_t *) func_start;
+        uint8_t lp_start_encoding = *lsda++;
+        get_rel_bases(lp_start_encoding, context, hdr.bases);
+        hdr.lp_start = (const uint8_t *) read_dwarf_encoded_val(lsda, lp_start_encoding, &hdr.bases);
+        if (hdr.lp_start == nullptr) {
+            hdr.lp_start = (const uint8_t *) func_start;
         }
         
         // Types table pointer
-        const uint8_t *types_tbl_ptr = nullptr;  // default to null
-        uint8_t types_encoding = *lsda++;
-        if (types_encoding != DW_EH_PE_omit) {
+        hdr.types_tbl = nullptr;  // default to null
+        hdr.types_encoding = *lsda++;
+        if (hdr.types_encoding != DW_EH_PE_omit) {
             //  "This is an unsigned LEB128 value, and is the byte offset from this field to the
             // start of the types table used for exception matching".
             // It is the offset from the *end* of this field:
             uintptr_t types_tbl_offs = read_ULEB128(lsda);
-            types_tbl_ptr = lsda + types_tbl_offs;
+            hdr.types_tbl = lsda + types_tbl_offs;
+            get_rel_bases(hdr.types_encoding, context, hdr.bases);
         }
         
-        uint8_t callsite_encoding = *lsda++;
+        hdr.callsite_encoding = *lsda++;
+        get_rel_bases(hdr.callsite_encoding, context, hdr.bases);
 
         uintptr_t callsite_tbl_len = read_ULEB128(lsda);
         
-        const uint8_t *callsite_tbl = lsda;
-        
-        const uint8_t *actions_tbl = callsite_tbl + callsite_tbl_len;
+        hdr.callsite_tbl = lsda;
+        hdr.actions_tbl = lsda + callsite_tbl_len;
         
         // Now we walk through the callsites until we find our current IP
         // ILT blog says the callsite start is offset from the landing pad base not the
@@ -379,159 +774,39 @@ _Unwind_Reason_Code __gxx_personality_v0(int version, _Unwind_Action actions, ui
         // 4) (Are landing pad base and func start ever different in practice anyway?).
         uintptr_t rIP_offs = rIP - func_start;
 
-        while (lsda < actions_tbl) {
-            uintptr_t cs_start = read_dwarf_encoded_val(lsda, callsite_encoding);
-            uintptr_t cs_len = read_dwarf_encoded_val(lsda, callsite_encoding);
-            uintptr_t cs_end = cs_start + cs_len;
-            uintptr_t lp_offs = read_dwarf_encoded_val(lsda, callsite_encoding); // landing pad
-            uintptr_t action_entry = read_ULEB128(lsda);
-                      
-            // check match
-            if (rIP_offs >= cs_start) {
-                if (rIP_offs < cs_end) {
-                    // matches location, we still need to check actions
-                    
-                    if (lp_offs == 0) {
-                        // Apparently, offset of 0 means no cleanup/catch
-                        return _URC_CONTINUE_UNWIND;
-                    }
-
-                    if (action_entry == 0) {
-                        // action_entry == 0 : cleanup only, no catches
-                        if (actions & _UA_SEARCH_PHASE) {
-                            return _URC_CONTINUE_UNWIND;
-                        }
-                        
-                        // Forced unwind, or cleanup phase
-                        // Set the registers in context so that the landing pad can resume unwind
-                        // when done:
-                        
-                        _Unwind_SetGR(context, (int)__builtin_eh_return_data_regno(0),
-                                (uintptr_t)unwind_exc);
-                        _Unwind_SetGR(context, (int)__builtin_eh_return_data_regno(1),
-                                (uintptr_t)0);
-                        _Unwind_SetIP(context, (uintptr_t)(lp_start + lp_offs));
-                        return _URC_INSTALL_CONTEXT;
-                    }
-
-                    const uint8_t *action_entry_ptr = actions_tbl + (action_entry - 1);
-
-                    while (action_entry != 0) {
-                        // "Each entry in the action table is a pair of signed LEB128 values"...
-                        // read the first one now, act on it, and read the 2nd (offset to next
-                        // entry) afterwards.
-                        intptr_t type_info_index = read_SLEB128(action_entry_ptr);
-                        
-                        // cleanup?
-                        if (type_info_index == 0) {
-                            if (actions & _UA_SEARCH_PHASE) {
-                                return _URC_CONTINUE_UNWIND;
-                            }
-                            _Unwind_SetGR(context, (int)__builtin_eh_return_data_regno(0),
-                                    (uintptr_t)unwind_exc);
-                            _Unwind_SetGR(context, (int)__builtin_eh_return_data_regno(1),
-                                    (uintptr_t)0);
-                            _Unwind_SetIP(context, (uintptr_t)(lp_start + lp_offs));
-                            return _URC_INSTALL_CONTEXT;
-                        }
-                        
-                        __cxa_exception *cxa_exception;
-                        unsigned type_info_sz;
-
-                        if (actions & _UA_FORCE_UNWIND) {
-                            // Used for thread cancellation or unwind-based longjmp
-                            goto next_action_entry;
-                        }
-
-                        {
-                            type_info_sz = size_from_encoding(types_encoding);
-                            if (type_info_sz == 0) abort();
-
-                            uintptr_t cxa_exception_addr = (uintptr_t)unwind_exc - offsetof(__cxa_exception, unwindHeader);
-                            cxa_exception = (__cxa_exception *) cxa_exception_addr;
-                        }
-
-                        // catch handler for single type?
-                        if (type_info_index > 0) {
-
-                            const uint8_t *catch_type_p = (types_tbl_ptr - type_info_index * type_info_sz);
-
-                            std::type_info *catch_type = (std::type_info *)
-                                    read_dwarf_encoded_val(catch_type_p, types_encoding);
-
-                            void * cxx_exception_ptr = (void *)(cxa_exception + 1);
-
-                            // A null catch_type is a catch-any aka "catch(...)". Otherwise we
-                            // need to check the type.
-                            if (catch_type == nullptr
-                                    || catch_type->__do_catch(cxa_exception->exceptionType,
-                                            &cxx_exception_ptr, 1)) {
-                                // Cache the values that will be used in phase 2:
-                                cxa_exception->adjustedPtr = cxx_exception_ptr;
-                                cxa_exception->handlerSwitchValue = type_info_index;
-                                cxa_exception->catchTemp = (void *)(lp_start + lp_offs);
-                                return _URC_HANDLER_FOUND;
-                            }
-                        }
-                        else /* (type_info_index < 0) */ {
-                            // throw specification (C++98). This is matched if the exception thrown is *not*
-                            // any from a list of types.
-                            const uint8_t *throw_spec_start = types_tbl_ptr - type_info_index;
-                            uintptr_t ts_index = read_ULEB128(throw_spec_start);
-                            while (ts_index != 0) {
-                                const uint8_t *catch_type_p = (types_tbl_ptr - ts_index * type_info_sz);
-
-                                std::type_info *catch_type = (std::type_info *)
-                                        read_dwarf_encoded_val(catch_type_p, types_encoding);
-
-                                void * cxx_exception_ptr = (void *)(cxa_exception + 1);
-
-                                if (catch_type->__do_catch(cxa_exception->exceptionType, &cxx_exception_ptr, 1)) {
-                                    cxa_exception->adjustedPtr = (void *)(cxa_exception + 1); // un-adjusted!
-                                    cxa_exception->handlerSwitchValue = type_info_index;
-                                    cxa_exception->catchTemp = (void *)(lp_start + lp_offs);
-                                    // The handler should just call __cxa_call_unexpected(), but
-                                    // that's in the hands of the compiler...
-                                    return _URC_HANDLER_FOUND;
-                                }
-
-                                ts_index = read_ULEB128(throw_spec_start);
-                            }
-                        }
-
-                        next_action_entry:
-
-                        // The next value we read is an offset from the current position in the
-                        // action entry table, so we need to avoid modifying the current position
-                        // before adding the offset; copy the value and use the copy in read_SLEB:
-                        const uint8_t *action_entry_read_next = action_entry_ptr;
-                        intptr_t action_entry_offs = read_SLEB128(action_entry_read_next);
-                        if (action_entry_offs == 0) break;
-                        action_entry_ptr += action_entry_offs;
-                    }
-                    
-                    // Got to end of actions without a match, continue unwind
-                    return _URC_CONTINUE_UNWIND;
-                }
-            }
-            else {
-                // we have: rIP_offs < cs_start
-                // call sites ordered by start address, therefore, we won't find one from here
-                
-                // "If the personality function finds that there is no entry for the current
-                // PC in the call-site table, then there is no exception information. This
-                // should not happen in normal operation, and in C++ will lead to a call to
-                // std::terminate"
-                
-                // We return an error here, that way _Unwind_RaiseException returns (instead of
-                // unwinding) and std::terminate() can be called from _cxa_throw(...).
-
-                return _URC_FATAL_PHASE1_ERROR;
-                
-                break;
-            }
-        }
+        // The walker is specialised for the call-site and types table encodings, so select it
+        // once (here) rather than decoding according to encoding for every field.
+        lsda_scanner scanner = select_lsda_scanner(hdr.callsite_encoding, hdr.types_encoding);
+        return scanner(hdr, rIP_offs, actions, unwind_exc, context);
     } // not handler frame
 
     return _URC_CONTINUE_UNWIND; 
 }
+
+// The personality routine (see gxx_personality, above), with the decision for the frame traced
+extern "C"
+_Unwind_Reason_Code __gxx_personality_v0(int version, _Unwind_Action actions, uint64_t exception_class,
+    _Unwind_Exception *unwind_exc, _Unwind_Context *context) noexcept
+{
+    _Unwind_Reason_Code result = gxx_personality(version, actions, exception_class, unwind_exc,
+            context, false);
+    trace_decision(result, actions, unwind_exc, context);
+    return result;
+}
+
+#ifdef BMCXX_COMPACT_LSDA
+
+// The personality routine for frames whose LSDA pointer has been changed (by bmcxx-lsdacompact -p)
+// to point to the compact form of the LSDA. A frame whose LSDA has not been converted is handled
+// as by __gxx_personality_v0.
+extern "C"
+_Unwind_Reason_Code __bmcxx_personality_compact(int version, _Unwind_Action actions,
+    uint64_t exception_class, _Unwind_Exception *unwind_exc, _Unwind_Context *context) noexcept
+{
+    _Unwind_Reason_Code result = gxx_personality(version, actions, exception_class, unwind_exc,
+            context, true);
+    trace_decision(result, actions, unwind_exc, context);
+    return result;
+}
+
+#endif
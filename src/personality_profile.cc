@@ -0,0 +1,169 @@
+// Per-frame personality routine profiler.
+//
+// When built with BMCXX_PERSONALITY_PROFILE defined, the personality routine records, for each
+// frame it is called for, the work it did (call-site records scanned, action entries evaluated,
+// __do_catch calls) and the cycles it took, and adds them to the totals for the frame's function
+// (identified by its start address, from _Unwind_GetRegionStart), separately for the search and
+// cleanup phases. The totals can be read with bmcxxabi_personality_profile_snapshot, to find the
+// functions whose LSDAs (eg with many call sites, or long action chains) or catch clauses (eg
+// against types in a deep hierarchy) make throwing through them expensive.
+//
+// The totals are kept in a single fixed-size table (BMCXX_PERSONALITY_PROFILE_SLOTS entries, a
+// power of 2), indexed by hashing the function address. Entries are claimed with atomic
+// compare-and-exchange and totals updated with atomic adds, so recording is lock-free. An entry
+// keeps its function for the life of the program; calls for functions which cannot be given an
+// entry (because the table is full around the hash position) are counted as dropped.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+#include "personality_profile.h"
+#include "../include/bmcxxabi.h"
+
+#ifdef BMCXX_PERSONALITY_PROFILE
+
+#ifndef BMCXX_PERSONALITY_PROFILE_SLOTS
+#define BMCXX_PERSONALITY_PROFILE_SLOTS 512
+#endif
+
+namespace {
+
+constexpr unsigned profile_slots = BMCXX_PERSONALITY_PROFILE_SLOTS;
+static_assert(profile_slots != 0 && (profile_slots & (profile_slots - 1)) == 0,
+        "BMCXX_PERSONALITY_PROFILE_SLOTS must be a power of 2");
+
+// Maximum number of slots examined (from the initial hash position) before giving up
+constexpr unsigned max_probes = profile_slots < 16 ? profile_slots : 16;
+
+// Totals for a function, for the search phase [0] and cleanup phase [1]
+struct function_totals {
+    uintptr_t func;    // 0 if the entry is unused
+    uint64_t calls[2];
+    uint64_t callsites[2];
+    uint64_t actions[2];
+    uint64_t do_catch[2];
+    uint64_t cycles[2];
+};
+
+function_totals profile_table[profile_slots];
+uint64_t num_dropped = 0;
+
+unsigned hash_func(uintptr_t func) noexcept
+{
+    return (unsigned)(((uint64_t)func * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+function_totals *find_totals(uintptr_t func) noexcept
+{
+    unsigned hash = hash_func(func);
+
+    for (unsigned i = 0; i < max_probes; ++i) {
+        function_totals &totals = profile_table[(hash + i) & (profile_slots - 1)];
+        uintptr_t entry_func = __atomic_load_n(&totals.func, __ATOMIC_RELAXED);
+        if (entry_func == 0) {
+            if (__atomic_compare_exchange_n(&totals.func, &entry_func, func, false,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return &totals;
+            }
+            // Lost a race to claim this entry; entry_func is now the winning function, check it
+        }
+        if (entry_func == func) {
+            return &totals;
+        }
+    }
+
+    return nullptr;
+}
+
+// Total cycles (both phases) of a snapshot entry
+uint64_t total_cycles(const bmcxxabi_personality_frame &frame) noexcept
+{
+    return frame.cycles[0] + frame.cycles[1];
+}
+
+} // anon namespace
+
+void personality_profile_record(uintptr_t func, bool cleanup_phase,
+        const personality_frame_cost &cost, uint64_t cycles) noexcept
+{
+    function_totals *totals = find_totals(func);
+    if (totals == nullptr) {
+        __atomic_fetch_add(&num_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    unsigned phase = cleanup_phase ? 1 : 0;
+    __atomic_fetch_add(&totals->calls[phase], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totals->callsites[phase], cost.callsites, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totals->actions[phase], cost.actions, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totals->do_catch[phase], cost.do_catch, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totals->cycles[phase], cycles, __ATOMIC_RELAXED);
+}
+
+// Store the totals for the (up to max) most expensive functions, by total cycles, in descending
+// order. The values for a function are read separately, so may be mutually inconsistent if
+// exceptions are being thrown concurrently.
+extern "C"
+size_t bmcxxabi_personality_profile_snapshot(bmcxxabi_personality_frame *frames, size_t max,
+        unsigned long long *dropped)
+{
+    size_t num_frames = 0;
+
+    for (function_totals &totals : profile_table) {
+        bmcxxabi_personality_frame frame;
+        frame.function = (const void *)__atomic_load_n(&totals.func, __ATOMIC_RELAXED);
+        if (frame.function == nullptr) {
+            continue;
+        }
+        for (unsigned phase = 0; phase < 2; ++phase) {
+            frame.calls[phase] = __atomic_load_n(&totals.calls[phase], __ATOMIC_RELAXED);
+            frame.callsites[phase] = __atomic_load_n(&totals.callsites[phase], __ATOMIC_RELAXED);
+            frame.actions[phase] = __atomic_load_n(&totals.actions[phase], __ATOMIC_RELAXED);
+            frame.do_catch[phase] = __atomic_load_n(&totals.do_catch[phase], __ATOMIC_RELAXED);
+            frame.cycles[phase] = __atomic_load_n(&totals.cycles[phase], __ATOMIC_RELAXED);
+        }
+        if (frame.calls[0] == 0 && frame.calls[1] == 0) {
+            continue;
+        }
+
+        // Insert in order, dropping the cheapest if the array is full
+        size_t i = num_frames;
+        if (num_frames < max) {
+            ++num_frames;
+        }
+        else if (max == 0 || total_cycles(frames[max - 1]) >= total_cycles(frame)) {
+            continue;
+        }
+        else {
+            i = max - 1;
+        }
+        for ( ; i > 0 && total_cycles(frames[i - 1]) < total_cycles(frame); --i) {
+            frames[i] = frames[i - 1];
+        }
+        frames[i] = frame;
+    }
+
+    if (dropped != nullptr) {
+        *dropped = __atomic_load_n(&num_dropped, __ATOMIC_RELAXED);
+    }
+    return num_frames;
+}
+
+// Zero all totals. (Calls recorded concurrently with the reset may or may not be counted.)
+extern "C"
+void bmcxxabi_personality_profile_reset()
+{
+    __atomic_store_n(&num_dropped, 0, __ATOMIC_RELAXED);
+    for (function_totals &totals : profile_table) {
+        for (unsigned phase = 0; phase < 2; ++phase) {
+            __atomic_store_n(&totals.calls[phase], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&totals.callsites[phase], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&totals.actions[phase], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&totals.do_catch[phase], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&totals.cycles[phase], 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _PERSONALITY_PROFILE_H_INCLUDED
+#define _PERSONALITY_PROFILE_H_INCLUDED 1
+
+#include "config.h"
+
+// Per-frame personality routine profiler (built with BMCXX_PERSONALITY_PROFILE defined). See
+// personality_profile.cc.
+
+#ifdef BMCXX_PERSONALITY_PROFILE
+
+#include <cstdint>
+
+// The work done by the personality routine for one frame
+struct personality_frame_cost {
+    unsigned callsites;   // call-site records scanned
+    unsigned actions;     // action entries (including throw specification entries) evaluated
+    unsigned do_catch;    // calls to __do_catch
+};
+
+// Add the cost of a personality routine call for the frame of the function starting at func, in
+// the search phase or (cleanup_phase true) the cleanup phase, to the function's totals.
+void personality_profile_record(uintptr_t func, bool cleanup_phase,
+        const personality_frame_cost &cost, uint64_t cycles) noexcept;
+
+#endif
+
+#endif
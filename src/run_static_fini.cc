@@ -1,5 +1,7 @@
 #include <cstdint>
 
+#include "config.h"
+
 struct opaque;
 
 // These should be defined via linker script
@@ -1,5 +1,9 @@
 #include <cstdint>
 
+#include "config.h"
+#include "cycle_count.h"
+#include "stats.h"
+
 struct opaque;
 
 extern opaque __init_array_start;
@@ -13,6 +17,10 @@ void bmcxxabi_run_init()
     uintptr_t *init_arr = (uintptr_t *) &__init_array_start;
     uintptr_t *end_init_arr = (uintptr_t *) &__init_array_end;
 
+#ifdef BMCXX_STATS
+    uint64_t start = bmcxx_cycle_count();
+#endif
+
     while (init_arr < end_init_arr) {
         uintptr_t init_func_addr = *(uintptr_t *)init_arr;
 
@@ -21,4 +29,8 @@ void bmcxxabi_run_init()
 
         init_arr++;
     }
+
+#ifdef BMCXX_STATS
+    stat_add(stat_run_init_cycles, bmcxx_cycle_count() - start);
+#endif
 }
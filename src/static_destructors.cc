@@ -2,6 +2,10 @@
 #include <cstdlib>
 #include <cstring>
 
+#include "config.h"
+#include "stats.h"
+#include "threads.h"
+
 // Fake DSO handle; needs to be defined as it will be referenced by compiler-generated code.
 // Its address will be passed to __cxa_atexit (3rd parameter). We make it weak to allow for
 // system-provided value to take precedence.
@@ -22,19 +26,14 @@ atexit_func *atexit_funcs = nullptr;
 unsigned atexit_funcs_size = 0;
 unsigned num_atexit_funcs = 0;
 
-}
+// protects the above
+BMCXX_LOCK atexit_lock;
 
-#endif
-
-extern "C"
-int __cxa_atexit (void (*f)(void *), void *p, void *d)
+// Add a function to the table; returns 0 on success
+int add_atexit_func(void (*f)(void *), void *p)
 {
-    // THREAD-SAFETY : this needs a mutex for thread safety
-
-#ifndef BMCXX_NO_SSD
-
     if (atexit_funcs == nullptr) {
-        atexit_funcs = (atexit_func *) malloc(sizeof(atexit_func) * 16);
+        atexit_funcs = (atexit_func *) BMCXX_ATEXIT_ALLOC(sizeof(atexit_func) * 16);
         if (atexit_funcs == nullptr) {
             return 1;
         }
@@ -48,22 +47,46 @@ int __cxa_atexit (void (*f)(void *), void *p, void *d)
             return 1;
         }
         unsigned new_funcs_size = atexit_funcs_size * 2;
-        atexit_func *new_atexit_funcs = (atexit_func *) malloc(sizeof(atexit_func) * new_funcs_size);
+        atexit_func *new_atexit_funcs = (atexit_func *) BMCXX_ATEXIT_ALLOC(sizeof(atexit_func) * new_funcs_size);
         if (new_atexit_funcs == nullptr) {
             return 1;
         }
 
         memcpy(new_atexit_funcs, atexit_funcs, num_atexit_funcs * sizeof(atexit_func));
-        free(atexit_funcs);
+        BMCXX_ATEXIT_FREE(atexit_funcs);
         atexit_funcs = new_atexit_funcs;
+        atexit_funcs_size = new_funcs_size;
     }
 
     atexit_funcs[num_atexit_funcs] = {f,p};
     ++num_atexit_funcs;
+    return 0;
+}
+
+}
 
 #endif
 
+extern "C"
+int __cxa_atexit (void (*f)(void *), void *p, void *d)
+{
+    stat_add(stat_atexit_registrations);
+    (void)d;
+
+#ifndef BMCXX_NO_SSD
+
+    atexit_lock.lock();
+    int r = add_atexit_func(f, p);
+    atexit_lock.unlock();
+    return r;
+
+#else
+
+    (void)f;
+    (void)p;
     return 0;
+
+#endif
 }
 
 // run static-storage destructors that were registered dynamically (via __cxa_atexit)
@@ -74,10 +97,50 @@ void __cxa_finalize(void *d)
 
     if (d != &__dso_handle) return; // shouldn't happen
 
-    for (unsigned i = num_atexit_funcs; i > 0; ) {
-        i--;;
-        atexit_funcs[i].f(atexit_funcs[i].p);
+    // (each function is removed before it is called, so a second call runs nothing twice; the
+    // lock is not held during the call, since the function may itself register functions)
+    while (true) {
+        atexit_lock.lock();
+        if (num_atexit_funcs == 0) {
+            atexit_lock.unlock();
+            break;
+        }
+        atexit_func func = atexit_funcs[--num_atexit_funcs];
+        atexit_lock.unlock();
+        func.f(func.p);
     }
 
 #endif
 }
+
+#ifdef BMCXX_STATS
+
+// Size of the registration table, and number of entries in use (for bmcxxabi_get_stats)
+void atexit_table_stats(unsigned &size, unsigned &entries) noexcept
+{
+#ifndef BMCXX_NO_SSD
+    atexit_lock.lock();
+    size = atexit_funcs_size;
+    entries = num_atexit_funcs;
+    atexit_lock.unlock();
+#else
+    size = 0;
+    entries = 0;
+#endif
+}
+
+#endif
+
+#if defined(BMCXX_HOSTED) && !defined(BMCXX_NO_SSD)
+
+// In a hosted build, the C library runs its own exit-time functions, but (for an executable not
+// built as position-independent) the startup code does not call __cxa_finalize, so the functions
+// registered above would never run. Run them from a destructor function instead. (Where the
+// startup code also calls __cxa_finalize, the second call has nothing left to run.)
+__attribute__((destructor))
+static void hosted_finalize()
+{
+    __cxa_finalize(&__dso_handle);
+}
+
+#endif
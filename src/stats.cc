@@ -0,0 +1,60 @@
+// Runtime statistics.
+//
+// When built with BMCXX_STATS defined, the runtime counts exception allocations, throws, frames
+// visited by the personality routine, catch matching calls, guard acquisitions, __cxa_atexit
+// registrations and so on (see bmcxxabi_stats in bmcxxabi.h). Each count is kept per CPU
+// (BMCXX_STATS_CPUS sets of counters, indexed by bmcxxabi_cpu_id()), and updated with a single
+// relaxed atomic add, so that the counters are cheap enough to leave enabled; bmcxxabi_get_stats
+// sums them. Since the counters are read separately, the totals are not a consistent snapshot if
+// the runtime is in use concurrently.
+
+#include <cstdint>
+
+#include "config.h"
+#include "stats.h"
+#include "../include/bmcxxabi.h"
+
+#ifdef BMCXX_STATS
+
+cpu_stats stats_per_cpu[BMCXX_STATS_CPUS];
+
+// Size of the __cxa_atexit registration table, and number of entries in use (see
+// static_destructors.cc)
+void atexit_table_stats(unsigned &size, unsigned &entries) noexcept;
+
+extern "C"
+void bmcxxabi_get_stats(bmcxxabi_stats *stats)
+{
+    uint64_t totals[num_stat_counters] = {};
+    for (cpu_stats &cs : stats_per_cpu) {
+        for (unsigned i = 0; i < num_stat_counters; ++i) {
+            totals[i] += __atomic_load_n(&cs.counters[i], __ATOMIC_RELAXED);
+        }
+    }
+
+    stats->exceptions_allocated = totals[stat_exceptions_allocated];
+    stats->exceptions_freed = totals[stat_exceptions_freed];
+    // (an exception may be freed on a different CPU to that which allocated it, so only the
+    // totals are meaningful)
+    stats->exception_bytes_live = totals[stat_exception_bytes_allocated]
+            - totals[stat_exception_bytes_freed];
+    stats->throws = totals[stat_throws];
+    stats->rethrows = totals[stat_rethrows];
+    stats->frames_search = totals[stat_frames_search];
+    stats->frames_cleanup = totals[stat_frames_cleanup];
+    stats->handlers_found = totals[stat_handlers_found];
+    stats->terminates = totals[stat_terminates];
+    stats->do_catch_calls = totals[stat_do_catch_calls];
+    stats->do_upcast_calls = totals[stat_do_upcast_calls];
+    stats->guard_acquires = totals[stat_guard_acquires];
+    stats->guard_contended = totals[stat_guard_contended];
+    stats->atexit_registrations = totals[stat_atexit_registrations];
+    stats->run_init_cycles = totals[stat_run_init_cycles];
+
+    unsigned atexit_size, atexit_entries;
+    atexit_table_stats(atexit_size, atexit_entries);
+    stats->atexit_table_size = atexit_size;
+    stats->atexit_table_entries = atexit_entries;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef _STATS_H_INCLUDED
+#define _STATS_H_INCLUDED 1
+
+// Runtime statistics counters (built with BMCXX_STATS defined); see stats.cc. Without BMCXX_STATS,
+// stat_add does nothing.
+
+#include <cstdint>
+
+#include "threads.h"
+
+enum stat_counter {
+    stat_exceptions_allocated,
+    stat_exceptions_freed,
+    stat_exception_bytes_allocated,
+    stat_exception_bytes_freed,
+    stat_throws,
+    stat_rethrows,
+    stat_frames_search,
+    stat_frames_cleanup,
+    stat_handlers_found,
+    stat_terminates,
+    stat_do_catch_calls,
+    stat_do_upcast_calls,
+    stat_guard_acquires,
+    stat_guard_contended,
+    stat_atexit_registrations,
+    stat_run_init_cycles,
+    num_stat_counters
+};
+
+#ifdef BMCXX_STATS
+
+#ifndef BMCXX_STATS_CPUS
+#ifdef BMCXX_THREADS
+#define BMCXX_STATS_CPUS 16
+#else
+#define BMCXX_STATS_CPUS 1
+#endif
+#endif
+
+struct alignas(64) cpu_stats {
+    uint64_t counters[num_stat_counters];
+};
+
+extern cpu_stats stats_per_cpu[BMCXX_STATS_CPUS];
+
+#endif
+
+// Add to a counter (for the current CPU)
+inline void stat_add(stat_counter counter, uint64_t n = 1) noexcept
+{
+#ifdef BMCXX_STATS
+    unsigned cpu = (BMCXX_STATS_CPUS == 1) ? 0 : BMCXX_CPU_ID() % BMCXX_STATS_CPUS;
+    __atomic_fetch_add(&stats_per_cpu[cpu].counters[counter], n, __ATOMIC_RELAXED);
+#else
+    (void)counter;
+    (void)n;
+#endif
+}
+
+#endif
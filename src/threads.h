@@ -0,0 +1,73 @@
+#ifndef BMCXX_THREADS_H_INCLUDED
+#define BMCXX_THREADS_H_INCLUDED 1
+
+// Support for multi-threaded environments (BMCXX_THREADS defined). Without BMCXX_THREADS, the
+// runtime assumes a single thread: the per-thread exception state is global, and the spinlock
+// below does nothing. With it, the environment must support thread-local storage (__thread);
+// waiting is done by spinning, calling bmcxxabi_thread_yield (which the environment can
+// override, eg to yield to the scheduler) on each iteration. Each of these can instead be
+// selected at compile time (BMCXX_THREAD_LOCAL, BMCXX_EH_GLOBALS, BMCXX_THREAD_YIELD, BMCXX_LOCK,
+// BMCXX_CPU_ID; see config.h).
+
+#include "config.h"
+
+#ifndef BMCXX_THREAD_LOCAL
+#ifdef BMCXX_THREADS
+#define BMCXX_THREAD_LOCAL __thread
+#else
+#define BMCXX_THREAD_LOCAL
+#endif
+#endif
+
+extern "C" void bmcxxabi_thread_yield();
+
+#ifndef BMCXX_THREAD_YIELD
+#define BMCXX_THREAD_YIELD bmcxxabi_thread_yield
+#endif
+
+// Per-CPU data, used by the profiling, diagnostics, statistics and tracing options and the throw
+// governor, is indexed by the number of the current CPU, as returned by bmcxxabi_cpu_id (which
+// the environment can override; see bmcxxabi.h).
+#if defined(BMCXX_THROW_PROFILE) || defined(BMCXX_THROW_BACKTRACE) || defined(BMCXX_STATS) \
+        || defined(BMCXX_EH_TRACE) || defined(BMCXX_THROW_GOVERNOR)
+#define BMCXX_PER_CPU 1
+#endif
+
+extern "C" unsigned bmcxxabi_cpu_id();
+
+#ifndef BMCXX_CPU_ID
+#define BMCXX_CPU_ID bmcxxabi_cpu_id
+#endif
+
+// A minimal test-and-test-and-set lock. Zero-initialised, so usable for static objects without
+// any constructor having run.
+class bmcxx_spinlock {
+#ifdef BMCXX_THREADS
+    char locked = 0;
+#endif
+
+public:
+    void lock() noexcept
+    {
+#ifdef BMCXX_THREADS
+        while (__atomic_exchange_n(&locked, 1, __ATOMIC_ACQUIRE)) {
+            while (__atomic_load_n(&locked, __ATOMIC_RELAXED)) {
+                BMCXX_THREAD_YIELD();
+            }
+        }
+#endif
+    }
+
+    void unlock() noexcept
+    {
+#ifdef BMCXX_THREADS
+        __atomic_store_n(&locked, 0, __ATOMIC_RELEASE);
+#endif
+    }
+};
+
+#ifndef BMCXX_LOCK
+#define BMCXX_LOCK bmcxx_spinlock
+#endif
+
+#endif
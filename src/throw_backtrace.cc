@@ -0,0 +1,217 @@
+// Throw-time backtrace capture.
+//
+// When built with BMCXX_THROW_BACKTRACE defined, __cxa_throw captures the return addresses of up to
+// BMCXX_THROW_BACKTRACE_DEPTH frames, starting at the throw site, into the exception header, so
+// that if the exception escapes (to std::terminate) the terminate handler can report where it was
+// thrown from, via bmcxxabi_exception_backtrace. Each throw (and rethrow) is also recorded in a
+// ring of recent throws per CPU (BMCXX_THROW_BACKTRACE_RING records per ring, and
+// BMCXX_THROW_BACKTRACE_CPUS rings, indexed by bmcxxabi_cpu_id()), readable via
+// bmcxxabi_recent_throws. No symbolisation is done; the addresses can be resolved off-line.
+//
+// The method of capture is selected at run time (bmcxxabi_throw_backtrace_mode):
+//
+//   BMCXXABI_BACKTRACE_FRAME_POINTER
+//           follow the chain of saved frame pointers. This is cheap (a load per frame), but gives
+//           a truncated backtrace for code compiled without frame pointers (eg, without
+//           -fno-omit-frame-pointer); the chain is followed only while it moves up the stack by
+//           less than BMCXX_THROW_BACKTRACE_MAX_FRAME bytes at a time.
+//   BMCXXABI_BACKTRACE_UNWIND
+//           use the unwinder (_Unwind_Backtrace), which works without frame pointers but must find
+//           and interpret the unwind table for each frame. This is the default.
+//   BMCXXABI_BACKTRACE_NONE
+//           no capture (or recording).
+//
+// Either way the cost is bounded by the depth limit. A ring record is written under a per-record
+// sequence number (as for a seqlock), so recording takes no lock; a reader discards a record that
+// was overwritten while it was being read.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <unwind.h>
+
+#include "config.h"
+#include "cycle_count.h"
+#include "throw_backtrace.h"
+#include "threads.h"
+#include "../include/bmcxxabi.h"
+
+#ifdef BMCXX_THROW_BACKTRACE
+
+#ifndef BMCXX_THROW_BACKTRACE_RING
+#define BMCXX_THROW_BACKTRACE_RING 16
+#endif
+
+#ifndef BMCXX_THROW_BACKTRACE_CPUS
+#ifdef BMCXX_THREADS
+#define BMCXX_THROW_BACKTRACE_CPUS 16
+#else
+#define BMCXX_THROW_BACKTRACE_CPUS 1
+#endif
+#endif
+
+#ifndef BMCXX_THROW_BACKTRACE_MAX_FRAME
+#define BMCXX_THROW_BACKTRACE_MAX_FRAME (1024 * 1024)
+#endif
+
+static_assert(BMCXX_THROW_BACKTRACE_DEPTH <= BMCXXABI_BACKTRACE_MAX_FRAMES,
+        "BMCXX_THROW_BACKTRACE_DEPTH exceeds BMCXXABI_BACKTRACE_MAX_FRAMES");
+
+namespace {
+
+char backtrace_mode = BMCXXABI_BACKTRACE_UNWIND;
+
+// A record in a ring; seq is the (1-based) position in the ring's sequence of records, or 0 while
+// the record is being written
+struct ring_record {
+    uint64_t seq;
+    bmcxxabi_throw_record record;
+};
+
+struct alignas(64) throw_ring {
+    uint64_t next;   // number of records ever written
+    ring_record records[BMCXX_THROW_BACKTRACE_RING];
+};
+
+throw_ring throw_rings[BMCXX_THROW_BACKTRACE_CPUS];
+
+unsigned capture_frame_pointer(void *frame_address, void **frames) noexcept
+{
+    // Each frame begins with the saved frame pointer of the caller, followed by the return address
+    void **fp = (void **)frame_address;
+    unsigned depth = 0;
+    while (depth < BMCXX_THROW_BACKTRACE_DEPTH) {
+        void *ret = fp[1];
+        if (ret == nullptr) break;
+        frames[depth++] = ret;
+
+        void **next = (void **)fp[0];
+        if (next <= fp || (uintptr_t)next - (uintptr_t)fp > BMCXX_THROW_BACKTRACE_MAX_FRAME
+                || ((uintptr_t)next & (sizeof(void *) - 1)) != 0) {
+            break;
+        }
+        fp = next;
+    }
+    return depth;
+}
+
+struct unwind_capture {
+    void **frames;
+    unsigned depth;
+    unsigned skip;
+};
+
+_Unwind_Reason_Code capture_unwind_frame(_Unwind_Context *context, void *arg)
+{
+    unwind_capture *capture = (unwind_capture *)arg;
+    if (capture->skip != 0) {
+        --capture->skip;
+        return _URC_NO_REASON;
+    }
+    uintptr_t ip = _Unwind_GetIP(context);
+    if (ip == 0) {
+        return _URC_END_OF_STACK;
+    }
+    capture->frames[capture->depth++] = (void *)ip;
+    return capture->depth < BMCXX_THROW_BACKTRACE_DEPTH ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+__attribute__((noinline))
+unsigned capture_unwind(void **frames) noexcept
+{
+    // The first frames reported are this function's, throw_backtrace_capture's, and that of
+    // __cxa_throw (or __cxa_rethrow), which are skipped
+    unwind_capture capture = {frames, 0, 3};
+    _Unwind_Backtrace(capture_unwind_frame, &capture);
+    return capture.depth;
+}
+
+void record_throw(const std::type_info *type, bool rethrow, void * const *frames,
+        unsigned depth) noexcept
+{
+    unsigned cpu = BMCXX_CPU_ID();
+    throw_ring &ring = throw_rings[cpu % BMCXX_THROW_BACKTRACE_CPUS];
+    uint64_t seq = __atomic_fetch_add(&ring.next, 1, __ATOMIC_RELAXED) + 1;
+    ring_record &rr = ring.records[(seq - 1) % BMCXX_THROW_BACKTRACE_RING];
+
+    __atomic_store_n(&rr.seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    rr.record.time = bmcxx_cycle_count();
+    rr.record.type = type;
+    rr.record.cpu = cpu;
+    rr.record.rethrow = rethrow;
+    rr.record.depth = depth;
+    memcpy(rr.record.frames, frames, depth * sizeof(void *));
+
+    __atomic_store_n(&rr.seq, seq, __ATOMIC_RELEASE);
+}
+
+} // anon namespace
+
+__attribute__((noinline))
+unsigned throw_backtrace_capture(void *frame_address, const std::type_info *type, bool rethrow,
+        void **frames) noexcept
+{
+    unsigned depth;
+    switch (__atomic_load_n(&backtrace_mode, __ATOMIC_RELAXED)) {
+    case BMCXXABI_BACKTRACE_FRAME_POINTER:
+        depth = capture_frame_pointer(frame_address, frames);
+        break;
+    case BMCXXABI_BACKTRACE_UNWIND:
+        depth = capture_unwind(frames);
+        break;
+    default:
+        return 0;
+    }
+
+    record_throw(type, rethrow, frames, depth);
+    return depth;
+}
+
+extern "C"
+void bmcxxabi_throw_backtrace_mode(int mode)
+{
+    __atomic_store_n(&backtrace_mode, (char)mode, __ATOMIC_RELAXED);
+}
+
+// Copy the records from all rings, most recent (by cycle count) first. Records being written, or
+// overwritten while being copied, are skipped.
+extern "C"
+size_t bmcxxabi_recent_throws(bmcxxabi_throw_record *records, size_t max)
+{
+    size_t num_records = 0;
+
+    for (throw_ring &ring : throw_rings) {
+        for (ring_record &rr : ring.records) {
+            uint64_t seq = __atomic_load_n(&rr.seq, __ATOMIC_ACQUIRE);
+            if (seq == 0) continue;
+
+            bmcxxabi_throw_record record;
+            memcpy(&record, &rr.record, sizeof(record));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&rr.seq, __ATOMIC_RELAXED) != seq) continue;
+
+            // Insert in order, dropping the oldest if the array is full
+            size_t i = num_records;
+            if (num_records < max) {
+                ++num_records;
+            }
+            else if (max == 0 || records[max - 1].time >= record.time) {
+                continue;
+            }
+            else {
+                i = max - 1;
+            }
+            for ( ; i > 0 && records[i - 1].time < record.time; --i) {
+                records[i] = records[i - 1];
+            }
+            records[i] = record;
+        }
+    }
+
+    return num_records;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _THROW_BACKTRACE_H_INCLUDED
+#define _THROW_BACKTRACE_H_INCLUDED 1
+
+#include "config.h"
+
+// Throw-time backtrace capture (built with BMCXX_THROW_BACKTRACE defined). See
+// throw_backtrace.cc.
+
+#ifdef BMCXX_THROW_BACKTRACE
+
+#ifndef BMCXX_THROW_BACKTRACE_DEPTH
+#define BMCXX_THROW_BACKTRACE_DEPTH 16
+#endif
+
+namespace std {
+    class type_info;
+}
+
+// Capture the return addresses of (up to BMCXX_THROW_BACKTRACE_DEPTH) frames, starting with the
+// caller of __cxa_throw/__cxa_rethrow, and record them in the ring of recent throws. The frame
+// address is that of __cxa_throw/__cxa_rethrow (__builtin_frame_address(0)). Returns the number
+// of frames captured (0 if capture is disabled).
+unsigned throw_backtrace_capture(void *frame_address, const std::type_info *type, bool rethrow,
+        void **frames) noexcept;
+
+#endif
+
+#endif
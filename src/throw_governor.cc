@@ -0,0 +1,293 @@
+// Throw-storm governor.
+//
+// When built with BMCXX_THROW_GOVERNOR defined, and configured at run time via
+// bmcxxabi_throw_governor_configure, __cxa_throw measures the rate of throws on each CPU over a
+// sliding window, for each throw site and type, for each type (from any site) and in total. When
+// a rate reaches its threshold, the configured callback is called (on the throwing thread, before
+// unwinding starts), at most once per window for each rate, so that the application can switch to
+// a cheaper way of reporting errors (eg error codes) while a "throw storm" lasts, rather than
+// saturating every CPU in the unwinder. The current rates can be read at any time via
+// bmcxxabi_throw_governor_rates. Rethrows are not counted.
+//
+// The sliding window is approximated with two consecutive fixed windows: the rate is the count in
+// the current window plus the count in the previous window, weighted by the part of it which is
+// still within the sliding window. Windows are measured in cycles (see cycle_count.h); where there
+// is no cycle counter, the window never ends, and each rate is the total number of throws.
+//
+// Rates are kept in a table per CPU (BMCXX_THROW_GOVERNOR_CPUS tables, each of
+// BMCXX_THROW_GOVERNOR_SLOTS entries, which must be a power of 2), indexed by bmcxxabi_cpu_id(),
+// with entries claimed as for the throw-site profiler (see throw_profile.cc). Counting is
+// lock-free; a throw which races with the start of a new window may be counted in the wrong one,
+// which is harmless for this purpose. Throws from sites which do not fit in the table are still
+// counted in the per-type and per-CPU rates, if they fit.
+//
+// THREAD-SAFETY : bmcxxabi_throw_governor_configure should not be called concurrently with
+//                 itself.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+#include "cycle_count.h"
+#include "throw_governor.h"
+#include "threads.h"
+#include "../include/bmcxxabi.h"
+
+#ifdef BMCXX_THROW_GOVERNOR
+
+#ifndef BMCXX_THROW_GOVERNOR_SLOTS
+#define BMCXX_THROW_GOVERNOR_SLOTS 256
+#endif
+
+#ifndef BMCXX_THROW_GOVERNOR_CPUS
+#ifdef BMCXX_THREADS
+#define BMCXX_THROW_GOVERNOR_CPUS 16
+#else
+#define BMCXX_THROW_GOVERNOR_CPUS 1
+#endif
+#endif
+
+char throw_governor_enabled = 0;
+
+namespace {
+
+constexpr unsigned governor_slots = BMCXX_THROW_GOVERNOR_SLOTS;
+static_assert(governor_slots != 0 && (governor_slots & (governor_slots - 1)) == 0,
+        "BMCXX_THROW_GOVERNOR_SLOTS must be a power of 2");
+
+// Maximum number of slots examined (from the initial hash position) before giving up
+constexpr unsigned max_probes = governor_slots < 16 ? governor_slots : 16;
+
+// The site of the entry for all throws of a type (a return address is never all-ones)
+const void * const any_site = (const void *)UINTPTR_MAX;
+
+// The configuration, which is read (without synchronisation) by throwing threads while enabled
+bmcxxabi_throw_governor_config config;
+
+// A count of throws, over the current and previous windows
+struct rate_counter {
+    uint64_t window;     // number of the current window
+    uint64_t current;    // throws in the current window
+    uint64_t previous;   // throws in the previous window
+    uint64_t alerted;    // number (plus 1) of the window in which the callback was last called
+    uint64_t total;      // throws since the counter was claimed
+};
+
+struct governor_entry {
+    // The key; a null type means the entry has been claimed (site is set) but the type is not yet
+    // stored
+    const void *site;
+    const std::type_info *type;
+    rate_counter counter;
+};
+
+struct alignas(64) governor_table {
+    rate_counter cpu_counter;
+    governor_entry entries[governor_slots];
+};
+
+governor_table governor_tables[BMCXX_THROW_GOVERNOR_CPUS];
+
+unsigned hash_key(const void *site, const std::type_info *type) noexcept
+{
+    uint64_t val = (uintptr_t)site ^ ((uintptr_t)type >> 3);
+    return (unsigned)((val * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+governor_entry *find_entry(governor_table &table, const void *site, const std::type_info *type)
+        noexcept
+{
+    unsigned hash = hash_key(site, type);
+
+    for (unsigned i = 0; i < max_probes; ++i) {
+        governor_entry &entry = table.entries[(hash + i) & (governor_slots - 1)];
+        const void *entry_site = __atomic_load_n(&entry.site, __ATOMIC_ACQUIRE);
+        if (entry_site == nullptr) {
+            if (__atomic_compare_exchange_n(&entry.site, &entry_site, site, false,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&entry.type, type, __ATOMIC_RELEASE);
+                return &entry;
+            }
+            // Lost a race to claim this entry; entry_site is now the winning site, check it
+        }
+
+        if (entry_site == site && __atomic_load_n(&entry.type, __ATOMIC_ACQUIRE) == type) {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+// The weight (in 256ths) of the previous window's count, at the given time within the current
+// window
+inline uint64_t previous_weight(uint64_t now, uint64_t window_len) noexcept
+{
+    uint64_t elapsed = now % window_len;
+    return ((window_len - elapsed) << 8) / window_len;
+}
+
+// Count a throw in the given window; returns the rate
+uint64_t counter_add(rate_counter &counter, uint64_t window, uint64_t weight) noexcept
+{
+    uint64_t counter_window = __atomic_load_n(&counter.window, __ATOMIC_ACQUIRE);
+    if (counter_window != window) {
+        if (counter_window < window && __atomic_compare_exchange_n(&counter.window,
+                &counter_window, window, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            uint64_t current = __atomic_exchange_n(&counter.current, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&counter.previous, (window == counter_window + 1) ? current : 0,
+                    __ATOMIC_RELAXED);
+        }
+    }
+
+    __atomic_fetch_add(&counter.total, 1, __ATOMIC_RELAXED);
+    uint64_t current = __atomic_add_fetch(&counter.current, 1, __ATOMIC_RELAXED);
+    return current + ((__atomic_load_n(&counter.previous, __ATOMIC_RELAXED) * weight) >> 8);
+}
+
+// The rate for a counter, in the given window (without counting a throw)
+uint64_t counter_rate(rate_counter &counter, uint64_t window, uint64_t weight) noexcept
+{
+    uint64_t counter_window = __atomic_load_n(&counter.window, __ATOMIC_ACQUIRE);
+    uint64_t current = __atomic_load_n(&counter.current, __ATOMIC_RELAXED);
+    if (counter_window == window) {
+        return current + ((__atomic_load_n(&counter.previous, __ATOMIC_RELAXED) * weight) >> 8);
+    }
+    if (counter_window + 1 == window) {
+        return (current * weight) >> 8;
+    }
+    return 0;
+}
+
+// If the rate has reached the threshold, call the callback (once per window)
+void check_threshold(rate_counter &counter, uint64_t window, uint64_t rate, uint64_t threshold,
+        const void *site, const std::type_info *type, unsigned cpu) noexcept
+{
+    if (threshold == 0 || rate < threshold) {
+        return;
+    }
+
+    uint64_t alerted = __atomic_load_n(&counter.alerted, __ATOMIC_RELAXED);
+    if (alerted == window + 1 || !__atomic_compare_exchange_n(&counter.alerted, &alerted,
+            window + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    bmcxxabi_throw_storm_callback callback = config.callback;
+    if (callback != nullptr) {
+        bmcxxabi_throw_storm storm = { site, type, rate, cpu };
+        callback(&storm);
+    }
+}
+
+} // anon namespace
+
+void throw_governor_record(const void *site, const std::type_info *type) noexcept
+{
+    unsigned cpu = BMCXX_CPU_ID();
+    governor_table &table = governor_tables[cpu % BMCXX_THROW_GOVERNOR_CPUS];
+
+    uint64_t window_len = config.window;
+    uint64_t now = bmcxx_cycle_count();
+    uint64_t window = now / window_len;
+    uint64_t weight = previous_weight(now, window_len);
+
+    uint64_t rate = counter_add(table.cpu_counter, window, weight);
+    check_threshold(table.cpu_counter, window, rate, config.cpu_threshold, nullptr, nullptr, cpu);
+
+    governor_entry *entry = find_entry(table, any_site, type);
+    if (entry != nullptr) {
+        rate = counter_add(entry->counter, window, weight);
+        check_threshold(entry->counter, window, rate, config.type_threshold, nullptr, type, cpu);
+    }
+
+    entry = find_entry(table, site, type);
+    if (entry != nullptr) {
+        rate = counter_add(entry->counter, window, weight);
+        check_threshold(entry->counter, window, rate, config.site_threshold, site, type, cpu);
+    }
+}
+
+// Set the configuration (and enable the governor), or, given null, disable the governor. The
+// counts are kept while disabled, but (unless they are very recent) no longer contribute to the
+// rates when it is re-enabled.
+extern "C"
+void bmcxxabi_throw_governor_configure(const bmcxxabi_throw_governor_config *new_config)
+{
+    __atomic_store_n(&throw_governor_enabled, 0, __ATOMIC_RELAXED);
+    if (new_config == nullptr) {
+        return;
+    }
+
+    bmcxxabi_throw_governor_config c = *new_config;
+    if (c.window == 0) {
+        c.window = 1;
+    }
+    config = c;
+    __atomic_store_n(&throw_governor_enabled, 1, __ATOMIC_RELEASE);
+}
+
+// Merge the per-CPU tables into the given array, highest rate first. Sites and types with no
+// throws in the window are omitted.
+extern "C"
+size_t bmcxxabi_throw_governor_rates(bmcxxabi_throw_rate *rates, size_t max,
+        unsigned long long *total_rate)
+{
+    uint64_t window_len = config.window != 0 ? config.window : 1;
+    uint64_t now = bmcxx_cycle_count();
+    uint64_t window = now / window_len;
+    uint64_t weight = previous_weight(now, window_len);
+
+    size_t num_rates = 0;
+    unsigned long long all_rate = 0;
+
+    for (governor_table &table : governor_tables) {
+        all_rate += counter_rate(table.cpu_counter, window, weight);
+
+        for (governor_entry &entry : table.entries) {
+            const void *site = __atomic_load_n(&entry.site, __ATOMIC_ACQUIRE);
+            const std::type_info *type = __atomic_load_n(&entry.type, __ATOMIC_ACQUIRE);
+            if (site == nullptr || type == nullptr) {
+                continue;
+            }
+            uint64_t rate = counter_rate(entry.counter, window, weight);
+            if (rate == 0) {
+                continue;
+            }
+            if (site == any_site) {
+                site = nullptr;
+            }
+
+            size_t i = 0;
+            while (i < num_rates && (rates[i].site != site || rates[i].type != type)) {
+                ++i;
+            }
+            if (i == num_rates) {
+                if (num_rates == max) {
+                    continue;
+                }
+                rates[i] = {site, type, 0, 0};
+                ++num_rates;
+            }
+            rates[i].rate += rate;
+            rates[i].total += __atomic_load_n(&entry.counter.total, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Insertion sort, by descending rate
+    for (size_t i = 1; i < num_rates; ++i) {
+        bmcxxabi_throw_rate r = rates[i];
+        size_t j = i;
+        for ( ; j > 0 && rates[j - 1].rate < r.rate; --j) {
+            rates[j] = rates[j - 1];
+        }
+        rates[j] = r;
+    }
+
+    if (total_rate != nullptr) {
+        *total_rate = all_rate;
+    }
+    return num_rates;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _THROW_GOVERNOR_H_INCLUDED
+#define _THROW_GOVERNOR_H_INCLUDED 1
+
+#include "config.h"
+
+// Throw-storm governor (built with BMCXX_THROW_GOVERNOR defined). See throw_governor.cc.
+
+#ifdef BMCXX_THROW_GOVERNOR
+
+namespace std {
+    class type_info;
+}
+
+// Non-zero while the governor is enabled (via bmcxxabi_throw_governor_configure). A throw
+// (raise_exception, in cxa_routines.cc) checks this, once it has filled in the exception header
+// and counted the exception as uncaught, and calls throw_governor_record only if it is set.
+extern char throw_governor_enabled;
+
+// Count a throw of the given type from the given site (return address of the __cxa_throw call),
+// and call the storm callback for any rate which has crossed its threshold
+void throw_governor_record(const void *site, const std::type_info *type) noexcept;
+
+#endif
+
+#endif
@@ -0,0 +1,191 @@
+// Throw-site profiler.
+//
+// When built with BMCXX_THROW_PROFILE defined, and enabled at run time via
+// bmcxxabi_throw_profile_enable, each throw (and rethrow) is counted against its throw site (the
+// return address of the __cxa_throw/__cxa_rethrow call) and the thrown type, along with the time
+// (in cycles) from the throw until the exception is caught. This makes it possible to find code
+// which throws at a high rate, eg using exceptions for control flow.
+//
+// Counts are kept in a table per CPU (BMCXX_THROW_PROFILE_CPUS tables, each of
+// BMCXX_THROW_PROFILE_SLOTS entries, which must be a power of 2), indexed by bmcxxabi_cpu_id(),
+// so that throws on different CPUs do not contend for the same cache lines. Entries are claimed
+// with atomic compare-and-exchange and counts are updated with atomic adds, so recording is
+// lock-free (and remains correct if a thread is migrated to another CPU part way through). An
+// entry, once claimed, keeps its key for the life of the program; since the number of distinct
+// (site, type) pairs is limited by the program's code, a table of adequate size does not fill.
+// Throws which cannot be recorded (because the table is full) are counted as dropped.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+#include "throw_profile.h"
+#include "threads.h"
+#include "../include/bmcxxabi.h"
+
+#ifdef BMCXX_THROW_PROFILE
+
+#ifndef BMCXX_THROW_PROFILE_SLOTS
+#define BMCXX_THROW_PROFILE_SLOTS 256
+#endif
+
+#ifndef BMCXX_THROW_PROFILE_CPUS
+#ifdef BMCXX_THREADS
+#define BMCXX_THROW_PROFILE_CPUS 16
+#else
+#define BMCXX_THROW_PROFILE_CPUS 1
+#endif
+#endif
+
+char throw_profile_enabled = 0;
+
+struct throw_profile_entry {
+    // The key; a null type means the entry has been claimed (site is set) but the type is not yet
+    // stored
+    const void *site;
+    const std::type_info *type;
+
+    uint64_t count;
+    uint64_t caught;
+    uint64_t cycles;
+};
+
+namespace {
+
+constexpr unsigned profile_slots = BMCXX_THROW_PROFILE_SLOTS;
+static_assert(profile_slots != 0 && (profile_slots & (profile_slots - 1)) == 0,
+        "BMCXX_THROW_PROFILE_SLOTS must be a power of 2");
+
+// Maximum number of slots examined (from the initial hash position) before giving up
+constexpr unsigned max_probes = profile_slots < 16 ? profile_slots : 16;
+
+struct alignas(64) profile_table {
+    throw_profile_entry entries[profile_slots];
+    uint64_t dropped;
+};
+
+profile_table profile_tables[BMCXX_THROW_PROFILE_CPUS];
+
+unsigned hash_key(const void *site, const std::type_info *type) noexcept
+{
+    uint64_t val = (uintptr_t)site ^ ((uintptr_t)type >> 3);
+    return (unsigned)((val * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+} // anon namespace
+
+throw_profile_entry *throw_profile_record(const void *site, const std::type_info *type) noexcept
+{
+    profile_table &table = profile_tables[BMCXX_CPU_ID() % BMCXX_THROW_PROFILE_CPUS];
+    unsigned hash = hash_key(site, type);
+
+    for (unsigned i = 0; i < max_probes; ++i) {
+        throw_profile_entry &entry = table.entries[(hash + i) & (profile_slots - 1)];
+        const void *entry_site = __atomic_load_n(&entry.site, __ATOMIC_ACQUIRE);
+        if (entry_site == nullptr) {
+            if (__atomic_compare_exchange_n(&entry.site, &entry_site, site, false,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&entry.type, type, __ATOMIC_RELEASE);
+                __atomic_fetch_add(&entry.count, 1, __ATOMIC_RELAXED);
+                return &entry;
+            }
+            // Lost a race to claim this entry; entry_site is now the winning site, check it
+        }
+
+        if (entry_site != site) {
+            continue;
+        }
+        // If the entry is concurrently being filled (type not yet stored), we don't wait for it
+        // but use another; the duplicate is merged when the tables are read.
+        if (__atomic_load_n(&entry.type, __ATOMIC_ACQUIRE) == type) {
+            __atomic_fetch_add(&entry.count, 1, __ATOMIC_RELAXED);
+            return &entry;
+        }
+    }
+
+    __atomic_fetch_add(&table.dropped, 1, __ATOMIC_RELAXED);
+    return nullptr;
+}
+
+void throw_profile_caught(throw_profile_entry *entry, uint64_t cycles) noexcept
+{
+    __atomic_fetch_add(&entry->caught, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->cycles, cycles, __ATOMIC_RELAXED);
+}
+
+extern "C"
+void bmcxxabi_throw_profile_enable(int enable)
+{
+    __atomic_store_n(&throw_profile_enabled, (char)(enable != 0), __ATOMIC_RELAXED);
+}
+
+// Merge the per-CPU tables into the given array, most frequent throws first. The count, caught
+// and cycles values of an entry are read separately, so may be mutually inconsistent if throws
+// occur concurrently.
+extern "C"
+size_t bmcxxabi_throw_profile_snapshot(bmcxxabi_throw_site *sites, size_t max,
+        unsigned long long *dropped)
+{
+    size_t num_sites = 0;
+    unsigned long long num_dropped = 0;
+
+    for (profile_table &table : profile_tables) {
+        num_dropped += __atomic_load_n(&table.dropped, __ATOMIC_RELAXED);
+        for (throw_profile_entry &entry : table.entries) {
+            const void *site = __atomic_load_n(&entry.site, __ATOMIC_ACQUIRE);
+            const std::type_info *type = __atomic_load_n(&entry.type, __ATOMIC_ACQUIRE);
+            uint64_t count = __atomic_load_n(&entry.count, __ATOMIC_RELAXED);
+            if (site == nullptr || type == nullptr || count == 0) {
+                continue;
+            }
+
+            size_t i = 0;
+            while (i < num_sites && (sites[i].site != site || sites[i].type != type)) {
+                ++i;
+            }
+            if (i == num_sites) {
+                if (num_sites == max) {
+                    num_dropped += count;
+                    continue;
+                }
+                sites[i] = {site, type, 0, 0, 0};
+                ++num_sites;
+            }
+            sites[i].count += count;
+            sites[i].caught += __atomic_load_n(&entry.caught, __ATOMIC_RELAXED);
+            sites[i].cycles += __atomic_load_n(&entry.cycles, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Insertion sort, by descending count
+    for (size_t i = 1; i < num_sites; ++i) {
+        bmcxxabi_throw_site s = sites[i];
+        size_t j = i;
+        for ( ; j > 0 && sites[j - 1].count < s.count; --j) {
+            sites[j] = sites[j - 1];
+        }
+        sites[j] = s;
+    }
+
+    if (dropped != nullptr) {
+        *dropped = num_dropped;
+    }
+    return num_sites;
+}
+
+// Zero all counts. (Throws recorded concurrently with the reset may or may not be counted, and
+// the time to catch an exception thrown before the reset may be added after it.)
+extern "C"
+void bmcxxabi_throw_profile_reset()
+{
+    for (profile_table &table : profile_tables) {
+        __atomic_store_n(&table.dropped, 0, __ATOMIC_RELAXED);
+        for (throw_profile_entry &entry : table.entries) {
+            __atomic_store_n(&entry.count, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&entry.caught, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&entry.cycles, 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef _THROW_PROFILE_H_INCLUDED
+#define _THROW_PROFILE_H_INCLUDED 1
+
+#include "config.h"
+
+// Throw-site profiler (built with BMCXX_THROW_PROFILE defined). See throw_profile.cc.
+
+#ifdef BMCXX_THROW_PROFILE
+
+#include <cstdint>
+
+namespace std {
+    class type_info;
+}
+
+struct throw_profile_entry;
+
+// Non-zero while profiling is enabled (via bmcxxabi_throw_profile_enable). __cxa_throw and
+// __cxa_rethrow check this before doing anything else.
+extern char throw_profile_enabled;
+
+// Record a throw of the given type from the given site (return address of the __cxa_throw or
+// __cxa_rethrow call). Returns the entry to which the time until the exception is caught should be
+// added, or nullptr if there is no room in the table.
+throw_profile_entry *throw_profile_record(const void *site, const std::type_info *type) noexcept;
+
+// Record that an exception recorded (via throw_profile_record) has been caught, after the given
+// number of cycles
+void throw_profile_caught(throw_profile_entry *entry, uint64_t cycles) noexcept;
+
+#endif
+
+#endif
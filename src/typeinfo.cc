@@ -6,7 +6,13 @@
 // The compiler then generates type_info objects with vtable pointers referring to these ABI
 // types.
 
+#include <cstddef>
+#include <cstdlib>
+
+#include "config.h"
 #include "../include/typeinfo"
+#include "stats.h"
+#include "threads.h"
 
 namespace std {
 
@@ -19,6 +25,7 @@ bool type_info::__do_catch(const type_info *thrown_type, void **thrown_obj, unsi
 
 bool type_info::__do_upcast(const __cxxabiv1::__class_type_info *target_type, void **obj_ptr) const noexcept
 {
+    stat_add(stat_do_upcast_calls);
     return false;
 }
 
@@ -31,6 +38,34 @@ const __cxxabiv1::__pointer_type_info *type_info::__as_pointer_type() const noex
 
 namespace __cxxabiv1 {
 
+#ifdef BMCXX_BOUNDED_LATENCY
+
+// In the bounded-latency mode, the number of base classes visited in matching a catch clause
+// against a thrown class type is limited; exceeding the limit aborts.
+#ifndef BMCXX_MAX_UPCAST_STEPS
+#define BMCXX_MAX_UPCAST_STEPS 256
+#endif
+
+// Steps remaining for the current match
+static BMCXX_THREAD_LOCAL unsigned upcast_steps_left;
+
+#endif
+
+static inline void reset_upcast_steps() noexcept
+{
+#ifdef BMCXX_BOUNDED_LATENCY
+    upcast_steps_left = BMCXX_MAX_UPCAST_STEPS;
+#endif
+}
+
+static inline void count_upcast_step() noexcept
+{
+#ifdef BMCXX_BOUNDED_LATENCY
+    if (upcast_steps_left == 0) abort();
+    --upcast_steps_left;
+#endif
+}
+
 // __fundamental_type_info
 
 // "the run-time support library should contain type_info objects for the types X, X* and
@@ -56,6 +91,9 @@ class __function_type_info : public std::type_info {};
 class __enum_type_info : public std::type_info {};
 
 
+// State of a dynamic_cast search (see __dynamic_cast below)
+struct dyncast_search;
+
 // __class_type_info : implements type_info for classes with no base classes, and provides a base
 // class for type_info structures representing classes *with* base classes.
 
@@ -75,6 +113,19 @@ public:
     //         subobject, or null)
     virtual bool __do_vmi_upcast(const __cxxabiv1::__class_type_info *target_type,
             void *current_subobj, void **found_subobj, int inh_flags) const noexcept;
+
+    // Visit the subobject of this class type at obj (and, in derived type_info classes, its
+    // bases) in a dynamic_cast search. dst_obj is the innermost enclosing subobject of the
+    // destination type, if any; path has dyncast_public_from_whole set if obj is reached from the
+    // complete object via public bases only, and dyncast_public_from_dst similarly for dst_obj.
+    virtual void __do_dyncast(dyncast_search &search, void *obj, void *dst_obj,
+            unsigned path) const noexcept;
+
+protected:
+    // Visit this subobject only (not its bases), updating dst_obj and path for the visit of the
+    // bases
+    void __dyncast_visit(dyncast_search &search, void *obj, void *&dst_obj, unsigned &path)
+            const noexcept;
 };
 
 __class_type_info::~__class_type_info() {}
@@ -94,6 +145,7 @@ bool __class_type_info::__do_catch(const std::type_info *thrown_type, void **thr
         return false;
     }
 
+    reset_upcast_steps();
     return thrown_type->__do_upcast(this, thrown_obj);
 }
 
@@ -110,6 +162,60 @@ bool __class_type_info::__do_vmi_upcast(const __cxxabiv1::__class_type_info *tar
     return true;
 }
 
+// A subobject found by a dynamic_cast search: if the same type is found at different addresses,
+// it is ambiguous; if found at the same address (a virtual base, via several paths) it is public
+// if any of the paths is public.
+struct dyncast_result {
+    void *obj = nullptr;
+    bool is_public = false;
+    bool ambiguous = false;
+
+    void add(void *found_obj, bool found_public) noexcept
+    {
+        if (obj != nullptr && obj != found_obj) {
+            ambiguous = true;
+        }
+        obj = found_obj;
+        is_public |= found_public;
+    }
+};
+
+struct dyncast_search {
+    const __class_type_info *src_type;
+    const void *src_obj;
+    const __class_type_info *dst_type;
+
+    dyncast_result down;   // the destination subobject containing the source (downcast)
+    dyncast_result cross;  // destination subobjects of the complete object (cross-cast)
+    bool src_public = false; // source is reached from the complete object via public bases
+};
+
+static const unsigned dyncast_public_from_whole = 0x1;
+static const unsigned dyncast_public_from_dst = 0x2;
+
+void __class_type_info::__dyncast_visit(dyncast_search &search, void *obj, void *&dst_obj,
+        unsigned &path) const noexcept
+{
+    count_upcast_step();
+    if (*this == *search.dst_type) {
+        search.cross.add(obj, path & dyncast_public_from_whole);
+        dst_obj = obj;
+        path |= dyncast_public_from_dst;
+    }
+    else if (obj == search.src_obj && *this == *search.src_type) {
+        search.src_public |= (path & dyncast_public_from_whole) != 0;
+        if (dst_obj != nullptr) {
+            search.down.add(dst_obj, path & dyncast_public_from_dst);
+        }
+    }
+}
+
+void __class_type_info::__do_dyncast(dyncast_search &search, void *obj, void *dst_obj,
+        unsigned path) const noexcept
+{
+    __dyncast_visit(search, obj, dst_obj, path);
+}
+
 // __si_class_type_info : type_info for class with single inheritance
 
 class __si_class_type_info : public __class_type_info
@@ -119,13 +225,25 @@ public:
     virtual ~__si_class_type_info() override;
     virtual bool __do_upcast(const __cxxabiv1::__class_type_info *__target_type, void **__obj_ptr)
             const noexcept override;
+    virtual void __do_dyncast(dyncast_search &search, void *obj, void *dst_obj,
+            unsigned path) const noexcept override;
 };
 
 __si_class_type_info::~__si_class_type_info() {}
 
+void __si_class_type_info::__do_dyncast(dyncast_search &search, void *obj, void *dst_obj,
+        unsigned path) const noexcept
+{
+    // The single base is public, non-virtual and at offset 0
+    __dyncast_visit(search, obj, dst_obj, path);
+    __base_type->__do_dyncast(search, obj, dst_obj, path);
+}
+
 bool __si_class_type_info::__do_upcast(const __cxxabiv1::__class_type_info *target_type,
         void **obj_ptr) const noexcept
 {
+    stat_add(stat_do_upcast_calls);
+    count_upcast_step();
     if (*__base_type == *target_type) {
         return true;
     }
@@ -277,6 +395,8 @@ public:
             const noexcept override;
     virtual bool __do_vmi_upcast(const __cxxabiv1::__class_type_info *target_type,
             void *current_subobj, void **found_subobj, int inh_flags) const noexcept override;
+    virtual void __do_dyncast(dyncast_search &search, void *obj, void *dst_obj,
+            unsigned path) const noexcept override;
 };
 
 static void *get_base_subobj(const __base_class_type_info *base_info, void *this_obj)
@@ -297,10 +417,12 @@ static void *get_base_subobj(const __base_class_type_info *base_info, void *this
 bool __vmi_class_type_info::__do_upcast(const __cxxabiv1::__class_type_info *target_type,
         void **obj_ptr) const noexcept
 {
+    stat_add(stat_do_upcast_calls);
     void *found_subobj = nullptr;
     for (unsigned i = 0; i < __base_count; ++i) {
         if (!(__base_info[i].__offset_flags & __base_class_type_info::__public_mask))
             continue;
+        count_upcast_step();
         void *base_subobj = get_base_subobj(&__base_info[i], *obj_ptr);
         if (*__base_info[i].__base_type == *target_type) {
             if (found_subobj == nullptr) {
@@ -341,6 +463,7 @@ bool __vmi_class_type_info::__do_vmi_upcast(const __cxxabiv1::__class_type_info
     for (unsigned i = 0; i < __base_count; ++i) {
         if (!(__base_info[i].__offset_flags & __base_class_type_info::__public_mask))
             continue;
+        count_upcast_step();
         void *base_subobj = get_base_subobj(&__base_info[i], current_subobj);
         if (*__base_info[i].__base_type == *target_type) {
             if (*found_subobj == nullptr) {
@@ -369,4 +492,66 @@ bool __vmi_class_type_info::__do_vmi_upcast(const __cxxabiv1::__class_type_info
     return true;
 }
 
+void __vmi_class_type_info::__do_dyncast(dyncast_search &search, void *obj, void *dst_obj,
+        unsigned path) const noexcept
+{
+    __dyncast_visit(search, obj, dst_obj, path);
+    for (unsigned i = 0; i < __base_count; ++i) {
+        unsigned base_path = path;
+        if (!(__base_info[i].__offset_flags & __base_class_type_info::__public_mask)) {
+            base_path &= ~(dyncast_public_from_whole | dyncast_public_from_dst);
+        }
+        void *base_subobj = get_base_subobj(&__base_info[i], obj);
+        __base_info[i].__base_type->__do_dyncast(search, base_subobj, dst_obj, base_path);
+    }
+}
+
+// dynamic_cast from src_ptr, pointing to a subobject of (static) type src_type, to dst_type.
+// src2dst_offset is a hint from the compiler: if >= 0, src_type is a unique public non-virtual base
+// of dst_type at that offset; -1: no hint; -2: src_type is not a public base of dst_type; -3:
+// src_type is a multiple public (non-virtual) base of dst_type.
+//
+// The result is, in order of preference: the unique destination subobject of which the source is a
+// public base (downcast); if the source is a public base of the complete object, the unique public
+// destination subobject of the complete object (cross-cast); otherwise, null. Casts to void * and
+// to an unambiguous public base are done by the compiler without calling this.
+extern "C" void *__dynamic_cast(const void *src_ptr, const __class_type_info *src_type,
+        const __class_type_info *dst_type, ptrdiff_t src2dst_offset)
+{
+    // The vtable holds the offset of the complete object, and its type_info, just before the
+    // address point
+    const void * const *vtable = *(const void * const * const *)src_ptr;
+    ptrdiff_t offset_to_top = ((const ptrdiff_t *)vtable)[-2];
+    const __class_type_info *whole_type = (const __class_type_info *)vtable[-1];
+    void *whole_obj = (char *)const_cast<void *>(src_ptr) + offset_to_top;
+
+    if (*whole_type == *dst_type) {
+        // The common case: a downcast to the complete object's type. With a hint, the answer is
+        // known without a search.
+        if (src2dst_offset >= 0) {
+            return ((const char *)src_ptr - src2dst_offset == whole_obj) ? whole_obj : nullptr;
+        }
+        if (src2dst_offset == -2) {
+            return nullptr;
+        }
+    }
+
+    dyncast_search search;
+    search.src_type = src_type;
+    search.src_obj = src_ptr;
+    search.dst_type = dst_type;
+
+    reset_upcast_steps();
+    whole_type->__do_dyncast(search, whole_obj, nullptr, dyncast_public_from_whole);
+
+    if (search.down.obj != nullptr && !search.down.ambiguous && search.down.is_public) {
+        return search.down.obj;
+    }
+    if (search.src_public && search.cross.obj != nullptr && !search.cross.ambiguous
+            && search.cross.is_public) {
+        return search.cross.obj;
+    }
+    return nullptr;
+}
+
 } // namespace __cxxabiv1
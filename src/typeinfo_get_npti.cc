@@ -1,3 +1,4 @@
+#include "config.h"
 #include "../include/typeinfo"
 
 namespace __cxxabiv1 {
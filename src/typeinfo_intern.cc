@@ -0,0 +1,134 @@
+// Interning of type_info names.
+//
+// Two type_info objects for the same type may exist if the type is used in separately-linked
+// modules (eg loadable modules which are not linked against the main image). In that case each
+// module has its own copy of the type_info and its name, and the type_info objects should compare
+// equal since their names are equal by content. Rather than comparing names with strcmp on every
+// catch, we map each name to a canonical pointer (the first copy of that name registered), and,
+// when a module's type_info objects are registered (via bmcxxabi_intern_type_infos, typically as
+// the module is loaded and before its relocated data is made read-only), point each of them at the
+// canonical copy of its name. type_info equality then remains a single comparison of name
+// pointers, at no cost beyond that of registration. The main image's type_info objects should be
+// registered first, so that its names (which need not be writable) become the canonical ones.
+//
+// Names beginning with '*' are, by GCC convention, unique to the module (the type has internal
+// linkage); those are never interned and are only ever compared by pointer.
+//
+// The table is fixed-size (BMCXX_TYPE_INTERN_SLOTS entries, must be a power of 2) and is never
+// allocated dynamically. A name which can't be entered because the table is full is left as it
+// is, and registration reports it. Entries are inserted with atomic compare-and-exchange, so
+// lookup and insertion are lock-free.
+//
+// All of this is only built with BMCXX_TYPE_INTERN defined. Otherwise, type_info objects compare
+// equal only if they (or their name pointers) are identical, which suffices within a single image.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "config.h"
+#include "../include/typeinfo"
+
+#ifdef BMCXX_TYPE_INTERN
+
+#ifndef BMCXX_TYPE_INTERN_SLOTS
+#define BMCXX_TYPE_INTERN_SLOTS 512
+#endif
+
+namespace {
+
+constexpr unsigned intern_slots = BMCXX_TYPE_INTERN_SLOTS;
+static_assert(intern_slots != 0 && (intern_slots & (intern_slots - 1)) == 0,
+        "BMCXX_TYPE_INTERN_SLOTS must be a power of 2");
+
+// Maximum number of slots examined (from the initial hash position) before giving up
+constexpr unsigned max_probes = intern_slots < 16 ? intern_slots : 16;
+
+// Canonical names, keyed by name contents. The hash is stored (as non-zero) to avoid most string
+// comparisons; a zero hash means the slot has been claimed but the hash not yet stored.
+struct name_slot {
+    const char *name;
+    uint32_t hash;
+};
+
+name_slot name_table[intern_slots];
+
+// FNV-1a hash of name, forced non-zero
+uint32_t hash_name(const char *name) noexcept
+{
+    uint32_t hash = 2166136261u;
+    while (*name != 0) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash | 1;
+}
+
+// Find the canonical pointer for the given name, inserting it as canonical if not yet present.
+// Returns nullptr if the table is full.
+const char *intern_name(const char *name) noexcept
+{
+    uint32_t hash = hash_name(name);
+
+    for (unsigned i = 0; i < max_probes; ++i) {
+        name_slot &slot = name_table[(hash + i) & (intern_slots - 1)];
+        const char *slot_name = __atomic_load_n(&slot.name, __ATOMIC_ACQUIRE);
+        if (slot_name == nullptr) {
+            if (__atomic_compare_exchange_n(&slot.name, &slot_name, name, false, __ATOMIC_ACQ_REL,
+                    __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&slot.hash, hash, __ATOMIC_RELAXED);
+                return name;
+            }
+            // Lost a race to fill this slot; slot_name is now the winning name, check it
+        }
+
+        uint32_t slot_hash = __atomic_load_n(&slot.hash, __ATOMIC_RELAXED);
+        if (slot_hash != 0 && slot_hash != hash) {
+            continue;
+        }
+        if (slot_name == name || strcmp(slot_name, name) == 0) {
+            return slot_name;
+        }
+    }
+
+    return nullptr;
+}
+
+} // anon namespace
+
+namespace std {
+
+bool type_info::__intern() const noexcept
+{
+    if (__type_name[0] == '*') {
+        return true;
+    }
+
+    const char *canon = intern_name(__type_name);
+    if (canon == nullptr) {
+        return false;
+    }
+    if (canon != __type_name) {
+        // (only written if it differs, since the main image's type_info objects may be read-only)
+        __atomic_store_n(&const_cast<type_info *>(this)->__type_name, canon, __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+} // namespace std
+
+// Intern the names of a set of type_info objects, eg those of a module being loaded; return the
+// number which couldn't be interned because the table is full.
+extern "C"
+size_t bmcxxabi_intern_type_infos(const std::type_info * const *tinfos, size_t count)
+{
+    size_t failed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!tinfos[i]->__intern()) {
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+#endif
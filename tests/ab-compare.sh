@@ -0,0 +1,45 @@
+# Build the A/B comparison workloads (ab_workloads.cc) against this library (hosted build),
+# libsupc++ and, if available, libc++abi; run each, and print a table of the results (median time
+# per operation, with the ratio of each runtime to libsupc++). Arguments are passed to the
+# workload programs (eg "-n <samples>", or a workload name filter). Per-runtime results, with
+# 99th percentiles, are left in ab-<runtime>.out.
+set -eu
+
+make -s ab-bmcxx ab-libsupc++
+runtimes="bmcxx libsupc++"
+if make -s ab-libc++abi >/dev/null 2>&1; then
+    runtimes="$runtimes libc++abi"
+else
+    echo "(libc++abi not found - set LIBCXXABI to its linker options; skipping)" >&2
+fi
+
+files=""
+for rt in $runtimes; do
+    ./ab-$rt "$@" > ab-$rt.out
+    files="$files ab-$rt.out"
+done
+
+awk -F '\t' -v runtimes="$runtimes" '
+    BEGIN { nrt = split(runtimes, rt, " ") }
+    FNR == 1 { ++file; next }
+    {
+        if (file == 1) { order[++n] = $1; unit[$1] = $2 }
+        median[file, $1] = $3
+    }
+    END {
+        printf "%-20s %-7s", "workload", "unit"
+        for (i = 1; i <= nrt; ++i) printf " %10s", rt[i]
+        for (i = 1; i <= nrt; ++i) if (i != 2) printf " %10s", rt[i] "/supc"
+        printf "\n"
+        for (j = 1; j <= n; ++j) {
+            w = order[j]
+            printf "%-20s %-7s", w, unit[w]
+            for (i = 1; i <= nrt; ++i) printf " %10s", median[i, w]
+            for (i = 1; i <= nrt; ++i) {
+                if (i == 2) continue
+                if (median[2, w] > 0) printf " %10.2f", median[i, w] / median[2, w]
+                else printf " %10s", "-"
+            }
+            printf "\n"
+        }
+    }' $files
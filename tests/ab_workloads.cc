@@ -0,0 +1,278 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <typeinfo>
+
+#include "harness.h"
+
+// A/B comparison workloads: exceptions, static-initialisation guards, __cxa_atexit registration,
+// dynamic_cast and the global allocation functions. This is compiled against the host C++ headers and
+// linked (see Makefile) with no C++ library other than the ABI runtime under test, which may be
+// BMCXXABI (hosted build), libsupc++ or libc++abi; so it must not use anything from the C++
+// library proper. ab-compare.sh runs each build and tabulates the results.
+//
+// Usage: ab-<runtime> [-n <samples>] [<name-filter>]
+//
+// Output is tab-separated, with a header line:
+//
+//     workload  unit  median  p99
+//
+// giving the time per operation (TSC cycles on x86, nanoseconds elsewhere). Cheap operations are
+// timed in batches, so that the timer overhead doesn't dominate.
+
+extern "C" int __cxa_guard_acquire(int64_t *guard);
+extern "C" void __cxa_guard_release(int64_t *guard);
+extern "C" int __cxa_atexit(void (*f)(void *), void *p, void *d);
+extern "C" void *__dso_handle;
+
+extern const char harness_name[] = "ab-workloads";
+
+namespace {
+
+unsigned num_samples = 2000;
+const char *filter = nullptr;
+uint64_t *samples;
+volatile unsigned sink;
+
+// Class hierarchies for catch matching
+
+struct Root { int v = 1; };
+struct L1 : Root {};
+struct L2 : L1 {};
+struct L3 : L2 {};
+struct L4 : L3 {};
+
+struct VBase { int v = 2; };
+struct VLeft : virtual VBase { int l = 0; };
+struct VRight : virtual VBase { int r = 0; };
+struct VDiamond : VLeft, VRight {};
+
+struct Other { int o = 3; };
+
+// Polymorphic hierarchies for dynamic_cast
+struct PRoot { virtual ~PRoot() {} int v = 1; };
+struct PL1 : PRoot {};
+struct PL2 : PL1 {};
+struct PL3 : PL2 {};
+struct PL4 : PL3 {};
+
+struct PBase { virtual ~PBase() {} int v = 2; };
+struct PLeft : virtual PBase { int l = 0; };
+struct PRight : virtual PBase { int r = 0; };
+struct PDiamond : PLeft, PRight {};
+
+struct POther { virtual ~POther() {} int o = 3; };
+
+struct Cleanup {
+    ~Cleanup() { sink = sink + 1; }
+};
+
+__attribute__((noinline)) void throw_int(unsigned depth)
+{
+    if (depth <= 1) throw 1;
+    throw_int(depth - 1);
+    asm volatile("");  // not a tail call
+}
+
+__attribute__((noinline)) void throw_with_cleanups(unsigned depth)
+{
+    Cleanup c;
+    if (depth <= 1) throw 1;
+    throw_with_cleanups(depth - 1);
+}
+
+__attribute__((noinline)) void throw_l4()
+{
+    throw L4();
+}
+
+__attribute__((noinline)) void throw_diamond()
+{
+    throw VDiamond();
+}
+
+void noop_exit_func(void *)
+{
+}
+
+// Run a workload: each sample times "batch" calls of body (after a warm-up call), and the result
+// is the time per call.
+template <typename F>
+void run(const char *name, unsigned batch, F body)
+{
+    if (filter != nullptr && strstr(name, filter) == nullptr) return;
+
+    body(0);
+    for (unsigned i = 0; i < num_samples; ++i) {
+        uint64_t start = now();
+        for (unsigned j = 0; j < batch; ++j) {
+            body(i * batch + j);
+        }
+        samples[i] = (now() - start) / batch;
+    }
+
+    qsort(samples, num_samples, sizeof(uint64_t), compare_u64);
+    unsigned p99 = (unsigned)((num_samples - 1) * 0.99);
+    printf("%s\t%s\t%llu\t%llu\n", name, time_unit, (unsigned long long)samples[num_samples / 2],
+            (unsigned long long)samples[p99]);
+}
+
+[[noreturn]] void fail(const char *name)
+{
+    fprintf(stderr, "ab-workloads: %s: wrong result\n", name);
+    exit(1);
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            num_samples = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argv[i][0] != '-' && filter == nullptr) {
+            filter = argv[i];
+        }
+        else {
+            fprintf(stderr, "usage: ab-<runtime> [-n <samples>] [<name-filter>]\n");
+            return 1;
+        }
+    }
+    if (num_samples == 0) num_samples = 1;
+    samples = (uint64_t *)malloc(num_samples * sizeof(uint64_t));
+    if (samples == nullptr) return 1;
+
+    printf("workload\tunit\tmedian\tp99\n");
+
+    // Exceptions
+
+    run("throw_catch", 1, [](unsigned) {
+        try {
+            throw_int(1);
+        }
+        catch (int i) {
+            if (i != 1) fail("throw_catch");
+        }
+    });
+
+    run("throw_depth16", 1, [](unsigned) {
+        try {
+            throw_int(16);
+        }
+        catch (int) {
+        }
+    });
+
+    run("throw_cleanups8", 1, [](unsigned) {
+        try {
+            throw_with_cleanups(8);
+        }
+        catch (int) {
+        }
+    });
+
+    run("catch_si_base", 1, [](unsigned) {
+        try {
+            throw_l4();
+        }
+        catch (Other &) {
+            fail("catch_si_base");
+        }
+        catch (Root &r) {
+            if (r.v != 1) fail("catch_si_base");
+        }
+    });
+
+    run("catch_virtual_base", 1, [](unsigned) {
+        try {
+            throw_diamond();
+        }
+        catch (Other &) {
+            fail("catch_virtual_base");
+        }
+        catch (VBase &b) {
+            if (b.v != 2) fail("catch_virtual_base");
+        }
+    });
+
+    run("catch_all", 1, [](unsigned) {
+        try {
+            throw_l4();
+        }
+        catch (...) {
+        }
+    });
+
+    run("rethrow", 1, [](unsigned) {
+        try {
+            try {
+                throw_l4();
+            }
+            catch (L2 &) {
+                throw;
+            }
+        }
+        catch (Root &r) {
+            if (r.v != 1) fail("rethrow");
+        }
+    });
+
+    // Static-initialisation guards: first-time initialisation (acquire and release on a new
+    // guard), and acquire on an already-initialised guard. (The compiler checks the guard
+    // inline before calling __cxa_guard_acquire, so the second case is normally rare.)
+
+    static int64_t guards[4096];
+    run("guard_first_init", 64, [](unsigned i) {
+        int64_t *g = &guards[i % 4096];
+        *g = 0;
+        if (!__cxa_guard_acquire(g)) fail("guard_first_init");
+        __cxa_guard_release(g);
+    });
+
+    run("guard_initialised", 64, [](unsigned i) {
+        if (__cxa_guard_acquire(&guards[i % 4096])) fail("guard_initialised");
+    });
+
+    // Exit-time destructor registration (the registered functions run, harmlessly, at exit)
+
+    run("atexit_register", 16, [](unsigned) {
+        if (__cxa_atexit(noop_exit_func, nullptr, &__dso_handle) != 0) fail("atexit_register");
+    });
+
+    // RTTI: dynamic_cast (__dynamic_cast). type_info comparison and ordering are inline in the
+    // host header, and catch matching is covered above. The objects are reached through volatile
+    // pointers so that the compiler can't determine their dynamic types.
+
+    static PL4 pl4;
+    static PDiamond pdiamond;
+    static PRoot *volatile proot = &pl4;
+    static PLeft *volatile pleft = &pdiamond;
+
+    run("dyncast_down_whole", 64, [](unsigned) {
+        if (dynamic_cast<PL4 *>(proot) != &pl4) fail("dyncast_down_whole");
+    });
+
+    run("dyncast_down_inner", 64, [](unsigned) {
+        if (dynamic_cast<PL2 *>(proot) != &pl4) fail("dyncast_down_inner");
+    });
+
+    run("dyncast_cross_vbase", 64, [](unsigned) {
+        if (dynamic_cast<PRight *>(pleft) != &pdiamond) fail("dyncast_cross_vbase");
+    });
+
+    run("dyncast_fail", 64, [](unsigned) {
+        if (dynamic_cast<POther *>(proot) != nullptr) fail("dyncast_fail");
+    });
+
+    // Global allocation functions
+
+    run("new_delete", 64, [](unsigned i) {
+        char *volatile p = new char[16 + (i & 63)];
+        delete[] p;
+    });
+
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,4 @@
+set -eu
+make -C .. OUTDIR="${PWD}"
+g++ -O2 -o bench-throw bench_throw.cc -L. -lcxxabi
+echo "Now run ./bench-throw"
@@ -0,0 +1,414 @@
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../include/bmcxxabi.h"
+
+#include "harness.h"
+
+// Throw-to-catch latency benchmark. Built (like the test suite) against libcxxabi.a, via
+// bench.sh. Each benchmark runs a number of iterations of a try/catch, timing each iteration
+// from entry to the try block until the handler has completed, and reports the median, 99th
+// percentile and minimum.
+//
+// Usage: bench-throw [-n <iterations>] [-m] [<name-filter>]
+//
+// Output is tab-separated, with a header line:
+//
+//     benchmark  param  unit  iterations  median  p99  min
+//
+// With -m, the memory footprint of each throw is also reported, in three more columns:
+//
+//     hdr_bytes  hdr_lines  l1d_misses
+//
+// "hdr_bytes" is the size of the runtime's exception header (the distance from the header of a
+// caught exception to the thrown object), "hdr_lines" the mean number of cache lines spanned by the
+// header and the first 8 bytes of the thrown object (all of it, for every exception thrown here)
+// per caught exception ("-" if none is caught), and "l1d_misses" the mean number of L1 data cache
+// read misses per iteration (in user mode, via perf_event_open), or "-" if the counter isn't
+// available. Run via header-bench.sh to compare the default and compact
+// (BMCXX_COMPACT_EXCEPTION_HEADER) headers.
+//
+// On x86 the unit is TSC cycles ("cycles"), otherwise nanoseconds ("ns"). "param" is the unwind
+// depth or the number of cleanup frames, where applicable (otherwise 0). The "cancel_throw" and
+// "cancel_forced" benchmarks compare two ways of cancelling a task whose frames each have a
+// cleanup and a (non-matching) catch clause: throwing a sentinel exception, caught at the root,
+// and bmcxxabi_cancel_current_stack, stopped at the root via longjmp. Compare runs with eg
+// "join" on the first two columns.
+
+extern const char harness_name[] = "bench-throw";
+
+namespace {
+
+unsigned iterations = 10000;
+const char *filter = nullptr;
+uint64_t *samples;
+
+// For -m: the header size, the total of the cache lines spanned by the header (and thrown
+// object) of each exception caught and the number of those, and the L1D miss counter (or -1)
+bool measure_memory = false;
+size_t header_bytes;
+uint64_t header_lines;
+uint64_t headers_seen;
+int l1d_miss_fd = -1;
+
+const size_t cache_line = 64;
+
+// Count of caught exceptions / completed cleanups, checked after each benchmark so that the
+// compiler can't elide any of the work.
+volatile unsigned caught_count;
+volatile unsigned cleanup_count;
+
+struct Base {
+    int v = 1;
+};
+
+struct Derived : Base {
+    int w = 2;
+};
+
+Derived derived_obj;
+
+struct CleanupObj {
+    ~CleanupObj() { cleanup_count = cleanup_count + 1; }
+};
+
+// The header of the exception currently being handled, if any: the first member of the ABI's
+// per-thread exception state is the stack of caught exceptions, most recent first.
+extern "C" void *__cxa_get_globals() noexcept;
+
+inline uintptr_t current_header()
+{
+    return *(uintptr_t *)__cxa_get_globals();
+}
+
+void caught()
+{
+    caught_count = caught_count + 1;
+    if (measure_memory) {
+        uintptr_t header = current_header();
+        if (header != 0) {
+            uintptr_t last = header + header_bytes + 8 - 1;
+            header_lines += last / cache_line - header / cache_line + 1;
+            ++headers_seen;
+        }
+    }
+}
+
+// Throw from the specified depth (1 = from the called function itself)
+__attribute__((noinline)) void throw_at_depth(unsigned depth)
+{
+    if (depth <= 1) throw 1;
+    throw_at_depth(depth - 1);
+    asm volatile("");  // not a tail call
+}
+
+// As throw_at_depth, but each frame has a cleanup (a local with a destructor)
+__attribute__((noinline)) void throw_with_cleanups(unsigned depth)
+{
+    CleanupObj obj;
+    if (depth <= 1) throw 1;
+    throw_with_cleanups(depth - 1);
+}
+
+struct Cancelled {
+};
+
+// The root of a task cancelled by bmcxxabi_cancel_current_stack: the stop function returns here
+struct cancel_root {
+    jmp_buf env;
+};
+
+// Stop at the root's frame, which is the first with a canonical frame address above the jmp_buf
+// (in the root's frame)
+void cancel_stop(void *cfa, void *ctx)
+{
+    cancel_root *root = (cancel_root *)ctx;
+    if ((uintptr_t)cfa > (uintptr_t)root) {
+        longjmp(root->env, 1);
+    }
+}
+
+// A task frame, with a cleanup and a catch clause which the cancellation doesn't match; cancels
+// at the specified depth, via a sentinel exception or (if root is not null) a forced unwind
+__attribute__((noinline)) void cancel_at_depth(unsigned depth, cancel_root *root)
+{
+    CleanupObj obj;
+    try {
+        if (depth <= 1) {
+            if (root != nullptr) bmcxxabi_cancel_current_stack(cancel_stop, root);
+            throw Cancelled();
+        }
+        cancel_at_depth(depth - 1, root);
+    }
+    catch (Derived &) {
+        abort();
+    }
+}
+
+// Run a task cancelled via bmcxxabi_cancel_current_stack
+__attribute__((noinline)) void run_forced_cancel(unsigned depth)
+{
+    cancel_root root;
+    if (setjmp(root.env) == 0) {
+        cancel_at_depth(depth, &root);
+    }
+    else {
+        caught();
+    }
+}
+
+__attribute__((noinline)) void throw_derived()
+{
+    throw Derived();
+}
+
+__attribute__((noinline)) void throw_derived_ptr()
+{
+    throw &derived_obj;
+}
+
+// Open a counter of L1 data cache read misses in user mode for this thread (initially disabled),
+// or return -1 if it isn't available (eg in a virtual machine without a PMU)
+int open_l1d_miss_counter()
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// The size of the runtime's exception header
+size_t measure_header_bytes()
+{
+    try {
+        throw_derived();
+    }
+    catch (Derived &d) {
+        return (uintptr_t)&d - current_header();
+    }
+    return 0;
+}
+
+// Run a benchmark: body is run once per iteration (plus a warm-up run) and must perform exactly
+// "expect_caught" catches and "expect_cleanups" cleanups per iteration.
+template <typename F>
+void run(const char *name, unsigned param, unsigned expect_caught, unsigned expect_cleanups,
+        F body)
+{
+    if (filter != nullptr && strstr(name, filter) == nullptr) return;
+
+    body();
+    caught_count = 0;
+    cleanup_count = 0;
+    header_lines = 0;
+    headers_seen = 0;
+
+    if (l1d_miss_fd >= 0) {
+        ioctl(l1d_miss_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(l1d_miss_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    for (unsigned i = 0; i < iterations; ++i) {
+        uint64_t start = now();
+        body();
+        samples[i] = now() - start;
+    }
+
+    uint64_t misses = 0;
+    if (l1d_miss_fd >= 0) {
+        ioctl(l1d_miss_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(l1d_miss_fd, &misses, sizeof(misses)) != sizeof(misses)) {
+            misses = 0;
+        }
+    }
+
+    if (caught_count != iterations * expect_caught
+            || cleanup_count != iterations * expect_cleanups) {
+        fprintf(stderr, "bench-throw: %s/%u: wrong catch or cleanup count\n", name, param);
+        exit(1);
+    }
+
+    qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+    unsigned p99 = (unsigned)((iterations - 1) * 0.99);
+    printf("%s\t%u\t%s\t%u\t%llu\t%llu\t%llu", name, param, time_unit, iterations,
+            (unsigned long long)samples[iterations / 2], (unsigned long long)samples[p99],
+            (unsigned long long)samples[0]);
+    if (measure_memory) {
+        printf("\t%zu", header_bytes);
+        if (headers_seen != 0) {
+            printf("\t%.2f", (double)header_lines / headers_seen);
+        }
+        else {
+            printf("\t-");
+        }
+        if (l1d_miss_fd >= 0) {
+            printf("\t%.2f", (double)misses / iterations);
+        }
+        else {
+            printf("\t-");
+        }
+    }
+    printf("\n");
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "-m") == 0) {
+            measure_memory = true;
+        }
+        else if (argv[i][0] != '-' && filter == nullptr) {
+            filter = argv[i];
+        }
+        else {
+            fprintf(stderr, "usage: bench-throw [-n <iterations>] [-m] [<name-filter>]\n");
+            return 1;
+        }
+    }
+    if (iterations == 0) iterations = 1;
+    samples = (uint64_t *)malloc(iterations * sizeof(uint64_t));
+    if (samples == nullptr) return 1;
+
+    if (measure_memory) {
+        header_bytes = measure_header_bytes();
+        l1d_miss_fd = open_l1d_miss_counter();
+        printf("benchmark\tparam\tunit\titerations\tmedian\tp99\tmin\thdr_bytes\thdr_lines"
+                "\tl1d_misses\n");
+    }
+    else {
+        printf("benchmark\tparam\tunit\titerations\tmedian\tp99\tmin\n");
+    }
+
+    static const unsigned depths[] = { 1, 4, 16, 64 };
+
+    for (unsigned depth : depths) {
+        run("depth", depth, 1, 0, [=] {
+            try {
+                throw_at_depth(depth);
+            }
+            catch (int) {
+                caught();
+            }
+        });
+    }
+
+    for (unsigned depth : depths) {
+        run("cleanups", depth, 1, depth, [=] {
+            try {
+                throw_with_cleanups(depth);
+            }
+            catch (int) {
+                caught();
+            }
+        });
+    }
+
+    for (unsigned depth : depths) {
+        run("cancel_throw", depth, 1, depth, [=] {
+            try {
+                cancel_at_depth(depth, nullptr);
+            }
+            catch (Cancelled &) {
+                caught();
+            }
+        });
+    }
+
+    for (unsigned depth : depths) {
+        run("cancel_forced", depth, 1, depth, [=] {
+            run_forced_cancel(depth);
+        });
+    }
+
+    run("catch_value", 0, 1, 0, [] {
+        try {
+            throw_derived();
+        }
+        catch (Base b) {
+            if (b.v == 1) caught();
+        }
+    });
+
+    run("catch_ref", 0, 1, 0, [] {
+        try {
+            throw_derived();
+        }
+        catch (Base &b) {
+            if (b.v == 1) caught();
+        }
+    });
+
+    run("catch_ptr", 0, 1, 0, [] {
+        try {
+            throw_derived_ptr();
+        }
+        catch (Base *b) {
+            if (b->v == 1) caught();
+        }
+    });
+
+    run("catch_all", 0, 1, 0, [] {
+        try {
+            throw_derived();
+        }
+        catch (...) {
+            caught();
+        }
+    });
+
+    // Rethrow (via __cxa_rethrow) from a handler, caught by an outer handler: two throws
+    run("rethrow", 0, 2, 0, [] {
+        try {
+            try {
+                throw_derived();
+            }
+            catch (Base &) {
+                caught();
+                throw;
+            }
+        }
+        catch (Derived &) {
+            caught();
+        }
+    });
+
+    // A new exception thrown and caught within a handler: two throws, with two exceptions
+    // active at once
+    run("nested", 0, 2, 0, [] {
+        try {
+            throw_derived();
+        }
+        catch (Base &) {
+            try {
+                throw_at_depth(1);
+            }
+            catch (int) {
+                caught();
+            }
+            caught();
+        }
+    });
+
+    if (l1d_miss_fd >= 0) close(l1d_miss_fd);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,11 @@
+# Build the catch matrix harness (catch-matrix), fill in its catch matrix with bmcxx-catchgen (into
+# catch-matrix-filled), and run both. The exit status is non-zero if either fails its checks.
+set -eu
+
+make -s -C ../tools bmcxx-catchgen
+make -s catch-matrix
+../tools/bmcxx-catchgen -v -o catch-matrix-filled catch-matrix
+chmod +x catch-matrix-filled
+
+./catch-matrix
+./catch-matrix-filled -m
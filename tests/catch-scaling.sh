@@ -0,0 +1,36 @@
+# Run the catch-matching benchmark (catch-bench) over a range of generated hierarchy shapes, and
+# print the combined results (one header line, then one line per configuration and category of
+# catch/thrown pair). Arguments are passed to catch-bench (eg "-n <samples>").
+#
+# The shapes can be overridden via the environment: DEPTHS, FANOUTS and VDENSITIES (each a
+# space-separated list); WIDTH, PTR_LEVELS and SEED (single values).
+set -eu
+
+DEPTHS=${DEPTHS:-"1 2 4 8"}
+FANOUTS=${FANOUTS:-"1 2 3"}
+VDENSITIES=${VDENSITIES:-"0 0.5 1"}
+WIDTH=${WIDTH:-4}
+PTR_LEVELS=${PTR_LEVELS:-3}
+SEED=${SEED:-1}
+
+make -s catch-hiergen
+
+header=1
+for depth in $DEPTHS; do
+    for fanout in $FANOUTS; do
+        for vdensity in $VDENSITIES; do
+            opts="-d $depth -f $fanout -w $WIDTH -v $vdensity -p $PTR_LEVELS -s $SEED"
+            if ! ./catch-hiergen $opts > /dev/null 2>&1; then
+                echo "(skipping $opts: hierarchy too large)" >&2
+                continue
+            fi
+            make -s catch-bench HIERGEN_OPTS="$opts"
+            if [ $header = 1 ]; then
+                ./catch-bench "$@"
+                header=0
+            else
+                ./catch-bench "$@" | tail -n +2
+            fi
+        done
+    done
+done
@@ -0,0 +1,44 @@
+#ifndef CATCH_BENCH_H_INCLUDED
+#define CATCH_BENCH_H_INCLUDED 1
+
+#include "../include/typeinfo"
+
+// Interface between the catch-matching benchmark (catch_bench.cc) and the generated hierarchy
+// source (from catch_hiergen.cc). The generated source defines the classes, an instance of each
+// thrown type, and a table of (catch type, thrown type) pairs with the expected result of matching
+// each.
+
+enum catch_bench_expect {
+    expect_match,         // catch type is the thrown type, or an unambiguous public base of it
+    expect_ambiguous,     // catch type is a base of the thrown type, but ambiguous
+    expect_unrelated,     // catch type is not a base of the thrown type
+    expect_ptr_match,     // pointer types; catch type can catch thrown type
+    expect_ptr_nomatch,   // pointer types; catch type can't catch thrown type
+    num_expect_kinds
+};
+
+struct catch_bench_pair {
+    const char *catch_name;
+    const char *thrown_name;
+    const std::type_info *catch_type;
+    const std::type_info *thrown_type;
+    void *thrown_obj;         // the thrown object
+    catch_bench_expect expect;
+    void *adjusted;           // expected adjusted pointer, for a match
+};
+
+struct catch_bench_config {
+    unsigned depth;           // number of levels of derivation
+    unsigned fanout;          // number of direct bases of each derived class
+    unsigned width;           // number of classes at each level
+    double vdensity;          // probability of each base being virtual
+    unsigned ptr_levels;      // maximum pointer depth for pointer cases
+    unsigned classes;         // total number of classes
+    unsigned long long max_subobjects;  // most base subobjects in any thrown type
+};
+
+extern const catch_bench_config catch_bench_cfg;
+extern const catch_bench_pair catch_bench_pairs[];
+extern const unsigned catch_bench_num_pairs;
+
+#endif
@@ -0,0 +1,335 @@
+// catch-hiergen: generate a class hierarchy, and a table of (catch type, thrown type) pairs with
+// expected results, for the catch-matching benchmark (catch_bench.cc, catch_bench.h). This is a
+// host program; the output is C++ source on stdout.
+//
+// Usage: catch-hiergen [-d <depth>] [-f <fanout>] [-w <width>] [-v <vdensity>] [-p <ptr-levels>]
+//                      [-s <seed>]
+//
+//   -d  number of levels of derivation above the root classes (default 4)
+//   -f  number of direct bases of each derived class (default 2)
+//   -w  number of classes at each level (default 4)
+//   -v  probability (0..1) that each base is virtual (default 0.5)
+//   -p  maximum pointer depth for the pointer qualification cases (default 2; 0 = none)
+//   -s  random seed (default 1)
+//
+// Level 0 consists of root classes; each class at level k > 0 has one direct base at level k-1
+// and the rest chosen from any lower level. The classes at the top level are thrown; every class
+// is used as a catch type against each of them. Non-virtual repeated bases give ambiguous (and
+// exponentially many) subobjects, so the generator refuses configurations in which a thrown type
+// would have too many.
+//
+// The pointer cases throw X*, X**, ... (with various cv-qualifications) for a thrown class X, and
+// catch as pointers to X or to a base of X with various cv-qualifications, per the qualification
+// conversion rules.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr unsigned long long max_subobjects_limit = 100000;
+
+struct xorshift {
+    unsigned long long s;
+    unsigned long long next()
+    {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+    unsigned below(unsigned n) { return (unsigned)(next() % n); }
+    double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+struct base_spec {
+    unsigned cls;
+    bool is_virtual;
+};
+
+struct class_spec {
+    std::string name;
+    unsigned level;
+    std::vector<base_spec> bases;
+};
+
+std::vector<class_spec> classes;
+
+// nv_count[x][c]: number of subobjects of type c in x reachable by non-virtual derivation
+// (including x itself); vbases[x]: all virtual bases of x, direct or indirect.
+std::vector<std::vector<unsigned long long>> nv_count;
+std::vector<std::set<unsigned>> vbases;
+
+unsigned long long sat_add(unsigned long long a, unsigned long long b)
+{
+    return (a + b < a) ? ~0ull : a + b;
+}
+
+void compute_counts()
+{
+    size_t n = classes.size();
+    nv_count.assign(n, std::vector<unsigned long long>(n, 0));
+    vbases.assign(n, std::set<unsigned>());
+
+    // classes are in level order, so bases are processed before derived classes
+    for (size_t x = 0; x < n; ++x) {
+        nv_count[x][x] = 1;
+        for (const base_spec &b : classes[x].bases) {
+            if (b.is_virtual) {
+                vbases[x].insert(b.cls);
+            }
+            else {
+                for (size_t c = 0; c < n; ++c) {
+                    nv_count[x][c] = sat_add(nv_count[x][c], nv_count[b.cls][c]);
+                }
+            }
+            vbases[x].insert(vbases[b.cls].begin(), vbases[b.cls].end());
+        }
+    }
+}
+
+// Number of subobjects of type c in an object of type x
+unsigned long long subobject_count(unsigned x, unsigned c)
+{
+    unsigned long long count = nv_count[x][c];
+    for (unsigned v : vbases[x]) {
+        count = sat_add(count, nv_count[v][c]);
+    }
+    return count;
+}
+
+unsigned long long total_subobjects(unsigned x)
+{
+    unsigned long long count = 0;
+    for (size_t c = 0; c < classes.size(); ++c) {
+        count = sat_add(count, subobject_count(x, c));
+    }
+    return count;
+}
+
+// Spell a (possibly multi-level) pointer type: cls, then for each level i (innermost first),
+// "const" if quals bit i is set, then "*". The outermost pointer itself is unqualified.
+std::string pointer_type(const std::string &cls, unsigned levels, unsigned quals)
+{
+    std::string s = cls;
+    for (unsigned i = 0; i < levels; ++i) {
+        if (quals & (1u << i)) s += " const";
+        s += " *";
+    }
+    return s;
+}
+
+// Whether a thrown pointer (levels, thrown_quals) to class X can be caught as a pointer with
+// catch_quals to class Y, where same_class indicates Y == X (otherwise Y is an unambiguous public
+// base of X): the qualification conversion rules, plus derived-to-base conversion at the first
+// level only.
+bool pointer_matches(unsigned levels, unsigned thrown_quals, unsigned catch_quals, bool same_class)
+{
+    if (!same_class && levels != 1) return false;
+    if ((thrown_quals & ~catch_quals) != 0) return false;
+
+    // if const is added at some level, every level outside it (excluding the outermost pointer
+    // itself) must be const
+    for (unsigned i = 0; i < levels; ++i) {
+        if ((catch_quals & ~thrown_quals) & (1u << i)) {
+            for (unsigned j = i + 1; j < levels; ++j) {
+                if (!(catch_quals & (1u << j))) return false;
+            }
+        }
+    }
+    return true;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: catch-hiergen [-d <depth>] [-f <fanout>] [-w <width>] "
+            "[-v <vdensity>] [-p <ptr-levels>] [-s <seed>]\n");
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    unsigned depth = 4, fanout = 2, width = 4, ptr_levels = 2;
+    double vdensity = 0.5;
+    unsigned long long seed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            usage();
+            return 1;
+        }
+        const char *arg = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 'd': depth = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 'f': fanout = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 'w': width = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 'v': vdensity = strtod(arg, nullptr); break;
+        case 'p': ptr_levels = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 's': seed = strtoull(arg, nullptr, 10); break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (width == 0 || fanout == 0 || ptr_levels > 8) {
+        fprintf(stderr, "catch-hiergen: width and fanout must be non-zero, ptr-levels at most 8\n");
+        return 1;
+    }
+
+    xorshift rng { seed * 0x9E3779B97F4A7C15ull + 1 };
+
+    for (unsigned level = 0; level <= depth; ++level) {
+        for (unsigned i = 0; i < width; ++i) {
+            class_spec cls;
+            cls.name = "H" + std::to_string(level) + "_" + std::to_string(i);
+            cls.level = level;
+            if (level > 0) {
+                std::set<unsigned> chosen;
+                unsigned first = (level - 1) * width + rng.below(width);
+                chosen.insert(first);
+                cls.bases.push_back(base_spec { first, rng.unit() < vdensity });
+                unsigned candidates = level * width;
+                while (cls.bases.size() < fanout && chosen.size() < candidates) {
+                    unsigned b = rng.below(candidates);
+                    if (!chosen.insert(b).second) continue;
+                    cls.bases.push_back(base_spec { b, rng.unit() < vdensity });
+                }
+            }
+            classes.push_back(cls);
+        }
+    }
+
+    compute_counts();
+
+    std::vector<unsigned> thrown;
+    for (unsigned i = 0; i < width; ++i) {
+        thrown.push_back(depth * width + i);
+    }
+
+    unsigned long long max_subobjects = 0;
+    for (unsigned t : thrown) {
+        unsigned long long n = total_subobjects(t);
+        if (n > max_subobjects) max_subobjects = n;
+    }
+    if (max_subobjects > max_subobjects_limit) {
+        fprintf(stderr, "catch-hiergen: a thrown type would have %llu subobjects (limit %llu); "
+                "reduce depth or fanout, or increase vdensity\n", max_subobjects,
+                max_subobjects_limit);
+        return 1;
+    }
+
+    printf("// Generated by catch-hiergen -d %u -f %u -w %u -v %g -p %u -s %llu; do not edit.\n\n",
+            depth, fanout, width, vdensity, ptr_levels, seed);
+    printf("#include \"catch_bench.h\"\n\n");
+
+    for (const class_spec &cls : classes) {
+        printf("struct %s", cls.name.c_str());
+        for (size_t i = 0; i < cls.bases.size(); ++i) {
+            printf("%s%s%s", i == 0 ? " : " : ", ", cls.bases[i].is_virtual ? "virtual " : "",
+                    classes[cls.bases[i].cls].name.c_str());
+        }
+        printf(" { int m_%s = %u; };\n", cls.name.c_str(), cls.level);
+    }
+
+    printf("\nnamespace {\n\n");
+    for (unsigned t : thrown) {
+        printf("%s obj_%s;\n", classes[t].name.c_str(), classes[t].name.c_str());
+    }
+
+    // Pointer cases: for the first thrown class X, and (if there is one) an unambiguous proper
+    // base Y of it. Thrown pointer variables are named ptr_<quals>_<level>.
+    std::vector<std::string> pairs;
+    auto add_pair = [&](const char *kind_str, const std::string &catch_type,
+            const std::string &thrown_type, const std::string &obj, const char *expect,
+            const std::string &adjusted) {
+        pairs.push_back("    { \"" + catch_type + "\", \"" + thrown_type + "\", &typeid(" +
+                catch_type + "), &typeid(" + thrown_type + "), (void *)" + obj + ", " + expect +
+                ", (void *)" + adjusted + " },  // " + kind_str);
+    };
+
+    if (ptr_levels > 0) {
+        unsigned x = thrown[0];
+        const std::string &xname = classes[x].name;
+        int y = -1;
+        for (unsigned c = 0; c < x; ++c) {
+            if (subobject_count(x, c) == 1) {
+                y = c;
+                break;
+            }
+        }
+
+        printf("\n");
+        for (unsigned levels = 1; levels <= ptr_levels; ++levels) {
+            unsigned num_quals = 1u << levels;
+            for (unsigned tq = 0; tq < num_quals; ++tq) {
+                // only a selection of thrown qualifications: unqualified, and fully qualified
+                if (tq != 0 && tq != num_quals - 1) continue;
+
+                // thrown pointer (and the chain of pointers it points through)
+                std::string prefix = "ptr_" + std::to_string(levels) + "_" + std::to_string(tq);
+                for (unsigned l = 1; l <= levels; ++l) {
+                    bool self_const = l < levels && (tq & (1u << l));
+                    printf("%s%s %s_%u = &%s;\n", pointer_type(xname, l, tq).c_str(),
+                            self_const ? " const" : "", prefix.c_str(), l,
+                            l == 1 ? ("obj_" + xname).c_str()
+                                   : (prefix + "_" + std::to_string(l - 1)).c_str());
+                }
+                std::string thrown_type = pointer_type(xname, levels, tq);
+                std::string thrown_var = prefix + "_" + std::to_string(levels);
+
+                for (unsigned cq = 0; cq < num_quals; ++cq) {
+                    for (int with_base = 0; with_base < 2; ++with_base) {
+                        if (with_base && y < 0) continue;
+                        const std::string &cname = with_base ? classes[y].name : xname;
+                        std::string catch_type = pointer_type(cname, levels, cq);
+                        bool match = pointer_matches(levels, tq, cq, !with_base);
+                        std::string adjusted = "0";
+                        if (match) {
+                            adjusted = levels == 1
+                                    ? "static_cast<" + catch_type + ">(" + thrown_var + ")"
+                                    : thrown_var;
+                        }
+                        add_pair("pointer", catch_type, thrown_type, "&" + thrown_var,
+                                match ? "expect_ptr_match" : "expect_ptr_nomatch", adjusted);
+                    }
+                }
+            }
+        }
+    }
+
+    printf("\n} // anon namespace\n\n");
+
+    for (unsigned t : thrown) {
+        const std::string &tname = classes[t].name;
+        for (unsigned c = 0; c < classes.size(); ++c) {
+            const std::string &cname = classes[c].name;
+            unsigned long long n = subobject_count(t, c);
+            if (n == 1) {
+                add_pair("class", cname, tname, "&obj_" + tname, "expect_match",
+                        "static_cast<" + cname + " *>(&obj_" + tname + ")");
+            }
+            else {
+                add_pair("class", cname, tname, "&obj_" + tname,
+                        n == 0 ? "expect_unrelated" : "expect_ambiguous", "0");
+            }
+        }
+    }
+
+    printf("const catch_bench_config catch_bench_cfg = { %u, %u, %u, %g, %u, %zu, %llu };\n\n",
+            depth, fanout, width, vdensity, ptr_levels, classes.size(), max_subobjects);
+    printf("const catch_bench_pair catch_bench_pairs[] = {\n");
+    for (const std::string &p : pairs) {
+        printf("%s\n", p.c_str());
+    }
+    printf("};\n\n");
+    printf("const unsigned catch_bench_num_pairs = sizeof(catch_bench_pairs) / "
+            "sizeof(catch_bench_pairs[0]);\n");
+
+    return 0;
+}
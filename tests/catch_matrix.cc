@@ -0,0 +1,217 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <typeinfo>
+
+#include "../src/catch_matrix.h"
+
+#include "harness.h"
+
+// Catch matrix harness, for the hosted build of the library with BMCXX_CATCH_MATRIX defined
+// (libcxxabi-matrix.a). Checks that exceptions are caught (exactly, by base class, by pointer to
+// base, and not by unrelated types), and that a thrown type which bmcxx-catchgen couldn't know
+// about (its type_info has no symbol) is still matched via __do_catch rather than being taken not
+// to match, even where its type_info lies among those of the known thrown types. Run via
+// catch-matrix.sh, which runs it unchanged and after bmcxx-catchgen.
+//
+// Usage: catch-matrix [-m]
+//
+// With -m, checks that bmcxx-catchgen has filled in the matrix. Otherwise the harness fills it in
+// itself, as bmcxx-catchgen would for the types here, but with the range of known thrown types
+// widened to include the type_info without a symbol (which the linker places after the others).
+// The exit status is non-zero if any check fails.
+
+extern catch_matrix_entry bmcxxabi_catch_matrix[];
+
+extern "C" void *__cxa_allocate_exception(size_t thrown_size) noexcept;
+extern "C" void __cxa_throw(void *thrown, void *tinfo, void (*destructor)(void *));
+
+// The vtable of __si_class_type_info, with which a type_info can be defined without a symbol
+extern "C" const void *si_class_type_info_vtable[]
+        asm("_ZTVN10__cxxabiv120__si_class_type_infoE");
+
+extern const char harness_name[] = "catch-matrix";
+
+namespace {
+
+struct Base {
+    int v = 1;
+};
+
+struct Derived : Base {
+    int w = 2;
+};
+
+struct Unrelated {
+    int u = 3;
+};
+
+// A class derived from Base whose type_info (hidden_ti) is defined by hand, as an object with no
+// (_ZTI) symbol, as could be the case for a type_info from a module linked in some other way
+struct Hidden : Base {
+    int h = 4;
+};
+
+struct si_class_type_info_layout {
+    const void *vptr;
+    const char *name;
+    const std::type_info *base;
+};
+
+const si_class_type_info_layout hidden_ti = {
+    si_class_type_info_vtable + 2, "N12_GLOBAL__N_16HiddenE", &typeid(Base)
+};
+
+Derived derived_obj;
+
+int compare_entries(const void *a, const void *b)
+{
+    uint64_t x = ((const catch_matrix_entry *)a)->key;
+    uint64_t y = ((const catch_matrix_entry *)b)->key;
+    return (x > y) - (x < y);
+}
+
+// Fill in the catch matrix for catches of Base and Unrelated (by reference) of the known thrown
+// types Base, Derived and Unrelated. Only the layout of Derived (Base at offset 0) is assumed.
+void fill_matrix()
+{
+    catch_matrix_entry *matrix = bmcxxabi_catch_matrix;
+    uint64_t base_ti = (uintptr_t)&typeid(Base);
+    uint64_t derived_ti = (uintptr_t)&typeid(Derived);
+    uint64_t unrelated_ti = (uintptr_t)&typeid(Unrelated);
+
+    catch_matrix_entry thrown[] = { { base_ti, 0 }, { derived_ti, 0 }, { unrelated_ti, 0 } };
+    qsort(thrown, 3, sizeof(catch_matrix_entry), compare_entries);
+
+    // catch types, then thrown types, then pairs (Base: 2, Unrelated: 1)
+    const uint64_t pairs_base = 2 + 2 + 3;
+    catch_matrix_entry base_pairs[] = { { base_ti, catch_match_object }, { derived_ti,
+            catch_match_object } };
+    qsort(base_pairs, 2, sizeof(catch_matrix_entry), compare_entries);
+    catch_matrix_entry catches[] = { { base_ti, pairs_base | ((uint64_t)2 << 32) },
+            { unrelated_ti, (pairs_base + 2) | ((uint64_t)1 << 32) } };
+    qsort(catches, 2, sizeof(catch_matrix_entry), compare_entries);
+
+    uint64_t hidden = (uintptr_t)&hidden_ti;
+    matrix[0] = { catch_matrix_magic, 2 | ((uint64_t)3 << 32) };
+    matrix[1] = { thrown[0].key < hidden ? thrown[0].key : hidden,
+            thrown[2].key > hidden ? thrown[2].key : hidden };
+    memcpy(matrix + 2, catches, sizeof(catches));
+    memcpy(matrix + 4, thrown, sizeof(thrown));
+    memcpy(matrix + pairs_base, base_pairs, sizeof(base_pairs));
+    matrix[pairs_base + 2] = { unrelated_ti, catch_match_object };
+}
+
+__attribute__((noinline)) void throw_derived()
+{
+    throw Derived();
+}
+
+__attribute__((noinline)) void throw_derived_ptr()
+{
+    throw &derived_obj;
+}
+
+__attribute__((noinline)) void throw_unrelated()
+{
+    throw Unrelated();
+}
+
+__attribute__((noinline)) void throw_hidden()
+{
+    void *exc = __cxa_allocate_exception(sizeof(Hidden));
+    new (exc) Hidden();
+    __cxa_throw(exc, (void *)&hidden_ti, nullptr);
+}
+
+// Throw via the given function; return 1 if caught as Unrelated, 2 if as Base, 3 if by catch(...)
+__attribute__((noinline)) int catch_object(void (*thrower)(), int *value)
+{
+    try {
+        thrower();
+    }
+    catch (Unrelated &u) {
+        *value = u.u;
+        return 1;
+    }
+    catch (Base &b) {
+        *value = b.v;
+        return 2;
+    }
+    catch (...) {
+        return 3;
+    }
+    return 0;
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    bool expect_matrix = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-m") == 0) {
+            expect_matrix = true;
+        }
+        else {
+            fprintf(stderr, "usage: catch-matrix [-m]\n");
+            return 1;
+        }
+    }
+
+    const catch_matrix_entry *matrix = bmcxxabi_catch_matrix;
+    bool have_matrix = matrix[0].key == catch_matrix_magic;
+    if (expect_matrix) {
+        check(have_matrix, "catch matrix not filled in");
+    }
+    else {
+        check(!have_matrix, "catch matrix unexpectedly filled in");
+        fill_matrix();
+
+        // (directly, as well as via the personality routine below)
+        Hidden hidden;
+        void *obj = &hidden;
+        check(bmcxxabi_catch_matrix_lookup(&typeid(Base), (const std::type_info *)&hidden_ti,
+                &obj) == -1, "lookup of unknown thrown type within range not left to __do_catch");
+        obj = &hidden;
+        check(bmcxxabi_catch_matrix_lookup(&typeid(Unrelated), &typeid(Derived), &obj) == 0,
+                "lookup of known thrown type: not a definite non-match");
+    }
+    uint64_t hidden_addr = (uintptr_t)&hidden_ti;
+    bool hidden_in_range = hidden_addr >= matrix[1].key && hidden_addr <= matrix[1].data;
+    check(expect_matrix || hidden_in_range, "type_info without a symbol not within range");
+
+    int value = 0;
+    check(catch_object(throw_derived, &value) == 2 && value == 1, "Derived not caught as Base");
+    check(catch_object(throw_unrelated, &value) == 1 && value == 3,
+            "Unrelated not caught as Unrelated");
+    check(catch_object(throw_derived_ptr, &value) == 3, "Derived * caught as an object");
+    check(catch_object(throw_hidden, &value) == 2 && value == 1,
+            "type without a type_info symbol not caught as Base");
+
+    try {
+        throw_derived_ptr();
+    }
+    catch (Unrelated *) {
+        check(false, "Derived * caught as Unrelated *");
+    }
+    catch (const Base *b) {
+        check(b == &derived_obj, "Derived * caught as const Base *, but wrongly adjusted");
+    }
+
+    try {
+        throw_derived();
+    }
+    catch (Derived &d) {
+        check(d.w == 2, "Derived caught exactly, but wrong object");
+    }
+
+    if (ok) {
+        printf("catch-matrix: %s matrix%s: all checks passed\n",
+                expect_matrix ? "generated" : "synthetic",
+                hidden_in_range ? "" : " (type_info without a symbol outside its range)");
+    }
+    return ok ? 0 : 1;
+}
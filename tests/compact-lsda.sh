@@ -0,0 +1,40 @@
+# Build the compact LSDA harness (compact-lsda), convert its LSDAs with bmcxx-lsdacompact (into
+# compact-lsda-indexed, where the personality routine finds them via the index, and with -p into
+# compact-lsda-direct, where the FDEs point to them), then run all three and tabulate the median
+# cycles for each benchmark. Each variant is run RUNS times (default 5), in turn with the others,
+# and the lowest median is shown, since the time of a throw can shift between runs of the same
+# program (by more than the differences being measured). Arguments are passed to compact-lsda (eg
+# "-n 200000"). The exit status is non-zero if any variant fails its checks.
+set -eu
+
+make -s -C ../tools bmcxx-lsdacompact
+make -s compact-lsda
+cp compact-lsda compact-lsda-indexed
+cp compact-lsda compact-lsda-direct
+../tools/bmcxx-lsdacompact -v compact-lsda-indexed
+../tools/bmcxx-lsdacompact -p compact-lsda-direct
+
+rm -f compact-lsda.out compact-lsda-indexed.out compact-lsda-direct.out
+run=0
+while [ $run -lt "${RUNS:-5}" ]; do
+    ./compact-lsda -m dwarf "$@" >> compact-lsda.out
+    ./compact-lsda-indexed -m indexed "$@" >> compact-lsda-indexed.out
+    ./compact-lsda-direct -m direct "$@" >> compact-lsda-direct.out
+    run=$((run + 1))
+done
+
+echo
+awk -F '\t' '
+FNR == 1 { ++file }
+$1 == "benchmark" { next }
+file == 1 && !(($1, 1) in median) { order[++n] = $1 }
+(($1, file) in median) && median[$1, file] <= $2 { next }
+{ median[$1, file] = $2 }
+END {
+    printf "benchmark\tdwarf\tindexed\tdirect\n"
+    for (i = 1; i <= n; ++i) {
+        b = order[i]
+        printf "%s\t%s\t%s\t%s\n", b, median[b, 1], median[b, 2], median[b, 3]
+    }
+}' compact-lsda.out compact-lsda-indexed.out compact-lsda-direct.out
+rm -f compact-lsda.out compact-lsda-indexed.out compact-lsda-direct.out
@@ -0,0 +1,258 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unwind.h>
+
+#include "../src/compact_lsda.h"
+
+#include "harness.h"
+
+// Compact LSDA harness, for the hosted build of the library with BMCXX_COMPACT_LSDA defined
+// (libcxxabi-compact.a). Checks that exceptions are caught (exactly, by base class, via catch(...),
+// after a rethrow and within handlers for one another) with cleanups run on the way, in whichever
+// form the LSDAs are in; then times throws through a function with many call sites, through a deep
+// chain of frames with cleanups, and to the last of several catch clauses. Run via compact-lsda.sh,
+// which runs it unchanged, after bmcxx-lsdacompact (with the compact LSDAs found via the index) and
+// after bmcxx-lsdacompact -p (with the FDEs pointing to them directly), and tabulates the results.
+//
+// Usage: compact-lsda [-n <iterations>] [-m dwarf|indexed|direct]
+//
+// With -m, checks that the LSDAs are in the given form: "dwarf" (not converted), "indexed"
+// (converted, found via the index) or "direct" (converted, with FDEs pointing to them). Output is
+// tab-separated, with a header line:
+//
+//     benchmark  cycles_median  cycles_min
+//
+// The exit status is non-zero if any check fails.
+
+extern uintptr_t bmcxxabi_compact_lsda[];
+
+extern const char harness_name[] = "compact-lsda";
+
+namespace {
+
+struct error_base {
+    int code;
+    explicit error_base(int c) : code(c) { }
+    virtual ~error_base() { }
+};
+
+struct io_error : error_base {
+    io_error() : error_base(5) { }
+};
+
+struct timeout_error : io_error { };
+
+struct other_error {
+    int code;
+};
+
+volatile unsigned sink;
+volatile unsigned cleanups;
+volatile unsigned throw_at = 63;
+
+struct cleanup {
+    ~cleanup() { cleanups = cleanups + 1; }
+};
+
+// The form of the LSDA of the first frame with one, as found by _Unwind_Backtrace
+_Unwind_Reason_Code find_lsda(_Unwind_Context *context, void *arg)
+{
+    const void *lsda = (const void *)_Unwind_GetLanguageSpecificData(context);
+    if (lsda == nullptr) return _URC_NO_REASON;
+    *(const void **)arg = lsda;
+    return _URC_END_OF_STACK;
+}
+
+__attribute__((noinline)) const char *lsda_form()
+{
+    cleanup c;
+    const void *lsda = nullptr;
+    _Unwind_Backtrace(find_lsda, &lsda);
+    if (lsda == nullptr) return "none";
+    if (((const compact_lsda_header *)lsda)->tag == compact_lsda_tag) return "direct";
+    return compact_lsda_find(lsda) != nullptr ? "indexed" : "dwarf";
+}
+
+__attribute__((noinline)) void throw_timeout()
+{
+    throw timeout_error();
+}
+
+__attribute__((noinline)) void throw_other()
+{
+    throw other_error{7};
+}
+
+__attribute__((noinline)) void throw_in(unsigned depth)
+{
+    cleanup c;
+    if (depth != 0) {
+        throw_in(depth - 1);
+    }
+    else if (throw_at != 0) {
+        throw_timeout();
+    }
+    sink = sink + 1;
+}
+
+// Throw within the handler for another exception, to the given depth
+__attribute__((noinline)) void nested(unsigned depth)
+{
+    try {
+        if (depth & 1) throw_other(); else throw_timeout();
+    }
+    catch (io_error &e) {
+        check(!(depth & 1) && e.code == 5, "nested: wrong handler");
+        if (depth > 1) nested(depth - 1);
+    }
+    catch (other_error &e) {
+        check((depth & 1) && e.code == 7, "nested: wrong handler");
+        if (depth > 1) nested(depth - 1);
+    }
+}
+
+__attribute__((noinline)) void step(unsigned n)
+{
+    if (n == throw_at) throw_timeout();
+}
+
+#define CALL_SITE(n) { cleanup c; step(n); }
+#define CALL_SITES_8(n) CALL_SITE(n) CALL_SITE(n + 1) CALL_SITE(n + 2) CALL_SITE(n + 3) \
+        CALL_SITE(n + 4) CALL_SITE(n + 5) CALL_SITE(n + 6) CALL_SITE(n + 7)
+
+// A function with 64 call sites (each with a cleanup), which throws from the last
+__attribute__((noinline)) void many_call_sites()
+{
+    CALL_SITES_8(0) CALL_SITES_8(8) CALL_SITES_8(16) CALL_SITES_8(24)
+    CALL_SITES_8(32) CALL_SITES_8(40) CALL_SITES_8(48) CALL_SITES_8(56)
+}
+
+__attribute__((noinline)) void catch_last()
+{
+    try {
+        throw_timeout();
+    }
+    catch (other_error &) {
+        sink = sink + 1;
+    }
+    catch (int) {
+        sink = sink + 2;
+    }
+    catch (const char *) {
+        sink = sink + 3;
+    }
+    catch (error_base &) {
+    }
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = 100000;
+    const char *mode = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            mode = argv[++i];
+        }
+        else {
+            fprintf(stderr, "usage: compact-lsda [-n <iterations>] [-m dwarf|indexed|direct]\n");
+            return 1;
+        }
+    }
+    if (iterations == 0) iterations = 1;
+
+    if (mode != nullptr) {
+        const char *form = lsda_form();
+        if (strcmp(form, mode) != 0) {
+            fprintf(stderr, "compact-lsda: LSDAs are in %s form, expected %s\n", form, mode);
+            return 1;
+        }
+        check((bmcxxabi_compact_lsda[0] == compact_lsda_magic) == (strcmp(mode, "dwarf") != 0),
+                "compact LSDA table not as expected");
+    }
+
+    try {
+        throw_timeout();
+    }
+    catch (timeout_error &e) {
+        check(e.code == 5, "exact catch: wrong object");
+    }
+
+    try {
+        throw_timeout();
+    }
+    catch (other_error &) {
+        check(false, "caught by the wrong handler");
+    }
+    catch (error_base &e) {
+        check(e.code == 5, "catch by base: wrong object");
+    }
+
+    try {
+        throw_other();
+    }
+    catch (...) {
+    }
+
+    cleanups = 0;
+    try {
+        throw_in(10);
+    }
+    catch (io_error &) {
+    }
+    check(cleanups == 11, "deep throw: cleanups not all run");
+
+    try {
+        try {
+            throw_timeout();
+        }
+        catch (io_error &) {
+            throw;
+        }
+    }
+    catch (error_base &e) {
+        check(e.code == 5, "rethrow: wrong object");
+    }
+
+    nested(8);
+
+    cleanups = 0;
+    try {
+        many_call_sites();
+    }
+    catch (timeout_error &) {
+    }
+    check(cleanups == 64, "many call sites: cleanups not all run");
+
+    if (!ok) return 1;
+
+    uint64_t *samples = (uint64_t *)malloc(iterations * sizeof(uint64_t));
+    if (samples == nullptr) return 1;
+
+    printf("benchmark\tcycles_median\tcycles_min\n");
+    bench("many_call_sites", samples, iterations, [] {
+        try {
+            many_call_sites();
+        }
+        catch (timeout_error &) {
+        }
+    });
+    bench("deep_cleanups", samples, iterations, [] {
+        try {
+            throw_in(20);
+        }
+        catch (io_error &) {
+        }
+    });
+    bench("catch_last", samples, iterations, catch_last);
+
+    free(samples);
+    return ok ? 0 : 1;
+}
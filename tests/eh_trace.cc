@@ -0,0 +1,411 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <typeinfo>
+
+#include <pthread.h>
+
+#include "../include/bmcxxabi.h"
+
+#include "harness.h"
+
+// Exception-handling event trace harness, for the diagnostics build of the library (BMCXX_EH_TRACE;
+// libcxxabi-prof.a, a hosted build). Checks:
+//
+//  - that nothing is recorded while tracing is disabled;
+//  - the exact sequence of events for a throw through a frame with a cleanup to a handler,
+//    including the function for each personality routine decision;
+//  - the events for a rethrow, and for initialisation of a guarded static;
+//  - delivery to a callback instead of the rings;
+//  - that concurrent throws on several threads each produce a complete timeline.
+//
+// Then measures the cost of a throw/catch with tracing disabled, to the rings, and to a (no-op)
+// callback.
+//
+// Usage: eh-trace [-n <iterations>] [-o <file>]
+//
+//   -o <file>  also write the records from a short mixed workload to the file, as raw
+//              bmcxxabi_trace_record structures, for bmcxx-tracedump (tools/tracedump.cc)
+//
+// Output is tab-separated, with a header line:
+//
+//     mode  unit  median  p99
+//
+// Times are TSC cycles on x86, nanoseconds elsewhere.
+
+extern const char harness_name[] = "eh-trace";
+
+namespace {
+
+volatile int sink;
+
+struct cleanup {
+    ~cleanup() { sink = sink + 1; }
+};
+
+struct guarded {
+    guarded() { sink = sink + 1; }
+};
+
+constexpr size_t max_records = 16384;
+bmcxxabi_trace_record records[max_records];
+
+int compare_time(const void *a, const void *b)
+{
+    return compare_u64(&((const bmcxxabi_trace_record *)a)->time,
+            &((const bmcxxabi_trace_record *)b)->time);
+}
+
+} // anon namespace
+
+extern "C" __attribute__((noinline)) void trace_thrower(int i)
+{
+    throw i;
+}
+
+extern "C" __attribute__((noinline)) void trace_cleanup(int i)
+{
+    cleanup c;
+    trace_thrower(i);
+}
+
+extern "C" __attribute__((noinline)) int *trace_outer(int i)
+{
+    try {
+        trace_cleanup(i);
+    }
+    catch (int &caught) {
+        return &caught;
+    }
+    return nullptr;
+}
+
+extern "C" __attribute__((noinline)) void trace_rethrower()
+{
+    try {
+        trace_cleanup(0);
+    }
+    catch (int) {
+        throw;
+    }
+}
+
+extern "C" __attribute__((noinline)) void trace_rethrow_outer()
+{
+    try {
+        trace_rethrower();
+    }
+    catch (int) { }
+}
+
+extern "C" __attribute__((noinline)) guarded *trace_guarded()
+{
+    static guarded g;
+    return &g;
+}
+
+namespace {
+
+struct expected_event {
+    unsigned event;
+    uint64_t arg;
+};
+
+const char *event_name(unsigned event)
+{
+    static const char * const names[] = {"?", "allocate", "throw", "rethrow", "search_continue",
+            "handler_found", "cleanup_continue", "install_cleanup", "install_handler",
+            "personality_error", "begin_catch", "end_catch", "free", "guard_acquire",
+            "guard_release", "guard_abort", "handler_type"};
+    return event < sizeof(names) / sizeof(names[0]) ? names[event] : "?";
+}
+
+// Drain all records, in order of time
+size_t drain_all(unsigned long long &lost)
+{
+    size_t n = bmcxxabi_trace_drain(records, max_records, &lost);
+    qsort(records, n, sizeof(records[0]), compare_time);
+    return n;
+}
+
+// Check that the records are exactly the expected sequence of events, for the given object
+bool check_sequence(const char *what, const bmcxxabi_trace_record *recs, size_t n,
+        const expected_event *expected, size_t num_expected, uint64_t object)
+{
+    bool ok = n == num_expected;
+    for (size_t i = 0; ok && i < n; ++i) {
+        ok = recs[i].event == expected[i].event && recs[i].arg == expected[i].arg
+                && recs[i].object == object;
+    }
+    if (!ok) {
+        fprintf(stderr, "eh-trace: %s: unexpected events:\n", what);
+        for (size_t i = 0; i < n; ++i) {
+            fprintf(stderr, "    %s object %#llx arg %#llx\n", event_name(recs[i].event),
+                    recs[i].object, recs[i].arg);
+        }
+    }
+    return ok;
+}
+
+bool check_throw()
+{
+    unsigned long long lost;
+    bmcxxabi_trace_enable(1);
+    int *caught = trace_outer(1);
+    bmcxxabi_trace_enable(0);
+    size_t n = drain_all(lost);
+
+    uint64_t cleanup_fn = (uintptr_t)&trace_cleanup;
+    uint64_t outer_fn = (uintptr_t)&trace_outer;
+    const expected_event expected[] = {
+        {BMCXXABI_TRACE_ALLOCATE, sizeof(int)},
+        {BMCXXABI_TRACE_THROW, (uintptr_t)&typeid(int)},
+        {BMCXXABI_TRACE_SEARCH_CONTINUE, cleanup_fn},
+        {BMCXXABI_TRACE_HANDLER_TYPE, (uintptr_t)&typeid(int)},
+        {BMCXXABI_TRACE_HANDLER_FOUND, outer_fn},
+        {BMCXXABI_TRACE_INSTALL_CLEANUP, cleanup_fn},
+        {BMCXXABI_TRACE_CLEANUP_CONTINUE, cleanup_fn},  // (resuming, after the cleanup)
+        {BMCXXABI_TRACE_INSTALL_HANDLER, outer_fn},
+        {BMCXXABI_TRACE_BEGIN_CATCH, 1},
+        {BMCXXABI_TRACE_END_CATCH, 0},
+        {BMCXXABI_TRACE_FREE, 0},
+    };
+    return check_sequence("throw", records, n, expected, sizeof(expected) / sizeof(expected[0]),
+            (uintptr_t)caught) && lost == 0;
+}
+
+bool check_rethrow()
+{
+    unsigned long long lost;
+    bmcxxabi_trace_enable(1);
+    trace_rethrow_outer();
+    bmcxxabi_trace_enable(0);
+    size_t n = drain_all(lost);
+
+    // Between the rethrow and the second catch, the rethrowing handler ends (with the exception
+    // still in flight); the exception is freed only once, at the end
+    const unsigned expected[] = {
+        BMCXXABI_TRACE_ALLOCATE, BMCXXABI_TRACE_THROW, BMCXXABI_TRACE_BEGIN_CATCH,
+        BMCXXABI_TRACE_RETHROW, BMCXXABI_TRACE_END_CATCH, BMCXXABI_TRACE_BEGIN_CATCH,
+        BMCXXABI_TRACE_END_CATCH, BMCXXABI_TRACE_FREE
+    };
+    size_t j = 0;
+    unsigned num_frees = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (j < sizeof(expected) / sizeof(expected[0]) && records[i].event == expected[j]) {
+            ++j;
+        }
+        num_frees += records[i].event == BMCXXABI_TRACE_FREE;
+    }
+    if (j != sizeof(expected) / sizeof(expected[0]) || num_frees != 1
+            || records[n - 1].event != BMCXXABI_TRACE_FREE) {
+        fprintf(stderr, "eh-trace: rethrow: unexpected events:\n");
+        for (size_t i = 0; i < n; ++i) {
+            fprintf(stderr, "    %s arg %#llx\n", event_name(records[i].event), records[i].arg);
+        }
+        return false;
+    }
+    return lost == 0;
+}
+
+bool check_guard()
+{
+    unsigned long long lost;
+    bmcxxabi_trace_enable(1);
+    trace_guarded();
+    trace_guarded();
+    bmcxxabi_trace_enable(0);
+    size_t n = drain_all(lost);
+
+    // (the second call finds the static initialised, without calling __cxa_guard_acquire)
+    if (n != 2 || records[0].event != BMCXXABI_TRACE_GUARD_ACQUIRE
+            || records[1].event != BMCXXABI_TRACE_GUARD_RELEASE
+            || records[0].object != records[1].object) {
+        fprintf(stderr, "eh-trace: guard: unexpected events (%zu records)\n", n);
+        return false;
+    }
+    return true;
+}
+
+unsigned num_callbacks;
+
+void count_callback(const bmcxxabi_trace_record *record)
+{
+    ++num_callbacks;
+}
+
+void null_callback(const bmcxxabi_trace_record *record)
+{
+}
+
+bool check_callback()
+{
+    unsigned long long lost;
+    num_callbacks = 0;
+    bmcxxabi_trace_set_callback(count_callback);
+    bmcxxabi_trace_enable(1);
+    trace_outer(1);
+    bmcxxabi_trace_enable(0);
+    bmcxxabi_trace_set_callback(nullptr);
+    size_t n = drain_all(lost);
+
+    if (num_callbacks != 11 || n != 0) {
+        fprintf(stderr, "eh-trace: callback: %u records delivered, %zu in the rings\n",
+                num_callbacks, n);
+        return false;
+    }
+    return true;
+}
+
+constexpr unsigned num_threads = 8;
+constexpr unsigned thread_throws = 10;
+
+void *throw_thread(void *)
+{
+    for (unsigned i = 0; i < thread_throws; ++i) {
+        trace_outer(i);
+    }
+    return nullptr;
+}
+
+// Each exception's timeline (from allocation to free) should be complete; an exception object
+// address may be reused once freed
+bool check_threads()
+{
+    unsigned long long lost;
+    bmcxxabi_trace_enable(1);
+    pthread_t threads[num_threads];
+    for (pthread_t &t : threads) {
+        if (pthread_create(&t, nullptr, throw_thread, nullptr) != 0) {
+            fprintf(stderr, "eh-trace: can't create thread\n");
+            return false;
+        }
+    }
+    for (pthread_t &t : threads) {
+        pthread_join(t, nullptr);
+    }
+    bmcxxabi_trace_enable(0);
+    size_t n = drain_all(lost);
+
+    unsigned complete = 0;
+    bool ok = lost == 0;
+    for (size_t i = 0; ok && i < n; ++i) {
+        if (records[i].event != BMCXXABI_TRACE_ALLOCATE) continue;
+        unsigned events = 1;
+        for (size_t j = i + 1; j < n; ++j) {
+            if (records[j].object != records[i].object) continue;
+            ++events;
+            if (records[j].event == BMCXXABI_TRACE_FREE) break;
+        }
+        complete += events == 11;
+    }
+    if (!ok || complete != num_threads * thread_throws) {
+        fprintf(stderr, "eh-trace: threads: %u complete timelines of %u, %llu records lost\n",
+                complete, num_threads * thread_throws, lost);
+        return false;
+    }
+    return true;
+}
+
+bool write_trace(const char *path)
+{
+    unsigned long long lost;
+    bmcxxabi_trace_enable(1);
+    trace_outer(1);
+    trace_rethrow_outer();
+    try {
+        trace_thrower(2);
+    }
+    catch (...) {
+        trace_outer(3);
+    }
+    bmcxxabi_trace_enable(0);
+    size_t n = bmcxxabi_trace_drain(records, max_records, &lost);
+
+    FILE *f = fopen(path, "wb");
+    if (f == nullptr || fwrite(records, sizeof(records[0]), n, f) != n || fclose(f) != 0) {
+        fprintf(stderr, "eh-trace: can't write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+void time_throws(const char *mode_name, unsigned iterations, uint64_t *times)
+{
+    unsigned long long lost;
+    for (unsigned i = 0; i < iterations; ++i) {
+        uint64_t start = now();
+        trace_outer(i);
+        times[i] = now() - start;
+        if ((i & 63) == 63) {
+            // (the rings are drained outside the timed region)
+            bmcxxabi_trace_drain(records, max_records, &lost);
+        }
+    }
+
+    qsort(times, iterations, sizeof(uint64_t), compare_u64);
+    printf("%s\t%s\t%llu\t%llu\n", mode_name, time_unit,
+            (unsigned long long)times[iterations / 2],
+            (unsigned long long)times[(unsigned)((iterations - 1) * 0.99)]);
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = 10000;
+    const char *trace_file = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (unsigned)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        }
+        else {
+            fprintf(stderr, "usage: eh-trace [-n <iterations>] [-o <file>]\n");
+            return 1;
+        }
+    }
+    if (iterations == 0) {
+        fprintf(stderr, "eh-trace: iterations must be positive\n");
+        return 1;
+    }
+
+    // Nothing is recorded while disabled
+    unsigned long long lost;
+    trace_outer(1);
+    if (bmcxxabi_trace_drain(records, max_records, &lost) != 0) {
+        fprintf(stderr, "eh-trace: events recorded while disabled\n");
+        return 1;
+    }
+
+    bool ok = check_throw();
+    ok &= check_rethrow();
+    ok &= check_guard();
+    ok &= check_callback();
+    ok &= check_threads();
+    if (trace_file != nullptr) {
+        ok &= write_trace(trace_file);
+    }
+    if (!ok) return 1;
+
+    uint64_t *times = (uint64_t *)malloc(iterations * sizeof(uint64_t));
+    if (times == nullptr) return 1;
+    // (warm up, so that the first mode measured is not penalised)
+    for (unsigned i = 0; i < iterations; ++i) {
+        trace_outer(i);
+    }
+    printf("mode\tunit\tmedian\tp99\n");
+    time_throws("disabled", iterations, times);
+    bmcxxabi_trace_enable(1);
+    time_throws("ring", iterations, times);
+    bmcxxabi_trace_set_callback(null_callback);
+    time_throws("callback", iterations, times);
+    bmcxxabi_trace_enable(0);
+    bmcxxabi_trace_set_callback(nullptr);
+    free(times);
+    return 0;
+}
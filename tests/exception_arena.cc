@@ -0,0 +1,328 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <pthread.h>
+
+#include "../include/bmcxxabi.h"
+
+#include "harness.h"
+
+// Exception arena harness, for the hosted build of the library (which is built with
+// BMCXX_EXCEPTION_ARENAS). malloc and free are wrapped (at link time, so only calls from the
+// program and the library are seen) to count allocations. Checks that, within an arena, throwing
+// and catching allocates nothing once the arena's storage has been reused, destructors still run
+// at the end of each handler, exceptions too large for the arena are allocated individually,
+// arenas nest, and an exception which escapes its arena (propagating out of the scope, or still
+// being handled when the arena is popped) remains valid and has its storage freed with it; also
+// uses arenas in several threads at once. Then compares requests (throwing and catching one
+// exception, four, or three with a fourth escaping the request) with and without an arena: the
+// time per request, and the calls to malloc and free per request, which are what an arena saves
+// (and, for an exception which escapes, costs: the arena's storage goes with the exception, so the
+// next arena allocates anew).
+//
+// Usage: exception-arena [-n <iterations>]
+//
+// Output is two tab-separated tables, each with a header line:
+//
+//     benchmark  cycles_median  cycles_min
+//     benchmark  allocator_calls
+//
+// The exit status is non-zero if any check fails.
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void __real_free(void *p);
+
+extern const char harness_name[] = "exception-arena";
+
+namespace {
+
+volatile unsigned long mallocs;
+volatile unsigned long frees;
+
+// (the number in existence, to check that each is destroyed)
+int live_errors;
+
+struct request_error {
+    char message[64];
+
+    explicit request_error(const char *m)
+    {
+        snprintf(message, sizeof(message), "%s", m);
+        __atomic_fetch_add(&live_errors, 1, __ATOMIC_RELAXED);
+    }
+
+    request_error(const request_error &other)
+    {
+        memcpy(message, other.message, sizeof(message));
+        __atomic_fetch_add(&live_errors, 1, __ATOMIC_RELAXED);
+    }
+
+    ~request_error()
+    {
+        memset(message, 0, sizeof(message));
+        __atomic_fetch_sub(&live_errors, 1, __ATOMIC_RELAXED);
+    }
+};
+
+struct large_error {
+    char payload[8192];
+};
+
+// Pops the arena at the end of a scope, including during unwinding
+struct arena_scope {
+    bmcxxabi_exception_arena arena;
+    explicit arena_scope(size_t capacity = 0) { bmcxxabi_exception_arena_push(&arena, capacity); }
+    ~arena_scope() { bmcxxabi_exception_arena_pop(&arena); }
+};
+
+__attribute__((noinline)) void throw_error(const char *message)
+{
+    throw request_error(message);
+}
+
+__attribute__((noinline)) void handle_request(unsigned n)
+{
+    arena_scope scope;
+    for (unsigned i = 0; i < n; ++i) {
+        try {
+            throw_error("bad request");
+        }
+        catch (request_error &e) {
+            check(strcmp(e.message, "bad request") == 0, "wrong exception contents");
+        }
+    }
+}
+
+// Throws out of the arena's scope
+__attribute__((noinline)) void escaping_request()
+{
+    arena_scope scope;
+    try {
+        throw_error("first");
+    }
+    catch (request_error &) {
+    }
+    throw_error("escaped");
+}
+
+// A request for the benchmark: throws and handles 'n' exceptions, within an arena if 'use_arena',
+// then, if 'escape', throws one more out of the request (and the arena's scope)
+__attribute__((noinline)) void bench_request(unsigned n, bool use_arena, bool escape)
+{
+    bmcxxabi_exception_arena arena;
+    struct pop_at_exit {
+        bmcxxabi_exception_arena *arena;
+        ~pop_at_exit() { if (arena != nullptr) bmcxxabi_exception_arena_pop(arena); }
+    } pop { use_arena ? &arena : nullptr };
+    if (use_arena) bmcxxabi_exception_arena_push(&arena, 0);
+
+    for (unsigned i = 0; i < n; ++i) {
+        try {
+            throw_error("bad request");
+        }
+        catch (request_error &) {
+        }
+    }
+    if (escape) throw_error("escaped");
+}
+
+// Run a benchmark request, handling the exception which escapes it (if any)
+template <bool use_arena, bool escape>
+void run_bench_request(unsigned n)
+{
+    try {
+        bench_request(n, use_arena, escape);
+    }
+    catch (request_error &) {
+    }
+}
+
+// The calls to malloc and free per run of a body, after a warm-up run
+template <typename F>
+double allocator_calls(F body)
+{
+    constexpr unsigned runs = 1000;
+    body();
+    unsigned long before = mallocs + frees;
+    for (unsigned i = 0; i < runs; ++i) {
+        body();
+    }
+    return (double)(mallocs + frees - before) / runs;
+}
+
+void *thread_requests(void *arg)
+{
+    unsigned n = *(unsigned *)arg;
+    for (unsigned i = 0; i < n; ++i) {
+        handle_request(4);
+        try {
+            escaping_request();
+        }
+        catch (request_error &e) {
+            if (strcmp(e.message, "escaped") != 0) ok = false;
+        }
+    }
+    bmcxxabi_exception_arena_trim();
+    return nullptr;
+}
+
+} // anon namespace
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+    __atomic_fetch_add(&mallocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+extern "C" void __wrap_free(void *p)
+{
+    if (p != nullptr) __atomic_fetch_add(&frees, 1, __ATOMIC_RELAXED);
+    __real_free(p);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = 100000;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else {
+            fprintf(stderr, "usage: exception-arena [-n <iterations>]\n");
+            return 1;
+        }
+    }
+    if (iterations == 0) iterations = 1;
+
+    // The first arena allocates its storage; the next reuses it, and nothing else is allocated
+    handle_request(1);
+    unsigned long m = mallocs, f = frees;
+    handle_request(10);
+    check(mallocs == m && frees == f, "allocation while throwing within an arena");
+    check(live_errors == 0, "destructors not run");
+
+    // Too large for the arena: allocated individually
+    {
+        arena_scope scope;
+        m = mallocs;
+        try {
+            throw large_error();
+        }
+        catch (large_error &) {
+            check(mallocs == m + 1, "large exception not allocated individually");
+        }
+    }
+
+    // Nested arenas: exceptions come from the innermost, and the outer is current again after
+    // the inner is popped
+    {
+        arena_scope outer;
+        {
+            arena_scope inner(256);
+            try {
+                throw_error("inner");
+            }
+            catch (request_error &e) {
+                check(strcmp(e.message, "inner") == 0, "nested: wrong exception contents");
+            }
+        }
+        m = mallocs;
+        try {
+            throw_error("outer");
+        }
+        catch (request_error &e) {
+            check(strcmp(e.message, "outer") == 0, "nested: wrong exception contents");
+        }
+        check(mallocs == m, "outer arena not current after inner popped");
+    }
+    bmcxxabi_exception_arena_trim();
+
+    // An exception propagating out of its arena's scope remains valid, and its storage is freed
+    // (once) at the end of its handler
+    handle_request(1);
+    f = frees;
+    try {
+        escaping_request();
+    }
+    catch (request_error &e) {
+        check(strcmp(e.message, "escaped") == 0, "escaped: wrong exception contents");
+        check(frees == f, "escaped: storage freed while handling");
+        try {
+            throw_error("within handler");
+        }
+        catch (request_error &e2) {
+            check(strcmp(e2.message, "within handler") == 0, "within handler: wrong contents");
+        }
+    }
+    check(frees == f + 1 + 1, "escaped: storage not freed with the exception");
+    check(live_errors == 0, "escaped: destructors not run");
+
+    // Still being handled when the arena is popped
+    {
+        bmcxxabi_exception_arena arena;
+        bmcxxabi_exception_arena_push(&arena, 0);
+        try {
+            throw_error("handled");
+        }
+        catch (request_error &e) {
+            bmcxxabi_exception_arena_pop(&arena);
+            handle_request(2);
+            check(strcmp(e.message, "handled") == 0, "handled at pop: wrong contents");
+        }
+    }
+    check(live_errors == 0, "handled at pop: destructors not run");
+
+    constexpr unsigned num_threads = 8;
+    unsigned per_thread = iterations / 100 + 1;
+    pthread_t threads[num_threads];
+    for (pthread_t &t : threads) {
+        if (pthread_create(&t, nullptr, thread_requests, &per_thread) != 0) {
+            fprintf(stderr, "exception-arena: can't create thread\n");
+            return 1;
+        }
+    }
+    for (pthread_t &t : threads) {
+        pthread_join(t, nullptr);
+    }
+    check(live_errors == 0, "threads: destructors not run");
+
+    if (!ok) return 1;
+
+    uint64_t *samples = (uint64_t *)malloc(2 * iterations * sizeof(uint64_t));
+    if (samples == nullptr) return 1;
+
+    // Requests with one throw, four, and three plus one which escapes; each with and without an
+    // arena (timed alternately)
+    struct {
+        const char *heap_name;
+        const char *arena_name;
+        void (*heap)(unsigned);
+        void (*arena)(unsigned);
+        unsigned throws;
+    } requests[] = {
+        { "request_1_throw_heap", "request_1_throw_arena", run_bench_request<false, false>,
+                run_bench_request<true, false>, 1 },
+        { "request_4_throws_heap", "request_4_throws_arena", run_bench_request<false, false>,
+                run_bench_request<true, false>, 4 },
+        { "request_escape_heap", "request_escape_arena", run_bench_request<false, true>,
+                run_bench_request<true, true>, 3 },
+    };
+
+    printf("benchmark\tcycles_median\tcycles_min\n");
+    for (const auto &r : requests) {
+        bench_pair(r.heap_name, r.arena_name, samples, iterations, [&r] { r.heap(r.throws); },
+                [&r] { r.arena(r.throws); });
+    }
+
+    printf("\nbenchmark\tallocator_calls\n");
+    for (const auto &r : requests) {
+        printf("%s\t%.1f\n", r.heap_name, allocator_calls([&r] { r.heap(r.throws); }));
+        printf("%s\t%.1f\n", r.arena_name, allocator_calls([&r] { r.arena(r.throws); }));
+    }
+
+    free(samples);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dlfcn.h>
+
+#include "../include/bmcxxabi.h"
+
+// Per-frame personality routine profiler harness, for the profiling build of the library
+// (BMCXX_PERSONALITY_PROFILE; libcxxabi-prof.a, a hosted build). Throws through functions which
+// are expensive for the personality routine in different respects, checks that the profile
+// attributes the work to the right functions, and dumps the profile.
+//
+//   frame_many_call_sites  a long call-site table (the throw is from the last call site)
+//   frame_long_chain       a long action chain: many catch clauses before the matching one
+//   frame_cleanup          a cleanup only, so no work in the search phase beyond the table walk
+//
+// Usage: frame-profile [-n <iterations>]
+//
+// Output is tab-separated, with a header line, one line per function, most expensive first:
+//
+//     function  phase  calls  callsites  actions  do_catch  cycles  cycles_per_call
+//
+// where the counts are totals over all calls, for each phase (search, cleanup) in which the
+// personality routine was called for the function. Function names are found via dladdr (the
+// harness is linked with -rdynamic).
+
+namespace {
+
+template <int N> struct tag { };
+
+int num_guards;
+
+struct guard {
+    ~guard() { ++num_guards; }
+};
+
+} // anon namespace
+
+extern "C" __attribute__((noinline)) void frame_maybe_throw(int i, int n)
+{
+    if (i == n) {
+        throw i;
+    }
+}
+
+// The throwing functions have external linkage, so that dladdr can name them.
+
+#define FRAME_SITE(i) { guard g; frame_maybe_throw(i, n); }
+#define FRAME_SITES8(i) FRAME_SITE(i) FRAME_SITE(i + 1) FRAME_SITE(i + 2) FRAME_SITE(i + 3) \
+        FRAME_SITE(i + 4) FRAME_SITE(i + 5) FRAME_SITE(i + 6) FRAME_SITE(i + 7)
+
+constexpr int many_call_sites = 64;
+
+extern "C" __attribute__((noinline)) void frame_many_call_sites(int n)
+{
+    FRAME_SITES8(0) FRAME_SITES8(8) FRAME_SITES8(16) FRAME_SITES8(24)
+    FRAME_SITES8(32) FRAME_SITES8(40) FRAME_SITES8(48) FRAME_SITES8(56)
+}
+
+#define FRAME_CATCH(i) catch (tag<i> &) { return i; }
+
+constexpr int long_chain_catches = 16;
+
+extern "C" __attribute__((noinline)) int frame_long_chain()
+{
+    try {
+        frame_maybe_throw(0, 0);
+    }
+    FRAME_CATCH(1) FRAME_CATCH(2) FRAME_CATCH(3) FRAME_CATCH(4)
+    FRAME_CATCH(5) FRAME_CATCH(6) FRAME_CATCH(7) FRAME_CATCH(8)
+    FRAME_CATCH(9) FRAME_CATCH(10) FRAME_CATCH(11) FRAME_CATCH(12)
+    FRAME_CATCH(13) FRAME_CATCH(14) FRAME_CATCH(15) FRAME_CATCH(16)
+    catch (int) {
+        return 0;
+    }
+    return -1;
+}
+
+extern "C" __attribute__((noinline)) void frame_cleanup()
+{
+    guard g;
+    frame_maybe_throw(0, 0);
+}
+
+namespace {
+
+const char *function_name(const void *func)
+{
+    Dl_info info;
+    if (dladdr(func, &info) == 0 || info.dli_sname == nullptr) {
+        return "?";
+    }
+    return info.dli_sname;
+}
+
+const bmcxxabi_personality_frame *find_frame(const bmcxxabi_personality_frame *frames,
+        size_t num_frames, const char *name)
+{
+    for (size_t i = 0; i < num_frames; ++i) {
+        if (strcmp(function_name(frames[i].function), name) == 0) {
+            return &frames[i];
+        }
+    }
+    fprintf(stderr, "frame-profile: no entry for %s\n", name);
+    return nullptr;
+}
+
+// Check that a function's per-call search-phase counts are at least those given
+bool check_search(const bmcxxabi_personality_frame *frame, unsigned long long calls,
+        unsigned callsites, unsigned actions, unsigned do_catch)
+{
+    if (frame == nullptr) return false;
+    const char *name = function_name(frame->function);
+    if (frame->calls[0] != calls) {
+        fprintf(stderr, "frame-profile: %s: %llu search phase calls, expected %llu\n", name,
+                frame->calls[0], calls);
+        return false;
+    }
+    if (frame->callsites[0] < callsites * calls || frame->actions[0] < actions * calls
+            || frame->do_catch[0] < do_catch * calls) {
+        fprintf(stderr, "frame-profile: %s: per call %.1f call sites, %.1f actions, %.1f "
+                "__do_catch calls; expected at least %u, %u, %u\n", name,
+                (double)frame->callsites[0] / calls, (double)frame->actions[0] / calls,
+                (double)frame->do_catch[0] / calls, callsites, actions, do_catch);
+        return false;
+    }
+    return true;
+}
+
+void print_frame(const bmcxxabi_personality_frame &frame)
+{
+    static const char *const phase_names[2] = {"search", "cleanup"};
+    for (unsigned phase = 0; phase < 2; ++phase) {
+        unsigned long long calls = frame.calls[phase];
+        if (calls == 0) continue;
+        printf("%s\t%s\t%llu\t%llu\t%llu\t%llu\t%llu\t%.1f\n", function_name(frame.function),
+                phase_names[phase], calls, frame.callsites[phase], frame.actions[phase],
+                frame.do_catch[phase], frame.cycles[phase], (double)frame.cycles[phase] / calls);
+    }
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = 1000;
+    if (argc == 3 && strcmp(argv[1], "-n") == 0) {
+        iterations = (unsigned)atoi(argv[2]);
+    }
+    else if (argc != 1) {
+        fprintf(stderr, "usage: frame-profile [-n <iterations>]\n");
+        return 1;
+    }
+    if (iterations == 0) {
+        fprintf(stderr, "frame-profile: iterations must be positive\n");
+        return 1;
+    }
+
+    bmcxxabi_personality_profile_reset();
+
+    for (unsigned i = 0; i < iterations; ++i) {
+        try {
+            frame_many_call_sites(many_call_sites - 1);
+        }
+        catch (int) { }
+        if (frame_long_chain() != 0) {
+            fprintf(stderr, "frame-profile: wrong handler in frame_long_chain\n");
+            return 1;
+        }
+        try {
+            frame_cleanup();
+        }
+        catch (int) { }
+    }
+
+    bmcxxabi_personality_frame frames[64];
+    unsigned long long dropped;
+    size_t num_frames = bmcxxabi_personality_profile_snapshot(frames, 64, &dropped);
+
+    printf("function\tphase\tcalls\tcallsites\tactions\tdo_catch\tcycles\tcycles_per_call\n");
+    for (size_t i = 0; i < num_frames; ++i) {
+        print_frame(frames[i]);
+    }
+
+    bool ok = true;
+    if (dropped != 0) {
+        fprintf(stderr, "frame-profile: %llu calls dropped\n", dropped);
+        ok = false;
+    }
+    // The throw comes from the last of the call sites, each with its own landing pad (for a
+    // cleanup, so with no action entries)
+    ok &= check_search(find_frame(frames, num_frames, "frame_many_call_sites"), iterations,
+            many_call_sites, 0, 0);
+    // Every catch clause up to the match is checked, each via __do_catch
+    ok &= check_search(find_frame(frames, num_frames, "frame_long_chain"), iterations, 1,
+            long_chain_catches + 1, long_chain_catches + 1);
+    ok &= check_search(find_frame(frames, num_frames, "frame_cleanup"), iterations, 1, 0, 0);
+    for (size_t i = 1; i < num_frames; ++i) {
+        if (frames[i].cycles[0] + frames[i].cycles[1]
+                > frames[i - 1].cycles[0] + frames[i - 1].cycles[1]) {
+            fprintf(stderr, "frame-profile: snapshot not sorted by cycles\n");
+            ok = false;
+        }
+    }
+
+    bmcxxabi_personality_profile_reset();
+    if (bmcxxabi_personality_profile_snapshot(frames, 64, nullptr) != 0) {
+        fprintf(stderr, "frame-profile: calls recorded after reset\n");
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
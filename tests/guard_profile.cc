@@ -0,0 +1,222 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <x86intrin.h>
+
+#include "../include/bmcxxabi.h"
+
+#include "harness.h"
+
+// First-use latency profiler harness, for the profiling build of the library (BMCXX_GUARD_PROFILE;
+// libcxxabi-prof.a, a hosted build). Initialises function-local statics of known cost: a slow one,
+// a cheap one, one whose initialiser throws the first time, one whose initialiser initialises
+// another, and one initialised by several threads at once. Checks that the snapshot records each
+// once, against the right function, with a plausible time, slowest first; and prints it.
+//
+// Usage: guard-profile
+//
+// Output is tab-separated, with a header line:
+//
+//     cycles  aborts  abort_cycles  function  guard
+//
+// where function is the function containing the static (linked with -rdynamic, so that dladdr can
+// find it). The exit status is non-zero if any check fails.
+
+extern const char harness_name[] = "guard-profile";
+
+namespace {
+
+constexpr uint64_t slow_cycles = 2000000;
+constexpr uint64_t inner_cycles = 400000;
+constexpr uint64_t outer_cycles = 300000;
+constexpr uint64_t abort_cycles = 100000;
+
+volatile unsigned sink;
+
+void spin(uint64_t cycles)
+{
+    uint64_t start = __rdtsc();
+    while (__rdtsc() - start < cycles) {
+        sink = sink + 1;
+    }
+}
+
+struct slow_object {
+    unsigned value;
+    explicit slow_object(uint64_t cycles) : value(sink) { spin(cycles); }
+};
+
+struct init_failed { };
+
+unsigned throwing_attempts;
+
+struct throwing_object {
+    throwing_object()
+    {
+        spin(abort_cycles);
+        if (throwing_attempts++ == 0) throw init_failed();
+    }
+};
+
+} // anon namespace
+
+// The functions containing the statics have external linkage, so that dladdr can name them.
+
+extern "C" __attribute__((noinline)) unsigned guard_slow_static()
+{
+    static slow_object s(slow_cycles);
+    return s.value;
+}
+
+extern "C" __attribute__((noinline)) unsigned guard_cheap_static()
+{
+    static unsigned v = sink + 1;
+    return v;
+}
+
+extern "C" __attribute__((noinline)) void guard_throwing_static()
+{
+    static throwing_object t;
+}
+
+extern "C" __attribute__((noinline)) unsigned guard_inner_static()
+{
+    static slow_object s(inner_cycles);
+    return s.value;
+}
+
+namespace {
+
+struct outer_object {
+    unsigned value;
+    outer_object() : value(guard_inner_static()) { spin(outer_cycles); }
+};
+
+} // anon namespace
+
+extern "C" __attribute__((noinline)) unsigned guard_outer_static()
+{
+    static outer_object o;
+    return o.value;
+}
+
+extern "C" __attribute__((noinline)) unsigned guard_shared_static()
+{
+    static slow_object s(slow_cycles / 2);
+    return s.value;
+}
+
+namespace {
+
+// The caller is a return address, so look up the address of the call instead
+const char *function_name(const void *caller)
+{
+    Dl_info info;
+    if (dladdr((const char *)caller - 1, &info) == 0 || info.dli_sname == nullptr) {
+        return "?";
+    }
+    return info.dli_sname;
+}
+
+void *thread_init(void *)
+{
+    for (unsigned i = 0; i < 100; ++i) {
+        guard_shared_static();
+    }
+    return nullptr;
+}
+
+const bmcxxabi_guard_init *find(const bmcxxabi_guard_init *inits, size_t num_inits,
+        const char *function)
+{
+    for (size_t i = 0; i < num_inits; ++i) {
+        if (strcmp(function_name(inits[i].caller), function) == 0) return &inits[i];
+    }
+    fprintf(stderr, "guard-profile: no initialisation recorded for %s\n", function);
+    ok = false;
+    return nullptr;
+}
+
+} // anon namespace
+
+int main(int argc, char **)
+{
+    if (argc != 1) {
+        fprintf(stderr, "usage: guard-profile\n");
+        return 1;
+    }
+
+    guard_slow_static();
+    guard_cheap_static();
+    try {
+        guard_throwing_static();
+    }
+    catch (init_failed &) {
+    }
+    guard_throwing_static();
+    guard_outer_static();
+
+    constexpr unsigned num_threads = 8;
+    pthread_t threads[num_threads];
+    for (pthread_t &t : threads) {
+        if (pthread_create(&t, nullptr, thread_init, nullptr) != 0) {
+            fprintf(stderr, "guard-profile: can't create thread\n");
+            return 1;
+        }
+    }
+    for (pthread_t &t : threads) {
+        pthread_join(t, nullptr);
+    }
+
+    // (initialising again does nothing)
+    guard_slow_static();
+    guard_throwing_static();
+
+    bmcxxabi_guard_init inits[64];
+    unsigned long long dropped;
+    size_t num_inits = bmcxxabi_guard_profile_snapshot(inits, 64, &dropped);
+
+    printf("cycles\taborts\tabort_cycles\tfunction\tguard\n");
+    for (size_t i = 0; i < num_inits; ++i) {
+        const bmcxxabi_guard_init &g = inits[i];
+        printf("%llu\t%llu\t%llu\t%s\t%p\n", g.cycles, g.aborts, g.abort_cycles,
+                function_name(g.caller), g.guard);
+    }
+
+    check(dropped == 0, "initialisations dropped");
+    for (size_t i = 0; i < num_inits; ++i) {
+        check(inits[i].complete != 0, "initialisation not complete");
+        if (i != 0) {
+            check(inits[i].cycles + inits[i].abort_cycles
+                    <= inits[i - 1].cycles + inits[i - 1].abort_cycles,
+                    "snapshot not sorted by time");
+        }
+        for (size_t j = 0; j < i; ++j) {
+            check(inits[i].guard != inits[j].guard, "guard recorded twice");
+        }
+    }
+
+    const bmcxxabi_guard_init *slow = find(inits, num_inits, "guard_slow_static");
+    const bmcxxabi_guard_init *cheap = find(inits, num_inits, "guard_cheap_static");
+    const bmcxxabi_guard_init *throwing = find(inits, num_inits, "guard_throwing_static");
+    const bmcxxabi_guard_init *inner = find(inits, num_inits, "guard_inner_static");
+    const bmcxxabi_guard_init *outer = find(inits, num_inits, "guard_outer_static");
+    const bmcxxabi_guard_init *shared = find(inits, num_inits, "guard_shared_static");
+    if (!ok) return 1;
+
+    check(slow->cycles >= slow_cycles && slow->aborts == 0, "slow static: wrong time");
+    check(cheap->cycles < slow_cycles / 10, "cheap static: too slow");
+    check(throwing->aborts == 1 && throwing->abort_cycles >= abort_cycles
+            && throwing->cycles >= abort_cycles, "throwing static: abort not recorded");
+    check(inner->cycles >= inner_cycles, "inner static: wrong time");
+    check(outer->cycles >= inner->cycles + outer_cycles, "outer static: doesn't include inner");
+    check(shared->cycles >= slow_cycles / 2 && shared->aborts == 0, "shared static: wrong time");
+    check(&inits[0] == slow, "slowest initialisation not first");
+
+    return ok ? 0 : 1;
+}
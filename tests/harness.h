@@ -0,0 +1,107 @@
+#ifndef HARNESS_H_INCLUDED
+#define HARNESS_H_INCLUDED 1
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Common parts of the test harnesses (throw_profile.cc, static_throw.cc, etc): reporting failed
+// checks, reading the time, and timing a body of code over a number of iterations. Each harness
+// defines harness_name, its program name, which prefixes the messages for failed checks.
+
+extern const char harness_name[];
+
+// Cleared by a failed check; the harness's exit status is non-zero if it is clear
+inline bool ok = true;
+
+namespace {
+
+inline void check(bool cond, const char *what)
+{
+    if (!cond) {
+        fprintf(stderr, "%s: %s\n", harness_name, what);
+        ok = false;
+    }
+}
+
+// The time, for timing short operations: TSC cycles on x86, nanoseconds elsewhere
+#if defined(__x86_64__) || defined(__i386__)
+const char time_unit[] = "cycles";
+
+inline uint64_t now()
+{
+    return __rdtsc();
+}
+#else
+const char time_unit[] = "ns";
+
+inline uint64_t now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+inline int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sort the times taken by the iterations of a benchmark, and print a result line (name, median,
+// minimum)
+inline void print_times(const char *name, uint64_t *times, unsigned iterations)
+{
+    qsort(times, iterations, sizeof(uint64_t), compare_u64);
+    printf("%s\t%llu\t%llu\n", name, (unsigned long long)times[iterations / 2],
+            (unsigned long long)times[0]);
+}
+
+// Time a body of code (after one untimed run), and print the result line; 'times' must have room
+// for 'iterations' entries
+template <typename F>
+void bench(const char *name, uint64_t *times, unsigned iterations, F body)
+{
+    body();
+    for (unsigned i = 0; i < iterations; ++i) {
+        uint64_t start = now();
+        body();
+        times[i] = now() - start;
+    }
+    print_times(name, times, iterations);
+}
+
+// Time two bodies of code alternately, so that both see the same conditions (the time of a throw
+// can shift between runs, eg with the placement of the unwinder's caches, by more than the
+// difference being measured), and print a result line for each; 'times' must have room for
+// 2 * 'iterations' entries
+template <typename F, typename G>
+void bench_pair(const char *name_a, const char *name_b, uint64_t *times, unsigned iterations,
+        F body_a, G body_b)
+{
+    uint64_t *times_b = times + iterations;
+    body_a();
+    body_b();
+    for (unsigned i = 0; i < iterations; ++i) {
+        uint64_t start = now();
+        body_a();
+        times[i] = now() - start;
+        start = now();
+        body_b();
+        times_b[i] = now() - start;
+    }
+    print_times(name_a, times, iterations);
+    print_times(name_b, times_b, iterations);
+}
+
+} // anon namespace
+
+#endif
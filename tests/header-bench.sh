@@ -0,0 +1,51 @@
+# Build libcxxabi.a with the default exception header and with the compact one
+# (BMCXX_COMPACT_EXCEPTION_HEADER), build bench-throw against each, run both with -m and tabulate,
+# for each benchmark, the median time, the header size, the cache lines spanned per exception and
+# the L1D misses per iteration. Arguments are passed to bench-throw (eg "-n 100000" or a benchmark
+# name filter).
+#
+# Each variant is built from a copy of the sources in a scratch directory (removed on exit), with
+# CXXFLAGS from the environment (eg "-O2 -DBMCXX_BOUNDED_LATENCY", for the pool allocator, whose
+# blocks are cache-line aligned; malloc'd headers span a number of lines which depends on malloc's
+# alignment), so the tree's own objects and libraries are left alone.
+#
+# "lines" is derived, not measured: bench-throw computes it from the address of each caught
+# exception's header and the header size (plus the first 8 bytes of the thrown object), assuming
+# 64-byte lines. "l1d_miss" is measured, by a perf_event_open counter of user-mode L1D read misses
+# around each benchmark; it is "-" where that counter isn't available (eg in a virtual machine
+# without a PMU).
+set -eu
+
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+for variant in default compact; do
+    flags=
+    if [ $variant = compact ]; then flags=-DBMCXX_COMPACT_EXCEPTION_HEADER; fi
+    mkdir "$scratch/$variant" "$scratch/$variant/src"
+    cp ../src/Makefile ../src/*.cc ../src/*.h "$scratch/$variant/src"
+    cp -R ../include "$scratch/$variant"
+    make -s -C "$scratch/$variant/src" OUTDIR="$scratch/$variant" \
+            CXXFLAGS="${CXXFLAGS:-} $flags" > /dev/null
+    g++ -O2 -o "$scratch/bench-throw-$variant" bench_throw.cc "$scratch/$variant/libcxxabi.a"
+    "$scratch/bench-throw-$variant" -m "$@" > "$scratch/header-$variant.out"
+done
+
+awk -F '\t' '
+FNR == 1 { ++file; next }
+file == 1 { order[++n] = $1 "/" $2 }
+{
+    k = $1 "/" $2
+    median[k, file] = $5; bytes[k, file] = $8; lines[k, file] = $9; misses[k, file] = $10
+}
+END {
+    printf "%-18s %9s %9s %7s %7s %7s %7s %9s %9s\n", "benchmark", "median", "compact", \
+            "bytes", "compact", "lines*", "compact", "l1d_miss", "compact"
+    for (i = 1; i <= n; ++i) {
+        k = order[i]
+        printf "%-18s %9s %9s %7s %7s %7s %7s %9s %9s\n", k, median[k, 1], median[k, 2], \
+                bytes[k, 1], bytes[k, 2], lines[k, 1], lines[k, 2], misses[k, 1], misses[k, 2]
+    }
+    print "(* derived from header addresses and size, not measured; l1d_miss via perf_event_open," \
+            " \"-\" without a PMU)"
+}' "$scratch/header-default.out" "$scratch/header-compact.out"
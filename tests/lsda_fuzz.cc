@@ -0,0 +1,1148 @@
+#include <csetjmp>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/dwarf_eh.h"
+
+#include "lsda_fuzz.h"
+
+// Host-side fuzzer and benchmark for LSDA decoding in the personality routine.
+//
+// Synthetic LSDAs are generated from a random abstract description (call sites, action chains,
+// types table, exception specifications) and encoded with a random choice of encodings. For each,
+// the result of the personality routine for a number of queries (IP, thrown type, unwind phase)
+// is checked against a reference model computed from the abstract description.
+//
+// The DWARF decoders, the call-site table walk and the exception specification walk are also
+// fuzzed with random/mutated/truncated input placed immediately before an inaccessible page, to
+// check that they never read past the end of their data (they may reject it, by calling abort(), which is intercepted via the linker's
+// --wrap option).
+//
+// Finally, the time per personality routine call is measured for some representative LSDA shapes.
+//
+// Build via "make lsda-fuzz" (in this directory). Run as:
+//
+//     ./lsda-fuzz [-s <seed>] [-n <cases>] [-F] [-B]
+//
+// -F skips the fuzzing (benchmark only), -B skips the benchmark. The exit status is non-zero if
+// any check fails.
+
+namespace {
+
+// ---- Random numbers ----
+
+struct rng {
+    uint64_t state;
+
+    uint64_t next()
+    {
+        // xorshift64*
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+
+    uint64_t below(uint64_t n) { return n == 0 ? 0 : next() % n; }
+    bool chance(unsigned percent) { return below(100) < percent; }
+
+    template <typename T, size_t N>
+    T pick(const T (&arr)[N]) { return arr[below(N)]; }
+};
+
+// ---- Abort/fault interception ----
+
+sigjmp_buf guard_jmp;
+volatile sig_atomic_t guard_active = 0;
+
+enum guard_result {
+    guard_ok, guard_aborted, guard_faulted
+};
+
+void fault_handler(int sig)
+{
+    if (guard_active) {
+        guard_active = 0;
+        siglongjmp(guard_jmp, guard_faulted);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+} // anon namespace
+
+extern "C" [[noreturn]] void __real_abort();
+
+extern "C" [[noreturn]] void __wrap_abort()
+{
+    if (guard_active) {
+        guard_active = 0;
+        siglongjmp(guard_jmp, guard_aborted);
+    }
+    __real_abort();
+}
+
+namespace {
+
+// Run a function, intercepting abort() and memory faults
+template <typename F>
+guard_result guarded(F f)
+{
+    int r = sigsetjmp(guard_jmp, 1);
+    if (r != 0) {
+        return (guard_result) r;
+    }
+    guard_active = 1;
+    f();
+    guard_active = 0;
+    return guard_ok;
+}
+
+// An area of memory immediately followed by an inaccessible page; data placed at the end of the
+// area can therefore not be read past.
+struct guarded_area {
+    uint8_t *base = nullptr;
+    size_t size = 0;
+
+    bool init(size_t min_size)
+    {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size = (min_size + page - 1) / page * page;
+        void *m = mmap(nullptr, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                -1, 0);
+        if (m == MAP_FAILED) return false;
+        base = (uint8_t *)m;
+        return mprotect(base + size, page, PROT_NONE) == 0;
+    }
+
+    // Get the address at which data of the given length should be placed
+    uint8_t *place(size_t len) { return base + size - len; }
+};
+
+// ---- Types (see lsda_fuzz_mock.cc) ----
+
+// can_catch[c][t]: whether catch type c catches thrown type t
+const bool can_catch[num_catch_types][num_thrown_types] = {
+    // A      B      C      D      int    B*
+    { true,  true,  true,  true,  true,  true  },  // (...)
+    { true,  true,  true,  false, false, false },  // A
+    { false, true,  true,  false, false, false },  // B
+    { false, false, true,  false, false, false },  // C
+    { false, false, false, true,  false, false },  // D
+    { false, false, false, false, true,  false },  // int
+    { false, false, false, false, false, true  },  // A *
+    { false, false, false, false, false, true  },  // const B *
+    { false, false, false, false, false, true  },  // B *
+};
+
+bool is_pointer_catch(unsigned c)
+{
+    return c == catch_A_ptr || c == catch_const_B_ptr || c == catch_B_ptr;
+}
+
+// Indirect (pointer-to-pointer) type table entries point at these
+const void *type_slots[num_catch_types];
+
+// ---- Abstract LSDA description ----
+
+struct model_call_site {
+    uint64_t start;
+    uint64_t len;
+    uint64_t lp;
+    int chain;          // index of action chain, or -1 for none (action 0: cleanup only)
+};
+
+// An action chain element: filter 0 = cleanup, > 0 = catch (types table index), < 0 = exception
+// spec (-1 = spec 0, -2 = spec 1, etc; the encoded filter is different)
+typedef std::vector<int> model_chain;
+
+struct model_lsda {
+    uintptr_t func_start;
+    uintptr_t lp_base;
+    uint8_t lp_start_encoding;
+    uint8_t types_encoding;
+    uint8_t callsite_encoding;
+    std::vector<unsigned> types;                 // catch type for each types table index - 1
+    std::vector<std::vector<unsigned>> specs;    // list of types table indices for each spec
+    std::vector<model_chain> chains;
+    std::vector<model_call_site> call_sites;
+};
+
+// Relative bases passed to the personality routine via the mock context
+struct rel_bases {
+    uintptr_t text;
+    uintptr_t data;
+};
+
+// Layout details of an encoded LSDA, needed by the model and the mutation fuzzer
+struct lsda_layout {
+    size_t size;
+    size_t callsite_start;              // offset of call-site table
+    size_t callsite_end;                // offset of end of call-site table
+    size_t types_end;                   // offset of end of types table (start of spec lists)
+    std::vector<int64_t> spec_filters;  // encoded filter for each spec
+};
+
+// ---- Encoding ----
+
+unsigned uleb_len(uint64_t v)
+{
+    unsigned n = 1;
+    while (v >= 0x80) { v >>= 7; n++; }
+    return n;
+}
+
+unsigned sleb_len(int64_t v)
+{
+    unsigned n = 1;
+    while (v >= 0x40 || v < -0x40) { v >>= 7; n++; }
+    return n;
+}
+
+struct writer {
+    std::vector<uint8_t> &b;
+    uintptr_t base;
+
+    uintptr_t addr() const { return base + b.size(); }
+
+    void u8(uint8_t v) { b.push_back(v); }
+
+    // (min_len allows a non-minimal encoding)
+    void uleb(uint64_t v, unsigned min_len = 1)
+    {
+        unsigned len = uleb_len(v);
+        if (len < min_len) len = min_len;
+        for (unsigned i = 1; i < len; i++) {
+            b.push_back((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        b.push_back(v & 0x7F);
+    }
+
+    void sleb(int64_t v, unsigned min_len = 1)
+    {
+        unsigned len = sleb_len(v);
+        if (len < min_len) len = min_len;
+        for (unsigned i = 1; i < len; i++) {
+            b.push_back((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        b.push_back(v & 0x7F);
+    }
+
+    void fixed(uint64_t v, unsigned size)
+    {
+        for (unsigned i = 0; i < size; i++) {
+            b.push_back(v & 0xFF);
+            v >>= 8;
+        }
+    }
+
+    void align(unsigned a)
+    {
+        while (addr() % a != 0) b.push_back(0);
+    }
+
+    // Write a value with the specified encoding, such that decoding it (with the given bases and
+    // function start) gives 'target' (or, for an indirect encoding, the address holding the
+    // value). Returns false if not representable.
+    bool encoded(uint8_t encoding, uintptr_t target, const rel_bases &bases, uintptr_t func)
+    {
+        if ((encoding & 0x70u) == DW_EH_PE_aligned) {
+            align(sizeof(uintptr_t));
+        }
+
+        uint64_t raw = target;
+        if (target != 0) {
+            switch (encoding & 0x70u) {
+            case DW_EH_PE_pcrel: raw = target - addr(); break;
+            case DW_EH_PE_textrel: raw = target - bases.text; break;
+            case DW_EH_PE_datarel: raw = target - bases.data; break;
+            case DW_EH_PE_funcrel: raw = target - func; break;
+            default: break;
+            }
+            if (raw == 0) return false;  // would decode as 0
+        }
+
+        int64_t sraw = (int64_t)raw;
+        switch (encoding & 0x0Fu) {
+        case DW_EH_PE_absptr:
+        case DW_EH_PE_udata8:
+        case DW_EH_PE_sdata8:
+            fixed(raw, 8);
+            break;
+        case DW_EH_PE_uleb128:
+            uleb(raw);
+            break;
+        case DW_EH_PE_sleb128:
+            sleb(sraw);
+            break;
+        case DW_EH_PE_udata2:
+            if (raw > 0xFFFF) return false;
+            fixed(raw, 2);
+            break;
+        case DW_EH_PE_sdata2:
+            if (sraw < -0x8000 || sraw > 0x7FFF) return false;
+            fixed(raw, 2);
+            break;
+        case DW_EH_PE_udata4:
+            if (raw > 0xFFFFFFFFu) return false;
+            fixed(raw, 4);
+            break;
+        case DW_EH_PE_sdata4:
+            if (sraw < -0x80000000LL || sraw > 0x7FFFFFFFLL) return false;
+            fixed(raw, 4);
+            break;
+        default:
+            return false;
+        }
+        return true;
+    }
+};
+
+// Encode an LSDA for placement at 'dest'. Returns false if it can't be encoded (some value is
+// not representable in the chosen encoding).
+bool encode_lsda(const model_lsda &m, uintptr_t dest, const rel_bases &bases,
+        std::vector<uint8_t> &out, lsda_layout &layout, rng &r)
+{
+    out.clear();
+    writer w { out, dest };
+
+    // Header: landing pad base
+    w.u8(m.lp_start_encoding);
+    if (m.lp_start_encoding != DW_EH_PE_omit) {
+        if (!w.encoded(m.lp_start_encoding, m.lp_base, bases, m.func_start)) return false;
+    }
+
+    // Spec lists (after the types table) and their offsets
+    std::vector<uint8_t> spec_bytes;
+    writer sw { spec_bytes, 0 };
+    layout.spec_filters.clear();
+    for (const std::vector<unsigned> &spec : m.specs) {
+        layout.spec_filters.push_back(-(int64_t)spec_bytes.size() - 1);
+        for (unsigned idx : spec) {
+            sw.uleb(idx, r.chance(10) ? 2 : 1);
+        }
+        sw.u8(0);
+    }
+
+    // Action table: records for each chain, laid out forwards or backwards (so that offsets to
+    // the next record may be negative). The "next" field is a fixed (possibly non-minimal) width.
+    std::vector<int64_t> chain_action(m.chains.size());
+    std::vector<uint8_t> actions;
+    std::vector<bool> reversed(m.chains.size());
+    for (size_t i = 0; i < m.chains.size(); i++) reversed[i] = r.chance(30);
+
+    auto encoded_filter = [&](int f) -> int64_t {
+        return f >= 0 ? f : layout.spec_filters[-f - 1];
+    };
+
+    for (unsigned next_width = 1; ; next_width++) {
+        if (next_width > 4) return false;
+        actions.clear();
+        writer aw { actions, 0 };
+        bool fits = true;
+        int64_t max_offs = ((int64_t)1 << (next_width * 7 - 1)) - 1;
+
+        for (size_t ci = 0; ci < m.chains.size() && fits; ci++) {
+            const model_chain &chain = m.chains[ci];
+            size_t n = chain.size();
+            std::vector<size_t> pos(n);
+            size_t p = actions.size();
+            for (size_t k = 0; k < n; k++) {
+                size_t i = reversed[ci] ? n - 1 - k : k;
+                pos[i] = p;
+                p += sleb_len(encoded_filter(chain[i])) + next_width;
+            }
+            for (size_t k = 0; k < n; k++) {
+                size_t i = reversed[ci] ? n - 1 - k : k;
+                int64_t filter = encoded_filter(chain[i]);
+                int64_t next = 0;
+                if (i + 1 < n) {
+                    next = (int64_t)pos[i + 1] - (int64_t)(pos[i] + sleb_len(filter));
+                    if (next > max_offs || next < -max_offs - 1) fits = false;
+                }
+                aw.sleb(filter);
+                aw.sleb(next, next_width);
+            }
+            chain_action[ci] = pos[0] + 1;
+        }
+        if (fits) break;
+    }
+
+    // Call-site table
+    std::vector<uint8_t> call_sites;
+    writer cw { call_sites, 0 };
+    for (const model_call_site &cs : m.call_sites) {
+        if (!cw.encoded(m.callsite_encoding, cs.start, bases, 0)) return false;
+        if (!cw.encoded(m.callsite_encoding, cs.len, bases, 0)) return false;
+        if (!cw.encoded(m.callsite_encoding, cs.lp, bases, 0)) return false;
+        uint64_t action = cs.chain < 0 ? 0 : chain_action[cs.chain];
+        cw.uleb(action, r.chance(5) ? 3 : 1);
+    }
+
+    size_t rest_size = 1 + uleb_len(call_sites.size()) + call_sites.size() + actions.size();
+
+    // Types table offset. The types table is aligned (by padding after the action table), which
+    // can affect the offset, which can affect the size of the offset field...
+    w.u8(m.types_encoding);
+    size_t pad = 0;
+    if (m.types_encoding != DW_EH_PE_omit) {
+        unsigned entry_size = size_from_encoding(m.types_encoding);
+        unsigned align_to = ((m.types_encoding & 0x70u) == DW_EH_PE_aligned)
+                ? sizeof(uintptr_t) : entry_size;
+        unsigned len;
+        uint64_t offset;
+        for (len = 1; ; len++) {
+            uintptr_t types_start = w.addr() + len + rest_size;
+            pad = (align_to - types_start % align_to) % align_to;
+            offset = rest_size + pad + m.types.size() * entry_size;
+            if (uleb_len(offset) <= len) break;
+        }
+        w.uleb(offset, len);
+    }
+
+    w.u8(m.callsite_encoding);
+    w.uleb(call_sites.size());
+    layout.callsite_start = out.size();
+    out.insert(out.end(), call_sites.begin(), call_sites.end());
+    layout.callsite_end = out.size();
+    out.insert(out.end(), actions.begin(), actions.end());
+    out.insert(out.end(), pad, 0);
+
+    if (m.types_encoding != DW_EH_PE_omit) {
+        // Types table: entry for index i is at (end - i * size)
+        for (size_t i = m.types.size(); i > 0; i--) {
+            unsigned ct = m.types[i - 1];
+            uintptr_t target = (uintptr_t)fuzz_catch_types[ct];
+            if ((m.types_encoding & DW_EH_PE_indirect) && target != 0) {
+                target = (uintptr_t)&type_slots[ct];
+            }
+            if (!w.encoded(m.types_encoding, target, bases, m.func_start)) return false;
+        }
+        layout.types_end = out.size();
+        out.insert(out.end(), spec_bytes.begin(), spec_bytes.end());
+    }
+    else {
+        layout.types_end = out.size();
+    }
+
+    layout.size = out.size();
+    return true;
+}
+
+// ---- Reference model ----
+
+struct expected_result {
+    _Unwind_Reason_Code code;
+    // for _URC_HANDLER_FOUND:
+    int switch_value;
+    void *adjusted_ptr;
+    // for _URC_HANDLER_FOUND (catch_temp) and _URC_INSTALL_CONTEXT (new IP):
+    uintptr_t landing_pad;
+};
+
+expected_result model_personality(const model_lsda &m, const lsda_layout &layout, uint64_t ip_offs,
+        _Unwind_Action actions, unsigned thrown, void *thrown_obj)
+{
+    expected_result res { _URC_FATAL_PHASE1_ERROR, 0, nullptr, 0 };
+
+    const model_call_site *cs = nullptr;
+    for (const model_call_site &c : m.call_sites) {
+        if (ip_offs < c.start) break;
+        if (ip_offs - c.start < c.len) {
+            cs = &c;
+            break;
+        }
+    }
+    if (cs == nullptr) {
+        return res;
+    }
+
+    res.code = _URC_CONTINUE_UNWIND;
+    if (cs->lp == 0) {
+        return res;
+    }
+
+    bool search = actions & _UA_SEARCH_PHASE;
+    uintptr_t lp = m.lp_base + cs->lp;
+
+    if (cs->chain < 0) {
+        if (!search) {
+            res.code = _URC_INSTALL_CONTEXT;
+            res.landing_pad = lp;
+        }
+        return res;
+    }
+
+    bool check_handlers = search && !(actions & _UA_FORCE_UNWIND);
+    bool have_cleanup = false;
+
+    for (int f : m.chains[cs->chain]) {
+        if (f == 0) {
+            have_cleanup = true;
+        }
+        else if (!check_handlers) {
+            // skip
+        }
+        else if (f > 0) {
+            unsigned ct = m.types[f - 1];
+            if (can_catch[ct][thrown]) {
+                res.code = _URC_HANDLER_FOUND;
+                res.switch_value = f;
+                res.adjusted_ptr = (is_pointer_catch(ct)) ? *(void **)thrown_obj : thrown_obj;
+                res.landing_pad = lp;
+                return res;
+            }
+        }
+        else {
+            bool allowed = false;
+            for (unsigned idx : m.specs[-f - 1]) {
+                if (can_catch[m.types[idx - 1]][thrown]) allowed = true;
+            }
+            if (!allowed) {
+                res.code = _URC_HANDLER_FOUND;
+                res.switch_value = (int)layout.spec_filters[-f - 1];
+                res.adjusted_ptr = thrown_obj;
+                res.landing_pad = lp;
+                return res;
+            }
+        }
+    }
+
+    if (have_cleanup && !search) {
+        res.code = _URC_INSTALL_CONTEXT;
+        res.landing_pad = lp;
+    }
+    return res;
+}
+
+// ---- Random LSDA generation ----
+
+const uint8_t lp_start_encodings[] = {
+    DW_EH_PE_omit, DW_EH_PE_omit, DW_EH_PE_absptr, DW_EH_PE_udata8, DW_EH_PE_uleb128,
+    DW_EH_PE_pcrel | DW_EH_PE_sdata8, DW_EH_PE_funcrel | DW_EH_PE_udata4,
+    DW_EH_PE_textrel | DW_EH_PE_sdata8, DW_EH_PE_datarel | DW_EH_PE_sdata8,
+    DW_EH_PE_aligned
+};
+
+const uint8_t types_encodings[] = {
+    DW_EH_PE_indirect | DW_EH_PE_pcrel | DW_EH_PE_sdata4,
+    DW_EH_PE_indirect | DW_EH_PE_pcrel | DW_EH_PE_sdata4,
+    DW_EH_PE_udata4, DW_EH_PE_absptr, DW_EH_PE_udata8, DW_EH_PE_aligned,
+    DW_EH_PE_pcrel | DW_EH_PE_sdata4, DW_EH_PE_pcrel | DW_EH_PE_sdata8,
+    DW_EH_PE_datarel | DW_EH_PE_sdata4, DW_EH_PE_textrel | DW_EH_PE_sdata8,
+    DW_EH_PE_indirect | DW_EH_PE_absptr, DW_EH_PE_indirect | DW_EH_PE_udata8
+};
+
+const uint8_t callsite_encodings[] = {
+    DW_EH_PE_uleb128, DW_EH_PE_uleb128, DW_EH_PE_udata4, DW_EH_PE_udata4, DW_EH_PE_udata2,
+    DW_EH_PE_udata8, DW_EH_PE_sdata2, DW_EH_PE_sdata4, DW_EH_PE_sdata8, DW_EH_PE_sleb128,
+    DW_EH_PE_absptr
+};
+
+uint64_t max_for_encoding(uint8_t encoding)
+{
+    switch (encoding & 0x0Fu) {
+    case DW_EH_PE_udata2: return 0xFFFF;
+    case DW_EH_PE_sdata2: return 0x7FFF;
+    default: return 0x7FFFFFFF;
+    }
+}
+
+// Generate a random count, mostly small but occasionally large
+unsigned random_count(rng &r, unsigned max)
+{
+    switch (r.below(4)) {
+    case 0: return r.below(5 < max ? 5 : max + 1);
+    case 1: return r.below(20 < max ? 20 : max + 1);
+    case 2: return r.below(100 < max ? 100 : max + 1);
+    default: return r.below(max + 1);
+    }
+}
+
+model_lsda random_lsda(rng &r, bool allow_actions)
+{
+    model_lsda m;
+    m.func_start = 0x10000000 + r.below(1u << 20) * 16;
+    m.lp_start_encoding = r.pick(lp_start_encodings);
+    m.lp_base = (m.lp_start_encoding == DW_EH_PE_omit) ? m.func_start
+            : m.func_start + 1 + r.below(0x10000);
+    m.callsite_encoding = r.pick(callsite_encodings);
+
+    unsigned n_types = allow_actions ? random_count(r, 300) : 0;
+    for (unsigned i = 0; i < n_types; i++) {
+        m.types.push_back(r.below(num_catch_types));
+    }
+
+    // Exception specifications; these can't include catch(...) entries
+    std::vector<unsigned> spec_candidates;
+    for (unsigned i = 0; i < n_types; i++) {
+        if (m.types[i] != catch_any) spec_candidates.push_back(i + 1);
+    }
+    unsigned n_specs = allow_actions ? r.below(4) : 0;
+    for (unsigned i = 0; i < n_specs; i++) {
+        std::vector<unsigned> spec;
+        if (!spec_candidates.empty()) {
+            unsigned len = r.below(4);
+            for (unsigned j = 0; j < len; j++) {
+                spec.push_back(spec_candidates[r.below(spec_candidates.size())]);
+            }
+        }
+        m.specs.push_back(spec);
+    }
+
+    unsigned n_chains = allow_actions ? r.below(10) : 0;
+    for (unsigned i = 0; i < n_chains; i++) {
+        model_chain chain;
+        unsigned len = 1 + r.below(6);
+        for (unsigned j = 0; j < len; j++) {
+            unsigned kind = r.below(100);
+            if (kind < 15 || (n_types == 0 && n_specs == 0)) {
+                chain.push_back(0);
+            }
+            else if ((kind < 30 && n_specs != 0) || n_types == 0) {
+                chain.push_back(-1 - (int)r.below(n_specs));
+            }
+            else {
+                chain.push_back(1 + r.below(n_types));
+            }
+        }
+        m.chains.push_back(chain);
+    }
+
+    // A types table is needed if there are any actions
+    if (n_chains != 0 || n_types != 0 || r.chance(50)) {
+        m.types_encoding = r.pick(types_encodings);
+        if (!allow_actions) m.types_encoding = DW_EH_PE_omit;
+    }
+    else {
+        m.types_encoding = DW_EH_PE_omit;
+    }
+
+    uint64_t max_val = max_for_encoding(m.callsite_encoding);
+    unsigned n_sites = random_count(r, 600);
+    uint64_t cur = r.below(16);
+    for (unsigned i = 0; i < n_sites; i++) {
+        model_call_site cs;
+        cur += r.chance(60) ? 0 : 1 + r.below(32);
+        cs.start = cur;
+        cs.len = 1 + (r.chance(90) ? r.below(64) : r.below(5000));
+        cs.lp = r.chance(10) ? 0 : 1 + r.below(max_val < 0x10000 ? max_val : 0x10000);
+        cs.chain = (n_chains == 0 || r.chance(30)) ? -1 : (int)r.below(n_chains);
+        if (cs.start + cs.len > max_val) break;
+        cur = cs.start + cs.len;
+        m.call_sites.push_back(cs);
+    }
+
+    return m;
+}
+
+// ---- Running the personality routine ----
+
+const int eh_version = 1;
+
+struct run_result {
+    _Unwind_Reason_Code code;
+    guard_result guard;
+    _Unwind_Context context;
+};
+
+run_result run_personality(const uint8_t *lsda, const model_lsda &m, const rel_bases &bases,
+        uint64_t ip_offs, _Unwind_Action actions, _Unwind_Exception *exc)
+{
+    run_result res;
+    res.code = _URC_FATAL_PHASE2_ERROR;
+    res.context = _Unwind_Context { lsda, m.func_start + ip_offs + 1, m.func_start, bases.text,
+            bases.data, { 0, 0 }, 0 };
+    res.guard = guarded([&]() {
+        res.code = __gxx_personality_v0(eh_version, actions, exc->exception_class, exc,
+                &res.context);
+    });
+    return res;
+}
+
+// Choose an IP offset to query: usually inside or at the edges of a call site
+uint64_t random_ip_offs(rng &r, const model_lsda &m)
+{
+    if (m.call_sites.empty() || r.chance(10)) {
+        return r.below(0x10000);
+    }
+    const model_call_site &cs = m.call_sites[r.below(m.call_sites.size())];
+    switch (r.below(4)) {
+    case 0: return cs.start;
+    case 1: return cs.start + cs.len - 1;
+    case 2: return cs.start + cs.len;
+    default: return cs.start + r.below(cs.len);
+    }
+}
+
+const _Unwind_Action query_actions[] = {
+    _UA_SEARCH_PHASE, _UA_SEARCH_PHASE, _UA_CLEANUP_PHASE, _UA_CLEANUP_PHASE | _UA_FORCE_UNWIND
+};
+
+void dump_bytes(const uint8_t *p, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        printf("%02x%s", p[i], (i % 32 == 31 || i + 1 == len) ? "\n" : " ");
+    }
+}
+
+double now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The LSDAs for the model check are placed here; being in the image, type_info objects are
+// in range for 32-bit relative encodings.
+alignas(16) uint8_t lsda_arena[1 << 20];
+
+// Check the personality routine against the model for randomly generated LSDAs
+bool fuzz_model(rng &r, unsigned cases, const rel_bases &bases)
+{
+    std::vector<uint8_t> bytes;
+    lsda_layout layout;
+    unsigned queries = 0, skipped = 0;
+    double total_ns = 0;
+
+    for (unsigned c = 0; c < cases; c++) {
+        model_lsda m = random_lsda(r, true);
+        uint8_t *dest = lsda_arena + r.below(64);
+        if (!encode_lsda(m, (uintptr_t)dest, bases, bytes, layout, r)
+                || bytes.size() > sizeof(lsda_arena) - 64) {
+            skipped++;
+            continue;
+        }
+        memcpy(dest, bytes.data(), bytes.size());
+
+        for (unsigned q = 0; q < 16; q++) {
+            uint64_t ip_offs = random_ip_offs(r, m);
+            _Unwind_Action actions = r.pick(query_actions);
+            unsigned thrown = r.below(num_thrown_types);
+            _Unwind_Exception *exc = fuzz_init_exception(thrown);
+
+            expected_result expected = model_personality(m, layout, ip_offs, actions, thrown,
+                    fuzz_thrown_object(exc));
+
+            double start = now_ns();
+            run_result res = run_personality(dest, m, bases, ip_offs, actions, exc);
+            total_ns += now_ns() - start;
+            queries++;
+
+            bool ok = res.guard == guard_ok && res.code == expected.code;
+            if (ok && expected.code == _URC_HANDLER_FOUND) {
+                fuzz_handler_info hi = fuzz_get_handler_info(exc);
+                ok = hi.switch_value == expected.switch_value
+                        && hi.adjusted_ptr == expected.adjusted_ptr
+                        && (uintptr_t)hi.catch_temp == expected.landing_pad;
+            }
+            if (ok && expected.code == _URC_INSTALL_CONTEXT) {
+                ok = res.context.new_ip == expected.landing_pad
+                        && res.context.gr[0] == (uintptr_t)exc && res.context.gr[1] == 0;
+            }
+
+            if (!ok) {
+                printf("FAIL: case %u query %u: ip offset 0x%llx, actions %d, thrown type %u\n",
+                        c, q, (unsigned long long)ip_offs, (int)actions, thrown);
+                printf("  encodings: lp_start 0x%02x, types 0x%02x, call sites 0x%02x; "
+                        "%zu call sites, %zu types, %zu specs, %zu chains\n",
+                        m.lp_start_encoding, m.types_encoding, m.callsite_encoding,
+                        m.call_sites.size(), m.types.size(), m.specs.size(), m.chains.size());
+                printf("  expected result %d, got %d%s\n", (int)expected.code, (int)res.code,
+                        res.guard == guard_aborted ? " (aborted)"
+                        : res.guard == guard_faulted ? " (fault)" : "");
+                if (bytes.size() <= 512) dump_bytes(dest, bytes.size());
+                return false;
+            }
+        }
+    }
+
+    printf("model check: %u LSDAs (%u skipped), %u queries: OK; %.1f ns per call (average)\n",
+            cases - skipped, skipped, queries, queries ? total_ns / queries : 0.0);
+    return true;
+}
+
+// Reference LEB128 decoding, one byte at a time; returns false if the value runs past 'end'
+bool ref_leb128(const uint8_t *p, const uint8_t *end, bool is_signed, uint64_t &val,
+        size_t &len)
+{
+    val = 0;
+    unsigned shift = 0;
+    const uint8_t *start = p;
+    uint8_t b;
+    do {
+        if (p == end) return false;
+        b = *p++;
+        if (shift < 64) val |= (uint64_t)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    if (is_signed && (b & 0x40) && shift < 64) {
+        val |= ~(uint64_t)0 << shift;
+    }
+    len = p - start;
+    return true;
+}
+
+// Fuzz the bounded decoders with random data placed just before an inaccessible page
+bool fuzz_decoders(rng &r, unsigned iterations, guarded_area &area)
+{
+    const uint8_t encodings[] = {
+        DW_EH_PE_absptr, DW_EH_PE_uleb128, DW_EH_PE_udata2, DW_EH_PE_udata4, DW_EH_PE_udata8,
+        DW_EH_PE_sleb128, DW_EH_PE_sdata2, DW_EH_PE_sdata4, DW_EH_PE_sdata8,
+        DW_EH_PE_pcrel | DW_EH_PE_sdata4, DW_EH_PE_aligned, DW_EH_PE_funcrel | DW_EH_PE_udata4
+    };
+    dwarf_eh_bases eh_bases { 0, 0, 0x1000 };
+
+    unsigned rejected = 0;
+
+    for (unsigned i = 0; i < iterations; i++) {
+        size_t len = r.below(24);
+        uint8_t *p = area.place(len);
+        unsigned cont_pct = r.below(100);
+        for (size_t j = 0; j < len; j++) {
+            p[j] = (r.below(128)) | (r.chance(cont_pct) ? 0x80 : 0);
+        }
+        const uint8_t *end = p + len;
+
+        // LEB128
+        bool is_signed = r.chance(50);
+        uint64_t ref_val;
+        size_t ref_len;
+        bool ref_ok = ref_leb128(p, end, is_signed, ref_val, ref_len);
+
+        uint64_t val = 0;
+        const uint8_t *rp = p;
+        guard_result g = guarded([&]() {
+            val = is_signed ? (uint64_t)read_SLEB128(rp, end) : (uint64_t)read_ULEB128(rp, end);
+        });
+        bool ok = (g == guard_ok && ref_ok && val == ref_val && (size_t)(rp - p) == ref_len)
+                || (g == guard_aborted && !ref_ok);
+        if (!ok) {
+            printf("FAIL: %s decode of %zu bytes: %s", is_signed ? "SLEB128" : "ULEB128", len,
+                    g == guard_faulted ? "fault\n" : "mismatch\n");
+            dump_bytes(p, len);
+            return false;
+        }
+
+        // Encoded value
+        uint8_t encoding = r.pick(encodings);
+        rp = p;
+        g = guarded([&]() {
+            val = read_dwarf_encoded_bounded(rp, end, encoding, &eh_bases);
+        });
+        if (g == guard_faulted || (g == guard_ok && rp > end)) {
+            printf("FAIL: decode of %zu bytes with encoding 0x%02x: read past end\n", len,
+                    encoding);
+            dump_bytes(p, len);
+            return false;
+        }
+        if (g == guard_aborted) rejected++;
+    }
+
+    printf("decoder fuzz: %u inputs (%u encoded-value inputs rejected): OK\n", iterations,
+            rejected);
+    return true;
+}
+
+// Fuzz the call-site table walk with mutated call-site tables, in LSDAs placed just before an
+// inaccessible page. (Only the call-site table is mutated: the personality routine cannot know
+// the extent of the LSDA as a whole, only that of the call-site table.)
+bool fuzz_call_sites(rng &r, unsigned iterations, guarded_area &area, const rel_bases &bases)
+{
+    std::vector<uint8_t> bytes;
+    lsda_layout layout;
+    unsigned rejected = 0, done = 0;
+
+    while (done < iterations) {
+        model_lsda m = random_lsda(r, false);
+        if (m.call_sites.empty()) continue;
+        // Encode once to find the size, and again at the final address (the encoding of some
+        // values depends on the address; if that changes the size, just try another LSDA).
+        rng enc_r = r;
+        uint8_t *dest = area.place(0);
+        if (!encode_lsda(m, (uintptr_t)dest, bases, bytes, layout, enc_r)) continue;
+        if (bytes.size() > area.size) continue;
+        dest = area.place(bytes.size());
+        enc_r = r;
+        if (!encode_lsda(m, (uintptr_t)dest, bases, bytes, layout, enc_r)
+                || bytes.size() != (size_t)(area.base + area.size - dest)) {
+            continue;
+        }
+        r = enc_r;
+        memcpy(dest, bytes.data(), bytes.size());
+
+        size_t cs_len = layout.callsite_end - layout.callsite_start;
+        unsigned mutations = 1 + r.below(8);
+        for (unsigned k = 0; k < mutations; k++) {
+            size_t pos = layout.callsite_start + r.below(cs_len);
+            switch (r.below(3)) {
+            case 0: dest[pos] ^= 1u << r.below(8); break;
+            case 1: dest[pos] = r.below(256); break;
+            default: dest[pos] |= 0x80; break;
+            }
+        }
+
+        for (unsigned q = 0; q < 4; q++) {
+            _Unwind_Exception *exc = fuzz_init_exception(r.below(num_thrown_types));
+            run_result res = run_personality(dest, m, bases, random_ip_offs(r, m),
+                    r.pick(query_actions), exc);
+            if (res.guard == guard_faulted) {
+                printf("FAIL: fault in call-site table walk (mutated LSDA, %zu bytes):\n",
+                        bytes.size());
+                if (bytes.size() <= 512) dump_bytes(dest, bytes.size());
+                return false;
+            }
+            if (res.guard == guard_aborted) rejected++;
+        }
+        done++;
+    }
+
+    printf("call-site table fuzz: %u mutated LSDAs (%u queries rejected): OK\n", iterations,
+            rejected);
+    return true;
+}
+
+// Truncate the last exception specification list of an encoded LSDA (drop its terminating 0),
+// and follow it with 0x80 bytes (LEB128 continuation) up to the furthest extent the personality
+// routine allows the list, which the LSDA doesn't record: a list of every types table entry, each
+// index with a maximal-length encoding, plus the terminator.
+void truncate_last_spec(const model_lsda &m, const lsda_layout &layout, std::vector<uint8_t> &bytes)
+{
+    const unsigned max_leb128_len = (sizeof(uintptr_t) * 8 + 6) / 7;
+    size_t entries = (layout.types_end - layout.callsite_end)
+            / size_from_encoding(m.types_encoding);
+    size_t last_start = layout.types_end + (-layout.spec_filters.back() - 1);
+    size_t limit = last_start + (entries + 1) * max_leb128_len;
+    bytes.pop_back();
+    bytes.resize(limit, 0x80);
+}
+
+// Fuzz the exception specification walk with a truncated final spec list, in LSDAs placed just
+// before an inaccessible page (at the list's furthest allowed extent). Every call site with an
+// action refers to a chain which begins with that spec, and the queries are search phase
+// queries, so that the list is read unless the thrown type matches one of its entries.
+bool fuzz_spec_lists(rng &r, unsigned iterations, guarded_area &area, const rel_bases &bases)
+{
+    std::vector<uint8_t> bytes;
+    lsda_layout layout;
+    unsigned rejected = 0, done = 0;
+
+    while (done < iterations) {
+        model_lsda m = random_lsda(r, true);
+        if (m.call_sites.empty() || m.specs.empty() || m.types_encoding == DW_EH_PE_omit) {
+            continue;
+        }
+        m.chains.push_back(model_chain { -(int)m.specs.size() });
+        for (model_call_site &cs : m.call_sites) {
+            if (cs.chain >= 0 || r.chance(50)) cs.chain = (int)m.chains.size() - 1;
+        }
+
+        // Encode once to find the size, and again at the final address (as for fuzz_call_sites)
+        rng enc_r = r;
+        uint8_t *dest = area.place(0);
+        if (!encode_lsda(m, (uintptr_t)dest, bases, bytes, layout, enc_r)) continue;
+        truncate_last_spec(m, layout, bytes);
+        if (bytes.size() > area.size) continue;
+        dest = area.place(bytes.size());
+        enc_r = r;
+        if (!encode_lsda(m, (uintptr_t)dest, bases, bytes, layout, enc_r)) continue;
+        truncate_last_spec(m, layout, bytes);
+        if (bytes.size() != (size_t)(area.base + area.size - dest)) continue;
+        r = enc_r;
+        memcpy(dest, bytes.data(), bytes.size());
+
+        for (unsigned q = 0; q < 4; q++) {
+            _Unwind_Exception *exc = fuzz_init_exception(r.below(num_thrown_types));
+            run_result res = run_personality(dest, m, bases, random_ip_offs(r, m),
+                    _UA_SEARCH_PHASE, exc);
+            if (res.guard == guard_faulted) {
+                printf("FAIL: fault in exception specification walk (truncated list, "
+                        "LSDA %zu bytes):\n", bytes.size());
+                if (bytes.size() <= 512) dump_bytes(dest, bytes.size());
+                return false;
+            }
+            if (res.guard == guard_aborted) rejected++;
+        }
+        done++;
+    }
+
+    if (rejected == 0) {
+        printf("FAIL: no truncated exception specification list was rejected\n");
+        return false;
+    }
+    printf("spec list fuzz: %u truncated lists (%u queries rejected): OK\n", iterations,
+            rejected);
+    return true;
+}
+
+// ---- Benchmark ----
+
+struct bench_shape {
+    const char *name;
+    uint8_t callsite_encoding;
+    uint8_t types_encoding;
+    unsigned call_sites;
+    _Unwind_Action actions;
+};
+
+model_lsda bench_lsda(const bench_shape &shape)
+{
+    model_lsda m;
+    m.func_start = 0x10000000;
+    m.lp_base = m.func_start;
+    m.lp_start_encoding = DW_EH_PE_omit;
+    m.types_encoding = shape.types_encoding;
+    m.callsite_encoding = shape.callsite_encoding;
+    m.types = { catch_D, catch_int, catch_A };
+    // catch (D), catch (int), catch (A)
+    m.chains.push_back(model_chain { 1, 2, 3 });
+    // local with destructor, in the same try block
+    m.chains.push_back(model_chain { 0, 1, 2, 3 });
+
+    uint64_t cur = 0;
+    for (unsigned i = 0; i < shape.call_sites; i++) {
+        // Typical call sites are a few bytes apart with small gaps
+        model_call_site cs { cur, 5 + (i % 7), 0x400 + 16 * i, (int)(i % 3) - 1 };
+        if (cs.chain < 0 && (shape.actions & _UA_SEARCH_PHASE)) cs.chain = 0;
+        m.call_sites.push_back(cs);
+        cur += cs.len + (i % 4);
+    }
+    return m;
+}
+
+bool run_benchmark(const rel_bases &bases)
+{
+    const bench_shape shapes[] = {
+        { "gcc pic, 4 call sites", DW_EH_PE_uleb128,
+                DW_EH_PE_indirect | DW_EH_PE_pcrel | DW_EH_PE_sdata4, 4, _UA_SEARCH_PHASE },
+        { "gcc pic, 32 call sites", DW_EH_PE_uleb128,
+                DW_EH_PE_indirect | DW_EH_PE_pcrel | DW_EH_PE_sdata4, 32, _UA_SEARCH_PHASE },
+        { "gcc pic, 256 call sites", DW_EH_PE_uleb128,
+                DW_EH_PE_indirect | DW_EH_PE_pcrel | DW_EH_PE_sdata4, 256, _UA_SEARCH_PHASE },
+        { "gcc non-pic, 32 call sites", DW_EH_PE_uleb128, DW_EH_PE_udata4, 32,
+                _UA_SEARCH_PHASE },
+        { "clang udata4, 32 call sites", DW_EH_PE_udata4,
+                DW_EH_PE_indirect | DW_EH_PE_pcrel | DW_EH_PE_sdata4, 32, _UA_SEARCH_PHASE },
+        { "generic (udata8), 32 call sites", DW_EH_PE_udata8, DW_EH_PE_udata8, 32,
+                _UA_SEARCH_PHASE },
+        { "cleanup phase, 32 call sites", DW_EH_PE_uleb128,
+                DW_EH_PE_indirect | DW_EH_PE_pcrel | DW_EH_PE_sdata4, 32, _UA_CLEANUP_PHASE },
+    };
+
+    std::vector<uint8_t> bytes;
+    lsda_layout layout;
+    rng r { 1 };
+
+    printf("\n%-36s %10s\n", "LSDA shape (IP in last call site)", "ns/call");
+
+    for (const bench_shape &shape : shapes) {
+        model_lsda m = bench_lsda(shape);
+        uint8_t *dest = lsda_arena;
+        if (!encode_lsda(m, (uintptr_t)dest, bases, bytes, layout, r)) {
+            printf("%-36s %10s\n", shape.name, "(n/a)");
+            continue;
+        }
+        memcpy(dest, bytes.data(), bytes.size());
+
+        const model_call_site &last = m.call_sites.back();
+        uint64_t ip_offs = last.start + last.len / 2;
+        _Unwind_Exception *exc = fuzz_init_exception(thrown_B);
+        _Unwind_Context context { dest, m.func_start + ip_offs + 1, m.func_start, bases.text,
+                bases.data, { 0, 0 }, 0 };
+
+        // Check first that the result is as expected
+        expected_result expected = model_personality(m, layout, ip_offs, shape.actions, thrown_B,
+                fuzz_thrown_object(exc));
+        run_result res = run_personality(dest, m, bases, ip_offs, shape.actions, exc);
+        if (res.guard != guard_ok || res.code != expected.code) {
+            printf("FAIL: %s: unexpected result %d\n", shape.name, (int)res.code);
+            return false;
+        }
+
+        const unsigned iterations = 200000;
+        double best = 0;
+        for (unsigned rep = 0; rep < 5; rep++) {
+            double start = now_ns();
+            for (unsigned i = 0; i < iterations; i++) {
+                __gxx_personality_v0(eh_version, shape.actions, exc->exception_class, exc,
+                        &context);
+                asm volatile("" : : : "memory");
+            }
+            double ns = (now_ns() - start) / iterations;
+            if (rep == 0 || ns < best) best = ns;
+        }
+        printf("%-36s %10.1f\n", shape.name, best);
+    }
+
+    return true;
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    uint64_t seed = 1;
+    unsigned cases = 20000;
+    bool do_fuzz = true;
+    bool do_bench = true;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 0);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            cases = strtoul(argv[++i], nullptr, 0);
+        }
+        else if (strcmp(argv[i], "-F") == 0) {
+            do_fuzz = false;
+        }
+        else if (strcmp(argv[i], "-B") == 0) {
+            do_bench = false;
+        }
+        else {
+            fprintf(stderr, "usage: %s [-s <seed>] [-n <cases>] [-F] [-B]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (unsigned i = 0; i < num_catch_types; i++) {
+        type_slots[i] = fuzz_catch_types[i];
+    }
+
+    signal(SIGSEGV, fault_handler);
+    signal(SIGBUS, fault_handler);
+
+    // Bases for textrel/datarel encodings: arbitrary, but within 32-bit range of the image
+    rel_bases bases { ((uintptr_t)&lsda_arena & ~(uintptr_t)0xFFFF) - 0x10000,
+            (uintptr_t)&lsda_arena };
+
+    guarded_area area;
+    if (!area.init(1 << 16)) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    if (do_fuzz) {
+        printf("LSDA fuzz, seed %llu\n", (unsigned long long)seed);
+        rng r { seed != 0 ? seed : 1 };
+        if (!fuzz_model(r, cases, bases)) return EXIT_FAILURE;
+        if (!fuzz_decoders(r, cases * 10, area)) return EXIT_FAILURE;
+        if (!fuzz_call_sites(r, cases, area, bases)) return EXIT_FAILURE;
+        if (!fuzz_spec_lists(r, cases, area, bases)) return EXIT_FAILURE;
+    }
+
+    if (do_bench) {
+        if (!run_benchmark(bases)) return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+#ifndef LSDA_FUZZ_H_INCLUDED
+#define LSDA_FUZZ_H_INCLUDED 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unwind.h>
+
+// Interface between the LSDA fuzzer/benchmark (lsda_fuzz.cc) and its mock environment
+// (lsda_fuzz_mock.cc). The mock is compiled against the BMCXXABI <typeinfo> and exception headers,
+// so it provides the type_info objects and exception objects; the fuzzer proper deals only in
+// opaque pointers, so that it can use the host C++ library freely.
+
+// Mock unwinder context. The personality routine only accesses this via the _Unwind_* functions,
+// which are implemented by the mock.
+struct _Unwind_Context {
+    const uint8_t *lsda;
+    uintptr_t ip;
+    uintptr_t region_start;
+    uintptr_t text_base;     // returned by _Unwind_GetTextRelBase
+    uintptr_t data_base;     // returned by _Unwind_GetDataRelBase
+    uintptr_t gr[2];         // EH data registers (set by _Unwind_SetGR)
+    uintptr_t new_ip;        // set by _Unwind_SetIP
+};
+
+// Catch types (type table entries): fuzz_catch_types[i] is the type_info for catch type i, where
+// index 0 is catch(...) (null). See lsda_fuzz_mock.cc for the types.
+enum {
+    catch_any, catch_A, catch_B, catch_C, catch_D, catch_int, catch_A_ptr, catch_const_B_ptr,
+    catch_B_ptr,
+    num_catch_types
+};
+
+// Thrown types
+enum {
+    thrown_A, thrown_B, thrown_C, thrown_D, thrown_int, thrown_B_ptr,
+    num_thrown_types
+};
+
+extern const void *const fuzz_catch_types[num_catch_types];
+
+// Create (or re-initialise) the exception object for a throw of the specified type. There is a
+// single exception object, which is re-used.
+_Unwind_Exception *fuzz_init_exception(unsigned thrown_type);
+
+// Address of the thrown object
+void *fuzz_thrown_object(_Unwind_Exception *exc);
+
+// Values cached in the exception by the personality routine when a handler is found
+struct fuzz_handler_info {
+    void *adjusted_ptr;
+    int switch_value;
+    void *catch_temp;
+};
+fuzz_handler_info fuzz_get_handler_info(_Unwind_Exception *exc);
+
+extern "C" _Unwind_Reason_Code __gxx_personality_v0(int version, _Unwind_Action actions,
+        uint64_t exception_class, _Unwind_Exception *unwind_exc, _Unwind_Context *context) noexcept;
+
+#endif
@@ -0,0 +1,123 @@
+#include <cstddef>
+#include <cstring>
+
+#include "../src/cxa_exception.h"
+
+#include "lsda_fuzz.h"
+
+// Mock environment for the LSDA fuzzer (see lsda_fuzz.cc): the unwinder functions used by the
+// personality routine, the types which are thrown and caught, and the exception object.
+
+namespace {
+
+struct A { int a = 1; };
+struct B : A { int b = 2; };
+struct C : B { int c = 3; };
+struct D { int d = 4; };
+
+B b_obj;
+
+union thrown_storage {
+    A a;
+    B b;
+    C c;
+    D d;
+    int i;
+    B *b_ptr;
+};
+
+// The exception: header immediately followed by the thrown object
+alignas(16) unsigned char exception_buf[sizeof(__cxa_exception) + sizeof(thrown_storage)];
+
+__cxa_exception *exception_header()
+{
+    return (__cxa_exception *)exception_buf;
+}
+
+} // anon namespace
+
+const void *const fuzz_catch_types[num_catch_types] = {
+    nullptr,
+    &typeid(A),
+    &typeid(B),
+    &typeid(C),
+    &typeid(D),
+    &typeid(int),
+    &typeid(A *),
+    &typeid(const B *),
+    &typeid(B *),
+};
+
+_Unwind_Exception *fuzz_init_exception(unsigned thrown_type)
+{
+    const std::type_info *ti;
+    thrown_storage &obj = *(thrown_storage *)(exception_header() + 1);
+
+    switch (thrown_type) {
+    case thrown_A: obj.a = A(); ti = &typeid(A); break;
+    case thrown_B: obj.b = B(); ti = &typeid(B); break;
+    case thrown_C: obj.c = C(); ti = &typeid(C); break;
+    case thrown_D: obj.d = D(); ti = &typeid(D); break;
+    case thrown_int: obj.i = 5; ti = &typeid(int); break;
+    default: obj.b_ptr = &b_obj; ti = &typeid(B *); break;
+    }
+
+    __cxa_exception &hdr = *exception_header();
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.exceptionType = const_cast<std::type_info *>(ti);
+    memcpy(&hdr.unwindHeader.exception_class, "GNUCC++\0", 8);
+    return &hdr.unwindHeader;
+}
+
+void *fuzz_thrown_object(_Unwind_Exception *exc)
+{
+    return (__cxa_exception *)((char *)exc - offsetof(__cxa_exception, unwindHeader)) + 1;
+}
+
+fuzz_handler_info fuzz_get_handler_info(_Unwind_Exception *exc)
+{
+    __cxa_exception *hdr = (__cxa_exception *)((char *)exc - offsetof(__cxa_exception, unwindHeader));
+    return fuzz_handler_info { hdr->adjustedPtr, hdr->handlerSwitchValue, hdr->catchTemp };
+}
+
+// Mock unwinder functions:
+
+extern "C" {
+
+void *_Unwind_GetLanguageSpecificData(_Unwind_Context *context)
+{
+    return (void *)context->lsda;
+}
+
+_Unwind_Ptr _Unwind_GetIP(_Unwind_Context *context)
+{
+    return context->ip;
+}
+
+_Unwind_Ptr _Unwind_GetRegionStart(_Unwind_Context *context)
+{
+    return context->region_start;
+}
+
+_Unwind_Ptr _Unwind_GetTextRelBase(_Unwind_Context *context)
+{
+    return context->text_base;
+}
+
+_Unwind_Ptr _Unwind_GetDataRelBase(_Unwind_Context *context)
+{
+    return context->data_base;
+}
+
+void _Unwind_SetGR(_Unwind_Context *context, int index, _Unwind_Word val)
+{
+    if (index == __builtin_eh_return_data_regno(0)) context->gr[0] = val;
+    else if (index == __builtin_eh_return_data_regno(1)) context->gr[1] = val;
+}
+
+void _Unwind_SetIP(_Unwind_Context *context, _Unwind_Ptr val)
+{
+    context->new_ip = val;
+}
+
+} // extern "C"
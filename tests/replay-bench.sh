@@ -0,0 +1,25 @@
+# Build and run the trace-driven replay benchmark (replay) for an exception-handling event trace
+# recorded from a running system (see the eh-trace harness for how to record and write one). The
+# trace is converted to a replay trace (replay.trace) by bmcxx-tracedump, naming the types from the
+# symbols of the recorded image if given, and the program generated from that by replay-gen is
+# built, like bench-throw (see bench.sh), against libcxxabi.a. Any further arguments are passed to
+# replay (eg "-n 1000"; see replay.cc).
+#
+# Usage: replay-bench.sh <trace> [<image>] [<replay options>]
+set -eu
+
+trace=$1
+shift
+image=
+if [ $# -gt 0 ] && [ "${1#-}" = "$1" ]; then
+    image=$1
+    shift
+fi
+
+make -s -C ../tools bmcxx-tracedump
+../tools/bmcxx-tracedump -r ${image:+-e "$image"} "$trace" > replay.trace
+make -s replay-gen
+./replay-gen -o replay-gen-ops.cc replay.trace
+make -s -C .. OUTDIR="${PWD}"
+g++ -O2 -fno-reorder-blocks-and-partition -o replay replay.cc replay-gen-ops.cc -L. -lcxxabi
+./replay "$@"
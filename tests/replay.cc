@@ -0,0 +1,216 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "replay.h"
+
+#include "harness.h"
+
+// Trace-driven replay benchmark. Replays a workload recorded from a running system (via the
+// exception-handling event trace, BMCXX_EH_TRACE, converted to a replay trace by
+// "bmcxx-tracedump -r") against libcxxabi.a: each exception is thrown, with a type standing for the
+// recorded one, through the recorded number of frames and cleanups, to a handler of the recorded
+// kind (the type itself, a base class, or catch(...)), with the recorded rethrows and nesting of
+// throws within handlers; guarded statics are initialised in the same order. The types and
+// operations are generated (as replay-gen-ops.cc) by replay-gen (replay_gen.cc). Built and run via
+// replay-bench.sh, which does all of this.
+//
+// Usage: replay [-n <iterations>]
+//
+// Each iteration replays the whole trace, timing each top-level operation (a throw, including any
+// rethrow and nested operations, or a guard initialisation). Output is tab-separated, with a header
+// line:
+//
+//     operation  unit  count  median  p99  total
+//
+// where count is the number of samples and total is the sum of the samples divided by the number
+// of iterations. The "trace" row is for the whole trace. On x86 the unit is TSC cycles ("cycles"),
+// otherwise nanoseconds ("ns").
+
+extern "C" int __cxa_guard_acquire(int64_t *guard);
+extern "C" void __cxa_guard_release(int64_t *guard);
+
+extern const char harness_name[] = "replay";
+
+namespace {
+
+volatile unsigned sink;
+
+// Count of handlers entered, checked after each iteration so that the compiler can't elide any of
+// the work (and to check that each exception reached its handler)
+volatile unsigned handled_count;
+
+struct cleanup {
+    ~cleanup() { sink = sink + 1; }
+};
+
+int64_t guard;
+
+void run_op(const replay_op &op)
+{
+    if (op.kind == replay_guard) {
+        guard = 0;
+        if (__cxa_guard_acquire(&guard)) {
+            sink = sink + 1;
+            __cxa_guard_release(&guard);
+        }
+    }
+    else if (op.rethrow_catcher != nullptr) {
+        op.rethrow_catcher(op);
+    }
+    else {
+        op.catcher(op);
+    }
+}
+
+// The number of handlers entered for an operation and its nested operations
+unsigned expected_handlers(const replay_op &op)
+{
+    if (op.kind != replay_throw) return 0;
+    unsigned n = 1;
+    for (unsigned i = op.first_child; i != replay_no_op; i = replay_ops[i].next_sibling) {
+        n += expected_handlers(replay_ops[i]);
+    }
+    return n;
+}
+
+void report(const char *name, uint64_t *samples, unsigned count, unsigned iterations)
+{
+    if (count == 0) return;
+    uint64_t total = 0;
+    for (unsigned i = 0; i < count; ++i) total += samples[i];
+    qsort(samples, count, sizeof(uint64_t), compare_u64);
+    printf("%s\t%s\t%u\t%llu\t%llu\t%llu\n", name, time_unit, count,
+            (unsigned long long)samples[count / 2],
+            (unsigned long long)samples[(unsigned)((count - 1) * 0.99)],
+            (unsigned long long)(total / iterations));
+}
+
+} // anon namespace
+
+__attribute__((noinline)) void replay_frames(const replay_op &op, replay_fn leaf, unsigned frames,
+        unsigned cleanups)
+{
+    // (a frame with a cleanup; the call without one has no landing pad, but the personality
+    // routine is still called for the frame, as for the recorded frames)
+    if (cleanups != 0) {
+        cleanup c;
+        replay_enter(op, leaf, frames - 1, cleanups - 1);
+    }
+    else {
+        replay_enter(op, leaf, frames - 1, 0);
+    }
+    sink = sink + 1;
+}
+
+__attribute__((noinline)) void replay_handler(const replay_op &op)
+{
+    handled_count = handled_count + 1;
+    for (unsigned i = op.first_child; i != replay_no_op; i = replay_ops[i].next_sibling) {
+        run_op(replay_ops[i]);
+    }
+}
+
+__attribute__((noinline)) void replay_throw_leaf(const replay_op &op)
+{
+    op.thrower();
+    sink = sink + 1;
+}
+
+__attribute__((noinline)) void replay_catch_leaf(const replay_op &op)
+{
+    op.catcher(op);
+    sink = sink + 1;
+}
+
+template <>
+__attribute__((noinline)) void replay_catcher<replay_catch_all>(const replay_op &op)
+{
+    try {
+        replay_enter(op, replay_throw_leaf, op.frames - 1, op.cleanups);
+    }
+    catch (...) {
+        replay_handler(op);
+        if (op.rethrow_catcher != nullptr) throw;
+    }
+}
+
+template <>
+__attribute__((noinline)) void replay_rethrow_catcher<replay_catch_all>(const replay_op &op)
+{
+    try {
+        replay_enter(op, replay_catch_leaf, op.rethrow_frames - 2, op.rethrow_cleanups - 1);
+    }
+    catch (...) {
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = 100;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else {
+            fprintf(stderr, "usage: replay [-n <iterations>]\n");
+            return 1;
+        }
+    }
+    if (iterations == 0) iterations = 1;
+
+    unsigned top_level = 0, throws = 0, guards = 0, expected = 0;
+    for (unsigned i = replay_first_op; i != replay_no_op; i = replay_ops[i].next_sibling) {
+        ++top_level;
+        expected += expected_handlers(replay_ops[i]);
+    }
+    if (top_level == 0) {
+        fprintf(stderr, "replay: no operations\n");
+        return 1;
+    }
+
+    uint64_t *throw_samples = (uint64_t *)malloc((size_t)top_level * iterations * sizeof(uint64_t));
+    uint64_t *guard_samples = (uint64_t *)malloc((size_t)top_level * iterations * sizeof(uint64_t));
+    uint64_t *trace_samples = (uint64_t *)malloc((size_t)iterations * sizeof(uint64_t));
+    if (throw_samples == nullptr || guard_samples == nullptr || trace_samples == nullptr) {
+        return 1;
+    }
+
+    // (once untimed, to warm up)
+    for (unsigned i = replay_first_op; i != replay_no_op; i = replay_ops[i].next_sibling) {
+        run_op(replay_ops[i]);
+    }
+
+    for (unsigned n = 0; n < iterations; ++n) {
+        handled_count = 0;
+        uint64_t trace_start = now();
+        for (unsigned i = replay_first_op; i != replay_no_op; i = replay_ops[i].next_sibling) {
+            const replay_op &op = replay_ops[i];
+            uint64_t start = now();
+            run_op(op);
+            uint64_t t = now() - start;
+            if (op.kind == replay_guard) {
+                guard_samples[guards++] = t;
+            }
+            else {
+                throw_samples[throws++] = t;
+            }
+        }
+        trace_samples[n] = now() - trace_start;
+        if (handled_count != expected) {
+            fprintf(stderr, "replay: %u handlers entered, expected %u\n", handled_count, expected);
+            return 1;
+        }
+    }
+
+    printf("operation\tunit\tcount\tmedian\tp99\ttotal\n");
+    report("throw", throw_samples, throws, iterations);
+    report("guard", guard_samples, guards, iterations);
+    report("trace", trace_samples, iterations, iterations);
+
+    free(throw_samples);
+    free(guard_samples);
+    free(trace_samples);
+    return 0;
+}
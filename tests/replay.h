@@ -0,0 +1,101 @@
+#ifndef REPLAY_H_INCLUDED
+#define REPLAY_H_INCLUDED 1
+
+// Trace-driven replay benchmark (replay.cc): the operations to replay, as generated by replay-gen
+// (replay_gen.cc) from a replay trace, and the frames which throw and catch them.
+
+enum replay_kind {
+    replay_throw,
+    replay_guard
+};
+
+struct replay_op;
+
+typedef void (*replay_fn)(const replay_op &op);
+
+// An operation. A throw is thrown by thrower and caught by catcher after passing through frames
+// frames (the catcher's included) and running cleanups cleanups. If rethrow_catcher is not null, the
+// handler then rethrows the exception, which is caught by rethrow_catcher after rethrow_frames
+// frames (including the catcher's) and rethrow_cleanups cleanups (including the end of the first
+// handler). Nested operations, which are run within the handler before it returns (or rethrows),
+// are linked via first_child and next_sibling (indices in replay_ops, or no_op).
+struct replay_op {
+    replay_kind kind;
+    void (*thrower)();
+    replay_fn catcher;
+    replay_fn rethrow_catcher;
+    unsigned frames;
+    unsigned cleanups;
+    unsigned rethrow_frames;
+    unsigned rethrow_cleanups;
+    unsigned first_child;
+    unsigned next_sibling;
+};
+
+constexpr unsigned replay_no_op = ~0u;
+
+// (generated) the operations, and the first top-level operation; the others follow via
+// next_sibling
+extern const replay_op replay_ops[];
+extern const unsigned replay_num_ops;
+extern const unsigned replay_first_op;
+
+// Catch type standing for catch(...)
+struct replay_catch_all { };
+
+// Call leaf(op) from within frames further frames, cleanups of which (the outermost) have a local
+// object with a destructor
+void replay_frames(const replay_op &op, replay_fn leaf, unsigned frames, unsigned cleanups);
+
+// Run the handler body for op: its nested operations
+void replay_handler(const replay_op &op);
+
+// The leaves, which throw and catch the exception for op
+void replay_throw_leaf(const replay_op &op);
+void replay_catch_leaf(const replay_op &op);
+
+inline void replay_enter(const replay_op &op, replay_fn leaf, unsigned frames, unsigned cleanups)
+{
+    if (frames == 0) {
+        leaf(op);
+    }
+    else {
+        replay_frames(op, leaf, frames, cleanups);
+    }
+}
+
+template <typename T>
+__attribute__((noinline)) void replay_thrower()
+{
+    throw T();
+}
+
+template <typename C>
+__attribute__((noinline)) void replay_catcher(const replay_op &op)
+{
+    try {
+        replay_enter(op, replay_throw_leaf, op.frames - 1, op.cleanups);
+    }
+    catch (C &) {
+        replay_handler(op);
+        if (op.rethrow_catcher != nullptr) throw;
+    }
+}
+
+template <typename C>
+__attribute__((noinline)) void replay_rethrow_catcher(const replay_op &op)
+{
+    try {
+        replay_enter(op, replay_catch_leaf, op.rethrow_frames - 2, op.rethrow_cleanups - 1);
+    }
+    catch (C &) {
+    }
+}
+
+template <>
+void replay_catcher<replay_catch_all>(const replay_op &op);
+
+template <>
+void replay_rethrow_catcher<replay_catch_all>(const replay_op &op);
+
+#endif
@@ -0,0 +1,323 @@
+// replay-gen: generate the types and operations for the trace-driven replay benchmark (replay.cc,
+// replay.h) from a replay trace, as written by "bmcxx-tracedump -r" (see tools/tracedump.cc for
+// the format). This is a host program.
+//
+// Usage: replay-gen -o <output> <replay-trace>
+//
+// Each type in the trace becomes an empty class, with a payload making up the recorded size of the
+// thrown object. A type caught by a handler for another type derives from it, so that the handler
+// is matched via a base class, as it was when recorded; where that would make the base ambiguous
+// (or the derivation circular), the operation is caught by its own type instead, with a warning.
+// Each throw and guard initialisation in the trace becomes an operation; throws with a nesting
+// level are nested within the handler of the most recent throw one level out, and a rethrow
+// applies to the most recent throw at its level.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr unsigned no_op = ~0u;
+constexpr int catch_all = -1;
+
+struct type_desc {
+    unsigned long long size;
+    std::string name;
+    std::vector<unsigned> bases;
+    bool used;
+};
+
+struct op_desc {
+    bool guard;
+    unsigned type;
+    unsigned frames;
+    unsigned cleanups;
+    int handler;
+    bool rethrow;
+    unsigned rethrow_frames;
+    unsigned rethrow_cleanups;
+    int rethrow_handler;
+    unsigned first_child;
+    unsigned last_child;
+    unsigned next_sibling;
+};
+
+std::vector<type_desc> types;
+std::vector<op_desc> ops;
+
+// The number of paths from type a up to its (indirect) base b; 1 for a == b
+unsigned paths(unsigned a, unsigned b)
+{
+    if (a == b) return 1;
+    unsigned n = 0;
+    for (unsigned base : types[a].bases) n += paths(base, b);
+    return n;
+}
+
+// Make the thrown type derive from the caught type, if it doesn't already; false if it can't
+bool derive(unsigned thrown, unsigned caught)
+{
+    if (paths(thrown, caught) != 0) return true;
+    if (paths(caught, thrown) != 0) return false;
+
+    // (a direct base which the new base also reaches would then be ambiguous; it is reached via
+    // the new base instead)
+    std::vector<unsigned> &bases = types[thrown].bases;
+    for (size_t i = 0; i < bases.size(); ) {
+        if (paths(caught, bases[i]) != 0) bases.erase(bases.begin() + i);
+        else ++i;
+    }
+    bases.push_back(caught);
+    return true;
+}
+
+// Check that a handler for the given type catches the thrown type unambiguously; otherwise (or for
+// an unknown type) fall back to catching the thrown type itself
+void check_handler(unsigned thrown, int &handler, unsigned line)
+{
+    if (handler == catch_all) return;
+    if ((unsigned)handler >= types.size() || paths(thrown, (unsigned)handler) != 1) {
+        fprintf(stderr, "replay-gen: line %u: handler type %d can't be a unique base of type %u; "
+                "catching type %u instead\n", line, handler, thrown, thrown);
+        handler = (int)thrown;
+    }
+    types[handler].used = true;
+}
+
+// Size of the class for a type (its bases' plus its payload, as generated)
+unsigned long long class_size(unsigned t, unsigned long long &payload)
+{
+    unsigned long long bases_size = 0, p;
+    for (unsigned base : types[t].bases) bases_size += class_size(base, p);
+    payload = types[t].size > bases_size ? types[t].size - bases_size : 0;
+    return bases_size + payload;
+}
+
+void emit_type(FILE *out, unsigned t, std::set<unsigned> &emitted)
+{
+    if (!emitted.insert(t).second) return;
+    for (unsigned base : types[t].bases) emit_type(out, base, emitted);
+
+    fprintf(out, "// %s\nstruct replay_type_%u", types[t].name.c_str(), t);
+    const char *sep = " : ";
+    for (unsigned base : types[t].bases) {
+        fprintf(out, "%sreplay_type_%u", sep, base);
+        sep = ", ";
+    }
+    unsigned long long payload;
+    class_size(t, payload);
+    if (payload != 0) {
+        fprintf(out, " {\n    char payload[%llu];\n};\n\n", payload);
+    }
+    else {
+        fprintf(out, " { };\n\n");
+    }
+}
+
+std::string catcher_name(const char *catcher, int handler)
+{
+    if (handler == catch_all) return std::string(catcher) + "<replay_catch_all>";
+    return std::string(catcher) + "<replay_type_" + std::to_string(handler) + ">";
+}
+
+int parse_handler(const char *s)
+{
+    return strcmp(s, "*") == 0 ? catch_all : atoi(s);
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: replay-gen -o <output> <replay-trace>\n");
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    const char *output = nullptr;
+    const char *input = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else if (argv[i][0] != '-' && input == nullptr) {
+            input = argv[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (output == nullptr || input == nullptr) {
+        usage();
+        return 1;
+    }
+
+    FILE *in = fopen(input, "r");
+    if (in == nullptr) {
+        fprintf(stderr, "replay-gen: can't open %s\n", input);
+        return 1;
+    }
+
+    // The most recent throw at each nesting level, and the top-level operations
+    std::vector<unsigned> last_at;
+    unsigned first_op = no_op, last_op = no_op;
+    std::vector<std::pair<unsigned, unsigned>> lines;   // (op, line), for checking handlers
+
+    char buf[4096];
+    unsigned line = 0;
+    while (fgets(buf, sizeof(buf), in) != nullptr) {
+        ++line;
+        char word[16], handler[16];
+        unsigned id, type, frames, cleanups, nest;
+        unsigned long long size;
+        int name_pos;
+
+        if (buf[0] == '#' || sscanf(buf, "%15s", word) != 1) {
+            continue;
+        }
+
+        if (strcmp(word, "type") == 0
+                && sscanf(buf, "type %u %llu %n", &id, &size, &name_pos) == 2) {
+            if (id != types.size()) {
+                fprintf(stderr, "replay-gen: line %u: types out of order\n", line);
+                return 1;
+            }
+            std::string name = buf + name_pos;
+            while (!name.empty() && (name.back() == '\n' || name.back() == '\r')) name.pop_back();
+            types.push_back({size, name, {}, false});
+            continue;
+        }
+
+        op_desc op = {false, 0, 0, 0, catch_all, false, 0, 0, catch_all, no_op, no_op, no_op};
+        if (strcmp(word, "guard") == 0) {
+            op.guard = true;
+            nest = 0;
+        }
+        else if (strcmp(word, "throw") == 0 && sscanf(buf, "throw %u %u %u %15s %u", &type,
+                &frames, &cleanups, handler, &nest) == 5 && type < types.size()) {
+            op.type = type;
+            op.frames = frames != 0 ? frames : 1;
+            op.cleanups = cleanups < op.frames ? cleanups : op.frames - 1;
+            op.handler = parse_handler(handler);
+        }
+        else if (strcmp(word, "rethrow") == 0 && sscanf(buf, "rethrow %u %u %15s %u", &frames,
+                &cleanups, handler, &nest) == 4) {
+            // (a rethrow with no throw to apply to, eg from before the trace started, is ignored)
+            if (nest < last_at.size() && !ops[last_at[nest]].rethrow) {
+                op_desc &target = ops[last_at[nest]];
+                target.rethrow = true;
+                target.rethrow_frames = frames >= 2 ? frames : 2;
+                target.rethrow_cleanups = cleanups == 0 ? 1
+                        : cleanups < target.rethrow_frames ? cleanups : target.rethrow_frames - 1;
+                target.rethrow_handler = parse_handler(handler);
+                lines.push_back({last_at[nest], line});
+            }
+            continue;
+        }
+        else {
+            fprintf(stderr, "replay-gen: line %u: malformed\n", line);
+            return 1;
+        }
+
+        // Link the operation into the handler of the enclosing throw, or the top level (also if
+        // the enclosing throw is not in the trace)
+        unsigned index = (unsigned)ops.size();
+        if (nest > last_at.size()) nest = (unsigned)last_at.size();
+        unsigned parent = nest != 0 ? last_at[nest - 1] : no_op;
+        unsigned &first = parent != no_op ? ops[parent].first_child : first_op;
+        unsigned &last = parent != no_op ? ops[parent].last_child : last_op;
+        if (last == no_op) {
+            first = index;
+        }
+        else {
+            ops[last].next_sibling = index;
+        }
+        last = index;
+
+        if (!op.guard) {
+            last_at.resize(nest);
+            last_at.push_back(index);
+            lines.push_back({index, line});
+            types[op.type].used = true;
+        }
+        ops.push_back(op);
+    }
+    fclose(in);
+
+    if (ops.empty()) {
+        fprintf(stderr, "replay-gen: %s: no operations\n", input);
+        return 1;
+    }
+
+    // Derive the class hierarchy from the handlers, then check that each handler still catches
+    // its exception unambiguously
+    for (const op_desc &op : ops) {
+        if (op.guard) continue;
+        if (op.handler != catch_all && (unsigned)op.handler < types.size()) {
+            derive(op.type, (unsigned)op.handler);
+        }
+        if (op.rethrow && op.rethrow_handler != catch_all
+                && (unsigned)op.rethrow_handler < types.size()) {
+            derive(op.type, (unsigned)op.rethrow_handler);
+        }
+    }
+    for (std::pair<unsigned, unsigned> &l : lines) {
+        op_desc &op = ops[l.first];
+        check_handler(op.type, op.handler, l.second);
+        if (op.rethrow) check_handler(op.type, op.rethrow_handler, l.second);
+    }
+
+    FILE *out = fopen(output, "w");
+    if (out == nullptr) {
+        fprintf(stderr, "replay-gen: can't create %s\n", output);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by replay-gen from %s; see replay_gen.cc\n\n", input);
+    fprintf(out, "#include \"replay.h\"\n\nnamespace {\n\n");
+    std::set<unsigned> emitted;
+    for (unsigned t = 0; t < types.size(); ++t) {
+        if (types[t].used) emit_type(out, t, emitted);
+    }
+    fprintf(out, "} // anon namespace\n\n");
+
+    fprintf(out, "const replay_op replay_ops[] = {\n");
+    for (const op_desc &op : ops) {
+        if (op.guard) {
+            fprintf(out, "    {replay_guard, nullptr, nullptr, nullptr, 0, 0, 0, 0, replay_no_op, ");
+        }
+        else {
+            fprintf(out, "    {replay_throw, replay_thrower<replay_type_%u>, %s, %s, %u, %u, %u, %u, ",
+                    op.type, catcher_name("replay_catcher", op.handler).c_str(),
+                    op.rethrow ? catcher_name("replay_rethrow_catcher",
+                            op.rethrow_handler).c_str() : "nullptr",
+                    op.frames, op.cleanups, op.rethrow_frames, op.rethrow_cleanups);
+            if (op.first_child == no_op) {
+                fprintf(out, "replay_no_op, ");
+            }
+            else {
+                fprintf(out, "%u, ", op.first_child);
+            }
+        }
+        if (op.next_sibling == no_op) {
+            fprintf(out, "replay_no_op},\n");
+        }
+        else {
+            fprintf(out, "%u},\n", op.next_sibling);
+        }
+    }
+    fprintf(out, "};\n\nconst unsigned replay_num_ops = %zu;\nconst unsigned replay_first_op = %u;\n",
+            ops.size(), first_op);
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "replay-gen: can't write %s\n", output);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,424 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unwind.h>
+
+#include "harness.h"
+
+// Worst-case latency harness for throws, for the bounded-latency build of the library
+// (BMCXX_BOUNDED_LATENCY; libcxxabi-rt.a, a hosted build). Each scenario performs a throw that
+// is adversarial in some respect (deep unwinding, a long action chain, many call sites, a deep or
+// wide class hierarchy, nested or rethrown exceptions) many times, and the time taken by each
+// step of every throw is recorded. The runtime's entry points are wrapped (via the linker's
+// --wrap; see Makefile) to take the timestamps:
+//
+//   allocate              __cxa_allocate_exception
+//   search_phase          from __cxa_throw (or __cxa_rethrow) until the personality routine is
+//                         first called for the cleanup phase: the unwinder's search phase
+//   cleanup_phase         from then until __cxa_begin_catch is called: the unwinder's cleanup
+//                         phase, including running cleanups (destructors) on the way
+//   personality_search    time spent in the personality routine during the search phase
+//   personality_cleanup   time spent in the personality routine during the cleanup phase
+//   begin_catch           __cxa_begin_catch
+//   end_catch             __cxa_end_catch (including destroying and freeing the exception)
+//
+// The phase times include the unwinder's own work (finding and interpreting unwind tables),
+// which is outside this library; the personality times isolate the library's part.
+//
+// Usage: rt-latency [-n <iterations>] [<name-filter>]
+//
+// Output is tab-separated, with a header line:
+//
+//     scenario  step  unit  samples  median  p99  max
+//
+// where max is the observed worst case. Times are TSC cycles on x86, nanoseconds elsewhere, and
+// include the overhead of reading the timer.
+
+extern "C" {
+void *__real___cxa_allocate_exception(size_t thrown_size) noexcept;
+void __real___cxa_throw(void *thrown, void *tinfo, void (*destructor)(void *));
+void __real___cxa_rethrow();
+_Unwind_Reason_Code __real___gxx_personality_v0(int version, _Unwind_Action actions,
+        uint64_t exception_class, _Unwind_Exception *unwind_exc, _Unwind_Context *context);
+void *__real___cxa_begin_catch(void *exception_object) noexcept;
+void __real___cxa_end_catch() noexcept;
+}
+
+extern const char harness_name[] = "rt-latency";
+
+namespace {
+
+enum step {
+    step_allocate,
+    step_search_phase,
+    step_cleanup_phase,
+    step_personality_search,
+    step_personality_cleanup,
+    step_begin_catch,
+    step_end_catch,
+    num_steps
+};
+
+const char *const step_names[num_steps] = {
+    "allocate", "search_phase", "cleanup_phase", "personality_search", "personality_cleanup",
+    "begin_catch", "end_catch"
+};
+
+// At most this many throws per scenario iteration
+constexpr unsigned max_throws_per_iteration = 4;
+
+unsigned iterations = 10000;
+const char *filter = nullptr;
+
+// Samples for each step, for the current scenario; recording is off during warm-up
+uint64_t *samples[num_steps];
+unsigned num_samples[num_steps];
+unsigned max_samples;
+bool recording;
+
+// State of the throw in progress. (Throws don't overlap in these scenarios: a nested throw
+// happens only once the enclosing exception has been caught.)
+uint64_t throw_start;
+uint64_t cleanup_start;
+uint64_t personality_time[2];   // search, cleanup
+
+volatile unsigned sink;
+unsigned caught_count;
+
+void record(step s, uint64_t time)
+{
+    if (recording && num_samples[s] < max_samples) {
+        samples[s][num_samples[s]++] = time;
+    }
+}
+
+void start_throw()
+{
+    cleanup_start = 0;
+    personality_time[0] = personality_time[1] = 0;
+    throw_start = now();
+}
+
+} // anon namespace
+
+extern "C" {
+
+void *__wrap___cxa_allocate_exception(size_t thrown_size) noexcept
+{
+    uint64_t start = now();
+    void *r = __real___cxa_allocate_exception(thrown_size);
+    record(step_allocate, now() - start);
+    return r;
+}
+
+void __wrap___cxa_throw(void *thrown, void *tinfo, void (*destructor)(void *))
+{
+    start_throw();
+    __real___cxa_throw(thrown, tinfo, destructor);
+}
+
+void __wrap___cxa_rethrow()
+{
+    start_throw();
+    __real___cxa_rethrow();
+}
+
+_Unwind_Reason_Code __wrap___gxx_personality_v0(int version, _Unwind_Action actions,
+        uint64_t exception_class, _Unwind_Exception *unwind_exc, _Unwind_Context *context)
+{
+    uint64_t start = now();
+    bool search = (actions & _UA_SEARCH_PHASE) != 0;
+    if (!search && cleanup_start == 0) {
+        cleanup_start = start;
+    }
+    _Unwind_Reason_Code r = __real___gxx_personality_v0(version, actions, exception_class,
+            unwind_exc, context);
+    personality_time[search ? 0 : 1] += now() - start;
+    return r;
+}
+
+void *__wrap___cxa_begin_catch(void *exception_object) noexcept
+{
+    uint64_t start = now();
+    void *r = __real___cxa_begin_catch(exception_object);
+    uint64_t end = now();
+
+    record(step_search_phase, cleanup_start - throw_start);
+    record(step_cleanup_phase, start - cleanup_start);
+    record(step_personality_search, personality_time[0]);
+    record(step_personality_cleanup, personality_time[1]);
+    record(step_begin_catch, end - start);
+    return r;
+}
+
+void __wrap___cxa_end_catch() noexcept
+{
+    uint64_t start = now();
+    __real___cxa_end_catch();
+    record(step_end_catch, now() - start);
+}
+
+} // extern "C"
+
+namespace {
+
+struct Thrown {
+    int v = 1;
+};
+
+struct Cleanup {
+    ~Cleanup() { sink = sink + 1; }
+};
+
+[[noreturn]] void fail(const char *name)
+{
+    fprintf(stderr, "rt-latency: %s: wrong handler\n", name);
+    exit(1);
+}
+
+void caught()
+{
+    ++caught_count;
+}
+
+// Deep unwinding, with a cleanup in every frame
+
+__attribute__((noinline)) void throw_with_cleanups(unsigned depth)
+{
+    Cleanup c;
+    if (depth <= 1) throw Thrown();
+    throw_with_cleanups(depth - 1);
+}
+
+// A long action chain: a try block with many (non-matching) handlers before the matching one
+
+template <unsigned N> struct Tag {};
+
+__attribute__((noinline)) void throw_thrown()
+{
+    throw Thrown();
+}
+
+#define TAG_CATCH(n) catch (Tag<n> &) { fail("long_chain"); }
+#define TAG_CATCH4(n) TAG_CATCH(n) TAG_CATCH(n + 1) TAG_CATCH(n + 2) TAG_CATCH(n + 3)
+#define TAG_CATCH16(n) TAG_CATCH4(n) TAG_CATCH4(n + 4) TAG_CATCH4(n + 8) TAG_CATCH4(n + 12)
+
+void long_chain()
+{
+    try {
+        throw_thrown();
+    }
+    TAG_CATCH16(0)
+    TAG_CATCH16(16)
+    catch (Thrown &) {
+        caught();
+    }
+}
+
+// Many call sites: each call is in its own scope with a cleanup, so has its own call-site table
+// entry; the throw comes from the last.
+
+__attribute__((noinline)) void throw_if(unsigned i, unsigned which)
+{
+    if (i == which) throw Thrown();
+    asm volatile("");
+}
+
+#define SITE(n) { Cleanup c; throw_if(n, which); }
+#define SITE8(n) SITE(n) SITE(n + 1) SITE(n + 2) SITE(n + 3) SITE(n + 4) SITE(n + 5) SITE(n + 6) \
+        SITE(n + 7)
+#define SITE64(n) SITE8(n) SITE8(n + 8) SITE8(n + 16) SITE8(n + 24) SITE8(n + 32) SITE8(n + 40) \
+        SITE8(n + 48) SITE8(n + 56)
+
+constexpr unsigned num_sites = 128;
+
+__attribute__((noinline)) void many_call_sites(unsigned which)
+{
+    SITE64(0)
+    SITE64(64)
+}
+
+// A deep single-inheritance hierarchy, caught as the root
+
+struct D0 { int v = 1; };
+template <unsigned N> struct D : D<N - 1> {};
+template <> struct D<0> : D0 {};
+
+__attribute__((noinline)) void throw_deep()
+{
+    throw D<16>();
+}
+
+// A wide hierarchy with repeated (non-virtual) bases, so that finding the target base requires
+// the whole hierarchy to be searched for ambiguity
+
+struct RepBase { int r = 0; };
+template <unsigned N> struct Rep : RepBase { int n = N; };
+struct Target { int v = 1; };
+struct Wide : Rep<0>, Rep<1>, Rep<2>, Rep<3>, Rep<4>, Rep<5>, Rep<6>, Rep<7>, Target {};
+
+__attribute__((noinline)) void throw_wide()
+{
+    throw Wide();
+}
+
+struct scenario {
+    const char *name;
+    unsigned throws;            // per iteration
+    void (*run)();
+};
+
+const scenario scenarios[] = {
+    { "simple", 1, [] {
+        try {
+            throw_thrown();
+        }
+        catch (Thrown &t) {
+            if (t.v == 1) caught();
+        }
+    } },
+    { "deep_cleanups", 1, [] {
+        try {
+            throw_with_cleanups(32);
+        }
+        catch (Thrown &) {
+            caught();
+        }
+    } },
+    { "long_chain", 1, long_chain },
+    { "many_call_sites", 1, [] {
+        try {
+            many_call_sites(num_sites - 1);
+        }
+        catch (Thrown &) {
+            caught();
+        }
+    } },
+    { "deep_hierarchy", 1, [] {
+        try {
+            throw_deep();
+        }
+        catch (D0 &d) {
+            if (d.v == 1) caught();
+        }
+    } },
+    { "wide_hierarchy", 1, [] {
+        try {
+            throw_wide();
+        }
+        catch (Target &t) {
+            if (t.v == 1) caught();
+        }
+    } },
+    { "nested", 4, [] {
+        // each handler throws another exception, so that up to four are live at once
+        try {
+            throw_thrown();
+        }
+        catch (Thrown &) {
+            try {
+                throw_thrown();
+            }
+            catch (Thrown &) {
+                try {
+                    throw_thrown();
+                }
+                catch (Thrown &) {
+                    try {
+                        throw_thrown();
+                    }
+                    catch (Thrown &) {
+                        caught();
+                    }
+                    caught();
+                }
+                caught();
+            }
+            caught();
+        }
+    } },
+    { "rethrow", 2, [] {
+        try {
+            try {
+                throw_thrown();
+            }
+            catch (Thrown &) {
+                caught();
+                throw;
+            }
+        }
+        catch (Thrown &) {
+            caught();
+        }
+    } },
+};
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argv[i][0] != '-' && filter == nullptr) {
+            filter = argv[i];
+        }
+        else {
+            fprintf(stderr, "usage: rt-latency [-n <iterations>] [<name-filter>]\n");
+            return 1;
+        }
+    }
+    if (iterations == 0) iterations = 1;
+
+    max_samples = iterations * max_throws_per_iteration;
+    for (unsigned s = 0; s < num_steps; ++s) {
+        samples[s] = (uint64_t *)malloc(max_samples * sizeof(uint64_t));
+        if (samples[s] == nullptr) return 1;
+    }
+
+    printf("scenario\tstep\tunit\tsamples\tmedian\tp99\tmax\n");
+
+    for (const scenario &sc : scenarios) {
+        if (filter != nullptr && strstr(sc.name, filter) == nullptr) continue;
+
+        // warm up (fault in code and data, and fill the type_info name cache)
+        recording = false;
+        for (unsigned i = 0; i < 100; ++i) {
+            sc.run();
+        }
+
+        for (unsigned s = 0; s < num_steps; ++s) {
+            num_samples[s] = 0;
+        }
+        caught_count = 0;
+        recording = true;
+        for (unsigned i = 0; i < iterations; ++i) {
+            sc.run();
+        }
+        recording = false;
+
+        if (caught_count != iterations * sc.throws) {
+            fprintf(stderr, "rt-latency: %s: wrong catch count\n", sc.name);
+            return 1;
+        }
+
+        for (unsigned s = 0; s < num_steps; ++s) {
+            unsigned n = num_samples[s];
+            if (n == 0) continue;
+            qsort(samples[s], n, sizeof(uint64_t), compare_u64);
+            unsigned p99 = (unsigned)((n - 1) * 0.99);
+            printf("%s\t%s\t%s\t%u\t%llu\t%llu\t%llu\n", sc.name, step_names[s], time_unit, n,
+                    (unsigned long long)samples[s][n / 2], (unsigned long long)samples[s][p99],
+                    (unsigned long long)samples[s][n - 1]);
+        }
+    }
+
+    for (unsigned s = 0; s < num_steps; ++s) {
+        free(samples[s]);
+    }
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include <csetjmp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <pthread.h>
+
+#include "../include/bmcxxabi.h"
+
+#include "harness.h"
+
+// Runtime statistics harness, for the diagnostics build of the library (BMCXX_STATS;
+// libcxxabi-prof.a, a hosted build). Performs known operations (throws, rethrows, catches by base
+// class, guarded static initialisation, __cxa_atexit registration, cancellation via
+// bmcxxabi_cancel_current_stack) and checks the resulting
+// change in each counter reported by bmcxxabi_get_stats, including for throws on several threads
+// at once (whose counts are kept per CPU, and summed).
+//
+// Usage: runtime-stats
+//
+// Prints the statistics at exit, one "name value" line per counter.
+
+extern const char harness_name[] = "runtime-stats";
+
+namespace {
+
+struct base { virtual ~base() {} };
+struct derived : base { };
+
+volatile int sink;
+
+__attribute__((noinline)) void thrower(int i)
+{
+    throw i;
+}
+
+__attribute__((noinline)) void frame(int i)
+{
+    struct cleanup { ~cleanup() { sink = sink + 1; } } c;
+    thrower(i);
+}
+
+__attribute__((noinline)) void rethrower()
+{
+    try {
+        frame(0);
+    }
+    catch (int) {
+        throw;
+    }
+}
+
+__attribute__((noinline)) void throw_derived()
+{
+    throw derived();
+}
+
+// Cancel (via a forced unwind) through a frame with a cleanup and a catch clause, to the
+// jmp_buf's frame
+__attribute__((noinline)) void cancel_frame(jmp_buf *env)
+{
+    struct cleanup { ~cleanup() { sink = sink + 1; } } c;
+    try {
+        bmcxxabi_cancel_current_stack([](void *cfa, void *ctx) {
+            if ((uintptr_t)cfa > (uintptr_t)ctx) longjmp(*(jmp_buf *)ctx, 1);
+        }, env);
+    }
+    catch (base &) {
+        abort();
+    }
+}
+
+__attribute__((noinline)) void cancel_root()
+{
+    jmp_buf env;
+    if (setjmp(env) == 0) {
+        cancel_frame(&env);
+    }
+}
+
+struct guarded {
+    guarded() { sink = sink + 1; }
+    ~guarded() { sink = sink - 1; }
+};
+
+__attribute__((noinline)) void use_guarded()
+{
+    static guarded g;
+    (void)g;
+}
+
+void *thread_throws(void *)
+{
+    for (unsigned i = 0; i < 100; ++i) {
+        try {
+            frame(i);
+        }
+        catch (int) { }
+    }
+    return nullptr;
+}
+
+#define FIELDS(X) \
+    X(exceptions_allocated) X(exceptions_freed) X(exception_bytes_live) X(throws) X(rethrows) \
+    X(frames_search) X(frames_cleanup) X(handlers_found) X(terminates) X(do_catch_calls) \
+    X(do_upcast_calls) X(guard_acquires) X(guard_contended) X(atexit_registrations) \
+    X(atexit_table_size) X(atexit_table_entries) X(run_init_cycles)
+
+// Check that the counter changed by the expected amount (or, if at_least, by at least that amount)
+void check(const char *what, const char *name, unsigned long long before,
+        unsigned long long after, unsigned long long expected, bool at_least = false)
+{
+    unsigned long long delta = after - before;
+    if (at_least ? delta < expected : delta != expected) {
+        fprintf(stderr, "runtime-stats: %s: %s changed by %llu, expected %s%llu\n", what, name,
+                delta, at_least ? "at least " : "", expected);
+        ok = false;
+    }
+}
+
+void print_stats()
+{
+    bmcxxabi_stats s;
+    bmcxxabi_get_stats(&s);
+#define PRINT(f) printf("%s %llu\n", #f, s.f);
+    FIELDS(PRINT)
+#undef PRINT
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 1) {
+        fprintf(stderr, "usage: runtime-stats\n");
+        return 1;
+    }
+
+    bmcxxabi_stats before, after;
+    constexpr unsigned n = 100;
+
+    // A throw through a frame with a cleanup, to a handler. thrower() has no LSDA, so the
+    // personality routine is called for frame() and the handler's frame in the search phase; in
+    // the cleanup phase, frame() is visited again when unwinding resumes after its cleanup.
+    bmcxxabi_get_stats(&before);
+    for (unsigned i = 0; i < n; ++i) {
+        try {
+            frame(i);
+        }
+        catch (int) { }
+    }
+    bmcxxabi_get_stats(&after);
+    check("throw", "throws", before.throws, after.throws, n);
+    check("throw", "exceptions_allocated", before.exceptions_allocated, after.exceptions_allocated,
+            n);
+    check("throw", "exceptions_freed", before.exceptions_freed, after.exceptions_freed, n);
+    check("throw", "exception_bytes_live", before.exception_bytes_live, after.exception_bytes_live,
+            0);
+    check("throw", "handlers_found", before.handlers_found, after.handlers_found, n);
+    check("throw", "frames_search", before.frames_search, after.frames_search, 2 * n);
+    check("throw", "frames_cleanup", before.frames_cleanup, after.frames_cleanup, 3 * n);
+    check("throw", "rethrows", before.rethrows, after.rethrows, 0);
+
+    // A rethrow
+    bmcxxabi_get_stats(&before);
+    for (unsigned i = 0; i < n; ++i) {
+        try {
+            rethrower();
+        }
+        catch (int) { }
+    }
+    bmcxxabi_get_stats(&after);
+    check("rethrow", "throws", before.throws, after.throws, n);
+    check("rethrow", "rethrows", before.rethrows, after.rethrows, n);
+    check("rethrow", "exceptions_allocated", before.exceptions_allocated,
+            after.exceptions_allocated, n);
+    check("rethrow", "handlers_found", before.handlers_found, after.handlers_found, 2 * n);
+
+    // Catch by base class, via __do_catch and __do_upcast
+    bmcxxabi_get_stats(&before);
+    for (unsigned i = 0; i < n; ++i) {
+        try {
+            throw_derived();
+        }
+        catch (base &) { }
+    }
+    bmcxxabi_get_stats(&after);
+    check("upcast", "do_catch_calls", before.do_catch_calls, after.do_catch_calls, n);
+    check("upcast", "do_upcast_calls", before.do_upcast_calls, after.do_upcast_calls, n, true);
+
+    // A live exception is accounted for until it is freed
+    bmcxxabi_get_stats(&before);
+    try {
+        frame(0);
+    }
+    catch (int) {
+        bmcxxabi_get_stats(&after);
+        check("live", "exception_bytes_live", before.exception_bytes_live,
+                after.exception_bytes_live, sizeof(int), true);
+    }
+
+    // A cancellation runs cleanups only: nothing is allocated or thrown, and catch clauses are
+    // not matched
+    bmcxxabi_get_stats(&before);
+    int sink_before = sink;
+    for (unsigned i = 0; i < n; ++i) {
+        cancel_root();
+    }
+    bmcxxabi_get_stats(&after);
+    check("cancel", "cleanups", sink_before, sink, n);
+    check("cancel", "exceptions_allocated", before.exceptions_allocated,
+            after.exceptions_allocated, 0);
+    check("cancel", "throws", before.throws, after.throws, 0);
+    check("cancel", "frames_search", before.frames_search, after.frames_search, 0);
+    check("cancel", "handlers_found", before.handlers_found, after.handlers_found, 0);
+    check("cancel", "do_catch_calls", before.do_catch_calls, after.do_catch_calls, 0);
+
+    // A guarded static: each call acquires the guard until initialisation completes, and the
+    // destructor is registered via __cxa_atexit
+    bmcxxabi_get_stats(&before);
+    for (unsigned i = 0; i < n; ++i) {
+        use_guarded();
+    }
+    bmcxxabi_get_stats(&after);
+    check("guard", "guard_acquires", before.guard_acquires, after.guard_acquires, 1);
+    check("guard", "guard_contended", before.guard_contended, after.guard_contended, 0);
+    check("guard", "atexit_registrations", before.atexit_registrations,
+            after.atexit_registrations, 1);
+    check("guard", "atexit_table_entries", before.atexit_table_entries,
+            after.atexit_table_entries, 1);
+    if (after.atexit_table_size < after.atexit_table_entries) {
+        fprintf(stderr, "runtime-stats: atexit table size %llu is less than entries %llu\n",
+                after.atexit_table_size, after.atexit_table_entries);
+        ok = false;
+    }
+
+    // Throws on several threads at once
+    constexpr unsigned num_threads = 8;
+    bmcxxabi_get_stats(&before);
+    pthread_t threads[num_threads];
+    for (pthread_t &t : threads) {
+        if (pthread_create(&t, nullptr, thread_throws, nullptr) != 0) {
+            fprintf(stderr, "runtime-stats: can't create thread\n");
+            return 1;
+        }
+    }
+    for (pthread_t &t : threads) {
+        pthread_join(t, nullptr);
+    }
+    bmcxxabi_get_stats(&after);
+    check("threads", "throws", before.throws, after.throws, num_threads * n);
+    check("threads", "exceptions_freed", before.exceptions_freed, after.exceptions_freed,
+            num_threads * n);
+    check("threads", "exception_bytes_live", before.exception_bytes_live,
+            after.exception_bytes_live, 0);
+    check("threads", "terminates", before.terminates, after.terminates, 0);
+
+    if (!ok) return 1;
+    print_stats();
+    return 0;
+}
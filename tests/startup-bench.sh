@@ -0,0 +1,10 @@
+# Build and run the startup/shutdown benchmark (startup-bench) over a generated program with the
+# given numbers of static-storage objects etc. Arguments are passed to startup-gen (eg
+# "-n 100000 -l 10000"; see startup_gen.cc).
+set -eu
+
+rm -f startup-gen-*.cc startup-gen-*.o
+make -s startup-gen
+./startup-gen "$@" -o startup-gen
+make -s -j"$(nproc)" startup-bench
+./startup-bench
@@ -0,0 +1,204 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "startup_bench.h"
+
+#include "harness.h"
+
+// Startup/shutdown benchmark: runs the static-storage constructors and destructors of a
+// generated program (see startup_gen.cc) via bmcxxabi_run_init, __cxa_finalize and
+// bmcxxabi_run_fini, timing each phase, and times each __cxa_atexit registration individually
+// (via the linker's --wrap) so that the cost of growing the registration table shows up. The
+// program is linked with startup_bench.ld, which collects the .init_array/.fini_array entries
+// as per the link script fragment in README.md, in place of the host's startup code; so nothing
+// is constructed before main. Built and run via startup-bench.sh.
+//
+// Usage: startup-bench
+//
+// Output is tab-separated. The first table, with a header line, has one line per phase:
+//
+//     phase  count  unit  total  per_item  median  p99  max
+//
+//   init             bmcxxabi_run_init: constructing the objects (and registering their
+//                    destructors) and running the constructor functions
+//   atexit_register  each __cxa_atexit call (during init and local_statics); median, p99 and
+//                    max are per call
+//   local_statics    the first call of each function containing function-local statics
+//   finalize         __cxa_finalize: destroying all objects, in reverse order of construction
+//   fini_array       bmcxxabi_run_fini: running the destructor functions
+//
+// The second table lists the __cxa_atexit calls which allocate or grow the registration table,
+// with the median call time for comparison. Times are TSC cycles on x86, nanoseconds elsewhere.
+
+extern "C" void bmcxxabi_run_init();
+extern "C" void bmcxxabi_run_fini();
+extern "C" void __cxa_finalize(void *d);
+extern "C" int __real___cxa_atexit(void (*f)(void *), void *p, void *d);
+extern "C" void *__dso_handle;
+
+extern const char harness_name[] = "startup-bench";
+
+namespace {
+
+// Construction/destruction tracking
+unsigned num_constructed;       // objects constructed
+unsigned num_destroyed;         // objects destroyed
+unsigned num_ctor_funcs;        // constructor functions run
+unsigned num_dtor_funcs;        // destructor functions run
+unsigned last_init_prio;        // priority of the last object / constructor function
+unsigned last_fini_prio = ~0u;  // priority of the last destructor function
+unsigned order_errors;
+
+// __cxa_atexit call times
+uint64_t *reg_times;
+unsigned max_registrations;
+unsigned num_registrations;
+
+void check_init_order(unsigned prio)
+{
+    if (prio < last_init_prio) ++order_errors;
+    last_init_prio = prio;
+}
+
+void print_phase(const char *phase, unsigned count, uint64_t total)
+{
+    printf("%s\t%u\t%s\t%llu\t%.1f\t-\t-\t-\n", phase, count, time_unit,
+            (unsigned long long)total, count ? (double)total / count : 0.0);
+}
+
+} // anon namespace
+
+startup_bench_obj::startup_bench_obj(unsigned prio) noexcept : seq(num_constructed++)
+{
+    check_init_order(prio);
+}
+
+startup_bench_obj::~startup_bench_obj()
+{
+    // objects must be destroyed in the reverse order of construction
+    if (seq != num_constructed - 1 - num_destroyed) ++order_errors;
+    ++num_destroyed;
+}
+
+void startup_bench_ctor_func(unsigned prio)
+{
+    check_init_order(prio);
+    ++num_ctor_funcs;
+}
+
+void startup_bench_dtor_func(unsigned prio)
+{
+    // destructor functions run in decreasing order of priority (the default being highest)
+    if (prio > last_fini_prio) ++order_errors;
+    last_fini_prio = prio;
+    ++num_dtor_funcs;
+}
+
+extern "C"
+int __wrap___cxa_atexit(void (*f)(void *), void *p, void *d)
+{
+    uint64_t start = now();
+    int r = __real___cxa_atexit(f, p, d);
+    uint64_t time = now() - start;
+    if (num_registrations < max_registrations) {
+        reg_times[num_registrations] = time;
+    }
+    ++num_registrations;
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        fprintf(stderr, "usage: startup-bench\n");
+        return 1;
+    }
+
+    const startup_bench_config &cfg = startup_bench_cfg;
+    if (num_constructed != 0 || num_ctor_funcs != 0) {
+        fprintf(stderr, "startup-bench: constructors ran before main (not linked with "
+                "startup_bench.ld?)\n");
+        return 1;
+    }
+
+    max_registrations = cfg.objects + cfg.locals;
+    reg_times = (uint64_t *)malloc((max_registrations + 1) * sizeof(uint64_t));
+    if (reg_times == nullptr) return 1;
+
+    uint64_t start = now();
+    bmcxxabi_run_init();
+    uint64_t init_time = now() - start;
+    unsigned init_registrations = num_registrations;
+
+    start = now();
+    startup_bench_init_locals();
+    uint64_t locals_time = now() - start;
+
+    unsigned init_count = num_constructed;
+    unsigned registrations = num_registrations;
+
+    start = now();
+    __cxa_finalize(&__dso_handle);
+    uint64_t finalize_time = now() - start;
+
+    start = now();
+    bmcxxabi_run_fini();
+    uint64_t fini_time = now() - start;
+
+    bool ok = true;
+    if (init_count != cfg.objects + cfg.locals || num_ctor_funcs != cfg.ctor_funcs
+            || registrations != init_count || init_registrations != cfg.objects) {
+        fprintf(stderr, "startup-bench: constructed %u objects (with %u registrations) and ran %u "
+                "constructor functions; expected %u, %u\n", init_count, registrations,
+                num_ctor_funcs, cfg.objects + cfg.locals, cfg.ctor_funcs);
+        ok = false;
+    }
+    if (num_destroyed != init_count || num_dtor_funcs != cfg.dtor_funcs) {
+        fprintf(stderr, "startup-bench: destroyed %u objects and ran %u destructor functions; "
+                "expected %u, %u\n", num_destroyed, num_dtor_funcs, init_count, cfg.dtor_funcs);
+        ok = false;
+    }
+    if (order_errors != 0) {
+        fprintf(stderr, "startup-bench: %u objects or functions ran out of order\n",
+                order_errors);
+        ok = false;
+    }
+    if (!ok) return 1;
+
+    uint64_t *sorted = (uint64_t *)malloc((registrations + 1) * sizeof(uint64_t));
+    if (sorted == nullptr) return 1;
+    uint64_t reg_total = 0;
+    for (unsigned i = 0; i < registrations; ++i) {
+        reg_total += reg_times[i];
+    }
+    memcpy(sorted, reg_times, registrations * sizeof(uint64_t));
+    qsort(sorted, registrations, sizeof(uint64_t), compare_u64);
+    uint64_t median = registrations ? sorted[registrations / 2] : 0;
+
+    printf("phase\tcount\tunit\ttotal\tper_item\tmedian\tp99\tmax\n");
+    print_phase("init", cfg.objects + cfg.ctor_funcs, init_time);
+    if (registrations != 0) {
+        unsigned p99 = (unsigned)((registrations - 1) * 0.99);
+        printf("atexit_register\t%u\t%s\t%llu\t%.1f\t%llu\t%llu\t%llu\n", registrations,
+                time_unit, (unsigned long long)reg_total, (double)reg_total / registrations,
+                (unsigned long long)median, (unsigned long long)sorted[p99],
+                (unsigned long long)sorted[registrations - 1]);
+    }
+    print_phase("local_statics", cfg.locals, locals_time);
+    print_phase("finalize", init_count, finalize_time);
+    print_phase("fini_array", cfg.dtor_funcs, fini_time);
+
+    // Growth points: the first call allocates the table (of 16 entries), and it doubles each
+    // time it fills
+    printf("\nregistration\tunit\ttime\tmedian\n");
+    for (unsigned i = 0; i < registrations; i = (i == 0) ? 16 : i * 2) {
+        printf("%u\t%s\t%llu\t%llu\n", i, time_unit, (unsigned long long)reg_times[i],
+                (unsigned long long)median);
+    }
+
+    free(sorted);
+    free(reg_times);
+    return 0;
+}
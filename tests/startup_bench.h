@@ -0,0 +1,39 @@
+#ifndef STARTUP_BENCH_H_INCLUDED
+#define STARTUP_BENCH_H_INCLUDED 1
+
+// Interface between the startup/shutdown benchmark (startup_bench.cc) and the generated sources
+// (from startup_gen.cc). The generated sources define the static-storage objects, constructor
+// and destructor functions, and function-local statics; each of these reports to the benchmark
+// as it is constructed or destroyed, so that the benchmark can check the counts and the order.
+
+// Priority reported by objects and functions without an init_priority / constructor or
+// destructor priority (which run after all those with one), and by function-local statics.
+constexpr unsigned startup_bench_default_prio = 65536;
+constexpr unsigned startup_bench_local_prio = 65537;
+
+struct startup_bench_obj {
+    unsigned seq;         // order of construction
+
+    explicit startup_bench_obj(unsigned prio) noexcept;
+    ~startup_bench_obj();
+};
+
+void startup_bench_ctor_func(unsigned prio);
+void startup_bench_dtor_func(unsigned prio);
+
+struct startup_bench_config {
+    unsigned objects;     // number of static-storage objects at namespace scope
+    unsigned locals;      // number of function-local statics
+    unsigned priorities;  // number of distinct priorities used (besides the default)
+    unsigned ctor_funcs;  // number of constructor functions
+    unsigned dtor_funcs;  // number of destructor functions
+    unsigned files;       // number of translation units
+};
+
+extern const startup_bench_config startup_bench_cfg;
+
+// Construct all function-local statics (by calling the function containing them in each
+// generated translation unit)
+void startup_bench_init_locals();
+
+#endif
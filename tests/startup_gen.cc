@@ -0,0 +1,170 @@
+// startup-gen: generate static-storage objects, constructor/destructor functions and
+// function-local statics, spread over a number of translation units, for the startup/shutdown
+// benchmark (startup_bench.cc, startup_bench.h). This is a host program.
+//
+// Usage: startup-gen [-n <objects>] [-l <locals>] [-p <priorities>] [-c <ctor-funcs>]
+//                    [-e <dtor-funcs>] [-f <files>] -o <prefix>
+//
+//   -n  number of static-storage objects at namespace scope (default 10000)
+//   -l  number of function-local statics (default 1000)
+//   -p  number of distinct init priorities (default 8; 0 = none)
+//   -c  number of constructor functions, ie. __attribute__((constructor)) (default 100)
+//   -e  number of destructor functions, ie. __attribute__((destructor)) (default 100)
+//   -f  number of translation units (default 16)
+//   -o  output prefix; writes <prefix>-<n>.cc for each translation unit and <prefix>-index.cc
+//
+// Objects and functions are dealt out round-robin over the priorities plus the default (no
+// priority), and over the translation units. Each translation unit with objects at a given
+// priority contributes one .init_array entry for that priority (the compiler-generated function
+// which constructs them and registers their destructors via __cxa_atexit); each constructor or
+// destructor function is a .init_array or .fini_array entry of its own.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+constexpr unsigned first_prio = 101;  // lower priorities are reserved for the implementation
+constexpr unsigned max_priorities = 65535 - first_prio;
+
+// Priority attribute argument for the given item, or 0 for the default (none)
+unsigned prio_for(unsigned index, unsigned priorities)
+{
+    unsigned slot = index % (priorities + 1);
+    return (slot == priorities) ? 0 : first_prio + slot;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: startup-gen [-n <objects>] [-l <locals>] [-p <priorities>] "
+            "[-c <ctor-funcs>] [-e <dtor-funcs>] [-f <files>] -o <prefix>\n");
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    unsigned objects = 10000, locals = 1000, priorities = 8, ctor_funcs = 100, dtor_funcs = 100;
+    unsigned files = 16;
+    const char *prefix = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            usage();
+            return 1;
+        }
+        const char *arg = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 'n': objects = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 'l': locals = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 'p': priorities = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 'c': ctor_funcs = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 'e': dtor_funcs = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 'f': files = (unsigned)strtoul(arg, nullptr, 10); break;
+        case 'o': prefix = arg; break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (prefix == nullptr) {
+        usage();
+        return 1;
+    }
+    if (files == 0 || priorities > max_priorities) {
+        fprintf(stderr, "startup-gen: files must be non-zero, priorities at most %u\n",
+                max_priorities);
+        return 1;
+    }
+
+    char opts[160];
+    snprintf(opts, sizeof(opts), "-n %u -l %u -p %u -c %u -e %u -f %u", objects, locals,
+            priorities, ctor_funcs, dtor_funcs, files);
+
+    for (unsigned k = 0; k < files; ++k) {
+        std::string name = std::string(prefix) + "-" + std::to_string(k) + ".cc";
+        FILE *out = fopen(name.c_str(), "w");
+        if (out == nullptr) {
+            perror(name.c_str());
+            return 1;
+        }
+
+        fprintf(out, "// Generated by startup-gen %s; do not edit.\n\n", opts);
+        fprintf(out, "#include \"startup_bench.h\"\n\n");
+
+        for (unsigned i = k; i < objects; i += files) {
+            unsigned prio = prio_for(i, priorities);
+            if (prio != 0) {
+                fprintf(out, "static startup_bench_obj o%u __attribute__((init_priority(%u))) "
+                        "(%u);\n", i, prio, prio);
+            }
+            else {
+                fprintf(out, "static startup_bench_obj o%u(startup_bench_default_prio);\n", i);
+            }
+        }
+
+        for (unsigned i = k; i < ctor_funcs; i += files) {
+            unsigned prio = prio_for(i, priorities);
+            if (prio != 0) {
+                fprintf(out, "__attribute__((constructor(%u))) static void c%u() "
+                        "{ startup_bench_ctor_func(%u); }\n", prio, i, prio);
+            }
+            else {
+                fprintf(out, "__attribute__((constructor)) static void c%u() "
+                        "{ startup_bench_ctor_func(startup_bench_default_prio); }\n", i);
+            }
+        }
+
+        for (unsigned i = k; i < dtor_funcs; i += files) {
+            unsigned prio = prio_for(i, priorities);
+            if (prio != 0) {
+                fprintf(out, "__attribute__((destructor(%u))) static void d%u() "
+                        "{ startup_bench_dtor_func(%u); }\n", prio, i, prio);
+            }
+            else {
+                fprintf(out, "__attribute__((destructor)) static void d%u() "
+                        "{ startup_bench_dtor_func(startup_bench_default_prio); }\n", i);
+            }
+        }
+
+        fprintf(out, "\nvoid startup_bench_locals_%u()\n{\n", k);
+        for (unsigned i = k; i < locals; i += files) {
+            fprintf(out, "    static startup_bench_obj l%u(startup_bench_local_prio);\n", i);
+        }
+        fprintf(out, "}\n");
+
+        if (fclose(out) != 0) {
+            perror(name.c_str());
+            return 1;
+        }
+    }
+
+    std::string name = std::string(prefix) + "-index.cc";
+    FILE *out = fopen(name.c_str(), "w");
+    if (out == nullptr) {
+        perror(name.c_str());
+        return 1;
+    }
+
+    fprintf(out, "// Generated by startup-gen %s; do not edit.\n\n", opts);
+    fprintf(out, "#include \"startup_bench.h\"\n\n");
+    fprintf(out, "const startup_bench_config startup_bench_cfg = { %u, %u, %u, %u, %u, %u };\n\n",
+            objects, locals, priorities, ctor_funcs, dtor_funcs, files);
+    for (unsigned k = 0; k < files; ++k) {
+        fprintf(out, "void startup_bench_locals_%u();\n", k);
+    }
+    fprintf(out, "\nvoid startup_bench_init_locals()\n{\n");
+    for (unsigned k = 0; k < files; ++k) {
+        fprintf(out, "    startup_bench_locals_%u();\n", k);
+    }
+    fprintf(out, "}\n");
+
+    if (fclose(out) != 0) {
+        perror(name.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <typeinfo>
+
+#include <pthread.h>
+
+#include "../include/bmcxxabi.h"
+
+#include "harness.h"
+
+// Static exception harness, for the hosted build of the library (which is built with
+// BMCXX_STATIC_EXCEPTIONS). Checks that static exceptions thrown via bmcxxabi_throw_static are
+// caught (by reference, by base class, by value, via catch(...) and after a rethrow) as the
+// object itself, are never destroyed, can be thrown within handlers for one another (beyond the
+// number of per-thread headers), and can be thrown by several threads at once; then compares the
+// cost of a throw and catch of a static exception with that of an ordinary throw expression
+// (timing the two alternately).
+//
+// Usage: static-throw [-n <iterations>]
+//
+// Output is tab-separated, with a header line:
+//
+//     benchmark  cycles_median  cycles_min
+//
+// The exit status is non-zero if any check fails.
+
+extern const char harness_name[] = "static-throw";
+
+namespace {
+
+struct error_base {
+    int code;
+    explicit error_base(int c) : code(c) { }
+    error_base(const error_base &other) : code(other.code) { }
+    ~error_base();
+};
+
+struct timeout_error : error_base {
+    timeout_error() : error_base(110) { }
+};
+
+struct queue_full : error_base {
+    queue_full() : error_base(105) { }
+};
+
+volatile unsigned destroyed;
+
+error_base::~error_base()
+{
+    destroyed = destroyed + 1;
+}
+
+const timeout_error timeout;
+const queue_full full;
+
+const bmcxxabi_static_exception timeout_exc = { &timeout, &typeid(timeout_error) };
+const bmcxxabi_static_exception full_exc = { &full, &typeid(queue_full) };
+
+__attribute__((noinline)) void throw_timeout()
+{
+    bmcxxabi_throw_static(&timeout_exc);
+}
+
+__attribute__((noinline)) void throw_timeout_dynamic()
+{
+    throw timeout_error();
+}
+
+// Throw a static exception within the handler for another, to the given depth
+__attribute__((noinline)) void nested(unsigned depth)
+{
+    try {
+        bmcxxabi_throw_static((depth & 1) ? &full_exc : &timeout_exc);
+    }
+    catch (error_base &e) {
+        check(&e == ((depth & 1) ? (const error_base *)&full : &timeout), "nested: wrong object");
+        if (depth > 1) nested(depth - 1);
+    }
+}
+
+void *thread_throws(void *arg)
+{
+    unsigned n = *(unsigned *)arg;
+    for (unsigned i = 0; i < n; ++i) {
+        try {
+            bmcxxabi_throw_static((i & 1) ? &full_exc : &timeout_exc);
+        }
+        catch (queue_full &e) {
+            if (&e != &full) ok = false;
+        }
+        catch (timeout_error &e) {
+            if (&e != &timeout) ok = false;
+        }
+    }
+    return nullptr;
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = 100000;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else {
+            fprintf(stderr, "usage: static-throw [-n <iterations>]\n");
+            return 1;
+        }
+    }
+    if (iterations == 0) iterations = 1;
+
+    try {
+        throw_timeout();
+    }
+    catch (timeout_error &e) {
+        check(&e == &timeout, "catch by reference: not the static object");
+    }
+
+    try {
+        throw_timeout();
+    }
+    catch (error_base &e) {
+        check(&e == &timeout && e.code == 110, "catch by base: wrong object");
+    }
+
+    try {
+        throw_timeout();
+    }
+    catch (error_base e) {
+        check(e.code == 110, "catch by value: wrong value");
+    }
+    check(destroyed == 1, "catch by value: copy not destroyed once");
+    destroyed = 0;
+
+    try {
+        throw_timeout();
+    }
+    catch (...) {
+    }
+
+    try {
+        try {
+            throw_timeout();
+        }
+        catch (timeout_error &) {
+            throw;
+        }
+    }
+    catch (error_base &e) {
+        check(&e == &timeout, "rethrow: wrong object");
+    }
+
+    try {
+        throw_timeout();
+    }
+    catch (queue_full &) {
+        check(false, "caught by the wrong handler");
+    }
+    catch (timeout_error &) {
+    }
+
+    nested(12);
+
+    constexpr unsigned num_threads = 8;
+    unsigned per_thread = iterations / 10 + 1;
+    pthread_t threads[num_threads];
+    for (pthread_t &t : threads) {
+        if (pthread_create(&t, nullptr, thread_throws, &per_thread) != 0) {
+            fprintf(stderr, "static-throw: can't create thread\n");
+            return 1;
+        }
+    }
+    for (pthread_t &t : threads) {
+        pthread_join(t, nullptr);
+    }
+
+    check(destroyed == 0, "static object destroyed");
+    if (!ok) return 1;
+
+    uint64_t *samples = (uint64_t *)malloc(2 * iterations * sizeof(uint64_t));
+    if (samples == nullptr) return 1;
+
+    printf("benchmark\tcycles_median\tcycles_min\n");
+    bench_pair("throw_expression", "throw_static", samples, iterations, [] {
+        try {
+            throw_timeout_dynamic();
+        }
+        catch (timeout_error &) {
+        }
+    }, [] {
+        try {
+            throw_timeout();
+        }
+        catch (timeout_error &) {
+        }
+    });
+
+    free(samples);
+    return ok ? 0 : 1;
+}
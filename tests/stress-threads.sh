@@ -0,0 +1,33 @@
+# Build and run the multi-threaded stress suite (stress-threads), then plot throughput against
+# thread count for each workload. Arguments are passed to stress-threads (eg "-t 16 -n 50000").
+# The raw results are left in stress-threads.out; the exit status is that of stress-threads, ie.
+# non-zero if any invariant was violated.
+set -eu
+
+make -s stress-threads
+status=0
+./stress-threads "$@" > stress-threads.out || status=$?
+cat stress-threads.out
+
+# One bar per thread count, scaled to the highest throughput for the workload
+echo
+awk -F '\t' '
+NR > 1 {
+    n = ++count[$1]; if (n == 1) order[++nw] = $1
+    threads[$1, n] = $2; rate[$1, n] = $5
+    if ($5 > max[$1]) max[$1] = $5
+}
+END {
+    for (w = 1; w <= nw; ++w) {
+        name = order[w]
+        printf "%s (ops/sec)\n", name
+        for (i = 1; i <= count[name]; ++i) {
+            len = max[name] > 0 ? int(50 * rate[name, i] / max[name] + 0.5) : 0
+            bar = ""
+            for (j = 0; j < len; ++j) bar = bar "#"
+            printf "  %4d  %-50s %.3g\n", threads[name, i], bar, rate[name, i]
+        }
+    }
+}' stress-threads.out
+
+exit $status
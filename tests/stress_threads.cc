@@ -0,0 +1,434 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+// Multi-threaded stress and scalability suite, for the hosted build of the library (which is
+// built with BMCXX_THREADS; see ../src/threads.h). Each workload is run with 1, 2, 4, ... threads
+// up to the maximum, every thread performing the same number of operations; the invariants are
+// checked after each run, and the throughput reported. Like the A/B workloads, this is compiled
+// against the host C++ headers and linked with no C++ library other than libcxxabi-hosted.a.
+// stress-threads.sh builds and runs it, and plots the results.
+//
+// Usage: stress-threads [-t <max-threads>] [-n <ops-per-thread>] [<name-filter>]
+//
+// (the default maximum is the number of CPUs, but at least 4, so that races between preempted
+// threads are exercised even on a single CPU.)
+//
+// Workloads, and the invariants checked:
+//   guard         threads race to initialise each of a set of guarded variables (with the
+//                 compiler's pattern of an inline check before __cxa_guard_acquire); each must
+//                 be initialised exactly once
+//   guard_abort   as guard, but the first initialisation attempt for each variable is abandoned
+//                 via __cxa_guard_abort; exactly one further attempt must then succeed
+//   atexit        threads register functions via __cxa_atexit concurrently; afterwards
+//                 __cxa_finalize must call every function exactly once, and each thread's
+//                 functions in the reverse of the order it registered them
+//   throw_catch   each thread throws and catches; the right object must be caught, destroyed
+//                 exactly once, and __cxa_uncaught_exceptions must be 1 during unwinding and 0
+//                 in the handler
+//   rethrow       as throw_catch, with the exception rethrown from an inner handler, and another
+//                 thrown and caught within the outer handler
+//
+// Output is tab-separated, with a header line:
+//
+//     workload  threads  ops  seconds  ops_per_sec  scaling
+//
+// where ops is the total over all threads and scaling is the throughput relative to a single
+// thread. The exit status is non-zero if any invariant is violated.
+
+extern "C" int __cxa_guard_acquire(int64_t *guard);
+extern "C" void __cxa_guard_release(int64_t *guard);
+extern "C" void __cxa_guard_abort(int64_t *guard);
+extern "C" int __cxa_atexit(void (*f)(void *), void *p, void *d);
+extern "C" void __cxa_finalize(void *d);
+extern "C" unsigned int __cxa_uncaught_exceptions() noexcept;
+extern "C" void *__dso_handle;
+
+namespace {
+
+constexpr unsigned max_threads_limit = 256;
+constexpr unsigned num_guards = 1024;
+
+unsigned max_threads;
+unsigned ops_per_thread = 20000;
+const char *filter = nullptr;
+
+unsigned num_threads;           // for the current run
+pthread_barrier_t start_barrier;
+pthread_barrier_t round_barrier;
+
+unsigned errors;                // (atomic)
+
+void error(const char *workload, const char *msg)
+{
+    if (__atomic_fetch_add(&errors, 1, __ATOMIC_RELAXED) < 10) {
+        fprintf(stderr, "stress-threads: %s/%u: %s\n", workload, num_threads, msg);
+    }
+}
+
+double now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Guards
+
+int64_t guards[num_guards];
+unsigned init_counts[num_guards];     // (deliberately not atomic)
+unsigned attempts[num_guards];        // (atomic)
+
+// As compiler-generated code for a guarded initialisation; init returns false to abandon the
+// attempt (as if by an exception).
+template <typename F>
+void guarded_init(int64_t *guard, F init)
+{
+    while (__atomic_load_n((char *)guard, __ATOMIC_ACQUIRE) == 0) {
+        if (__cxa_guard_acquire(guard)) {
+            if (init()) {
+                __cxa_guard_release(guard);
+            }
+            else {
+                __cxa_guard_abort(guard);
+            }
+        }
+    }
+}
+
+unsigned guard_rounds()
+{
+    unsigned rounds = ops_per_thread / num_guards;
+    return rounds != 0 ? rounds : 1;
+}
+
+// Run rounds over all the guards; between rounds, thread 0 checks the counts and resets.
+void run_guards(unsigned tid, const char *name, bool abort_first)
+{
+    for (unsigned r = 0; r < guard_rounds(); ++r) {
+        unsigned start = tid * (num_guards / num_threads);
+        for (unsigned j = 0; j < num_guards; ++j) {
+            unsigned i = (start + j) % num_guards;
+            guarded_init(&guards[i], [=] {
+                unsigned attempt = __atomic_fetch_add(&attempts[i], 1, __ATOMIC_RELAXED);
+                if (abort_first && attempt == 0) return false;
+                init_counts[i] = init_counts[i] + 1;
+                return true;
+            });
+        }
+
+        pthread_barrier_wait(&round_barrier);
+        if (tid == 0) {
+            for (unsigned i = 0; i < num_guards; ++i) {
+                if (init_counts[i] != 1) {
+                    error(name, "variable initialised other than exactly once");
+                }
+                if (attempts[i] != (abort_first ? 2u : 1u)) {
+                    error(name, "wrong number of initialisation attempts");
+                }
+                guards[i] = 0;
+                init_counts[i] = 0;
+                attempts[i] = 0;
+            }
+        }
+        pthread_barrier_wait(&round_barrier);
+    }
+}
+
+void guard_run(unsigned tid)
+{
+    run_guards(tid, "guard", false);
+}
+
+void guard_abort_run(unsigned tid)
+{
+    run_guards(tid, "guard_abort", true);
+}
+
+unsigned guard_ops()
+{
+    return guard_rounds() * num_guards;
+}
+
+// atexit
+
+// Each registered function records when (in the sequence of calls from __cxa_finalize) it was
+// called; 0 if not called.
+unsigned *atexit_slots;
+unsigned atexit_calls;
+
+void atexit_func(void *p)
+{
+    unsigned *slot = (unsigned *)p;
+    if (*slot != 0) error("atexit", "function called twice");
+    *slot = ++atexit_calls;
+}
+
+bool atexit_setup()
+{
+    free(atexit_slots);
+    atexit_slots = (unsigned *)calloc((size_t)num_threads * ops_per_thread, sizeof(unsigned));
+    atexit_calls = 0;
+    return atexit_slots != nullptr;
+}
+
+void atexit_run(unsigned tid)
+{
+    unsigned *slots = atexit_slots + (size_t)tid * ops_per_thread;
+    for (unsigned i = 0; i < ops_per_thread; ++i) {
+        if (__cxa_atexit(atexit_func, &slots[i], &__dso_handle) != 0) {
+            error("atexit", "registration failed");
+        }
+    }
+}
+
+void atexit_check()
+{
+    __cxa_finalize(&__dso_handle);
+
+    if (atexit_calls != num_threads * ops_per_thread) {
+        error("atexit", "registrations lost");
+    }
+    for (unsigned t = 0; t < num_threads; ++t) {
+        unsigned *slots = atexit_slots + (size_t)t * ops_per_thread;
+        for (unsigned i = 0; i < ops_per_thread; ++i) {
+            if (slots[i] == 0) {
+                error("atexit", "function not called");
+                return;
+            }
+            if (i != 0 && slots[i] > slots[i - 1]) {
+                error("atexit", "functions not called in reverse order of registration");
+                return;
+            }
+        }
+    }
+}
+
+// Exceptions
+
+__thread unsigned objs_live;    // exception objects constructed but not destroyed
+
+struct Thrown {
+    unsigned tid;
+    unsigned seq;
+
+    Thrown(unsigned tid, unsigned seq) : tid(tid), seq(seq) { ++objs_live; }
+    Thrown(const Thrown &other) : tid(other.tid), seq(other.seq) { ++objs_live; }
+    ~Thrown() { --objs_live; }
+};
+
+// Checks the uncaught exception count when destroyed (ie. during unwinding)
+struct UncaughtCheck {
+    const char *name;
+    unsigned expect;
+
+    ~UncaughtCheck()
+    {
+        if (__cxa_uncaught_exceptions() != expect) {
+            error(name, "wrong uncaught exception count during unwinding");
+        }
+    }
+};
+
+__attribute__((noinline)) void throw_thrown(const char *name, unsigned tid, unsigned seq,
+        unsigned uncaught)
+{
+    UncaughtCheck check { name, uncaught + 1 };
+    throw Thrown(tid, seq);
+}
+
+void check_caught(const char *name, const Thrown &t, unsigned tid, unsigned seq, unsigned uncaught)
+{
+    if (t.tid != tid || t.seq != seq) {
+        error(name, "caught the wrong exception object");
+    }
+    if (__cxa_uncaught_exceptions() != uncaught) {
+        error(name, "wrong uncaught exception count in handler");
+    }
+}
+
+void check_after(const char *name)
+{
+    if (objs_live != 0) {
+        error(name, "exception object not destroyed exactly once");
+        objs_live = 0;
+    }
+    if (__cxa_uncaught_exceptions() != 0) {
+        error(name, "uncaught exception count not zero after handling");
+    }
+}
+
+void throw_catch_run(unsigned tid)
+{
+    for (unsigned i = 0; i < ops_per_thread; ++i) {
+        try {
+            throw_thrown("throw_catch", tid, i, 0);
+        }
+        catch (Thrown &t) {
+            check_caught("throw_catch", t, tid, i, 0);
+        }
+    }
+    check_after("throw_catch");
+}
+
+void rethrow_run(unsigned tid)
+{
+    for (unsigned i = 0; i < ops_per_thread; ++i) {
+        try {
+            try {
+                throw_thrown("rethrow", tid, i, 0);
+            }
+            catch (Thrown &t) {
+                check_caught("rethrow", t, tid, i, 0);
+                UncaughtCheck check { "rethrow", 1 };
+                throw;
+            }
+        }
+        catch (Thrown &t) {
+            check_caught("rethrow", t, tid, i, 0);
+            try {
+                throw_thrown("rethrow", tid, ~i, 0);
+            }
+            catch (Thrown &inner) {
+                check_caught("rethrow", inner, tid, ~i, 0);
+            }
+            check_caught("rethrow", t, tid, i, 0);
+        }
+    }
+    check_after("rethrow");
+}
+
+unsigned per_thread_ops()
+{
+    return ops_per_thread;
+}
+
+struct workload {
+    const char *name;
+    void (*run)(unsigned tid);
+    unsigned (*ops)();          // operations per thread
+    bool (*setup)();            // (may be null)
+    void (*check)();            // after all threads have finished (may be null)
+};
+
+const workload workloads[] = {
+    { "guard", guard_run, guard_ops, nullptr, nullptr },
+    { "guard_abort", guard_abort_run, guard_ops, nullptr, nullptr },
+    { "atexit", atexit_run, per_thread_ops, atexit_setup, atexit_check },
+    { "throw_catch", throw_catch_run, per_thread_ops, nullptr, nullptr },
+    { "rethrow", rethrow_run, per_thread_ops, nullptr, nullptr },
+};
+
+const workload *current;
+
+// Start and end time of each thread; the elapsed time for a run is from the first start to the
+// last end. (Timing from the main thread would be wrong if the workers were scheduled first.)
+double thread_start[max_threads_limit];
+double thread_end[max_threads_limit];
+
+void *thread_main(void *arg)
+{
+    unsigned tid = (unsigned)(uintptr_t)arg;
+    pthread_barrier_wait(&start_barrier);
+    thread_start[tid] = now();
+    current->run(tid);
+    thread_end[tid] = now();
+    return nullptr;
+}
+
+// Run the current workload with num_threads threads; returns the elapsed time
+double run_threads()
+{
+    pthread_t threads[max_threads_limit];
+    pthread_barrier_init(&start_barrier, nullptr, num_threads + 1);
+    pthread_barrier_init(&round_barrier, nullptr, num_threads);
+
+    for (unsigned t = 0; t < num_threads; ++t) {
+        if (pthread_create(&threads[t], nullptr, thread_main, (void *)(uintptr_t)t) != 0) {
+            fprintf(stderr, "stress-threads: can't create thread\n");
+            exit(1);
+        }
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    double start = 0, end = 0;
+    for (unsigned t = 0; t < num_threads; ++t) {
+        pthread_join(threads[t], nullptr);
+        if (t == 0 || thread_start[t] < start) start = thread_start[t];
+        if (thread_end[t] > end) end = thread_end[t];
+    }
+    double elapsed = end - start;
+
+    pthread_barrier_destroy(&start_barrier);
+    pthread_barrier_destroy(&round_barrier);
+    return elapsed;
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    max_threads = cpus > 4 ? (unsigned)cpus : 4;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            max_threads = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            ops_per_thread = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argv[i][0] != '-' && filter == nullptr) {
+            filter = argv[i];
+        }
+        else {
+            fprintf(stderr, "usage: stress-threads [-t <max-threads>] [-n <ops-per-thread>] "
+                    "[<name-filter>]\n");
+            return 1;
+        }
+    }
+    if (max_threads == 0) max_threads = 1;
+    if (max_threads > max_threads_limit) max_threads = max_threads_limit;
+    if (ops_per_thread == 0) ops_per_thread = 1;
+
+    printf("workload\tthreads\tops\tseconds\tops_per_sec\tscaling\n");
+
+    for (const workload &w : workloads) {
+        if (filter != nullptr && strstr(w.name, filter) == nullptr) continue;
+        current = &w;
+
+        double base_rate = 0;
+        for (unsigned n = 1; ; n *= 2) {
+            if (n > max_threads) n = max_threads;
+            num_threads = n;
+            if (w.setup != nullptr && !w.setup()) {
+                fprintf(stderr, "stress-threads: out of memory\n");
+                return 1;
+            }
+
+            double elapsed = run_threads();
+            if (w.check != nullptr) w.check();
+
+            unsigned long long ops = (unsigned long long)w.ops() * n;
+            double rate = elapsed > 0 ? ops / elapsed : 0;
+            if (n == 1) base_rate = rate;
+            printf("%s\t%u\t%llu\t%.4f\t%.0f\t%.2f\n", w.name, n, ops, elapsed, rate,
+                    base_rate > 0 ? rate / base_rate : 0);
+            fflush(stdout);
+            if (n == max_threads) break;
+        }
+    }
+
+    free(atexit_slots);
+
+    if (errors != 0) {
+        fprintf(stderr, "stress-threads: %u invariant violations\n", errors);
+        return 1;
+    }
+    return 0;
+}
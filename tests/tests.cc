@@ -2,9 +2,18 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <new>
+#include <typeinfo>
 
 #include <unistd.h>
 
+extern "C" void *__cxa_allocate_exception(size_t thrown_size) noexcept;
+extern "C" void __cxa_throw(void *thrown, void *tinfo, void (*destructor)(void *));
+
+// Defined only if the library is built with BMCXX_TYPE_INTERN
+extern "C" __attribute__((weak)) size_t bmcxxabi_intern_type_infos(const std::type_info * const *,
+        size_t);
+
 
 void print(const char *str)
 {
@@ -35,6 +44,16 @@ struct VA2 : virtual public A {};
 
 struct VI : public VA1, public VA2 {};
 
+// Polymorphic hierarchy for dynamic_cast
+struct PA { virtual ~PA() {} };
+struct PB { virtual ~PB() {} };
+struct PC : public PA, public PB {};
+struct PD : public PC, public PA {};
+class PE : private PA, public PB {};
+struct PVA1 : virtual public PA {};
+struct PVA2 : virtual public PA, public PB {};
+struct PVI : public PVA1, public PVA2 {};
+
 void testPtrCatch1()
 {
     print("testPtrCatch1... ");
@@ -205,9 +224,175 @@ static void throwIncComplete()
     throw &incObj; // throw ptr-ptr-complete
 }
 
-// TODO:
-// - test general unwinding (cleanup)
-// - rethrowing
+// Test catching where the thrown type_info is a distinct copy (with a distinct copy of the name),
+// as would be the case if the exception was thrown from a separately-linked module. Such types
+// only match if the library is built with BMCXX_TYPE_INTERN and the copy is registered (after the
+// original) via bmcxxabi_intern_type_infos, as a module loader would.
+
+void testModuleCopyTypeCatch()
+{
+    print("testModuleCopyTypeCatch... ");
+    if (bmcxxabi_intern_type_infos == nullptr) {
+        print("SKIP (not built with BMCXX_TYPE_INTERN)\n");
+        return;
+    }
+
+    // type_info layout: vtable pointer, name
+    struct {
+        const void *vptr;
+        const char *name;
+    } ti_copy;
+    static char name_copy[32];
+
+    const std::type_info &a_ti = typeid(A);
+    strcpy(name_copy, a_ti.name());
+    memcpy(&ti_copy.vptr, &a_ti, sizeof(ti_copy.vptr));
+    ti_copy.name = name_copy;
+
+    const std::type_info *main_tinfos[] = { &a_ti, &typeid(B) };
+    const std::type_info *module_tinfos[] = { (const std::type_info *)&ti_copy };
+    if (bmcxxabi_intern_type_infos(main_tinfos, 2) != 0
+            || bmcxxabi_intern_type_infos(module_tinfos, 1) != 0 || ti_copy.name != a_ti.name()) {
+        print("*** FAIL ***\n");
+        return;
+    }
+
+    try {
+        void *exc = __cxa_allocate_exception(sizeof(A));
+        new (exc) A();
+        __cxa_throw(exc, &ti_copy, nullptr);
+    }
+    catch (B &) {
+        print("*** FAIL ***\n");
+        return;
+    }
+    catch (A &a) {
+        if (a.v != 0x1234) {
+            print("*** FAIL ***\n");
+            return;
+        }
+    }
+    catch (...) {
+        print("*** FAIL ***\n");
+        return;
+    }
+    print("PASS\n");
+}
+
+// Test unwinding with cleanup: destructor of a local inside a try block must run, and the
+// exception must still be caught by the handler in the same function.
+
+static int cleanupCount = 0;
+
+struct CleanupCounter {
+    ~CleanupCounter() { cleanupCount++; }
+};
+
+__attribute__((noinline)) static void throwA()
+{
+    throw A();
+}
+
+void testCleanupInTryCatch()
+{
+    print("testCleanupInTryCatch... ");
+    try {
+        CleanupCounter cc;
+        throwA();
+    }
+    catch (A &a) {
+        if (cleanupCount != 1 || a.v != 0x1234) {
+            print("*** FAIL ***\n");
+            return;
+        }
+        print("PASS\n");
+        return;
+    }
+    print("*** FAIL ***\n");
+}
+
+void testCatchAll()
+{
+    print("testCatchAll... ");
+    try {
+        throwA();
+    }
+    catch (...) {
+        print("PASS\n");
+        return;
+    }
+    print("*** FAIL ***\n");
+}
+
+// Test catch by value: the compiler copies the exception object (from the address given by
+// __cxa_get_exception_ptr) before calling __cxa_begin_catch.
+void testCatchByValue()
+{
+    print("testCatchByValue... ");
+    try {
+        throw C();
+    }
+    catch (A a) {
+        if (a.v != 0x1234) {
+            print("*** FAIL ***\n");
+            return;
+        }
+        print("PASS\n");
+        return;
+    }
+    print("*** FAIL ***\n");
+}
+
+// Test rethrowing: "throw;" caught again within the handler, and then propagating out of it. The
+// exception object must survive both, and be destroyed (once) when the final handler completes.
+
+static int rethrowDtorCount = 0;
+
+struct RethrowObj {
+    int v = 0x5678;
+    ~RethrowObj() { rethrowDtorCount++; }
+};
+
+__attribute__((noinline)) static void throwRethrowObj()
+{
+    throw RethrowObj();
+}
+
+void testRethrow()
+{
+    print("testRethrow... ");
+    bool ok = false;
+    try {
+        try {
+            throwRethrowObj();
+        }
+        catch (RethrowObj &r) {
+            try {
+                throw;
+            }
+            catch (RethrowObj &r2) {
+                if (&r2 != &r) {
+                    print("*** FAIL ***\n");
+                    return;
+                }
+            }
+            if (rethrowDtorCount != 0) {
+                print("*** FAIL ***\n");
+                return;
+            }
+            throw;
+        }
+    }
+    catch (RethrowObj &r) {
+        ok = (r.v == 0x5678 && rethrowDtorCount == 0);
+    }
+    if (!ok || rethrowDtorCount != 1) {
+        print("*** FAIL ***\n");
+        return;
+    }
+    print("PASS\n");
+}
+
 
 int sVal = 0;
 
@@ -221,6 +406,35 @@ static void funcWithStatic()
     static sValBumper bumper;
 }
 
+void testDynamicCast()
+{
+    print("testDynamicCast... ");
+
+    // Volatile so that the compiler can't resolve the casts itself
+    static PD pd;
+    static PE pe;
+    static PVI pvi;
+    PA *volatile pd_pa = static_cast<PC *>(&pd);
+    PB *volatile pd_pb = &pd;
+    PB *volatile pe_pb = &pe;
+    PA *volatile pvi_pa = &pvi;
+    PB *volatile pvi_pb = &pvi;
+
+    if (dynamic_cast<PD *>(pd_pa) != &pd           // downcast from one of two PA bases
+            || dynamic_cast<PC *>(pd_pa) != &pd    // downcast to an intermediate base
+            || dynamic_cast<PA *>(pd_pb) != nullptr // cross-cast to an ambiguous base
+            || dynamic_cast<PA *>(pe_pb) != nullptr // cross-cast to a private base
+            || dynamic_cast<PE *>(pe_pb) != &pe
+            || dynamic_cast<PVI *>(pvi_pa) != &pvi // downcast from a virtual base
+            || dynamic_cast<PVA2 *>(pvi_pa) != &pvi
+            || dynamic_cast<PA *>(pvi_pb) != pvi_pa // cross-cast to a virtual base
+            || dynamic_cast<PVA1 *>(pvi_pb) != &pvi) {
+        print("*** FAIL ***\n");
+        return;
+    }
+    print("PASS\n");
+}
+
 void testStaticInitGuard()
 {
     print("testStaticInitGuard... ");
@@ -299,12 +513,18 @@ int main(int argc, char **argv)
         testNullptrThrowCatch();
         testIncompleteTypePtrCatch();
         testIncompleteTypePtrCatch2();
+        testModuleCopyTypeCatch();
+        testCleanupInTryCatch();
+        testCatchAll();
+        testCatchByValue();
+        testRethrow();
     }
     catch (...) {
         puts("\n\n!!! Unexpected exception leak from test !!!\n\n");
     }
 
     // Other tests
+    testDynamicCast();
     testStaticStorageConstructors();
     testStaticInitGuard();
 
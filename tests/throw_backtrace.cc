@@ -0,0 +1,281 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <typeinfo>
+
+#include <dlfcn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../include/bmcxxabi.h"
+
+#include "harness.h"
+
+// Throw-time backtrace harness, for the diagnostics build of the library (BMCXX_THROW_BACKTRACE;
+// libcxxabi-prof.a, a hosted build). For each capture method (frame pointer walk, unwinder):
+//
+//  - throws through a known chain of functions, and checks the backtrace of the caught exception
+//    (bmcxxabi_exception_backtrace) and the most recent record in the ring
+//    (bmcxxabi_recent_throws), including that of a rethrow;
+//  - in a child process, lets an exception escape a noexcept function, and checks the backtrace
+//    from within std::terminate (abort, here, is wrapped via the linker's --wrap to stand in for a
+//    terminate handler).
+//
+// Then measures the cost of a throw/catch, from a stack deeper than the capture depth, with each
+// method and with capture disabled.
+//
+// Usage: throw-backtrace [-n <iterations>]
+//
+// Output is tab-separated, with a header line:
+//
+//     mode  depth  unit  median  p99
+//
+// where depth is the number of frames captured per throw. Times are TSC cycles on x86,
+// nanoseconds elsewhere. The harness is built with frame pointers and -rdynamic, so that the
+// frame pointer walk works and dladdr can name the functions.
+
+extern const char harness_name[] = "throw-backtrace";
+
+namespace {
+
+// (prevents the calls in the chain from being tail calls, which would leave no frame)
+volatile int sink;
+
+const char *const chain_names[] = {"bt_level1", "bt_level2", "bt_level3"};
+constexpr unsigned chain_length = 3;
+
+} // anon namespace
+
+// The chain of functions has external linkage, so that dladdr can name them.
+
+extern "C" __attribute__((noinline)) void bt_level1(int i)
+{
+    throw i;
+}
+
+extern "C" __attribute__((noinline)) void bt_level2(int i)
+{
+    bt_level1(i);
+    sink = sink + 1;
+}
+
+extern "C" __attribute__((noinline)) void bt_level3(int i)
+{
+    bt_level2(i);
+    sink = sink + 1;
+}
+
+extern "C" __attribute__((noinline)) void bt_outer()
+{
+    bt_level3(1);
+    sink = sink + 1;
+}
+
+extern "C" __attribute__((noinline)) void bt_rethrow()
+{
+    try {
+        bt_level3(0);
+    }
+    catch (int) {
+        throw;
+    }
+}
+
+extern "C" __attribute__((noinline)) void bt_escape() noexcept
+{
+    bt_level3(0);
+    sink = sink + 1;
+}
+
+extern "C" __attribute__((noinline)) void bt_recurse(int n)
+{
+    if (n == 0) {
+        throw n;
+    }
+    bt_recurse(n - 1);
+    sink = sink + 1;
+}
+
+namespace {
+
+// Name of the function containing the call before the given return address
+const char *function_name(const void *ret)
+{
+    Dl_info info;
+    if (dladdr((const char *)ret - 1, &info) == 0 || info.dli_sname == nullptr) {
+        return "?";
+    }
+    return info.dli_sname;
+}
+
+// Check that the backtrace begins with the chain bt_level1, bt_level2, bt_level3 and then the
+// given function
+bool check_chain(const char *what, void * const *frames, unsigned depth, const char *outer)
+{
+    bool ok = depth > chain_length;
+    for (unsigned i = 0; ok && i < chain_length; ++i) {
+        ok = strcmp(function_name(frames[i]), chain_names[i]) == 0;
+    }
+    if (ok) {
+        ok = strcmp(function_name(frames[chain_length]), outer) == 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "throw-backtrace: %s: backtrace (%u frames) does not match:", what, depth);
+        for (unsigned i = 0; i < depth; ++i) {
+            fprintf(stderr, " %s", function_name(frames[i]));
+        }
+        fprintf(stderr, "\n");
+    }
+    return ok;
+}
+
+bool check_mode(const char *mode_name)
+{
+    bool ok = true;
+    char what[64];
+
+    try {
+        bt_outer();
+    }
+    catch (int) {
+        void *frames[BMCXXABI_BACKTRACE_MAX_FRAMES];
+        unsigned depth = bmcxxabi_exception_backtrace(frames, BMCXXABI_BACKTRACE_MAX_FRAMES);
+        snprintf(what, sizeof(what), "%s, caught", mode_name);
+        ok &= check_chain(what, frames, depth, "bt_outer");
+    }
+
+    bmcxxabi_throw_record records[2];
+    size_t num_records = bmcxxabi_recent_throws(records, 2);
+    snprintf(what, sizeof(what), "%s, recent", mode_name);
+    if (num_records == 0 || records[0].rethrow || *records[0].type != typeid(int)) {
+        fprintf(stderr, "throw-backtrace: %s: no record of the throw\n", what);
+        ok = false;
+    }
+    else {
+        ok &= check_chain(what, records[0].frames, records[0].depth, "bt_outer");
+    }
+
+    try {
+        bt_rethrow();
+    }
+    catch (int) {
+        void *frames[BMCXXABI_BACKTRACE_MAX_FRAMES];
+        unsigned depth = bmcxxabi_exception_backtrace(frames, BMCXXABI_BACKTRACE_MAX_FRAMES);
+        snprintf(what, sizeof(what), "%s, rethrown", mode_name);
+        ok &= check_chain(what, frames, depth, "bt_rethrow");
+    }
+
+    num_records = bmcxxabi_recent_throws(records, 2);
+    snprintf(what, sizeof(what), "%s, rethrow record", mode_name);
+    if (num_records != 2 || !records[0].rethrow || records[1].rethrow
+            || records[0].time < records[1].time) {
+        fprintf(stderr, "throw-backtrace: %s: rethrow not recorded\n", what);
+        ok = false;
+    }
+    else if (records[0].depth == 0
+            || strcmp(function_name(records[0].frames[0]), "bt_rethrow") != 0) {
+        fprintf(stderr, "throw-backtrace: %s: rethrow site is %s\n", what,
+                records[0].depth ? function_name(records[0].frames[0]) : "missing");
+        ok = false;
+    }
+
+    return ok;
+}
+
+// Let an exception escape from bt_escape (which is noexcept), in a child process; abort (called
+// by std::terminate) checks the backtrace
+bool check_terminate(const char *mode_name)
+{
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        bt_escape();
+        _exit(2);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "throw-backtrace: %s: backtrace not available in terminate\n", mode_name);
+        return false;
+    }
+    return true;
+}
+
+void time_throws(const char *mode_name, int mode, unsigned iterations, uint64_t *times)
+{
+    bmcxxabi_throw_backtrace_mode(mode);
+    for (unsigned i = 0; i < iterations; ++i) {
+        uint64_t start = now();
+        try {
+            bt_recurse(BMCXXABI_BACKTRACE_MAX_FRAMES);
+        }
+        catch (int) { }
+        times[i] = now() - start;
+    }
+
+    bmcxxabi_throw_record record;
+    unsigned depth = 0;
+    if (mode != BMCXXABI_BACKTRACE_NONE && bmcxxabi_recent_throws(&record, 1) != 0) {
+        depth = record.depth;
+    }
+    qsort(times, iterations, sizeof(uint64_t), compare_u64);
+    printf("%s\t%u\t%s\t%llu\t%llu\n", mode_name, depth, time_unit,
+            (unsigned long long)times[iterations / 2],
+            (unsigned long long)times[(unsigned)((iterations - 1) * 0.99)]);
+}
+
+} // anon namespace
+
+// Stands in for a terminate handler (std::terminate calls abort, in the hosted build)
+extern "C" void __wrap_abort()
+{
+    void *frames[BMCXXABI_BACKTRACE_MAX_FRAMES];
+    unsigned depth = bmcxxabi_exception_backtrace(frames, BMCXXABI_BACKTRACE_MAX_FRAMES);
+    _exit(check_chain("terminate", frames, depth, "bt_escape") ? 0 : 1);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = 10000;
+    if (argc == 3 && strcmp(argv[1], "-n") == 0) {
+        iterations = (unsigned)atoi(argv[2]);
+    }
+    else if (argc != 1) {
+        fprintf(stderr, "usage: throw-backtrace [-n <iterations>]\n");
+        return 1;
+    }
+    if (iterations == 0) {
+        fprintf(stderr, "throw-backtrace: iterations must be positive\n");
+        return 1;
+    }
+
+    struct {
+        const char *name;
+        int mode;
+    } const modes[] = {
+        {"none", BMCXXABI_BACKTRACE_NONE},
+        {"frame_pointer", BMCXXABI_BACKTRACE_FRAME_POINTER},
+        {"unwind", BMCXXABI_BACKTRACE_UNWIND},
+    };
+
+    bool ok = true;
+    for (auto &m : modes) {
+        if (m.mode == BMCXXABI_BACKTRACE_NONE) continue;
+        bmcxxabi_throw_backtrace_mode(m.mode);
+        ok &= check_mode(m.name);
+        ok &= check_terminate(m.name);
+    }
+    if (!ok) return 1;
+
+    uint64_t *times = (uint64_t *)malloc(iterations * sizeof(uint64_t));
+    if (times == nullptr) return 1;
+    printf("mode\tdepth\tunit\tmedian\tp99\n");
+    for (auto &m : modes) {
+        time_throws(m.name, m.mode, iterations, times);
+    }
+    free(times);
+    return 0;
+}
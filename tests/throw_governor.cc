@@ -0,0 +1,231 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <typeinfo>
+
+#include <time.h>
+#include <x86intrin.h>
+
+#include "../include/bmcxxabi.h"
+
+#include "harness.h"
+
+// Throw-storm governor harness, for the profiling build of the library (BMCXX_THROW_GOVERNOR;
+// libcxxabi-prof.a, a hosted build). Simulates a failing downstream dependency: a request handler
+// throws on every request until the governor's storm callback switches it to returning an error
+// code. Checks that throws at a low rate raise no storm, that a storm is reported for the right
+// site and type (and stops the throwing), that the rates are visible while it lasts and decay once
+// it ends, and that a CPU-wide storm is reported for throws spread over several types. Then
+// measures the cost of a throw and catch with the governor disabled and enabled. x86 only (the
+// window is measured in TSC cycles).
+//
+// Usage: throw-governor [-n <iterations>]
+//
+// Output is tab-separated: the storms reported, one per line:
+//
+//     storm  site  type  rate  cpu
+//
+// the rates during the storm:
+//
+//     rate  site  type  rate  total
+//
+// and the time per throw/catch, in cycles:
+//
+//     governor  median  p99
+
+extern const char harness_name[] = "throw-governor";
+
+namespace {
+
+struct downstream_error {
+    int code;
+};
+
+struct parse_error {
+    int pos;
+};
+
+struct io_error {
+    int fd;
+};
+
+// Storms reported by the callback
+constexpr unsigned max_storms = 64;
+bmcxxabi_throw_storm storms[max_storms];
+unsigned num_storms;
+
+// Set by the callback: report errors without throwing
+volatile bool degraded;
+
+void storm_callback(const bmcxxabi_throw_storm *storm)
+{
+    unsigned i = __atomic_fetch_add(&num_storms, 1, __ATOMIC_RELAXED);
+    if (i < max_storms) {
+        storms[i] = *storm;
+    }
+    degraded = true;
+}
+
+volatile bool downstream_failed;
+
+__attribute__((noinline)) void downstream_call()
+{
+    if (downstream_failed) {
+        throw downstream_error{503};
+    }
+}
+
+// Handle a request, returning 0 on success or an error code. Throws from the downstream call
+// are caught here, unless the governor has switched the handler to the error-code path.
+__attribute__((noinline)) int handle_request()
+{
+    if (degraded) {
+        return downstream_failed ? 503 : 0;
+    }
+    try {
+        downstream_call();
+    }
+    catch (downstream_error &e) {
+        return e.code;
+    }
+    return 0;
+}
+
+template <typename T>
+__attribute__((noinline)) void throw_and_catch(T value)
+{
+    try {
+        throw value;
+    }
+    catch (T &) {
+    }
+}
+
+void sleep_ms(unsigned ms)
+{
+    timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+    nanosleep(&ts, nullptr);
+}
+
+uint64_t cycles_per_ms()
+{
+    timespec start_ts, end_ts;
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    uint64_t start = __rdtsc();
+    sleep_ms(20);
+    uint64_t end = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    uint64_t ns = (uint64_t)(end_ts.tv_sec - start_ts.tv_sec) * 1000000000u
+            + end_ts.tv_nsec - start_ts.tv_nsec;
+    return (end - start) * 1000000 / ns;
+}
+
+void print_storms()
+{
+    for (unsigned i = 0; i < num_storms && i < max_storms; ++i) {
+        printf("storm\t%p\t%s\t%llu\t%u\n", storms[i].site,
+                storms[i].type ? storms[i].type->name() : "*", storms[i].rate, storms[i].cpu);
+    }
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = 100000;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (unsigned)strtoul(argv[++i], nullptr, 10);
+        }
+        else {
+            fprintf(stderr, "usage: throw-governor [-n <iterations>]\n");
+            return 1;
+        }
+    }
+    if (iterations == 0) iterations = 1;
+
+    uint64_t ms = cycles_per_ms();
+    bmcxxabi_throw_governor_config config = { 10 * ms, 500, 800, 0, storm_callback };
+    bmcxxabi_throw_governor_configure(&config);
+
+    // A low rate of failures: no storm
+    downstream_failed = true;
+    for (unsigned i = 0; i < 20; ++i) {
+        check(handle_request() == 503, "quiet: wrong result");
+        sleep_ms(1);
+    }
+    check(num_storms == 0, "quiet: storm reported");
+
+    // Every request fails: a storm, after which requests fail without throwing
+    constexpr unsigned requests = 20000;
+    for (unsigned i = 0; i < requests; ++i) {
+        check(handle_request() == 503, "storm: wrong result");
+    }
+    check(degraded, "storm: not reported");
+    check(num_storms == 1, "storm: reported more than once");
+    check(storms[0].site != nullptr && *storms[0].type == typeid(downstream_error)
+            && storms[0].rate >= 500, "storm: wrong site, type or rate");
+
+    bmcxxabi_throw_rate rates[16];
+    unsigned long long total_rate;
+    size_t num_rates = bmcxxabi_throw_governor_rates(rates, 16, &total_rate);
+    bool found_site = false, found_type = false;
+    for (size_t i = 0; i < num_rates; ++i) {
+        printf("rate\t%p\t%s\t%llu\t%llu\n", rates[i].site, rates[i].type->name(), rates[i].rate,
+                rates[i].total);
+        // (the storm was reported at the threshold, but the window may have moved on since, so
+        // that some of the throws no longer count)
+        if (*rates[i].type == typeid(downstream_error)) {
+            if (rates[i].site == storms[0].site) found_site = rates[i].total >= 500;
+            if (rates[i].site == nullptr) found_type = rates[i].total >= 500;
+        }
+    }
+    check(found_site && found_type, "storm: rates not visible");
+    check(total_rate != 0, "storm: total rate is zero");
+
+    // Once the storm has passed (over two windows later), the rates decay to nothing
+    sleep_ms(25);
+    num_rates = bmcxxabi_throw_governor_rates(rates, 16, &total_rate);
+    check(num_rates == 0 && total_rate == 0, "after storm: rates not zero");
+
+    // A CPU-wide storm, spread over types none of which reaches its own threshold
+    degraded = false;
+    config.site_threshold = 0;
+    config.type_threshold = 0;
+    config.cpu_threshold = 1000;
+    bmcxxabi_throw_governor_configure(&config);
+    for (unsigned i = 0; i < 10000 && !degraded; ++i) {
+        switch (i % 3) {
+        case 0: throw_and_catch(parse_error{(int)i}); break;
+        case 1: throw_and_catch(io_error{(int)i}); break;
+        default: throw_and_catch((int)i); break;
+        }
+    }
+    check(degraded && num_storms == 2 && storms[1].site == nullptr && storms[1].type == nullptr,
+            "cpu storm: not reported");
+
+    print_storms();
+
+    // Cost
+    uint64_t *samples = (uint64_t *)malloc(iterations * sizeof(uint64_t));
+    if (samples == nullptr) return 1;
+    config = { 10 * ms, 0, 0, 0, nullptr };
+    for (int enabled = 0; enabled < 2; ++enabled) {
+        bmcxxabi_throw_governor_configure(enabled ? &config : nullptr);
+        throw_and_catch(1);
+        for (unsigned i = 0; i < iterations; ++i) {
+            uint64_t start = __rdtsc();
+            throw_and_catch((int)i);
+            samples[i] = __rdtsc() - start;
+        }
+        qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+        printf("governor\t%s\t%llu\t%llu\n", enabled ? "enabled" : "disabled",
+                (unsigned long long)samples[iterations / 2],
+                (unsigned long long)samples[(unsigned)((iterations - 1) * 0.99)]);
+    }
+    free(samples);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,573 @@
+// bmcxx-catchgen: compute the catch matrix for a statically-linked image, and store it in the
+// image (see src/catch_matrix.h for details). The image must have been built with the
+// BMCXX_CATCH_MATRIX macro defined (so that space for the matrix is reserved), and must have a
+// symbol table.
+//
+// Usage: bmcxx-catchgen [-v] [-o <output>] <image>
+//
+// The catch types are those referenced from the types tables of LSDAs for functions using
+// __gxx_personality_v0; the thrown types are all type_info objects that have symbols (_ZTI...)
+// in the image. For each catch type, the matrix records each thrown type which it matches
+// (together with the adjustment to the exception object pointer), and each thrown type for which
+// the result can't be determined in advance (eg because a virtual base class is involved); all
+// other known thrown types don't match. The thrown types are listed too, so that the runtime
+// falls back to __do_catch for any other type. The computation mirrors that done by the __do_catch and
+// __do_upcast implementations in src/typeinfo.cc.
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../src/catch_matrix.h"
+
+#include "elf_image.h"
+#include "eh_frame.h"
+
+namespace {
+
+// Kinds of type_info, determined by the vtable (i.e. the ABI class of the type_info object)
+enum class ti_kind {
+    unknown,     // unrecognised; can't be matched in advance
+    equality,    // fundamental, enum, array, function, pointer-to-member: matched by equality only
+    class_,      // __class_type_info
+    si_class,    // __si_class_type_info
+    vmi_class,   // __vmi_class_type_info
+    pointer,     // __pointer_type_info
+};
+
+const struct {
+    const char *symbol;
+    ti_kind kind;
+} abi_vtables[] = {
+    { "_ZTVN10__cxxabiv117__class_type_infoE", ti_kind::class_ },
+    { "_ZTVN10__cxxabiv120__si_class_type_infoE", ti_kind::si_class },
+    { "_ZTVN10__cxxabiv121__vmi_class_type_infoE", ti_kind::vmi_class },
+    { "_ZTVN10__cxxabiv119__pointer_type_infoE", ti_kind::pointer },
+    { "_ZTVN10__cxxabiv123__fundamental_type_infoE", ti_kind::equality },
+    { "_ZTVN10__cxxabiv117__array_type_infoE", ti_kind::equality },
+    { "_ZTVN10__cxxabiv120__function_type_infoE", ti_kind::equality },
+    { "_ZTVN10__cxxabiv116__enum_type_infoE", ti_kind::equality },
+    { "_ZTVN10__cxxabiv129__pointer_to_member_type_infoE", ti_kind::equality },
+};
+
+// Flags and masks, as per src/typeinfo.cc
+constexpr int64_t base_virtual_mask = 0x1;
+constexpr int64_t base_public_mask = 0x2;
+constexpr int base_offset_shift = 8;
+constexpr unsigned vmi_non_diamond_repeat_mask = 0x1;
+constexpr unsigned pbase_const_mask = 0x1;
+
+struct base_info {
+    uint64_t type;
+    int64_t offset_flags;
+};
+
+struct type_desc {
+    uint64_t addr;
+    ti_kind kind;
+    const char *name;               // (raw name; may begin with '*'; may be null if unreadable)
+    unsigned flags;                 // vmi class or pointer flags
+    std::vector<base_info> bases;   // si or vmi class
+    uint64_t pointee;               // pointer
+};
+
+bool is_class(const type_desc &desc)
+{
+    return desc.kind == ti_kind::class_ || desc.kind == ti_kind::si_class
+            || desc.kind == ti_kind::vmi_class;
+}
+
+enum class match_kind {
+    none, object, pointer, fallback
+};
+
+struct match_result {
+    match_kind kind;
+    int64_t offset;
+};
+
+class catch_matrix_gen {
+public:
+    catch_matrix_gen(const elf_image &img) : img(img)
+    {
+        for (auto &vt : abi_vtables) {
+            const elf_image::symbol *sym = img.find_symbol(vt.symbol);
+            if (sym != nullptr) {
+                // type_info vtable pointer points past the offset-to-top and RTTI fields
+                vtable_kinds[sym->value + 16] = vt.kind;
+            }
+        }
+    }
+
+    const type_desc &get_desc(uint64_t addr);
+
+    match_result match(const type_desc &catch_type, const type_desc &thrown_type);
+
+private:
+    const elf_image &img;
+    std::map<uint64_t, ti_kind> vtable_kinds;
+    std::map<uint64_t, type_desc> descs;
+
+    bool same_type(const type_desc &a, const type_desc &b);
+
+    struct upcast_result {
+        std::set<int64_t> offsets;
+        bool uncertain = false;
+    };
+
+    void find_bases(const type_desc &cls, const type_desc &target, int64_t offset, bool via_virtual,
+            upcast_result &result, unsigned depth);
+    match_result upcast(const type_desc &derived, const type_desc &target);
+    match_result match_pointer(const type_desc &catch_type, const type_desc &thrown_type,
+            unsigned outer);
+};
+
+const type_desc &catch_matrix_gen::get_desc(uint64_t addr)
+{
+    auto it = descs.find(addr);
+    if (it != descs.end()) return it->second;
+
+    type_desc desc = { addr, ti_kind::unknown, nullptr, 0, {}, 0 };
+    uint64_t vptr, name_addr;
+    if (img.read_u64(addr, vptr) && img.read_u64(addr + 8, name_addr)) {
+        desc.name = img.read_string(name_addr);
+        auto vk = vtable_kinds.find(vptr);
+        if (vk != vtable_kinds.end() && desc.name != nullptr) {
+            desc.kind = vk->second;
+        }
+    }
+
+    uint32_t u32val;
+    uint64_t u64val;
+    switch (desc.kind) {
+    case ti_kind::si_class:
+        if (!img.read_u64(addr + 16, u64val)) {
+            desc.kind = ti_kind::unknown;
+            break;
+        }
+        // single, public, non-virtual base at offset 0
+        desc.bases.push_back(base_info { u64val, base_public_mask });
+        break;
+    case ti_kind::vmi_class:
+    {
+        uint32_t base_count;
+        if (!img.read_u32(addr + 16, u32val) || !img.read_u32(addr + 20, base_count)) {
+            desc.kind = ti_kind::unknown;
+            break;
+        }
+        desc.flags = u32val;
+        for (uint32_t i = 0; i < base_count; ++i) {
+            uint64_t base_type, offset_flags;
+            if (!img.read_u64(addr + 24 + i * 16, base_type)
+                    || !img.read_u64(addr + 32 + i * 16, offset_flags)) {
+                desc.kind = ti_kind::unknown;
+                break;
+            }
+            desc.bases.push_back(base_info { base_type, (int64_t)offset_flags });
+        }
+        break;
+    }
+    case ti_kind::pointer:
+        if (!img.read_u32(addr + 16, u32val) || !img.read_u64(addr + 24, u64val)) {
+            desc.kind = ti_kind::unknown;
+            break;
+        }
+        desc.flags = u32val;
+        desc.pointee = u64val;
+        break;
+    default:
+        break;
+    }
+
+    return descs.emplace(addr, std::move(desc)).first->second;
+}
+
+// Check type equality, as per type_info::operator==
+bool catch_matrix_gen::same_type(const type_desc &a, const type_desc &b)
+{
+    if (a.addr == b.addr) return true;
+    if (a.name == nullptr || b.name == nullptr) return false;
+    if (a.name[0] == '*' || b.name[0] == '*') return a.name == b.name;
+    return strcmp(a.name, b.name) == 0;
+}
+
+// Find base subobjects of type 'target' reachable from class 'cls' (at the given offset) via
+// public inheritance. Any subobject reached via a virtual base is at an offset which can only be
+// determined at run time; that (and anything else we can't determine) makes the result uncertain.
+void catch_matrix_gen::find_bases(const type_desc &cls, const type_desc &target, int64_t offset,
+        bool via_virtual, upcast_result &result, unsigned depth)
+{
+    if (depth > 64) {
+        result.uncertain = true;
+        return;
+    }
+
+    for (const base_info &base : cls.bases) {
+        if (!(base.offset_flags & base_public_mask)) continue;
+
+        const type_desc &base_desc = get_desc(base.type);
+        bool base_virtual = via_virtual || (base.offset_flags & base_virtual_mask);
+        int64_t base_offset = offset + (base.offset_flags >> base_offset_shift);
+
+        if (same_type(base_desc, target)) {
+            if (base_virtual) {
+                result.uncertain = true;
+            }
+            else {
+                result.offsets.insert(base_offset);
+            }
+        }
+        else if (is_class(base_desc)) {
+            find_bases(base_desc, target, base_offset, base_virtual, result, depth + 1);
+        }
+        else {
+            result.uncertain = true;
+        }
+    }
+}
+
+// Determine whether (and at what offset) 'target' is an unambiguous public base of 'derived'
+match_result catch_matrix_gen::upcast(const type_desc &derived, const type_desc &target)
+{
+    upcast_result result;
+    find_bases(derived, target, 0, false, result, 0);
+
+    if (result.uncertain) {
+        return match_result { match_kind::fallback, 0 };
+    }
+    if (result.offsets.size() == 1) {
+        return match_result { match_kind::object, *result.offsets.begin() };
+    }
+    if (result.offsets.empty()) {
+        return match_result { match_kind::none, 0 };
+    }
+
+    // Ambiguous base. The run-time upcast detects this only if the class is flagged as having
+    // repeated (non-diamond) bases, which the compiler should always do in this case.
+    if (derived.kind == ti_kind::vmi_class && (derived.flags & vmi_non_diamond_repeat_mask)) {
+        return match_result { match_kind::none, 0 };
+    }
+    return match_result { match_kind::fallback, 0 };
+}
+
+// Match for a pointer catch type, as per __pointer_type_info::__do_catch; 'outer' is as for
+// __do_catch (bits 1+ count outer pointers, bit 0 indicates all outer pointers are const)
+match_result catch_matrix_gen::match_pointer(const type_desc &catch_type,
+        const type_desc &thrown_type, unsigned outer)
+{
+    const match_result no_match = { match_kind::none, 0 };
+    const match_result fallback = { match_kind::fallback, 0 };
+
+    if (same_type(catch_type, thrown_type)) {
+        return match_result { match_kind::pointer, 0 };
+    }
+    if (thrown_type.kind == ti_kind::unknown) {
+        return fallback;
+    }
+    if (thrown_type.name != nullptr && strcmp(thrown_type.name, "Dn") == 0) {
+        // nullptr_t; leave this to the run-time check
+        return fallback;
+    }
+    if (thrown_type.kind != ti_kind::pointer) {
+        return no_match;
+    }
+
+    // Qualification conversion: the thrown pointer may not have qualifiers that the catch type
+    // lacks, and may have fewer only if all outer pointers are const.
+    if ((thrown_type.flags & ~catch_type.flags) != 0) {
+        return no_match;
+    }
+    if (thrown_type.flags != catch_type.flags && (outer & 1) == 0) {
+        return no_match;
+    }
+
+    unsigned new_outer = (outer + 2) & ~(~catch_type.flags & pbase_const_mask);
+
+    const type_desc &catch_pointee = get_desc(catch_type.pointee);
+    const type_desc &thrown_pointee = get_desc(thrown_type.pointee);
+
+    switch (catch_pointee.kind) {
+    case ti_kind::equality:
+        return same_type(catch_pointee, thrown_pointee)
+                ? match_result { match_kind::pointer, 0 } : no_match;
+
+    case ti_kind::class_:
+    case ti_kind::si_class:
+    case ti_kind::vmi_class:
+    {
+        if (same_type(catch_pointee, thrown_pointee)) {
+            return match_result { match_kind::pointer, 0 };
+        }
+        // (conversion to base only allowed for a single level of pointer)
+        if (new_outer >= 4) {
+            return no_match;
+        }
+        if (thrown_pointee.kind == ti_kind::unknown) {
+            return fallback;
+        }
+        if (!is_class(thrown_pointee)) {
+            return no_match;
+        }
+        match_result result = upcast(thrown_pointee, catch_pointee);
+        if (result.kind == match_kind::object) {
+            result.kind = match_kind::pointer;
+        }
+        return result;
+    }
+
+    case ti_kind::pointer:
+        return match_pointer(catch_pointee, thrown_pointee, new_outer);
+
+    default:
+        return fallback;
+    }
+}
+
+match_result catch_matrix_gen::match(const type_desc &catch_type, const type_desc &thrown_type)
+{
+    const match_result no_match = { match_kind::none, 0 };
+    const match_result fallback = { match_kind::fallback, 0 };
+
+    switch (catch_type.kind) {
+    case ti_kind::equality:
+        return same_type(catch_type, thrown_type) ? match_result { match_kind::object, 0 } : no_match;
+
+    case ti_kind::class_:
+    case ti_kind::si_class:
+    case ti_kind::vmi_class:
+        if (same_type(catch_type, thrown_type)) {
+            return match_result { match_kind::object, 0 };
+        }
+        if (is_class(thrown_type)) {
+            return upcast(thrown_type, catch_type);
+        }
+        return (thrown_type.kind == ti_kind::unknown) ? fallback : no_match;
+
+    case ti_kind::pointer:
+        return match_pointer(catch_type, thrown_type, 1);
+
+    default:
+        return fallback;
+    }
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: bmcxx-catchgen [-v] [-o <output>] <image>\n");
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    const char *input = nullptr;
+    const char *output = nullptr;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else if (argv[i][0] != '-' && input == nullptr) {
+            input = argv[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (input == nullptr) {
+        usage();
+        return 1;
+    }
+    if (output == nullptr) {
+        output = input;
+    }
+
+    elf_image img;
+    std::string err;
+    if (!img.load(input, err)) {
+        fprintf(stderr, "bmcxx-catchgen: %s: %s\n", input, err.c_str());
+        return 1;
+    }
+
+    const elf_image::symbol *matrix_sym = img.find_symbol("bmcxxabi_catch_matrix");
+    if (matrix_sym == nullptr) {
+        fprintf(stderr, "bmcxx-catchgen: %s: no catch matrix symbol (library not built with "
+                "BMCXX_CATCH_MATRIX?)\n", input);
+        return 1;
+    }
+    uint64_t capacity = matrix_sym->size / sizeof(catch_matrix_entry);
+    if (img.at_vaddr(matrix_sym->value, matrix_sym->size) == nullptr) {
+        fprintf(stderr, "bmcxx-catchgen: %s: catch matrix is not stored in the image file\n",
+                input);
+        return 1;
+    }
+
+    const elf_image::symbol *pers_sym = img.find_symbol("__gxx_personality_v0");
+    if (pers_sym == nullptr) {
+        fprintf(stderr, "bmcxx-catchgen: %s: no __gxx_personality_v0 symbol\n", input);
+        return 1;
+    }
+
+    std::vector<eh_cie> cies;
+    std::vector<eh_fde> fdes;
+    if (!read_eh_frame(img, cies, fdes, err)) {
+        fprintf(stderr, "bmcxx-catchgen: %s: %s\n", input, err.c_str());
+        return 1;
+    }
+
+    // Collect the catch types from all LSDAs
+    std::set<uint64_t> catch_types;
+    unsigned num_lsdas = 0;
+    for (const eh_fde &fde : fdes) {
+        if (fde.lsda == 0 || cies[fde.cie_index].personality != pers_sym->value) continue;
+
+        lsda_info lsda;
+        if (!read_lsda(img, fde.lsda, fde.pc_begin, lsda, err)) {
+            fprintf(stderr, "bmcxx-catchgen: %s: %s\n", input, err.c_str());
+            return 1;
+        }
+        ++num_lsdas;
+
+        std::vector<int64_t> type_indices;
+        for (const lsda_call_site &cs : lsda.call_sites) {
+            if (cs.action != 0) {
+                read_action_chain(img, lsda, cs.action, type_indices);
+            }
+        }
+
+        std::vector<int64_t> catch_indices;
+        for (int64_t type_index : type_indices) {
+            if (type_index > 0) {
+                catch_indices.push_back(type_index);
+            }
+            else if (type_index < 0) {
+                read_exception_spec(img, lsda, type_index, catch_indices);
+            }
+        }
+
+        for (int64_t index : catch_indices) {
+            uint64_t tinfo;
+            if (!read_type_entry(img, lsda, index, tinfo)) {
+                fprintf(stderr, "bmcxx-catchgen: %s: bad types table entry in LSDA at 0x%llx\n",
+                        input, (unsigned long long)lsda.vaddr);
+                return 1;
+            }
+            if (tinfo != 0) {
+                catch_types.insert(tinfo);
+            }
+        }
+    }
+
+    catch_matrix_gen gen(img);
+
+    // Candidate thrown types: all type_info objects with symbols
+    std::vector<uint64_t> thrown_types;
+    for (const elf_image::symbol &sym : img.symbols()) {
+        if (sym.name.compare(0, 4, "_ZTI") == 0 && sym.shndx != 0 && sym.value != 0) {
+            thrown_types.push_back(sym.value);
+        }
+    }
+    std::sort(thrown_types.begin(), thrown_types.end());
+    thrown_types.erase(std::unique(thrown_types.begin(), thrown_types.end()), thrown_types.end());
+
+    if (thrown_types.empty()) {
+        fprintf(stderr, "bmcxx-catchgen: %s: no type_info symbols found (stripped image?)\n",
+                input);
+        return 1;
+    }
+
+    // Compute the matrix. (std::set and the sorted thrown_types mean entries are generated in
+    // sorted order).
+    std::vector<catch_matrix_entry> catch_entries;
+    std::vector<catch_matrix_entry> pair_entries;
+    unsigned num_fallback = 0;
+
+    for (uint64_t catch_addr : catch_types) {
+        const type_desc &catch_type = gen.get_desc(catch_addr);
+        if (catch_type.kind == ti_kind::unknown) {
+            // not covered at all
+            continue;
+        }
+
+        uint64_t first_pair = pair_entries.size();
+        for (uint64_t thrown_addr : thrown_types) {
+            match_result result = gen.match(catch_type, gen.get_desc(thrown_addr));
+            uint64_t kind;
+            switch (result.kind) {
+            case match_kind::object:
+                kind = catch_match_object;
+                break;
+            case match_kind::pointer:
+                kind = catch_match_pointer;
+                break;
+            case match_kind::fallback:
+                kind = catch_match_fallback;
+                ++num_fallback;
+                break;
+            default:
+                continue;
+            }
+            pair_entries.push_back(catch_matrix_entry { thrown_addr,
+                    ((uint64_t)result.offset << catch_match_offset_shift) | kind });
+        }
+
+        catch_entries.push_back(catch_matrix_entry { catch_addr,
+                first_pair | ((uint64_t)(pair_entries.size() - first_pair) << 32) });
+    }
+
+    uint64_t needed = 2 + catch_entries.size() + thrown_types.size() + pair_entries.size();
+    if (needed > capacity) {
+        fprintf(stderr, "bmcxx-catchgen: %s: catch matrix needs %llu entries, but capacity is "
+                "%llu (increase BMCXX_CATCH_MATRIX_SIZE)\n", input, (unsigned long long)needed,
+                (unsigned long long)capacity);
+        return 1;
+    }
+
+    // Pair indexes are relative to the array start
+    uint64_t pairs_base = 2 + catch_entries.size() + thrown_types.size();
+    for (catch_matrix_entry &ent : catch_entries) {
+        ent.data += pairs_base;
+    }
+
+    uint64_t addr = matrix_sym->value;
+    auto put = [&](const catch_matrix_entry &ent) {
+        img.write_u64(addr, ent.key);
+        img.write_u64(addr + 8, ent.data);
+        addr += sizeof(catch_matrix_entry);
+    };
+
+    put(catch_matrix_entry { catch_matrix_magic,
+            (uint64_t)catch_entries.size() | ((uint64_t)thrown_types.size() << 32) });
+    put(catch_matrix_entry { thrown_types.front(), thrown_types.back() });
+    for (const catch_matrix_entry &ent : catch_entries) put(ent);
+    for (uint64_t thrown_addr : thrown_types) put(catch_matrix_entry { thrown_addr, 0 });
+    for (const catch_matrix_entry &ent : pair_entries) put(ent);
+    while (addr < matrix_sym->value + capacity * sizeof(catch_matrix_entry)) {
+        put(catch_matrix_entry { 0, 0 });
+    }
+
+    if (!img.save(output, err)) {
+        fprintf(stderr, "bmcxx-catchgen: %s\n", err.c_str());
+        return 1;
+    }
+
+    if (verbose) {
+        printf("%u LSDAs, %zu catch types, %zu thrown types\n", num_lsdas, catch_entries.size(),
+                thrown_types.size());
+        printf("%zu pair entries (%u fallback), %llu/%llu matrix entries used\n",
+                pair_entries.size(), num_fallback, (unsigned long long)needed,
+                (unsigned long long)capacity);
+    }
+
+    return 0;
+}
@@ -0,0 +1,627 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "../src/dwarf_eh.h"
+
+#include "eh_frame.h"
+
+// Maximum number of entries followed in an action chain, in case of a malformed (cyclic) chain
+constexpr unsigned max_chain_length = 4096;
+
+void eh_reader::seek(uint64_t vaddr)
+{
+    uint64_t avail;
+    p = img.at_vaddr(vaddr, 0, &avail);
+    if (p == nullptr) {
+        base_p = end = nullptr;
+        base_vaddr = vaddr;
+        return;
+    }
+    base_p = p;
+    end = p + avail;
+    base_vaddr = vaddr;
+}
+
+bool eh_reader::have_leb() const
+{
+    // A LEB128 value of up to 10 bytes (enough for 64 bits) must terminate within the section
+    for (const uint8_t *lp = p; lp < end && lp < p + 10; ++lp) {
+        if (!(*lp & 0x80)) return true;
+    }
+    return false;
+}
+
+bool eh_reader::read_u8(uint8_t &val)
+{
+    if (p == nullptr || p == end) return false;
+    val = *p++;
+    return true;
+}
+
+bool eh_reader::read_u32(uint32_t &val)
+{
+    if (p == nullptr || end - p < 4) return false;
+    val = read_val<uint32_t>(p);
+    return true;
+}
+
+bool eh_reader::read_u64(uint64_t &val)
+{
+    if (p == nullptr || end - p < 8) return false;
+    val = read_val<uint64_t>(p);
+    return true;
+}
+
+bool eh_reader::read_uleb(uint64_t &val)
+{
+    if (p == nullptr || !have_leb()) return false;
+    val = read_ULEB128(p, end);
+    return true;
+}
+
+bool eh_reader::read_sleb(int64_t &val)
+{
+    if (p == nullptr || !have_leb()) return false;
+    val = read_SLEB128(p, end);
+    return true;
+}
+
+bool eh_reader::read_string(std::string &val)
+{
+    if (p == nullptr) return false;
+    const uint8_t *nul = (const uint8_t *)memchr(p, 0, end - p);
+    if (nul == nullptr) return false;
+    val.assign((const char *)p, nul - p);
+    p = nul + 1;
+    return true;
+}
+
+bool valid_eh_encoding(uint8_t encoding)
+{
+    if (encoding == DW_EH_PE_omit) return true;
+
+    switch (encoding & 0x0Fu) {
+    case DW_EH_PE_absptr:
+    case DW_EH_PE_uleb128:
+    case DW_EH_PE_udata2:
+    case DW_EH_PE_udata4:
+    case DW_EH_PE_udata8:
+    case DW_EH_PE_sleb128:
+    case DW_EH_PE_sdata2:
+    case DW_EH_PE_sdata4:
+    case DW_EH_PE_sdata8:
+        break;
+    default:
+        return false;
+    }
+
+    switch (encoding & 0x70u) {
+    case DW_EH_PE_absptr:
+    case DW_EH_PE_pcrel:
+    case DW_EH_PE_funcrel:
+        return true;
+    case DW_EH_PE_aligned:
+        return (encoding & 0x0Fu) == DW_EH_PE_absptr;
+    default:
+        // textrel/datarel: base not known
+        return false;
+    }
+}
+
+bool eh_reader::read_encoded(uint8_t encoding, uint64_t &val, uint64_t func_base,
+        uint64_t data_base)
+{
+    if (encoding == DW_EH_PE_omit) {
+        val = 0;
+        return true;
+    }
+    if (p == nullptr) return false;
+    if ((encoding & 0x70u) == DW_EH_PE_datarel && data_base != 0) {
+        if (!valid_eh_encoding(encoding & ~0x70u)) return false;
+    }
+    else if (!valid_eh_encoding(encoding)) {
+        return false;
+    }
+
+    if ((encoding & 0x70u) == DW_EH_PE_aligned) {
+        uint64_t cur = vaddr();
+        uint64_t skip = ((cur + 7) & ~(uint64_t)7) - cur;
+        if ((uint64_t)(end - p) < skip) return false;
+        p += skip;
+    }
+
+    uint64_t field_vaddr = vaddr();
+    unsigned size = size_from_encoding(encoding);
+    if (size == 0) {
+        if (!have_leb()) return false;
+    }
+    else if ((unsigned)(end - p) < size) {
+        return false;
+    }
+
+    uint64_t raw = read_dwarf_encoded_raw(p, encoding);
+
+    // (as per personality routine, a 0 value remains 0)
+    if (raw == 0) {
+        val = 0;
+        return true;
+    }
+
+    switch (encoding & 0x70u) {
+    case DW_EH_PE_pcrel:
+        raw += field_vaddr;
+        break;
+    case DW_EH_PE_funcrel:
+        raw += func_base;
+        break;
+    case DW_EH_PE_datarel:
+        raw += data_base;
+        break;
+    default:
+        break;
+    }
+
+    if (encoding & DW_EH_PE_indirect) {
+        if (!img.read_u64(raw, raw)) return false;
+    }
+
+    val = raw;
+    return true;
+}
+
+bool write_encoded(elf_image &img, uint64_t field_vaddr, uint8_t encoding, uint64_t val)
+{
+    if (encoding & DW_EH_PE_indirect) {
+        uint64_t slot;
+        eh_reader r(img, field_vaddr);
+        if (!r.read_encoded(encoding & ~DW_EH_PE_indirect, slot) || slot == 0) return false;
+        return img.write_u64(slot, val);
+    }
+
+    int64_t raw;
+    switch (encoding & 0x70u) {
+    case DW_EH_PE_absptr:
+        raw = (int64_t)val;
+        break;
+    case DW_EH_PE_pcrel:
+        raw = (int64_t)(val - field_vaddr);
+        break;
+    default:
+        return false;
+    }
+
+    switch (encoding & 0x0Fu) {
+    case DW_EH_PE_absptr:
+    case DW_EH_PE_udata8:
+    case DW_EH_PE_sdata8:
+        return img.write_u64(field_vaddr, (uint64_t)raw);
+    case DW_EH_PE_udata4: {
+        if (raw < 0 || raw > (int64_t)UINT32_MAX) return false;
+        uint32_t v = (uint32_t)raw;
+        return img.write(field_vaddr, &v, sizeof(v));
+    }
+    case DW_EH_PE_sdata4: {
+        if (raw < INT32_MIN || raw > INT32_MAX) return false;
+        int32_t v = (int32_t)raw;
+        return img.write(field_vaddr, &v, sizeof(v));
+    }
+    case DW_EH_PE_udata2: {
+        if (raw < 0 || raw > (int64_t)UINT16_MAX) return false;
+        uint16_t v = (uint16_t)raw;
+        return img.write(field_vaddr, &v, sizeof(v));
+    }
+    case DW_EH_PE_sdata2: {
+        if (raw < INT16_MIN || raw > INT16_MAX) return false;
+        int16_t v = (int16_t)raw;
+        return img.write(field_vaddr, &v, sizeof(v));
+    }
+    default:
+        // (variable-length)
+        return false;
+    }
+}
+
+namespace {
+
+// Read the CIE at the specified address (the start of the record, i.e. the length field)
+bool read_cie(const elf_image &img, uint64_t vaddr, eh_cie &cie, std::string &err)
+{
+    eh_reader r(img, vaddr);
+    cie = eh_cie { vaddr, std::string(), DW_EH_PE_absptr, DW_EH_PE_omit, DW_EH_PE_omit, 0, 0 };
+
+    uint32_t len32, id;
+    if (!r.read_u32(len32)) goto bad_cie;
+    if (len32 == 0xFFFFFFFFu) {
+        uint64_t len64;
+        if (!r.read_u64(len64)) goto bad_cie;
+    }
+    if (!r.read_u32(id) || id != 0) goto bad_cie;
+
+    {
+        uint8_t version;
+        uint64_t code_align, ra_reg;
+        int64_t data_align;
+        if (!r.read_u8(version) || !r.read_string(cie.augmentation)) goto bad_cie;
+        if (cie.augmentation.find("eh") != std::string::npos) {
+            uint64_t eh_data;
+            if (!r.read_u64(eh_data)) goto bad_cie;
+        }
+        if (!r.read_uleb(code_align) || !r.read_sleb(data_align)) goto bad_cie;
+        if (version == 1) {
+            uint8_t ra_reg8;
+            if (!r.read_u8(ra_reg8)) goto bad_cie;
+        }
+        else if (!r.read_uleb(ra_reg)) {
+            goto bad_cie;
+        }
+
+        if (cie.augmentation.empty() || cie.augmentation[0] != 'z') {
+            return true;
+        }
+
+        uint64_t aug_len;
+        if (!r.read_uleb(aug_len)) goto bad_cie;
+        uint64_t aug_end = r.vaddr() + aug_len;
+
+        for (size_t i = 1; i < cie.augmentation.size(); ++i) {
+            switch (cie.augmentation[i]) {
+            case 'L':
+                if (!r.read_u8(cie.lsda_encoding)) goto bad_cie;
+                break;
+            case 'R':
+                if (!r.read_u8(cie.fde_encoding)) goto bad_cie;
+                break;
+            case 'P':
+                if (!r.read_u8(cie.personality_encoding)) goto bad_cie;
+                cie.personality_field = r.vaddr();
+                if (!r.read_encoded(cie.personality_encoding, cie.personality)) goto bad_cie;
+                break;
+            case 'S':
+            case 'B':
+                break;
+            default:
+                // unknown augmentation; the rest of the augmentation data can't be interpreted
+                i = cie.augmentation.size();
+                break;
+            }
+        }
+
+        if (r.vaddr() > aug_end) goto bad_cie;
+        return true;
+    }
+
+bad_cie:
+    char buf[64];
+    snprintf(buf, sizeof(buf), "malformed CIE at 0x%llx", (unsigned long long)vaddr);
+    err = buf;
+    return false;
+}
+
+} // anon namespace
+
+bool read_eh_frame(const elf_image &img, std::vector<eh_cie> &cies, std::vector<eh_fde> &fdes,
+        std::string &err)
+{
+    const elf_image::section *eh_frame = img.find_section(".eh_frame");
+    if (eh_frame == nullptr) {
+        err = "image has no .eh_frame section";
+        return false;
+    }
+
+    std::map<uint64_t, size_t> cie_indexes;
+    uint64_t addr = eh_frame->addr;
+    uint64_t end_addr = eh_frame->addr + eh_frame->size;
+
+    while (end_addr - addr >= 4) {
+        eh_reader r(img, addr);
+        uint32_t len32;
+        uint64_t len;
+        if (!r.read_u32(len32)) break;
+        if (len32 == 0) {
+            // terminator
+            break;
+        }
+        len = len32;
+        if (len32 == 0xFFFFFFFFu && !r.read_u64(len)) break;
+
+        uint64_t id_addr = r.vaddr();
+        uint64_t rec_end = id_addr + len;
+        if (rec_end > end_addr || rec_end < id_addr) {
+            err = "malformed .eh_frame record";
+            return false;
+        }
+
+        uint32_t id;
+        if (!r.read_u32(id)) break;
+
+        if (id != 0) {
+            // FDE; id is the offset back to the CIE
+            uint64_t cie_addr = id_addr - id;
+            auto ci = cie_indexes.find(cie_addr);
+            size_t cie_index;
+            if (ci == cie_indexes.end()) {
+                eh_cie cie;
+                if (!read_cie(img, cie_addr, cie, err)) return false;
+                cie_index = cies.size();
+                cies.push_back(cie);
+                cie_indexes[cie_addr] = cie_index;
+            }
+            else {
+                cie_index = ci->second;
+            }
+
+            const eh_cie &cie = cies[cie_index];
+            eh_fde fde = { addr, cie_index, 0, 0, 0, 0 };
+            if (!r.read_encoded(cie.fde_encoding, fde.pc_begin)
+                    || !r.read_encoded(cie.fde_encoding & 0x0Fu, fde.pc_range)) {
+                goto bad_fde;
+            }
+
+            if (!cie.augmentation.empty() && cie.augmentation[0] == 'z') {
+                uint64_t aug_len;
+                if (!r.read_uleb(aug_len)) goto bad_fde;
+                if (cie.lsda_encoding != DW_EH_PE_omit) {
+                    fde.lsda_field = r.vaddr();
+                    if (!r.read_encoded(cie.lsda_encoding, fde.lsda)) goto bad_fde;
+                    if (fde.lsda == 0) {
+                        fde.lsda_field = 0;
+                    }
+                }
+            }
+
+            // An FDE with zero range is a placeholder (eg for a discarded function)
+            if (fde.pc_range != 0) {
+                fdes.push_back(fde);
+            }
+        }
+        else if (cie_indexes.find(addr) == cie_indexes.end()) {
+            eh_cie cie;
+            if (!read_cie(img, addr, cie, err)) return false;
+            cie_indexes[addr] = cies.size();
+            cies.push_back(cie);
+        }
+
+        addr = rec_end;
+        continue;
+
+    bad_fde:
+        char buf[64];
+        snprintf(buf, sizeof(buf), "malformed FDE at 0x%llx", (unsigned long long)addr);
+        err = buf;
+        return false;
+    }
+
+    return true;
+}
+
+bool read_eh_frame_hdr(const elf_image &img, bool &hdr_present, uint64_t &eh_frame_addr,
+        std::vector<eh_frame_hdr_entry> &table, std::string &err)
+{
+    table.clear();
+    eh_frame_addr = 0;
+
+    const elf_image::section *hdr_sect = img.find_section(".eh_frame_hdr");
+    hdr_present = (hdr_sect != nullptr);
+    if (!hdr_present) return true;
+
+    // Format:
+    //     u8   version (1)
+    //     u8   eh_frame_ptr encoding
+    //     u8   fde_count encoding
+    //     u8   table encoding
+    //     [eh_frame_ptr encoding]  address of .eh_frame
+    //     [fde_count encoding]     number of table entries
+    //     [table encoding] pairs of (initial location, FDE address), sorted by initial location
+    // Data-relative values are relative to the start of .eh_frame_hdr.
+    uint64_t data_base = hdr_sect->addr;
+    eh_reader r(img, hdr_sect->addr);
+    uint8_t version, frame_ptr_enc, count_enc, table_enc;
+    uint64_t count;
+    if (!r.read_u8(version) || !r.read_u8(frame_ptr_enc) || !r.read_u8(count_enc)
+            || !r.read_u8(table_enc)) {
+        goto bad_hdr;
+    }
+    if (version != 1) {
+        err = "unsupported .eh_frame_hdr version";
+        return false;
+    }
+    if (!r.read_encoded(frame_ptr_enc, eh_frame_addr, 0, data_base)) goto bad_hdr;
+
+    if (count_enc == DW_EH_PE_omit || table_enc == DW_EH_PE_omit) {
+        // no search table
+        return true;
+    }
+    if (!r.read_encoded(count_enc, count, 0, data_base)) goto bad_hdr;
+
+    // (each entry is at least two bytes, which bounds the count against the section size)
+    if (count > hdr_sect->size / 2) goto bad_hdr;
+    table.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        eh_frame_hdr_entry ent;
+        if (!r.read_encoded(table_enc, ent.pc, 0, data_base)
+                || !r.read_encoded(table_enc, ent.fde, 0, data_base)) {
+            goto bad_hdr;
+        }
+        table.push_back(ent);
+    }
+    return true;
+
+bad_hdr:
+    err = "malformed .eh_frame_hdr section";
+    return false;
+}
+
+namespace {
+
+// Read the action chain, also tracking the extent of the data read
+bool read_action_chain(const elf_image &img, const lsda_info &info, uint64_t action,
+        std::vector<int64_t> &type_indices, uint64_t &extent)
+{
+    eh_reader r(img, info.action_table + (action - 1));
+
+    for (unsigned i = 0; i < max_chain_length; ++i) {
+        int64_t type_index, next_offs;
+        if (!r.read_sleb(type_index)) return false;
+        type_indices.push_back(type_index);
+
+        // The offset to the next entry is relative to the start of the offset field itself
+        uint64_t offs_addr = r.vaddr();
+        if (!r.read_sleb(next_offs)) return false;
+        if (r.vaddr() > extent) extent = r.vaddr();
+        if (next_offs == 0) return true;
+        r.seek(offs_addr + next_offs);
+    }
+
+    return false;
+}
+
+bool read_exception_spec(const elf_image &img, const lsda_info &info, int64_t type_index,
+        std::vector<int64_t> &indices, uint64_t &extent)
+{
+    if (info.types_table == 0) return false;
+
+    // The (negative) type index is a negated, one-based byte offset from the end of the types
+    // table to a zero-terminated list of (ULEB128) type indices
+    eh_reader r(img, info.types_table + (-type_index - 1));
+
+    for (unsigned i = 0; i < max_chain_length; ++i) {
+        uint64_t index;
+        if (!r.read_uleb(index)) return false;
+        if (index == 0) {
+            if (r.vaddr() > extent) extent = r.vaddr();
+            return true;
+        }
+        indices.push_back((int64_t)index);
+    }
+
+    return false;
+}
+
+} // anon namespace
+
+bool read_action_chain(const elf_image &img, const lsda_info &info, uint64_t action,
+        std::vector<int64_t> &type_indices)
+{
+    uint64_t extent = 0;
+    return read_action_chain(img, info, action, type_indices, extent);
+}
+
+bool read_exception_spec(const elf_image &img, const lsda_info &info, int64_t type_index,
+        std::vector<int64_t> &indices)
+{
+    uint64_t extent = 0;
+    return read_exception_spec(img, info, type_index, indices, extent);
+}
+
+bool read_type_entry(const elf_image &img, const lsda_info &info, int64_t index, uint64_t &tinfo)
+{
+    if (info.types_table == 0 || index <= 0) return false;
+
+    unsigned entry_size = size_from_encoding(info.types_encoding);
+    if (entry_size == 0) return false;
+
+    eh_reader r(img, info.types_table - (uint64_t)index * entry_size);
+    return r.read_encoded(info.types_encoding, tinfo);
+}
+
+bool read_lsda(const elf_image &img, uint64_t vaddr, uint64_t func_start, lsda_info &info,
+        std::string &err)
+{
+    eh_reader r(img, vaddr);
+    info = lsda_info();
+    info.vaddr = vaddr;
+
+    char buf[80];
+    uint64_t call_site_table_len;
+
+    if (!r.read_u8(info.lp_start_encoding)
+            || !r.read_encoded(info.lp_start_encoding, info.lp_start, func_start)) {
+        goto bad_lsda;
+    }
+    if (info.lp_start == 0) {
+        info.lp_start = func_start;
+    }
+
+    if (!r.read_u8(info.types_encoding) || !valid_eh_encoding(info.types_encoding)) {
+        goto bad_lsda;
+    }
+    if (info.types_encoding != DW_EH_PE_omit) {
+        uint64_t types_offs;
+        if (!r.read_uleb(types_offs)) goto bad_lsda;
+        info.types_table = r.vaddr() + types_offs;
+    }
+
+    if (!r.read_u8(info.call_site_encoding) || !valid_eh_encoding(info.call_site_encoding)
+            || info.call_site_encoding == DW_EH_PE_omit
+            || !r.read_uleb(call_site_table_len)) {
+        goto bad_lsda;
+    }
+    info.call_site_table = r.vaddr();
+    info.action_table = info.call_site_table + call_site_table_len;
+
+    while (r.vaddr() < info.action_table) {
+        lsda_call_site cs = { 0, 0, 0, 0, 0 };
+        if (!r.read_encoded(info.call_site_encoding, cs.start, func_start)
+                || !r.read_encoded(info.call_site_encoding, cs.length, func_start)
+                || !r.read_encoded(info.call_site_encoding, cs.landing_pad, func_start)
+                || !r.read_uleb(cs.action)) {
+            goto bad_lsda;
+        }
+        info.call_sites.push_back(cs);
+    }
+    if (r.vaddr() != info.action_table) {
+        goto bad_lsda;
+    }
+
+    {
+        uint64_t extent = info.action_table;
+        std::vector<int64_t> spec_offsets;
+        std::vector<int64_t> type_indices;
+
+        for (lsda_call_site &cs : info.call_sites) {
+            if (cs.action == 0) continue;
+            type_indices.clear();
+            if (!read_action_chain(img, info, cs.action, type_indices, extent)) {
+                goto bad_lsda;
+            }
+            cs.chain_length = type_indices.size();
+            for (int64_t type_index : type_indices) {
+                if (type_index > info.max_type_index) {
+                    info.max_type_index = type_index;
+                }
+                else if (type_index < 0) {
+                    bool seen = false;
+                    for (int64_t so : spec_offsets) seen = seen || (so == type_index);
+                    if (!seen) spec_offsets.push_back(type_index);
+                }
+            }
+        }
+
+        for (int64_t spec : spec_offsets) {
+            std::vector<int64_t> indices;
+            if (!read_exception_spec(img, info, spec, indices, extent)) {
+                goto bad_lsda;
+            }
+            for (int64_t index : indices) {
+                if (index > info.max_type_index) {
+                    info.max_type_index = index;
+                }
+            }
+        }
+        info.num_specs = spec_offsets.size();
+
+        if (info.types_table != 0 && info.types_table > extent) {
+            extent = info.types_table;
+        }
+        info.size = extent - vaddr;
+    }
+
+    return true;
+
+bad_lsda:
+    snprintf(buf, sizeof(buf), "malformed LSDA at 0x%llx", (unsigned long long)vaddr);
+    err = buf;
+    return false;
+}
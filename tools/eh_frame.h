@@ -0,0 +1,130 @@
+#ifndef BMCXX_TOOLS_EH_FRAME_H_INCLUDED
+#define BMCXX_TOOLS_EH_FRAME_H_INCLUDED 1
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "elf_image.h"
+
+// Parsing of exception-handling information (.eh_frame section, and the LSDAs referenced from
+// it) in an ELF image, for the host-side tools. Decoding of individual values is done using the
+// same routines as the personality routine (src/dwarf_eh.h), with bounds checking and address
+// translation (file contents to image virtual addresses) added.
+
+// A reader for DWARF EH encoded data in an image, positioned at a virtual address. All reads
+// fail (return false) if they would run off the end of the containing section.
+class eh_reader {
+public:
+    eh_reader(const elf_image &img, uint64_t vaddr) : img(img) { seek(vaddr); }
+
+    void seek(uint64_t vaddr);
+    uint64_t vaddr() const { return base_vaddr + (p - base_p); }
+    bool valid() const { return p != nullptr; }
+
+    bool read_u8(uint8_t &val);
+    bool read_u32(uint32_t &val);
+    bool read_u64(uint64_t &val);
+    bool read_uleb(uint64_t &val);
+    bool read_sleb(int64_t &val);
+    bool read_string(std::string &val);
+
+    // Read an encoded value, applying the relative-base and indirection parts of the encoding
+    // (function-relative values are relative to func_base, data-relative values to data_base; a
+    // data-relative encoding is only accepted if data_base is non-zero). A DW_EH_PE_omit encoding
+    // yields 0.
+    bool read_encoded(uint8_t encoding, uint64_t &val, uint64_t func_base = 0,
+            uint64_t data_base = 0);
+
+private:
+    const elf_image &img;
+    const uint8_t *base_p;
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t base_vaddr;
+
+    bool have_leb() const;
+};
+
+// Check whether an encoding is one we can decode
+bool valid_eh_encoding(uint8_t encoding);
+
+// Write a value to an encoded field (of fixed size, ie not LEB128) at the given address, as
+// read_encoded would read it back, except that for an indirect encoding the value is written to
+// the location the field points to. Fails if the value can't be represented.
+bool write_encoded(elf_image &img, uint64_t field_vaddr, uint8_t encoding, uint64_t val);
+
+struct eh_cie {
+    uint64_t vaddr;
+    std::string augmentation;
+    uint8_t fde_encoding;
+    uint8_t lsda_encoding;
+    uint8_t personality_encoding;
+    uint64_t personality;        // address of personality routine, 0 if none
+    uint64_t personality_field;  // address of (encoded) personality pointer in CIE, 0 if none
+};
+
+struct eh_fde {
+    uint64_t vaddr;
+    size_t cie_index;            // index into CIE vector
+    uint64_t pc_begin;
+    uint64_t pc_range;
+    uint64_t lsda;               // address of LSDA, 0 if none
+    uint64_t lsda_field;         // address of (encoded) LSDA pointer in FDE, 0 if none
+};
+
+// Read all CIEs and FDEs from the .eh_frame section
+bool read_eh_frame(const elf_image &img, std::vector<eh_cie> &cies, std::vector<eh_fde> &fdes,
+        std::string &err);
+
+// An entry in the .eh_frame_hdr search table
+struct eh_frame_hdr_entry {
+    uint64_t pc;                 // initial location of function
+    uint64_t fde;                // address of FDE
+};
+
+// Read the .eh_frame_hdr section (if present; hdr_present is set false otherwise), giving the
+// address of .eh_frame that it records and the binary search table (empty if the section has no
+// table). The table is returned in the order it appears in the section.
+bool read_eh_frame_hdr(const elf_image &img, bool &hdr_present, uint64_t &eh_frame_addr,
+        std::vector<eh_frame_hdr_entry> &table, std::string &err);
+
+struct lsda_call_site {
+    uint64_t start;        // offset from function start
+    uint64_t length;
+    uint64_t landing_pad;  // offset from landing pad base, 0 = none
+    uint64_t action;       // 0 = cleanup only, otherwise offset into action table + 1
+    unsigned chain_length; // number of entries in action chain
+};
+
+struct lsda_info {
+    uint64_t vaddr;
+    uint64_t size;          // extent of data referenced by the LSDA (approximate)
+    uint8_t lp_start_encoding;
+    uint64_t lp_start;
+    uint8_t types_encoding;
+    uint64_t types_table;   // address of *end* of types table, 0 if none
+    uint8_t call_site_encoding;
+    uint64_t call_site_table;
+    uint64_t action_table;  // (also end of call site table)
+    std::vector<lsda_call_site> call_sites;
+    int64_t max_type_index; // highest type table index referenced
+    unsigned num_specs;     // number of distinct exception specifications referenced
+};
+
+// Read an LSDA, including action chains (to determine their length and the overall LSDA size)
+bool read_lsda(const elf_image &img, uint64_t vaddr, uint64_t func_start, lsda_info &info,
+        std::string &err);
+
+// Read the type indices in an action chain (action = call site action value, non-zero)
+bool read_action_chain(const elf_image &img, const lsda_info &info, uint64_t action,
+        std::vector<int64_t> &type_indices);
+
+// Read a types table entry (index > 0), giving the address of a type_info (0 for catch-all)
+bool read_type_entry(const elf_image &img, const lsda_info &info, int64_t index, uint64_t &tinfo);
+
+// Read an exception specification (for type_index < 0), giving a list of type table indices
+bool read_exception_spec(const elf_image &img, const lsda_info &info, int64_t type_index,
+        std::vector<int64_t> &indices);
+
+#endif
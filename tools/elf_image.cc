@@ -0,0 +1,230 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <elf.h>
+
+#include "elf_image.h"
+
+bool elf_image::load(const char *path, std::string &err)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) {
+        err = std::string("cannot open ") + path + ": " + strerror(errno);
+        return false;
+    }
+
+    contents.clear();
+    uint8_t buf[65536];
+    size_t r;
+    while ((r = fread(buf, 1, sizeof(buf), f)) > 0) {
+        contents.insert(contents.end(), buf, buf + r);
+    }
+    bool read_err = ferror(f);
+    fclose(f);
+    if (read_err) {
+        err = std::string("error reading ") + path;
+        return false;
+    }
+
+    Elf64_Ehdr ehdr;
+    if (contents.size() < sizeof(ehdr)) {
+        err = "not an ELF file";
+        return false;
+    }
+    memcpy(&ehdr, contents.data(), sizeof(ehdr));
+    if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0) {
+        err = "not an ELF file";
+        return false;
+    }
+    if (ehdr.e_ident[EI_CLASS] != ELFCLASS64 || ehdr.e_ident[EI_DATA] != ELFDATA2LSB) {
+        err = "not a 64-bit little-endian ELF file";
+        return false;
+    }
+    if (ehdr.e_shentsize != sizeof(Elf64_Shdr) || ehdr.e_shoff == 0
+            || ehdr.e_shoff + (uint64_t)ehdr.e_shnum * sizeof(Elf64_Shdr) > contents.size()
+            || ehdr.e_shstrndx >= ehdr.e_shnum) {
+        err = "bad or missing section header table";
+        return false;
+    }
+
+    is_exec = ehdr.e_type == ET_EXEC;
+
+    std::vector<Elf64_Shdr> shdrs(ehdr.e_shnum);
+    memcpy(shdrs.data(), contents.data() + ehdr.e_shoff, ehdr.e_shnum * sizeof(Elf64_Shdr));
+
+    for (const Elf64_Shdr &shdr : shdrs) {
+        if (shdr.sh_type != SHT_NOBITS && shdr.sh_offset + shdr.sh_size > contents.size()) {
+            err = "section extends beyond end of file";
+            return false;
+        }
+    }
+
+    auto get_str = [&](const Elf64_Shdr &strtab, uint32_t offs) -> std::string {
+        if (offs >= strtab.sh_size) return std::string();
+        const char *s = (const char *)contents.data() + strtab.sh_offset + offs;
+        return std::string(s, strnlen(s, strtab.sh_size - offs));
+    };
+
+    const Elf64_Shdr &shstrtab = shdrs[ehdr.e_shstrndx];
+    sects.clear();
+    for (const Elf64_Shdr &shdr : shdrs) {
+        sects.push_back(section { get_str(shstrtab, shdr.sh_name), shdr.sh_type, shdr.sh_flags,
+                shdr.sh_addr, shdr.sh_offset, shdr.sh_size });
+    }
+
+    // Symbols: prefer the full symbol table, but fall back to the dynamic symbol table
+    syms.clear();
+    const Elf64_Shdr *symtab = nullptr;
+    for (const Elf64_Shdr &shdr : shdrs) {
+        if (shdr.sh_type == SHT_SYMTAB) symtab = &shdr;
+    }
+    if (symtab == nullptr) {
+        for (const Elf64_Shdr &shdr : shdrs) {
+            if (shdr.sh_type == SHT_DYNSYM) symtab = &shdr;
+        }
+    }
+    if (symtab != nullptr && symtab->sh_link < shdrs.size()) {
+        const Elf64_Shdr &strtab = shdrs[symtab->sh_link];
+        size_t num_syms = symtab->sh_size / sizeof(Elf64_Sym);
+        for (size_t i = 1; i < num_syms; ++i) {
+            Elf64_Sym sym;
+            memcpy(&sym, contents.data() + symtab->sh_offset + i * sizeof(Elf64_Sym), sizeof(sym));
+            syms.push_back(symbol { get_str(strtab, sym.st_name), sym.st_value, sym.st_size,
+                    (unsigned char)ELF64_ST_TYPE(sym.st_info), sym.st_shndx });
+        }
+    }
+
+    func_syms.clear();
+    for (size_t i = 0; i < syms.size(); ++i) {
+        if (syms[i].type == STT_FUNC && syms[i].shndx != SHN_UNDEF) {
+            func_syms.push_back(i);
+        }
+    }
+    std::sort(func_syms.begin(), func_syms.end(), [&](size_t a, size_t b) {
+        return syms[a].value < syms[b].value;
+    });
+
+    return true;
+}
+
+bool elf_image::save(const char *path, std::string &err) const
+{
+    FILE *f = fopen(path, "wb");
+    if (f == nullptr) {
+        err = std::string("cannot open ") + path + " for writing: " + strerror(errno);
+        return false;
+    }
+    bool ok = fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        err = std::string("error writing ") + path;
+    }
+    return ok;
+}
+
+const elf_image::section *elf_image::find_section(const char *name) const
+{
+    for (const section &sect : sects) {
+        if (sect.name == name) return &sect;
+    }
+    return nullptr;
+}
+
+const elf_image::symbol *elf_image::find_symbol(const char *name) const
+{
+    for (const symbol &sym : syms) {
+        if (sym.name == name && sym.shndx != SHN_UNDEF) return &sym;
+    }
+    return nullptr;
+}
+
+const elf_image::symbol *elf_image::function_at(uint64_t addr) const
+{
+    auto it = std::upper_bound(func_syms.begin(), func_syms.end(), addr,
+            [&](uint64_t a, size_t idx) { return a < syms[idx].value; });
+    while (it != func_syms.begin()) {
+        --it;
+        const symbol &sym = syms[*it];
+        if (addr < sym.value + std::max<uint64_t>(sym.size, 1)) {
+            return &sym;
+        }
+        if (sym.value != addr && sym.size != 0) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+const elf_image::section *elf_image::section_for(uint64_t vaddr, uint64_t len) const
+{
+    for (const section &sect : sects) {
+        if (!(sect.flags & SHF_ALLOC) || sect.type == SHT_NOBITS) continue;
+        if (vaddr >= sect.addr && vaddr - sect.addr < sect.size
+                && len <= sect.size - (vaddr - sect.addr)) {
+            return &sect;
+        }
+    }
+    return nullptr;
+}
+
+const uint8_t *elf_image::at_vaddr(uint64_t vaddr, uint64_t len, uint64_t *avail) const
+{
+    const section *sect = section_for(vaddr, len);
+    if (sect == nullptr) return nullptr;
+    if (avail != nullptr) {
+        *avail = sect->size - (vaddr - sect->addr);
+    }
+    return contents.data() + sect->offset + (vaddr - sect->addr);
+}
+
+uint8_t *elf_image::at_vaddr(uint64_t vaddr, uint64_t len, uint64_t *avail)
+{
+    const section *sect = section_for(vaddr, len);
+    if (sect == nullptr) return nullptr;
+    if (avail != nullptr) {
+        *avail = sect->size - (vaddr - sect->addr);
+    }
+    return contents.data() + sect->offset + (vaddr - sect->addr);
+}
+
+bool elf_image::read_u32(uint64_t vaddr, uint32_t &val) const
+{
+    const uint8_t *p = at_vaddr(vaddr, sizeof(val));
+    if (p == nullptr) return false;
+    memcpy(&val, p, sizeof(val));
+    return true;
+}
+
+bool elf_image::read_u64(uint64_t vaddr, uint64_t &val) const
+{
+    const uint8_t *p = at_vaddr(vaddr, sizeof(val));
+    if (p == nullptr) return false;
+    memcpy(&val, p, sizeof(val));
+    return true;
+}
+
+bool elf_image::write_u64(uint64_t vaddr, uint64_t val)
+{
+    uint8_t *p = at_vaddr(vaddr, sizeof(val));
+    if (p == nullptr) return false;
+    memcpy(p, &val, sizeof(val));
+    return true;
+}
+
+bool elf_image::write(uint64_t vaddr, const void *data, uint64_t len)
+{
+    uint8_t *p = at_vaddr(vaddr, len);
+    if (p == nullptr) return false;
+    memcpy(p, data, len);
+    return true;
+}
+
+const char *elf_image::read_string(uint64_t vaddr) const
+{
+    uint64_t avail;
+    const uint8_t *p = at_vaddr(vaddr, 1, &avail);
+    if (p == nullptr || memchr(p, 0, avail) == nullptr) return nullptr;
+    return (const char *)p;
+}
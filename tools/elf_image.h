@@ -0,0 +1,72 @@
+#ifndef BMCXX_TOOLS_ELF_IMAGE_H_INCLUDED
+#define BMCXX_TOOLS_ELF_IMAGE_H_INCLUDED 1
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A (linked) ELF64 little-endian image, loaded entirely into memory, for use by the host-side
+// tools. Contents can be inspected via virtual address, and modified and saved back to a file.
+
+class elf_image {
+public:
+    struct section {
+        std::string name;
+        uint32_t type;
+        uint64_t flags;
+        uint64_t addr;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct symbol {
+        std::string name;
+        uint64_t value;
+        uint64_t size;
+        unsigned char type;  // STT_xxx
+        uint16_t shndx;
+    };
+
+    bool load(const char *path, std::string &err);
+    bool save(const char *path, std::string &err) const;
+
+    // Whether the image is an executable (ET_EXEC), ie not position-independent
+    bool executable() const { return is_exec; }
+
+    const std::vector<section> &sections() const { return sects; }
+    const std::vector<symbol> &symbols() const { return syms; }
+
+    const section *find_section(const char *name) const;
+    const symbol *find_symbol(const char *name) const;
+
+    // Find the function symbol containing the specified address, or nullptr
+    const symbol *function_at(uint64_t addr) const;
+
+    // Get a pointer to the file contents at the specified virtual address, provided that the
+    // range [vaddr, vaddr + len) is backed by the contents of a single section; otherwise
+    // return nullptr. If 'avail' is non-null, it is set to the number of bytes available from
+    // the returned pointer to the end of the section.
+    const uint8_t *at_vaddr(uint64_t vaddr, uint64_t len, uint64_t *avail = nullptr) const;
+    uint8_t *at_vaddr(uint64_t vaddr, uint64_t len, uint64_t *avail = nullptr);
+
+    bool read_u32(uint64_t vaddr, uint32_t &val) const;
+    bool read_u64(uint64_t vaddr, uint64_t &val) const;
+    bool write_u64(uint64_t vaddr, uint64_t val);
+    bool write(uint64_t vaddr, const void *data, uint64_t len);
+
+    // Read a nul-terminated string; returns nullptr if not (entirely) mapped
+    const char *read_string(uint64_t vaddr) const;
+
+private:
+    std::vector<uint8_t> contents;
+    std::vector<section> sects;
+    std::vector<symbol> syms;
+    bool is_exec = false;
+
+    // indexes into syms of function symbols, sorted by address
+    std::vector<size_t> func_syms;
+
+    const section *section_for(uint64_t vaddr, uint64_t len) const;
+};
+
+#endif
@@ -0,0 +1,341 @@
+// bmcxx-lsdacompact: convert the LSDAs of a statically-linked image to the compact, fixed-width
+// form read by the personality routine, and store them in the image (see src/compact_lsda.h for
+// the format). The image must have been built with the BMCXX_COMPACT_LSDA macro defined (so that
+// space for the tables is reserved), must not be position-independent (since the tables hold
+// absolute addresses), and must have a symbol table.
+//
+// Usage: bmcxx-lsdacompact [-p] [-v] [-o <output>] <image>
+//
+//   -p           also change the LSDA pointer of each converted function's FDE to point to the
+//                compact LSDA, and the personality routine of each CIE which uses
+//                __gxx_personality_v0 to __bmcxx_personality_compact, so that no lookup is needed
+//   -v           print a summary
+//   -o <output>  write the result to <output> (default: modify the image in place)
+//
+// The LSDAs converted are those of functions using __gxx_personality_v0. If they don't all fit in
+// the reserved space, as many as fit are converted (in order of address), and the others continue
+// to be decoded from their DWARF form. Running the tool again on its output converts the (DWARF)
+// LSDAs again, replacing the tables; with -p, FDEs which already point to compact LSDAs are left
+// as they are.
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../src/compact_lsda.h"
+#include "../src/dwarf_eh.h"
+
+#include "elf_image.h"
+#include "eh_frame.h"
+
+namespace {
+
+const char *input;
+
+// A compact LSDA, built at a given offset in the table (which determines the addresses of its
+// exception specification arrays)
+struct compact_blob {
+    uint64_t lsda;              // address of the DWARF LSDA
+    std::vector<uint8_t> data;
+};
+
+void append(std::vector<uint8_t> &data, const void *p, size_t len)
+{
+    data.insert(data.end(), (const uint8_t *)p, (const uint8_t *)p + len);
+}
+
+bool type_entry(const elf_image &img, const lsda_info &lsda, int64_t index, uint64_t &tinfo)
+{
+    if (!read_type_entry(img, lsda, index, tinfo)) {
+        fprintf(stderr, "bmcxx-lsdacompact: %s: bad types table entry in LSDA at 0x%llx\n",
+                input, (unsigned long long)lsda.vaddr);
+        return false;
+    }
+    return true;
+}
+
+// Convert an LSDA, for placement at the given address
+bool convert(const elf_image &img, const lsda_info &lsda, uint64_t vaddr, compact_blob &blob)
+{
+    std::vector<compact_call_site> call_sites;
+    std::vector<compact_action> actions;
+    std::vector<uint64_t> spec_types;
+
+    // (an action chain shared by several call sites is flattened once)
+    std::map<uint64_t, uint32_t> chains;
+    std::vector<std::pair<size_t, size_t>> spec_refs;   // (action, index in spec_types)
+
+    for (const lsda_call_site &cs : lsda.call_sites) {
+        if (cs.start > UINT32_MAX || cs.length > UINT32_MAX || cs.landing_pad > UINT32_MAX) {
+            fprintf(stderr, "bmcxx-lsdacompact: %s: call site out of range in LSDA at 0x%llx\n",
+                    input, (unsigned long long)lsda.vaddr);
+            return false;
+        }
+        compact_call_site ccs = { (uint32_t)cs.start, (uint32_t)cs.length,
+                (uint32_t)cs.landing_pad, 0 };
+
+        if (cs.action != 0) {
+            auto it = chains.find(cs.action);
+            if (it != chains.end()) {
+                ccs.action = it->second;
+            }
+            else {
+                std::vector<int64_t> type_indices;
+                if (!read_action_chain(img, lsda, cs.action, type_indices)) {
+                    fprintf(stderr, "bmcxx-lsdacompact: %s: bad action chain in LSDA at 0x%llx\n",
+                            input, (unsigned long long)lsda.vaddr);
+                    return false;
+                }
+                ccs.action = (uint32_t)actions.size() + 1;
+                chains.emplace(cs.action, ccs.action);
+
+                for (int64_t index : type_indices) {
+                    compact_action action = { 0, (int32_t)index, 0 };
+                    if (index > INT32_MAX || index < INT32_MIN) return false;
+                    if (index > 0) {
+                        uint64_t tinfo;
+                        if (!type_entry(img, lsda, index, tinfo)) return false;
+                        action.type = tinfo;
+                    }
+                    else if (index < 0) {
+                        std::vector<int64_t> indices;
+                        if (!read_exception_spec(img, lsda, index, indices)) {
+                            fprintf(stderr, "bmcxx-lsdacompact: %s: bad exception specification "
+                                    "in LSDA at 0x%llx\n", input, (unsigned long long)lsda.vaddr);
+                            return false;
+                        }
+                        spec_refs.push_back({actions.size(), spec_types.size()});
+                        action.flags = (uint32_t)indices.size();
+                        for (int64_t spec_index : indices) {
+                            uint64_t tinfo;
+                            if (!type_entry(img, lsda, spec_index, tinfo)) return false;
+                            spec_types.push_back(tinfo);
+                        }
+                    }
+                    actions.push_back(action);
+                }
+                actions.back().flags |= compact_action_last;
+            }
+        }
+        call_sites.push_back(ccs);
+    }
+
+    // Exception specification arrays follow the actions
+    uint64_t specs_vaddr = vaddr + sizeof(compact_lsda_header)
+            + call_sites.size() * sizeof(compact_call_site) + actions.size() * sizeof(compact_action);
+    for (const std::pair<size_t, size_t> &ref : spec_refs) {
+        actions[ref.first].type = specs_vaddr + ref.second * sizeof(uint64_t);
+    }
+
+    compact_lsda_header hdr = { compact_lsda_tag, (uint32_t)call_sites.size(),
+            lsda.lp_start_encoding == DW_EH_PE_omit ? 0 : lsda.lp_start };
+    blob.lsda = lsda.vaddr;
+    blob.data.clear();
+    append(blob.data, &hdr, sizeof(hdr));
+    append(blob.data, call_sites.data(), call_sites.size() * sizeof(compact_call_site));
+    append(blob.data, actions.data(), actions.size() * sizeof(compact_action));
+    append(blob.data, spec_types.data(), spec_types.size() * sizeof(uint64_t));
+    return true;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: bmcxx-lsdacompact [-p] [-v] [-o <output>] <image>\n");
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    const char *output = nullptr;
+    bool swap = false;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-p") == 0) {
+            swap = true;
+        }
+        else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        }
+        else if (argv[i][0] != '-' && input == nullptr) {
+            input = argv[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (input == nullptr) {
+        usage();
+        return 1;
+    }
+    if (output == nullptr) {
+        output = input;
+    }
+
+    elf_image img;
+    std::string err;
+    if (!img.load(input, err)) {
+        fprintf(stderr, "bmcxx-lsdacompact: %s: %s\n", input, err.c_str());
+        return 1;
+    }
+    if (!img.executable()) {
+        fprintf(stderr, "bmcxx-lsdacompact: %s: not a (non-position-independent) executable\n",
+                input);
+        return 1;
+    }
+
+    const elf_image::symbol *table_sym = img.find_symbol("bmcxxabi_compact_lsda");
+    if (table_sym == nullptr) {
+        fprintf(stderr, "bmcxx-lsdacompact: %s: no compact LSDA table symbol (library not built "
+                "with BMCXX_COMPACT_LSDA?)\n", input);
+        return 1;
+    }
+    if (img.at_vaddr(table_sym->value, table_sym->size) == nullptr) {
+        fprintf(stderr, "bmcxx-lsdacompact: %s: compact LSDA table is not stored in the image "
+                "file\n", input);
+        return 1;
+    }
+
+    const elf_image::symbol *pers_sym = img.find_symbol("__gxx_personality_v0");
+    const elf_image::symbol *compact_pers_sym = img.find_symbol("__bmcxx_personality_compact");
+    if (pers_sym == nullptr || (swap && compact_pers_sym == nullptr)) {
+        fprintf(stderr, "bmcxx-lsdacompact: %s: no %s symbol\n", input,
+                pers_sym == nullptr ? "__gxx_personality_v0" : "__bmcxx_personality_compact");
+        return 1;
+    }
+
+    std::vector<eh_cie> cies;
+    std::vector<eh_fde> fdes;
+    if (!read_eh_frame(img, cies, fdes, err)) {
+        fprintf(stderr, "bmcxx-lsdacompact: %s: %s\n", input, err.c_str());
+        return 1;
+    }
+
+    // The DWARF LSDAs, by address (with the start of a function using each)
+    std::map<uint64_t, uint64_t> lsdas;
+    for (const eh_fde &fde : fdes) {
+        uint64_t personality = cies[fde.cie_index].personality;
+        if (fde.lsda != 0 && (personality == pers_sym->value
+                || (compact_pers_sym != nullptr && personality == compact_pers_sym->value))
+                && (fde.lsda < table_sym->value || fde.lsda >= table_sym->value + table_sym->size)) {
+            lsdas.emplace(fde.lsda, fde.pc_begin);
+        }
+    }
+
+    // Convert as many as fit: the index takes two words for each, followed by the compact LSDAs
+    uint64_t capacity = table_sym->size;
+    uint64_t header_size = 2 * sizeof(uint64_t);
+    std::vector<compact_blob> blobs;
+    std::vector<lsda_info> infos;
+    uint64_t data_size = 0;
+    for (const std::pair<const uint64_t, uint64_t> &l : lsdas) {
+        lsda_info info;
+        if (!read_lsda(img, l.first, l.second, info, err)) {
+            fprintf(stderr, "bmcxx-lsdacompact: %s: %s\n", input, err.c_str());
+            return 1;
+        }
+        infos.push_back(info);
+    }
+
+    // (the position of each compact LSDA depends on the number converted, since the index comes
+    // first; so size them first, and place them once the number is known)
+    size_t num_converted = 0;
+    for (const lsda_info &info : infos) {
+        compact_blob blob;
+        if (!convert(img, info, 0, blob)) return 1;
+        uint64_t size = (blob.data.size() + 7) & ~(uint64_t)7;
+        if (header_size + (num_converted + 1) * 2 * sizeof(uint64_t) + data_size + size
+                > capacity) {
+            break;
+        }
+        data_size += size;
+        ++num_converted;
+    }
+
+    uint64_t index_end = header_size + num_converted * 2 * sizeof(uint64_t);
+    uint64_t offset = index_end;
+    std::vector<uint64_t> offsets;
+    for (size_t i = 0; i < num_converted; ++i) {
+        compact_blob blob;
+        if (!convert(img, infos[i], table_sym->value + offset, blob)) return 1;
+        blob.data.resize((blob.data.size() + 7) & ~(size_t)7);
+        offsets.push_back(offset);
+        offset += blob.data.size();
+        blobs.push_back(std::move(blob));
+    }
+
+    // Write the table (clearing the rest of it)
+    std::vector<uint8_t> table(capacity, 0);
+    uint64_t words[2] = { compact_lsda_magic, num_converted };
+    memcpy(table.data(), words, sizeof(words));
+    for (size_t i = 0; i < num_converted; ++i) {
+        uint64_t entry[2] = { blobs[i].lsda, offsets[i] };
+        memcpy(table.data() + header_size + i * sizeof(entry), entry, sizeof(entry));
+        memcpy(table.data() + offsets[i], blobs[i].data.data(), blobs[i].data.size());
+    }
+    img.write(table_sym->value, table.data(), capacity);
+
+    // Point the FDEs at the compact LSDAs, and the CIEs at the compact personality routine. (The
+    // compact personality routine also handles LSDAs which have not been converted, so every CIE
+    // can be changed.)
+    unsigned num_fdes = 0, num_cies = 0;
+    if (swap) {
+        std::map<uint64_t, uint64_t> compact_addrs;
+        for (size_t i = 0; i < num_converted; ++i) {
+            compact_addrs[blobs[i].lsda] = table_sym->value + offsets[i];
+        }
+        for (const eh_fde &fde : fdes) {
+            auto it = compact_addrs.find(fde.lsda);
+            if (it == compact_addrs.end() || fde.lsda_field == 0) continue;
+            if (!write_encoded(img, fde.lsda_field, cies[fde.cie_index].lsda_encoding,
+                    it->second)) {
+                fprintf(stderr, "bmcxx-lsdacompact: %s: can't change the LSDA pointer of the FDE "
+                        "at 0x%llx\n", input, (unsigned long long)fde.vaddr);
+                return 1;
+            }
+            ++num_fdes;
+        }
+        for (const eh_cie &cie : cies) {
+            if (cie.personality != pers_sym->value) continue;
+            if (!write_encoded(img, cie.personality_field, cie.personality_encoding,
+                    compact_pers_sym->value)) {
+                fprintf(stderr, "bmcxx-lsdacompact: %s: can't change the personality routine of "
+                        "the CIE at 0x%llx\n", input, (unsigned long long)cie.vaddr);
+                return 1;
+            }
+            ++num_cies;
+        }
+    }
+
+    if (!img.save(output, err)) {
+        fprintf(stderr, "bmcxx-lsdacompact: %s\n", err.c_str());
+        return 1;
+    }
+
+    if (num_converted < infos.size()) {
+        fprintf(stderr, "bmcxx-lsdacompact: %s: only %zu of %zu LSDAs fit (increase "
+                "BMCXX_COMPACT_LSDA_SIZE)\n", input, num_converted, infos.size());
+    }
+    if (verbose) {
+        uint64_t dwarf_size = 0;
+        for (size_t i = 0; i < num_converted; ++i) dwarf_size += infos[i].size;
+        printf("%zu LSDAs converted (%llu bytes), %llu/%llu table bytes used\n", num_converted,
+                (unsigned long long)dwarf_size, (unsigned long long)offset,
+                (unsigned long long)capacity);
+        if (swap) {
+            printf("%u FDE LSDA pointers and %u CIE personality pointers changed\n", num_fdes,
+                    num_cies);
+        }
+    }
+
+    return 0;
+}
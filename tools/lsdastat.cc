@@ -0,0 +1,396 @@
+// bmcxx-lsdastat: report, for each function in an image which has an LSDA, the properties of the
+// LSDA which determine the cost of the personality routine when an exception propagates through
+// (or is caught in) that function, together with an estimate of that cost.
+//
+// Usage: bmcxx-lsdastat [-s <column>] [-r] [-n <count>] [-H] [-m] [-v] <image>
+//
+//   -s <column>  sort by the named column (default: cost). Numeric columns sort in descending
+//                order, "function" sorts alphabetically and "pc" by address.
+//   -r           reverse the sort order
+//   -n <count>   only report the first <count> functions
+//   -H           omit the header line
+//   -m           don't demangle function names
+//   -v           print a summary (to stderr), including the .eh_frame_hdr cross-check
+//
+// Output is tab-separated, one line per function, with columns:
+//
+//   cost       estimated cost (see below)
+//   sites      number of call-site records
+//   pads       number of call sites with a landing pad
+//   lsda       size of the LSDA in bytes (including the types table and specifications)
+//   cs_bytes   size of the call-site table in bytes
+//   max_chain  longest action chain
+//   avg_chain  mean action chain length, over all call sites
+//   types      number of types table entries referenced
+//   specs      number of exception specifications referenced
+//   cs_enc     call-site encoding
+//   types_enc  types table encoding ("omit" if there is no types table)
+//   lp_enc     landing pad base encoding
+//   pc         function start address
+//   function   function name (or "?" if there is no symbol for it)
+//
+// The cost estimate models the personality routine in src/personality.cc, in units roughly
+// equivalent to decoding one single-byte field. For a throw from a call site chosen uniformly at
+// random, the routine walks (on average) half of the call-site table in each of the two unwind
+// phases, and then the action chain for the call site, testing each catch clause against the
+// thrown type in the search phase. Records using an encoding for which the walker is not
+// specialised are decoded generically, at roughly twice the cost. The estimate is intended for
+// ranking functions against each other, not as an absolute figure; the LSDA fuzzer's benchmark
+// mode (tests/lsda_fuzz.cc) gives the corresponding measurements for synthetic LSDAs.
+//
+// The .eh_frame_hdr search table, which the unwinder uses to find FDEs, is cross-checked against
+// the FDEs in .eh_frame: a function whose FDE is missing from the table can't be unwound through
+// (so an exception thrown through it terminates), and this is reported as a warning.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <cxxabi.h>
+
+#include "../src/dwarf_eh.h"
+
+#include "elf_image.h"
+#include "eh_frame.h"
+
+namespace {
+
+// Cost model parameters (see above)
+constexpr double header_cost = 8;         // decode LSDA header, select walker
+constexpr double record_cost = 4;         // one call-site record (four fields)
+constexpr double generic_factor = 2;      // multiplier for unspecialised encodings
+constexpr double action_cost = 3;         // one action entry (two SLEB128 values + type entry)
+constexpr double match_cost = 10;         // one catch-clause type test
+
+struct function_stats {
+    uint64_t pc;
+    std::string name;
+    double cost;
+    uint64_t sites;
+    uint64_t pads;
+    uint64_t lsda_bytes;
+    uint64_t cs_bytes;
+    unsigned max_chain;
+    double avg_chain;
+    int64_t types;
+    unsigned specs;
+    uint8_t cs_enc;
+    uint8_t types_enc;
+    uint8_t lp_enc;
+};
+
+enum class column_kind { number, text, address };
+
+struct column {
+    const char *name;
+    column_kind kind;
+    double (*value)(const function_stats &);
+};
+
+const column columns[] = {
+    { "cost", column_kind::number, [](const function_stats &s) { return s.cost; } },
+    { "sites", column_kind::number, [](const function_stats &s) { return (double)s.sites; } },
+    { "pads", column_kind::number, [](const function_stats &s) { return (double)s.pads; } },
+    { "lsda", column_kind::number, [](const function_stats &s) { return (double)s.lsda_bytes; } },
+    { "cs_bytes", column_kind::number,
+            [](const function_stats &s) { return (double)s.cs_bytes; } },
+    { "max_chain", column_kind::number,
+            [](const function_stats &s) { return (double)s.max_chain; } },
+    { "avg_chain", column_kind::number, [](const function_stats &s) { return s.avg_chain; } },
+    { "types", column_kind::number, [](const function_stats &s) { return (double)s.types; } },
+    { "specs", column_kind::number, [](const function_stats &s) { return (double)s.specs; } },
+    { "cs_enc", column_kind::number, [](const function_stats &s) { return (double)s.cs_enc; } },
+    { "types_enc", column_kind::number,
+            [](const function_stats &s) { return (double)s.types_enc; } },
+    { "lp_enc", column_kind::number, [](const function_stats &s) { return (double)s.lp_enc; } },
+    { "pc", column_kind::address, nullptr },
+    { "function", column_kind::text, nullptr },
+};
+
+// Whether the personality routine has a specialised call-site walker for the given encodings (see
+// select_lsda_scanner in src/personality.cc)
+bool walker_specialised(uint8_t cs_enc, uint8_t types_enc)
+{
+    if (cs_enc != DW_EH_PE_uleb128 && cs_enc != DW_EH_PE_udata4) return false;
+    switch (types_enc) {
+    case DW_EH_PE_omit:
+    case DW_EH_PE_absptr:
+    case DW_EH_PE_udata4:
+    case DW_EH_PE_indirect | DW_EH_PE_pcrel | DW_EH_PE_sdata4:
+        return true;
+    default:
+        return false;
+    }
+}
+
+double estimate_cost(const lsda_info &lsda, unsigned total_chain)
+{
+    double sites = lsda.call_sites.size();
+    if (sites == 0) return header_cost;
+
+    double rec = record_cost;
+    if (lsda.call_site_encoding == DW_EH_PE_uleb128) {
+        // multi-byte values cost a little more than single-byte values
+        double bytes_per_record = (double)(lsda.action_table - lsda.call_site_table) / sites;
+        rec += std::max(0.0, bytes_per_record - 4) * 0.5;
+    }
+    if (!walker_specialised(lsda.call_site_encoding, lsda.types_encoding)) {
+        rec *= generic_factor;
+    }
+
+    double avg_chain = total_chain / sites;
+    double walk = header_cost + (sites + 1) / 2 * rec;
+
+    // Both phases walk the call-site table and action chain; only the search phase tests the
+    // catch clauses.
+    return 2 * walk + avg_chain * (2 * action_cost + match_cost);
+}
+
+std::string encoding_name(uint8_t enc)
+{
+    if (enc == DW_EH_PE_omit) return "omit";
+    char buf[8];
+    snprintf(buf, sizeof(buf), "0x%02x", enc);
+    return buf;
+}
+
+std::string function_name(const elf_image &img, uint64_t pc, bool demangle)
+{
+    const elf_image::symbol *sym = img.function_at(pc);
+    if (sym == nullptr) return "?";
+
+    std::string name = sym->name;
+    if (demangle) {
+        int status;
+        char *demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+        if (demangled != nullptr) {
+            name = demangled;
+            free(demangled);
+        }
+    }
+    if (sym->value != pc) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "+0x%llx", (unsigned long long)(pc - sym->value));
+        name += buf;
+    }
+    return name;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: bmcxx-lsdastat [-s <column>] [-r] [-n <count>] [-H] [-m] [-v] "
+            "<image>\n");
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    const char *input = nullptr;
+    const char *sort_column = "cost";
+    bool reverse = false;
+    bool header = true;
+    bool demangle = true;
+    bool verbose = false;
+    uint64_t limit = UINT64_MAX;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            sort_column = argv[++i];
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            char *end;
+            limit = strtoull(argv[++i], &end, 10);
+            if (*end != 0) {
+                usage();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-r") == 0) {
+            reverse = true;
+        }
+        else if (strcmp(argv[i], "-H") == 0) {
+            header = false;
+        }
+        else if (strcmp(argv[i], "-m") == 0) {
+            demangle = false;
+        }
+        else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        }
+        else if (argv[i][0] != '-' && input == nullptr) {
+            input = argv[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (input == nullptr) {
+        usage();
+        return 1;
+    }
+
+    const column *sort_col = nullptr;
+    for (const column &col : columns) {
+        if (strcmp(col.name, sort_column) == 0) sort_col = &col;
+    }
+    if (sort_col == nullptr) {
+        fprintf(stderr, "bmcxx-lsdastat: unknown column '%s'\n", sort_column);
+        return 1;
+    }
+
+    elf_image img;
+    std::string err;
+    if (!img.load(input, err)) {
+        fprintf(stderr, "bmcxx-lsdastat: %s: %s\n", input, err.c_str());
+        return 1;
+    }
+
+    std::vector<eh_cie> cies;
+    std::vector<eh_fde> fdes;
+    if (!read_eh_frame(img, cies, fdes, err)) {
+        fprintf(stderr, "bmcxx-lsdastat: %s: %s\n", input, err.c_str());
+        return 1;
+    }
+
+    // Cross-check the search table in .eh_frame_hdr (if any) against .eh_frame
+    bool have_hdr;
+    uint64_t hdr_eh_frame;
+    std::vector<eh_frame_hdr_entry> hdr_table;
+    if (!read_eh_frame_hdr(img, have_hdr, hdr_eh_frame, hdr_table, err)) {
+        fprintf(stderr, "bmcxx-lsdastat: %s: %s\n", input, err.c_str());
+        return 1;
+    }
+
+    unsigned num_warnings = 0;
+    if (have_hdr && !hdr_table.empty()) {
+        const elf_image::section *eh_frame = img.find_section(".eh_frame");
+        if (hdr_eh_frame != eh_frame->addr) {
+            fprintf(stderr, "bmcxx-lsdastat: warning: .eh_frame_hdr records .eh_frame at 0x%llx, "
+                    "but it is at 0x%llx\n", (unsigned long long)hdr_eh_frame,
+                    (unsigned long long)eh_frame->addr);
+            ++num_warnings;
+        }
+
+        std::map<uint64_t, uint64_t> fde_pcs;   // FDE address -> pc_begin
+        for (const eh_fde &fde : fdes) {
+            fde_pcs[fde.vaddr] = fde.pc_begin;
+        }
+
+        std::map<uint64_t, bool> in_table;
+        for (size_t i = 0; i < hdr_table.size(); ++i) {
+            const eh_frame_hdr_entry &ent = hdr_table[i];
+            if (i != 0 && ent.pc < hdr_table[i - 1].pc) {
+                fprintf(stderr, "bmcxx-lsdastat: warning: .eh_frame_hdr table is not sorted at "
+                        "entry %zu\n", i);
+                ++num_warnings;
+            }
+            auto it = fde_pcs.find(ent.fde);
+            if (it == fde_pcs.end() || it->second != ent.pc) {
+                fprintf(stderr, "bmcxx-lsdastat: warning: .eh_frame_hdr entry for 0x%llx does "
+                        "not match an FDE\n", (unsigned long long)ent.pc);
+                ++num_warnings;
+            }
+            in_table[ent.fde] = true;
+        }
+        for (const eh_fde &fde : fdes) {
+            if (in_table.find(fde.vaddr) == in_table.end()) {
+                fprintf(stderr, "bmcxx-lsdastat: warning: FDE for %s (0x%llx) is missing from "
+                        ".eh_frame_hdr\n", function_name(img, fde.pc_begin, demangle).c_str(),
+                        (unsigned long long)fde.pc_begin);
+                ++num_warnings;
+            }
+        }
+    }
+
+    std::vector<function_stats> stats;
+    unsigned num_personality = 0;
+    for (const eh_fde &fde : fdes) {
+        if (cies[fde.cie_index].personality != 0) ++num_personality;
+        if (fde.lsda == 0) continue;
+
+        lsda_info lsda;
+        if (!read_lsda(img, fde.lsda, fde.pc_begin, lsda, err)) {
+            fprintf(stderr, "bmcxx-lsdastat: %s: %s\n", input, err.c_str());
+            return 1;
+        }
+
+        function_stats s = {};
+        s.pc = fde.pc_begin;
+        s.name = function_name(img, fde.pc_begin, demangle);
+        s.sites = lsda.call_sites.size();
+        s.lsda_bytes = lsda.size;
+        s.cs_bytes = lsda.action_table - lsda.call_site_table;
+        unsigned total_chain = 0;
+        for (const lsda_call_site &cs : lsda.call_sites) {
+            if (cs.landing_pad != 0) ++s.pads;
+            s.max_chain = std::max(s.max_chain, cs.chain_length);
+            total_chain += cs.chain_length;
+        }
+        s.avg_chain = s.sites ? (double)total_chain / s.sites : 0;
+        s.types = lsda.max_type_index;
+        s.specs = lsda.num_specs;
+        s.cs_enc = lsda.call_site_encoding;
+        s.types_enc = lsda.types_encoding;
+        s.lp_enc = lsda.lp_start_encoding;
+        s.cost = estimate_cost(lsda, total_chain);
+        stats.push_back(s);
+    }
+
+    auto less = [&](const function_stats &a, const function_stats &b) {
+        switch (sort_col->kind) {
+        case column_kind::text:
+            return a.name < b.name;
+        case column_kind::address:
+            return a.pc < b.pc;
+        default:
+            // descending
+            return sort_col->value(a) > sort_col->value(b);
+        }
+    };
+    std::stable_sort(stats.begin(), stats.end(), [&](const function_stats &a,
+            const function_stats &b) { return reverse ? less(b, a) : less(a, b); });
+
+    if (header) {
+        for (const column &col : columns) {
+            printf("%s%c", col.name, &col == std::end(columns) - 1 ? '\n' : '\t');
+        }
+    }
+
+    uint64_t total_lsda = 0;
+    for (const function_stats &s : stats) {
+        total_lsda += s.lsda_bytes;
+    }
+
+    uint64_t count = 0;
+    for (const function_stats &s : stats) {
+        if (count++ == limit) break;
+        printf("%.0f\t%llu\t%llu\t%llu\t%llu\t%u\t%.2f\t%lld\t%u\t%s\t%s\t%s\t0x%llx\t%s\n",
+                s.cost, (unsigned long long)s.sites, (unsigned long long)s.pads,
+                (unsigned long long)s.lsda_bytes, (unsigned long long)s.cs_bytes, s.max_chain,
+                s.avg_chain, (long long)s.types, s.specs, encoding_name(s.cs_enc).c_str(),
+                encoding_name(s.types_enc).c_str(), encoding_name(s.lp_enc).c_str(),
+                (unsigned long long)s.pc, s.name.c_str());
+    }
+
+    if (verbose) {
+        fprintf(stderr, "%zu FDEs (%u with a personality routine), %zu with an LSDA; "
+                "%llu bytes of LSDA\n", fdes.size(), num_personality, stats.size(),
+                (unsigned long long)total_lsda);
+        if (!have_hdr) {
+            fprintf(stderr, "no .eh_frame_hdr section\n");
+        }
+        else {
+            fprintf(stderr, ".eh_frame_hdr: %zu search table entries, %u warnings\n",
+                    hdr_table.size(), num_warnings);
+        }
+    }
+
+    return 0;
+}
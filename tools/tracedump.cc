@@ -0,0 +1,533 @@
+// bmcxx-tracedump: decode an exception-handling event trace (see src/eh_trace.cc) and print a
+// timeline for each exception, from its allocation to its freeing, showing each decision of the
+// personality routine along the way.
+//
+// Usage: bmcxx-tracedump [-e <image>] [-s] [-n <count>] [-g] [-m] [-r] <trace>
+//
+//   -e <image>   name functions, thrown types and guard variables using the symbols of the image
+//                (which must be linked at the addresses in the trace, ie not position-independent)
+//   -s           print the slowest exceptions (by time from allocation to freeing) first
+//   -n <count>   only print the first <count> exceptions
+//   -g           also print a timeline for each guard variable
+//   -m           don't demangle names
+//   -r           instead of the timelines, write a replay trace (see below)
+//
+// The trace file is a sequence of bmcxxabi_trace_record structures (32 bytes each, little-endian),
+// as moved from the rings by bmcxxabi_trace_drain (or passed to a trace callback), concatenated in
+// any order; eg tests/eh_trace.cc writes one with its -o option. Records are sorted by time, and
+// then grouped by object (the thrown object, or guard variable). An exception's timeline begins
+// with its allocation and ends when it is freed, after which the address may be reused by another
+// exception; a timeline without either end (because it was lost, or fell outside the trace) is
+// marked incomplete.
+//
+// Each event is printed with its time relative to the start of the timeline (in cycles, as
+// recorded) and the CPU on which it occurred.
+//
+// A replay trace is a compact, textual summary of the workload in the trace, for the replay
+// benchmark (tests/replay_gen.cc, tests/replay.cc). It lists the types involved and then, in
+// order, each exception handled and each guarded static initialised:
+//
+//     type <id> <size> <name>
+//     throw <type> <frames> <cleanups> <handler> <nest>
+//     rethrow <frames> <cleanups> <handler> <nest>
+//     guard
+//
+// where <size> is the size of the thrown object (0 for a type which is only caught); <frames> is
+// the number of frames for which the personality routine was called in the search phase, up to and
+// including the frame with the handler; <cleanups> is the number of cleanups run on the way;
+// <handler> is the type caught, or "*" for catch(...); and <nest> is the number of other exceptions
+// being handled, on the same CPU, when the exception was thrown. A rethrow applies to the most
+// recent throw with the same <nest>. Exceptions which were not caught (or were caught by an
+// exception specification), or whose throw is not in the trace, are omitted.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <cxxabi.h>
+
+#include "../include/bmcxxabi.h"
+
+#include "elf_image.h"
+
+namespace {
+
+constexpr size_t record_size = 32;
+
+struct trace_record {
+    uint64_t time;
+    uint64_t object;
+    uint64_t arg;
+    uint32_t event;
+    uint32_t cpu;
+};
+
+struct timeline {
+    std::vector<trace_record> events;
+    bool complete;
+};
+
+uint64_t get_u64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+uint32_t get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool read_trace(const char *path, std::vector<trace_record> &records, std::string &err)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) {
+        err = strerror(errno);
+        return false;
+    }
+
+    unsigned char buf[record_size];
+    size_t n;
+    while ((n = fread(buf, 1, record_size, f)) == record_size) {
+        records.push_back({get_u64(buf), get_u64(buf + 8), get_u64(buf + 16), get_u32(buf + 24),
+                get_u32(buf + 28)});
+    }
+    bool ok = ferror(f) == 0 && n == 0;
+    if (!ok) {
+        err = ferror(f) ? strerror(errno) : "truncated record at end of file";
+    }
+    fclose(f);
+    return ok;
+}
+
+const char *event_name(uint32_t event)
+{
+    switch (event) {
+    case BMCXXABI_TRACE_ALLOCATE: return "allocate";
+    case BMCXXABI_TRACE_THROW: return "throw";
+    case BMCXXABI_TRACE_RETHROW: return "rethrow";
+    case BMCXXABI_TRACE_SEARCH_CONTINUE: return "search: continue";
+    case BMCXXABI_TRACE_HANDLER_FOUND: return "search: handler found";
+    case BMCXXABI_TRACE_CLEANUP_CONTINUE: return "cleanup: continue";
+    case BMCXXABI_TRACE_INSTALL_CLEANUP: return "cleanup: run cleanup";
+    case BMCXXABI_TRACE_INSTALL_HANDLER: return "cleanup: enter handler";
+    case BMCXXABI_TRACE_PERSONALITY_ERROR: return "personality error";
+    case BMCXXABI_TRACE_BEGIN_CATCH: return "begin catch";
+    case BMCXXABI_TRACE_END_CATCH: return "end catch";
+    case BMCXXABI_TRACE_FREE: return "free";
+    case BMCXXABI_TRACE_GUARD_ACQUIRE: return "guard acquire";
+    case BMCXXABI_TRACE_GUARD_RELEASE: return "guard release";
+    case BMCXXABI_TRACE_GUARD_ABORT: return "guard abort";
+    case BMCXXABI_TRACE_HANDLER_TYPE: return "search: catches";
+    default: return "?";
+    }
+}
+
+std::string hex(uint64_t addr)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)addr);
+    return buf;
+}
+
+bool is_guard_event(uint32_t event)
+{
+    return event == BMCXXABI_TRACE_GUARD_ACQUIRE || event == BMCXXABI_TRACE_GUARD_RELEASE
+            || event == BMCXXABI_TRACE_GUARD_ABORT;
+}
+
+// Names for addresses, from the symbols of an image (if one was given)
+class symbolizer {
+    const elf_image *img;
+    bool demangle;
+    std::map<uint64_t, std::string> objects;
+
+    std::string demangled(const std::string &name) const
+    {
+        if (!demangle) return name;
+        int status;
+        char *d = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+        if (d == nullptr) return name;
+        std::string r = d;
+        free(d);
+        return r;
+    }
+
+public:
+    symbolizer(const elf_image *img_p, bool demangle_p) : img(img_p), demangle(demangle_p)
+    {
+        if (img == nullptr) return;
+        for (const elf_image::symbol &sym : img->symbols()) {
+            if (sym.value != 0 && !sym.name.empty()) objects.emplace(sym.value, sym.name);
+        }
+    }
+
+    std::string function(uint64_t pc) const
+    {
+        const elf_image::symbol *sym = img ? img->function_at(pc) : nullptr;
+        if (sym == nullptr) return hex(pc);
+        std::string name = demangled(sym->name);
+        if (sym->value != pc) name += "+" + hex(pc - sym->value);
+        return name;
+    }
+
+    // A data object (type_info, guard variable) at exactly the given address
+    std::string object(uint64_t addr) const
+    {
+        auto it = objects.find(addr);
+        if (it == objects.end()) return hex(addr);
+        std::string name = demangled(it->second);
+        if (demangle && name.compare(0, 13, "typeinfo for ") == 0) {
+            name.erase(0, 13);
+        }
+        return name;
+    }
+};
+
+std::string event_detail(const trace_record &r, const symbolizer &syms)
+{
+    char buf[32];
+    switch (r.event) {
+    case BMCXXABI_TRACE_ALLOCATE:
+        snprintf(buf, sizeof(buf), "size %llu", (unsigned long long)r.arg);
+        return buf;
+    case BMCXXABI_TRACE_THROW:
+        return syms.object(r.arg);
+    case BMCXXABI_TRACE_HANDLER_TYPE:
+        return r.arg != 0 ? syms.object(r.arg) : "...";
+    case BMCXXABI_TRACE_SEARCH_CONTINUE:
+    case BMCXXABI_TRACE_HANDLER_FOUND:
+    case BMCXXABI_TRACE_CLEANUP_CONTINUE:
+    case BMCXXABI_TRACE_INSTALL_CLEANUP:
+    case BMCXXABI_TRACE_INSTALL_HANDLER:
+    case BMCXXABI_TRACE_PERSONALITY_ERROR:
+        return syms.function(r.arg);
+    case BMCXXABI_TRACE_BEGIN_CATCH:
+    case BMCXXABI_TRACE_END_CATCH:
+        snprintf(buf, sizeof(buf), "handlers %lld", (long long)r.arg);
+        return buf;
+    default:
+        return "";
+    }
+}
+
+uint64_t duration(const timeline &t)
+{
+    return t.events.back().time - t.events.front().time;
+}
+
+void print_timeline(const char *kind, unsigned number, const timeline &t, const symbolizer &syms)
+{
+    const trace_record &first = t.events.front();
+    std::string type;
+    for (const trace_record &r : t.events) {
+        if (r.event == BMCXXABI_TRACE_THROW) {
+            type = ", type " + syms.object(r.arg);
+            break;
+        }
+    }
+    std::string object = is_guard_event(first.event) ? syms.object(first.object)
+            : hex(first.object);
+    printf("%s %u: object %s%s, %llu cycles%s\n", kind, number, object.c_str(), type.c_str(),
+            (unsigned long long)duration(t), t.complete ? "" : " (incomplete)");
+    for (const trace_record &r : t.events) {
+        std::string detail = event_detail(r, syms);
+        printf("    %+12lld  cpu %-3u  %-*s%s\n", (long long)(r.time - first.time), r.cpu,
+                detail.empty() ? 0 : 24, event_name(r.event), detail.c_str());
+    }
+}
+
+// Builds a replay trace from the records (in order of time)
+class replay_recorder {
+    const symbolizer &syms;
+
+    struct replay_type {
+        uint64_t addr;
+        uint64_t size;
+    };
+
+    // An exception between its throw (or rethrow) and entering its handler
+    struct in_flight {
+        unsigned type;
+        unsigned frames;
+        unsigned cleanups;
+        int handler;        // type id, catch_all, or no_handler
+        unsigned nest;
+        bool rethrow;
+    };
+
+    static constexpr int catch_all = -1;
+    static constexpr int no_handler = -2;
+
+    std::vector<replay_type> types;
+    std::map<uint64_t, unsigned> type_ids;
+    std::map<uint64_t, uint64_t> sizes;             // by object
+    std::map<uint64_t, unsigned> thrown_types;      // by object
+    std::map<uint64_t, in_flight> flights;          // by object
+    std::map<uint64_t, std::pair<uint32_t, unsigned>> caught;  // CPU and handler count, by object
+    std::vector<std::string> ops;
+
+    unsigned type_id(uint64_t addr, uint64_t size)
+    {
+        auto it = type_ids.find(addr);
+        if (it == type_ids.end()) {
+            it = type_ids.emplace(addr, (unsigned)types.size()).first;
+            types.push_back({addr, 0});
+        }
+        if (types[it->second].size == 0) types[it->second].size = size;
+        return it->second;
+    }
+
+    // The number of exceptions being handled on the CPU, other than the given one
+    unsigned nesting(uint32_t cpu, uint64_t object) const
+    {
+        unsigned n = 0;
+        for (auto &c : caught) {
+            n += c.first != object && c.second.first == cpu;
+        }
+        return n;
+    }
+
+public:
+    replay_recorder(const symbolizer &syms_p) : syms(syms_p) { }
+
+    void record(const trace_record &r)
+    {
+        auto flight = flights.find(r.object);
+        char buf[128];
+
+        switch (r.event) {
+        case BMCXXABI_TRACE_ALLOCATE:
+            sizes[r.object] = r.arg;
+            break;
+        case BMCXXABI_TRACE_THROW: {
+            auto size = sizes.find(r.object);
+            unsigned type = type_id(r.arg, size != sizes.end() ? size->second : 0);
+            thrown_types[r.object] = type;
+            flights[r.object] = {type, 0, 0, no_handler, nesting(r.cpu, r.object), false};
+            break;
+        }
+        case BMCXXABI_TRACE_RETHROW: {
+            auto thrown = thrown_types.find(r.object);
+            if (thrown != thrown_types.end()) {
+                flights[r.object] = {thrown->second, 0, 0, no_handler, nesting(r.cpu, r.object),
+                        true};
+            }
+            break;
+        }
+        case BMCXXABI_TRACE_SEARCH_CONTINUE:
+        case BMCXXABI_TRACE_HANDLER_FOUND:
+            if (flight != flights.end()) ++flight->second.frames;
+            break;
+        case BMCXXABI_TRACE_HANDLER_TYPE:
+            if (flight != flights.end()) {
+                flight->second.handler = r.arg != 0 ? (int)type_id(r.arg, 0) : catch_all;
+            }
+            break;
+        case BMCXXABI_TRACE_INSTALL_CLEANUP:
+            if (flight != flights.end()) ++flight->second.cleanups;
+            break;
+        case BMCXXABI_TRACE_INSTALL_HANDLER:
+            if (flight != flights.end()) {
+                const in_flight &f = flight->second;
+                if (f.handler != no_handler) {
+                    std::string handler = f.handler == catch_all ? "*"
+                            : std::to_string(f.handler);
+                    if (f.rethrow) {
+                        snprintf(buf, sizeof(buf), "rethrow %u %u %s %u", f.frames, f.cleanups,
+                                handler.c_str(), f.nest);
+                    }
+                    else {
+                        snprintf(buf, sizeof(buf), "throw %u %u %u %s %u", f.type, f.frames,
+                                f.cleanups, handler.c_str(), f.nest);
+                    }
+                    ops.push_back(buf);
+                }
+                flights.erase(flight);
+            }
+            break;
+        case BMCXXABI_TRACE_BEGIN_CATCH: {
+            std::pair<uint32_t, unsigned> &c = caught[r.object];
+            c.first = r.cpu;
+            ++c.second;
+            break;
+        }
+        case BMCXXABI_TRACE_END_CATCH: {
+            auto c = caught.find(r.object);
+            if (c != caught.end() && --c->second.second == 0) caught.erase(c);
+            break;
+        }
+        case BMCXXABI_TRACE_FREE:
+            caught.erase(r.object);
+            sizes.erase(r.object);
+            thrown_types.erase(r.object);
+            flights.erase(r.object);
+            break;
+        case BMCXXABI_TRACE_GUARD_RELEASE:
+            ops.push_back("guard");
+            break;
+        default:
+            break;
+        }
+    }
+
+    void print() const
+    {
+        printf("# bmcxx replay trace: %zu types, %zu operations\n", types.size(), ops.size());
+        for (size_t i = 0; i < types.size(); ++i) {
+            printf("type %zu %llu %s\n", i, (unsigned long long)types[i].size,
+                    syms.object(types[i].addr).c_str());
+        }
+        for (const std::string &op : ops) {
+            printf("%s\n", op.c_str());
+        }
+    }
+};
+
+void usage()
+{
+    fprintf(stderr, "usage: bmcxx-tracedump [-e <image>] [-s] [-n <count>] [-g] [-m] [-r] <trace>\n");
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    const char *input = nullptr;
+    const char *image = nullptr;
+    bool slowest_first = false;
+    bool guards = false;
+    bool demangle = true;
+    bool replay = false;
+    uint64_t limit = UINT64_MAX;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            image = argv[++i];
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            char *end;
+            limit = strtoull(argv[++i], &end, 10);
+            if (*end != 0) {
+                usage();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-s") == 0) {
+            slowest_first = true;
+        }
+        else if (strcmp(argv[i], "-g") == 0) {
+            guards = true;
+        }
+        else if (strcmp(argv[i], "-m") == 0) {
+            demangle = false;
+        }
+        else if (strcmp(argv[i], "-r") == 0) {
+            replay = true;
+        }
+        else if (argv[i][0] != '-' && input == nullptr) {
+            input = argv[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (input == nullptr) {
+        usage();
+        return 1;
+    }
+
+    std::string err;
+    elf_image img;
+    if (image != nullptr && !img.load(image, err)) {
+        fprintf(stderr, "bmcxx-tracedump: %s: %s\n", image, err.c_str());
+        return 1;
+    }
+    symbolizer syms(image != nullptr ? &img : nullptr, demangle);
+
+    std::vector<trace_record> records;
+    if (!read_trace(input, records, err)) {
+        fprintf(stderr, "bmcxx-tracedump: %s: %s\n", input, err.c_str());
+        return 1;
+    }
+    std::stable_sort(records.begin(), records.end(),
+            [](const trace_record &a, const trace_record &b) { return a.time < b.time; });
+
+    if (replay) {
+        replay_recorder recorder(syms);
+        for (const trace_record &r : records) {
+            recorder.record(r);
+        }
+        recorder.print();
+        return 0;
+    }
+
+    // Group the records into timelines, by object. An exception's timeline is closed when it is
+    // freed; a guard's, when it is released or the initialisation is aborted.
+    std::vector<timeline> exceptions;
+    std::vector<timeline> guard_timelines;
+    std::map<uint64_t, size_t> open_exceptions;
+    std::map<uint64_t, size_t> open_guards;
+
+    for (const trace_record &r : records) {
+        bool guard = is_guard_event(r.event);
+        std::vector<timeline> &timelines = guard ? guard_timelines : exceptions;
+        std::map<uint64_t, size_t> &open = guard ? open_guards : open_exceptions;
+
+        auto it = open.find(r.object);
+        bool starts = r.event == BMCXXABI_TRACE_ALLOCATE || r.event == BMCXXABI_TRACE_GUARD_ACQUIRE;
+        if (it != open.end() && starts) {
+            // (the previous timeline for this object did not end in the trace)
+            open.erase(it);
+            it = open.end();
+        }
+        if (it == open.end()) {
+            timelines.push_back({{}, starts});
+            it = open.emplace(r.object, timelines.size() - 1).first;
+        }
+
+        timeline &t = timelines[it->second];
+        t.events.push_back(r);
+        if (r.event == BMCXXABI_TRACE_FREE || r.event == BMCXXABI_TRACE_GUARD_RELEASE
+                || r.event == BMCXXABI_TRACE_GUARD_ABORT) {
+            open.erase(it);
+        }
+    }
+    for (auto &o : open_exceptions) exceptions[o.second].complete = false;
+    for (auto &o : open_guards) guard_timelines[o.second].complete = false;
+
+    std::vector<size_t> order(exceptions.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    if (slowest_first) {
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return duration(exceptions[a]) > duration(exceptions[b]);
+        });
+    }
+
+    uint64_t printed = 0;
+    unsigned incomplete = 0;
+    for (size_t i : order) {
+        incomplete += !exceptions[i].complete;
+        if (printed++ < limit) {
+            print_timeline("exception", (unsigned)i + 1, exceptions[i], syms);
+        }
+    }
+
+    if (guards) {
+        for (size_t i = 0; i < guard_timelines.size(); ++i) {
+            print_timeline("guard", (unsigned)i + 1, guard_timelines[i], syms);
+        }
+    }
+
+    printf("%zu records, %zu exceptions (%u incomplete), %zu guard initialisations\n",
+            records.size(), exceptions.size(), incomplete, guard_timelines.size());
+    return 0;
+}